@@ -14,6 +14,8 @@
 #include <mrpt/opengl.h>
 #include <mrpt/gui.h>
 #include <mrpt/math/ops_vectors.h>
+#include <mrpt/system/CTicTac.h>
+#include <fstream>
 #include <thread>  // for sleep()
 #include <mrpt/3rdparty/tclap/CmdLine.h>
 
@@ -42,8 +44,132 @@ TCLAP::ValueArg<double> arg_timestep(
 TCLAP::SwitchArg arg_save_q(
 	"", "save-q", "Saves decimated Q history to a txt file", cmd);
 
+TCLAP::ValueArg<std::string> arg_solver(
+	"", "solver",
+	"Dynamic simulator class name, as accepted by "
+	"CDynamicSimulatorBase::Create()",
+	false, "CDynamicSimulator_ALi3_Dense", "CDynamicSimulator_xxx", cmd);
+
+TCLAP::ValueArg<std::string> arg_integrator(
+	"", "integrator",
+	"ODE integrator: Euler, Trapezoidal, RK4, RK45, GeneralizedAlpha, "
+	"MultiRate",
+	false, "RK4", "RK4", cmd);
+
+TCLAP::ValueArg<unsigned int> arg_substeps(
+	"", "substeps",
+	"MultiRate integrator: substeps of the bodies tagged as `fast` per "
+	"time step",
+	false, 10, "N", cmd);
+
+TCLAP::SwitchArg arg_headless(
+	"", "headless",
+	"Runs without GUI, as fast as possible, until --end-time", cmd);
+
+TCLAP::ValueArg<double> arg_end_time(
+	"", "end-time", "Simulation end time (headless mode)", false, 10.0,
+	"Time[s]", cmd);
+
+TCLAP::ValueArg<std::string> arg_output(
+	"o", "output",
+	"Headless mode: streams 't q dq' rows to this text file while "
+	"simulating",
+	false, "", "states.txt", cmd);
+
+TCLAP::ValueArg<unsigned int> arg_output_decimation(
+	"", "output-decimation", "Headless mode: save one out of N time steps",
+	false, 1, "N", cmd);
+
+TCLAP::ValueArg<std::string> arg_profile_json(
+	"", "profile-json",
+	"Headless mode: save profiler statistics to this JSON file", false, "",
+	"profile.json", cmd);
+
+TCLAP::ValueArg<std::string> arg_profile_trace(
+	"", "profile-trace",
+	"Headless mode: save a Chrome trace (chrome://tracing, Perfetto) of "
+	"all profiled scopes to this file",
+	false, "", "trace.json", cmd);
+
 void my_callback([[maybe_unused]] TSimulationStateRef& simul_state) {}
 
+static ODE_integrator_t integratorFromName(const std::string& name)
+{
+	if (name == "Euler") return ODE_Euler;
+	if (name == "Trapezoidal") return ODE_Trapezoidal;
+	if (name == "RK4") return ODE_RK4;
+	if (name == "RK45") return ODE_RK45;
+	if (name == "GeneralizedAlpha") return ODE_GeneralizedAlpha;
+	if (name == "MultiRate") return ODE_MultiRate;
+	THROW_EXCEPTION("Unknown integrator name: " + name);
+}
+
+static void runHeadless(
+	CDynamicSimulatorBase& dynSimul, const AssembledRigidModel& arm)
+{
+	const double t_end = arg_end_time.getValue();
+	ASSERT_GT_(t_end, 0);
+
+	// Stream states to disk from within the simulation loop:
+	std::ofstream f;
+	if (!arg_output.getValue().empty())
+	{
+		f.open(arg_output.getValue());
+		ASSERTMSG_(
+			f.is_open(), "Cannot open output file: " + arg_output.getValue());
+		f << "% t q[" << arm.q_.size() << "] dq[" << arm.dotq_.size()
+		  << "]\n";
+		f.precision(12);
+	}
+
+	const unsigned int decim = std::max(1U, arg_output_decimation.getValue());
+	size_t numSteps = 0;
+
+	dynSimul.params.user_callback = [&](TSimulationStateRef st) {
+		if (f.is_open() && numSteps % decim == 0)
+		{
+			// The callback is invoked with the time at the step beginning:
+			f << st.t + st.dt;
+			for (int i = 0; i < st.arm->q_.size(); i++)
+				f << ' ' << st.arm->q_[i];
+			for (int i = 0; i < st.arm->dotq_.size(); i++)
+				f << ' ' << st.arm->dotq_[i];
+			f << '\n';
+		}
+		numSteps++;
+	};
+
+	if (arg_profile_trace.isSet())
+		mbse::profiler::setTraceCapacity(1000000);
+
+	mrpt::system::CTicTac tictac;
+	const double t_final = dynSimul.run(0, t_end);
+	const double wallTime = tictac.Tac();
+
+	f.close();
+
+	std::cout << "Simulated time  : " << t_final << " s\n"
+			  << "Time steps      : " << numSteps << "\n"
+			  << "Wall-clock time : " << wallTime << " s\n"
+			  << "Steps/s         : " << numSteps / wallTime << "\n"
+			  << "Realtime factor : " << t_final / wallTime << "\n"
+			  << "Final |Phi|     : " << arm.Phi_.norm() << "\n";
+
+	// Per-phase timings, as recorded by the solvers:
+	mbse::profiler::printStats(std::cout);
+
+	if (arg_profile_json.isSet())
+	{
+		std::ofstream fp(arg_profile_json.getValue());
+		mbse::profiler::exportJSON(fp);
+	}
+	if (arg_profile_trace.isSet())
+	{
+		std::ofstream fp(arg_profile_trace.getValue());
+		mbse::profiler::exportChromeTrace(fp);
+	}
+}
+
 static void runDynamicSimulation()
 {
 	// Load mechanism model:
@@ -84,6 +210,36 @@ static void runDynamicSimulation()
 	// aMBS->setGravityVector(0,-9.80665,0);
 	aMBS->setGravityVector(0, -9.81, 0);
 
+	// Executes a dynamic simulation:
+	// -----------------------------------------------
+	const auto dynSimulPtr =
+		CDynamicSimulatorBase::Create(arg_solver.getValue(), aMBS);
+	CDynamicSimulatorBase& dynSimul = *dynSimulPtr;
+
+	// dynSimul.params_penalty.alpha = 1e7;
+	// dynSimul.params_penalty.xi = 0.5;
+	// dynSimul.params_penalty.w = 20;
+
+	// Mark points for logging:
+	// -----------------------------------------------
+	// dynSimul.addPointSensor(3);
+	// dynSimul.addPointSensor(2);
+
+	// Set params:
+	// -----------------------------
+	dynSimul.params.time_step = arg_timestep.getValue();
+	dynSimul.params.ode_solver = integratorFromName(arg_integrator.getValue());
+	dynSimul.params.multirate_substeps = arg_substeps.getValue();
+	dynSimul.params.user_callback = simul_callback_t(my_callback);
+
+	if (arg_headless.isSet())
+	{
+		// Prepare solver; must be called before "run()".
+		dynSimul.prepare();
+		runHeadless(dynSimul, *aMBS);
+		return;
+	}
+
 	// Prepare 3D scene:
 	// -----------------------------------------------
 	auto gl_MBS = mrpt::opengl::CSetOfObjects::Create();
@@ -131,37 +287,6 @@ static void runDynamicSimulation()
 		}
 #endif
 
-	// Executes a dynamic simulation:
-	// -----------------------------------------------
-	// using dynamics_t = CDynamicSimulator_Lagrange_LU_dense;
-	// using dynamics_t = CDynamicSimulator_Lagrange_UMFPACK;
-	// using dynamics_t = CDynamicSimulator_Lagrange_KLU;
-	// using dynamics_t = CDynamicSimulator_Lagrange_CHOLMOD;
-	// using dynamics_t = CDynamicSimulator_Indep_dense;
-	// using dynamics_t = CDynamicSimulator_AugmentedLagrangian_KLU;
-	// using dynamics_t = CDynamicSimulator_AugmentedLagrangian_Dense;
-	using dynamics_t = CDynamicSimulator_ALi3_Dense;
-	// using dynamics_t = CDynamicSimulator_R_matrix_dense;
-
-	
-	dynamics_t dynSimul(aMBS);
-
-	// dynSimul.params_penalty.alpha = 1e7;
-	// dynSimul.params_penalty.xi = 0.5;
-	// dynSimul.params_penalty.w = 20;
-
-	// Mark points for logging:
-	// -----------------------------------------------
-	// dynSimul.addPointSensor(3);
-	// dynSimul.addPointSensor(2);
-
-	// Set params:
-	// -----------------------------
-	dynSimul.params.time_step = arg_timestep.getValue();
-	dynSimul.params.ode_solver = ODE_RK4;
-	// dynSimul.params.ode_solver = ODE_Trapezoidal;
-	dynSimul.params.user_callback = simul_callback_t(my_callback);
-
 	// Energy stats:
 	AssembledRigidModel::TEnergyValues energy;
 	vector<double> E_tot, E_kin, E_pot;
@@ -239,12 +364,12 @@ static void runDynamicSimulation()
 		{
 			tictac_gui_refresh.Tic();
 
-			mbse::timelog().enter("update_3D_view");
+			MBSE_PROFILE_ENTER("update_3D_view");
 			win3D.get3DSceneAndLock();
 			aMBS->update3DRepresentation(dynamic_rp);
 			win3D.unlockAccess3DScene();
 			win3D.repaint();
-			mbse::timelog().leave("update_3D_view");
+			MBSE_PROFILE_LEAVE("update_3D_view");
 
 			// Update 3D scene:
 			win3D.addTextMessage(
@@ -255,7 +380,7 @@ static void runDynamicSimulation()
 				0 /* txt ID */, fp);
 
 			const double simul_t =
-				mbse::timelog().getMeanTime("mbs.run_complete_timestep");
+				mbse::profiler::getStats("mbs.run_complete_timestep").mean();
 			const double simul_Hz = simul_t > 0 ? 1.0 / simul_t : 0;
 			win3D.addTextMessage(
 				10, 30,
@@ -336,6 +461,14 @@ int main(int argc, char** argv)
 		if (!cmd.parse(argc, argv))
 			throw std::runtime_error("");  // should exit.
 
+#if !defined(SPARSEMBS_HAVE_PROFILER)
+		// They would be written empty:
+		ASSERTMSG_(
+			!arg_profile_json.isSet() && !arg_profile_trace.isSet(),
+			"--profile-json and --profile-trace require mbse built with "
+			"MBSE_WITH_PROFILER=ON");
+#endif
+
 		runDynamicSimulation();
 
 		return 0;  // program ended OK.
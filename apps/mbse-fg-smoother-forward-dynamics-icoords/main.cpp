@@ -25,8 +25,7 @@
 #include <gtsam/nonlinear/Values.h>
 #include <gtsam/slam/BetweenFactor.h>
 #include <gtsam/slam/PriorFactor.h>
-#include <gtsam/nonlinear/BatchFixedLagSmoother.h>
-// #include <gtsam_unstable/nonlinear/IncrementalFixedLagSmoother.h>
+#include <gtsam/nonlinear/LevenbergMarquardtOptimizer.h>
 #include <iostream>
 #include <mbse/AssembledRigidModel.h>
 #include <mbse/ModelDefinition.h>
@@ -37,6 +36,7 @@
 #include <mbse/factors/FactorDynamicsIndep.h>
 #include <mbse/factors/FactorEulerInt.h>
 #include <mbse/factors/FactorTrapInt.h>
+#include <mbse/factors/SlidingWindowSmoother.h>
 #include <mbse/mbse-utils.h>
 #include <mrpt/core/round.h>
 #include <mrpt/math/CVectorDynamic.h>
@@ -181,42 +181,39 @@ void test_smoother()
 	state_t last_q = q_0, last_dq = zeros_q, last_ddq = zeros_q;
 	state_t last_z = z_0, last_dz = zeros_z, last_ddz = zeros_z;
 
-	std::multimap<double, gtsam::NonlinearFactor::shared_ptr> factorsByTime;
-	std::multimap<double, gtsam::Key> keysByTime;
+	const double lag = arg_lag_time.getValue();	 // seconds
 
-	// Create Prior factors:
-	factorsByTime.emplace(
-		0.0, boost::make_shared<gtsam::PriorFactor<state_t>>(
-				 sZ(0), z_0, noise_prior_z_0));
-	factorsByTime.emplace(
-		0.0, boost::make_shared<gtsam::PriorFactor<state_t>>(
-				 sZp(0), zeros_z, noise_prior_dz_0));
+	SlidingWindowSmoother::Parameters swParams;
+	swParams.lag = lag;
+	swParams.lm.maxIterations = arg_smoother_iterations.getValue();
+	swParams.lm.absoluteErrorTol = 0;
+	swParams.lm.relativeErrorTol = 1e-8;
 
-	const double lag = arg_lag_time.getValue();	 // seconds
+	SlidingWindowSmoother smoother(swParams);
 
+	// The whole FG is only kept if needed at the end. Without it, the values
+	// are kept only for the variables in the smoother window:
 	gtsam::NonlinearFactorGraph wholeFG;
 	gtsam::Values wholeValues;
 
-	gtsam::Values estimated;
-	gtsam::FixedLagSmoother::KeyTimestampMap new_timestamps;
-
-	wholeValues.insert(sQ(0), last_q);
-	new_timestamps[sQ(0)] = 0 * dt;
-
-	wholeValues.insert(sQp(0), last_dq);
-	new_timestamps[sQp(0)] = 0 * dt;
-
-	wholeValues.insert(sQpp(0), last_ddq);
-	new_timestamps[sQpp(0)] = 0 * dt;
-
-	wholeValues.insert(sZ(0), last_z);
-	new_timestamps[sZ(0)] = 0 * dt;
-
-	wholeValues.insert(sZp(0), last_dz);
-	new_timestamps[sZp(0)] = 0 * dt;
+	// New factors and variables for the next smoother update:
+	gtsam::NonlinearFactorGraph newFactors;
+	gtsam::Values newValues;
+	SlidingWindowSmoother::KeyTimestampMap newTimestamps;
 
-	wholeValues.insert(sZpp(0), last_ddz);
-	new_timestamps[sZpp(0)] = 0 * dt;
+	// Create Prior factors:
+	newFactors.emplace_shared<gtsam::PriorFactor<state_t>>(
+		sZ(0), z_0, noise_prior_z_0);
+	newFactors.emplace_shared<gtsam::PriorFactor<state_t>>(
+		sZp(0), zeros_z, noise_prior_dz_0);
+
+	newValues.insert(sQ(0), last_q);
+	newValues.insert(sQp(0), last_dq);
+	newValues.insert(sQpp(0), last_ddq);
+	newValues.insert(sZ(0), last_z);
+	newValues.insert(sZp(0), last_dz);
+	newValues.insert(sZpp(0), last_ddz);
+	for (const auto& kv : newValues) newTimestamps[kv.key] = 0 * dt;
 
 	// Save states to files:
 	mrpt::math::CMatrixDouble Qs(N + 1, n + 1), dotQs(N + 1, n + 1),
@@ -264,237 +261,117 @@ void test_smoother()
 	const bool buildWholeFG =
 		arg_show_factor_errors.isSet() || argRunFinalBatch.isSet();
 
-	gtsam::LevenbergMarquardtParams lp =
-		gtsam::LevenbergMarquardtParams::LegacyDefaults();
-
-	lp.maxIterations = arg_smoother_iterations.getValue();
-	lp.absoluteErrorTol = 0;
-	lp.relativeErrorTol = 1e-8;
-
 	for (unsigned int timeStep = 0; timeStep < N; timeStep++, t += dt)
 	{
 		mrpt::system::CTimeLoggerEntry tleStep(
 			mbse::timelog(), "wholeTimeStep");
 
 		// Create Trapezoidal Integrator factors:
-		factorsByTime.emplace(
-			t, boost::make_shared<FactorTrapInt>(
-				   dt, noise_vel_z, sZ(timeStep), sZ(timeStep + 1),
-				   sZp(timeStep), sZp(timeStep + 1)));
-		factorsByTime.emplace(
-			t, boost::make_shared<FactorTrapInt>(
-				   dt, noise_acc_z, sZp(timeStep), sZp(timeStep + 1),
-				   sZpp(timeStep), sZpp(timeStep + 1)));
+		newFactors.emplace_shared<FactorTrapInt>(
+			dt, noise_vel_z, sZ(timeStep), sZ(timeStep + 1), sZp(timeStep),
+			sZp(timeStep + 1));
+		newFactors.emplace_shared<FactorTrapInt>(
+			dt, noise_acc_z, sZp(timeStep), sZp(timeStep + 1), sZpp(timeStep),
+			sZpp(timeStep + 1));
 
 		// Create Dynamics factors:
-		factorsByTime.emplace(
-			t + dt,
-			boost::make_shared<FactorDynamicsIndep>(
-				&dynSimul, noise_dyn_z, sZ(timeStep + 1), sZp(timeStep + 1),
-				sZpp(timeStep + 1), sQ(timeStep + 1), wholeValues));
+		newFactors.emplace_shared<FactorDynamicsIndep>(
+			&dynSimul, noise_dyn_z, sZ(timeStep + 1), sZp(timeStep + 1),
+			sZpp(timeStep + 1), sQ(timeStep + 1), wholeValues);
 		if (timeStep == 0)
-			factorsByTime.emplace(
-				t, boost::make_shared<FactorDynamicsIndep>(
-					   &dynSimul, noise_dyn_z, sZ(timeStep), sZp(timeStep),
-					   sZpp(timeStep), sQ(timeStep), wholeValues));
+			newFactors.emplace_shared<FactorDynamicsIndep>(
+				&dynSimul, noise_dyn_z, sZ(timeStep), sZp(timeStep),
+				sZpp(timeStep), sQ(timeStep), wholeValues);
 
 		// "Soft equality" constraints between q_i and q_{i+1} to solve
 		// configuration/branches ambiguities:
-		factorsByTime.emplace(
-			t, boost::make_shared<gtsam::BetweenFactor<state_t>>(
-				   sQ(timeStep), sQ(timeStep + 1), zeros_q, softBetweenNoise));
+		newFactors.emplace_shared<gtsam::BetweenFactor<state_t>>(
+			sQ(timeStep), sQ(timeStep + 1), zeros_q, softBetweenNoise);
 
 		// Add dependent-coordinates constraint factor:
 		if (timeStep == 0)
 		{
-			factorsByTime.emplace(
-				t, boost::make_shared<FactorConstraintsIndep>(
-					   aMBS, indepCoordIndices, noise_constr_z, sZ(timeStep),
-					   sQ(timeStep)));
-
-			factorsByTime.emplace(
-				t, boost::make_shared<FactorConstraintsVelIndep>(
-					   aMBS, indepCoordIndices, noise_constr_dz, sQ(timeStep),
-					   sQp(timeStep), sZp(timeStep)));
-
-			factorsByTime.emplace(
-				t, boost::make_shared<FactorConstraintsAccIndep>(
-					   aMBS, indepCoordIndices, noise_constr_dz, sQ(timeStep),
-					   sQp(timeStep), sQpp(timeStep), sZpp(timeStep)));
-		}
+			newFactors.emplace_shared<FactorConstraintsIndep>(
+				aMBS, indepCoordIndices, noise_constr_z, sZ(timeStep),
+				sQ(timeStep));
 
-		// if (timeStep < N - 1)
-		{
-			factorsByTime.emplace(
-				t + dt, boost::make_shared<FactorConstraintsIndep>(
-							aMBS, indepCoordIndices, noise_constr_z,
-							sZ(timeStep + 1), sQ(timeStep + 1)));
-
-			factorsByTime.emplace(
-				t + dt,
-				boost::make_shared<FactorConstraintsVelIndep>(
-					aMBS, indepCoordIndices, noise_constr_dz, sQ(timeStep + 1),
-					sQp(timeStep + 1), sZp(timeStep + 1)));
-
-			factorsByTime.emplace(
-				t + dt,
-				boost::make_shared<FactorConstraintsAccIndep>(
-					aMBS, indepCoordIndices, noise_constr_dz, sQ(timeStep + 1),
-					sQp(timeStep + 1), sQpp(timeStep + 1), sZpp(timeStep + 1)));
-		}
+			newFactors.emplace_shared<FactorConstraintsVelIndep>(
+				aMBS, indepCoordIndices, noise_constr_dz, sQ(timeStep),
+				sQp(timeStep), sZp(timeStep));
 
-		// Create initial estimates:
-		if (timeStep > 0)
-		{
-			last_ddq = wholeValues.at<state_t>(sQpp(timeStep - 1));
-			last_ddz = wholeValues.at<state_t>(sZpp(timeStep - 1));
+			newFactors.emplace_shared<FactorConstraintsAccIndep>(
+				aMBS, indepCoordIndices, noise_constr_dz, sQ(timeStep),
+				sQp(timeStep), sQpp(timeStep), sZpp(timeStep));
 		}
 
-		wholeValues.insert(sQpp(timeStep + 1), last_ddq);
-		new_timestamps[sQpp(timeStep + 1)] = (timeStep + 1) * dt;
+		newFactors.emplace_shared<FactorConstraintsIndep>(
+			aMBS, indepCoordIndices, noise_constr_z, sZ(timeStep + 1),
+			sQ(timeStep + 1));
+
+		newFactors.emplace_shared<FactorConstraintsVelIndep>(
+			aMBS, indepCoordIndices, noise_constr_dz, sQ(timeStep + 1),
+			sQp(timeStep + 1), sZp(timeStep + 1));
 
-		wholeValues.insert(sZpp(timeStep + 1), last_ddz);
-		new_timestamps[sZpp(timeStep + 1)] = (timeStep + 1) * dt;
+		newFactors.emplace_shared<FactorConstraintsAccIndep>(
+			aMBS, indepCoordIndices, noise_constr_dz, sQ(timeStep + 1),
+			sQp(timeStep + 1), sQpp(timeStep + 1), sZpp(timeStep + 1));
 
 		// Create initial estimates (so we can run the optimizer)
-		wholeValues.insert(sQ(timeStep + 1), last_q);
-		new_timestamps[sQ(timeStep + 1)] = (timeStep + 1) * dt;
-
-		wholeValues.insert(sZ(timeStep + 1), last_z);
-		new_timestamps[sZ(timeStep + 1)] = (timeStep + 1) * dt;
-
-		wholeValues.insert(sQp(timeStep + 1), last_dq);
-		new_timestamps[sQp(timeStep + 1)] = (timeStep + 1) * dt;
-
-		wholeValues.insert(sZp(timeStep + 1), last_dz);
-		new_timestamps[sZp(timeStep + 1)] = (timeStep + 1) * dt;
-
-		keysByTime.emplace(t, sQ(timeStep));
-		keysByTime.emplace(t, sQp(timeStep));
-		keysByTime.emplace(t, sQpp(timeStep));
-		keysByTime.emplace(t, sQ(timeStep + 1));
-		keysByTime.emplace(t, sQp(timeStep + 1));
-		keysByTime.emplace(t, sQpp(timeStep + 1));
-
-		keysByTime.emplace(t, sZ(timeStep));
-		keysByTime.emplace(t, sZp(timeStep));
-		keysByTime.emplace(t, sZpp(timeStep));
-		keysByTime.emplace(t, sZ(timeStep + 1));
-		keysByTime.emplace(t, sZp(timeStep + 1));
-		keysByTime.emplace(t, sZpp(timeStep + 1));
-
-		// Optimize a sliding window of the whole FG:
-		gtsam::NonlinearFactorGraph fgWindow;
-		for (auto timFactor : factorsByTime)
-			if (timFactor.first >= (t - lag)) fgWindow += timFactor.second;
-
-		gtsam::Values valuesWindow;
-		uint64_t firstTimeIndexInWindow = std::numeric_limits<uint64_t>::max();
-		for (auto timKey : keysByTime)
-			if (timKey.first >= (t - lag))
-			{
-				const auto symbolIdx = gtsam::Symbol(timKey.second).index();
-				mrpt::keep_min(firstTimeIndexInWindow, symbolIdx);
-
-				if (!valuesWindow.exists(timKey.second))
-					valuesWindow.insert(
-						timKey.second, wholeValues.at(timKey.second));
-			}
-
-		// For any timestep > 0, add anchoring prior factors to trust the
-		// first q,dq values in the window. Not neccesary for t==0 just
-		// before we already have prior factors defined (permanent ones, for
-		// t=0).
-		if (firstTimeIndexInWindow > 0)
+		if (timeStep > 0)
 		{
-			const state_t z_init_win =
-				wholeValues.at<state_t>(sZ(firstTimeIndexInWindow));
-			const state_t dz_init_win =
-				wholeValues.at<state_t>(sZp(firstTimeIndexInWindow));
-
-			// Create Prior factors:
-			fgWindow.emplace_shared<gtsam::PriorFactor<state_t>>(
-				sZ(firstTimeIndexInWindow), z_init_win, noise_prior_z_0);
-			fgWindow.emplace_shared<gtsam::PriorFactor<state_t>>(
-				sZp(firstTimeIndexInWindow), dz_init_win, noise_prior_dz_0);
+			if (wholeValues.exists(sQpp(timeStep - 1)))
+				last_ddq = wholeValues.at<state_t>(sQpp(timeStep - 1));
+			if (wholeValues.exists(sZpp(timeStep - 1)))
+				last_ddz = wholeValues.at<state_t>(sZpp(timeStep - 1));
 		}
 
-#if 0
-    lp.iterationHook = [&fgWindow](size_t iter, double errBef,
-                                   double errAfter) {
-      const auto N = fgWindow.size();
-      std::cout << "LM iter #" << iter << " rmse: " << std::sqrt(errBef / N)
-                << " -> " << std::sqrt(errAfter / N) << std::endl;
-    };
-#endif
-
-#if 0
-    fgWindow.print("\n\n***** FG window input*****\n");
-    valuesWindow.print("\n\n ******* valuesWindow ****** \n");
-#endif
-
-		gtsam::LevenbergMarquardtOptimizer lm(fgWindow, valuesWindow, lp);
-		const auto& estimated = lm.optimize();
-
-#if 0
-    // std::cout << " === INIT:\n";
-    // fgWindow.printErrors(valuesWindow);
-    // valuesWindow.print("valuesWindow");
-    std::cout << " === FINAL:\n";
-
-    const auto lambdaPrintError = [](const gtsam::Factor *, double err,
-                                     size_t) { return err > 0.1; };
-
-    fgWindow.printErrors(estimated, "", gtsam::DefaultKeyFormatter,
-                         lambdaPrintError);
-    // estimated.print("estimated:");
-#endif
+		newValues.insert(sQpp(timeStep + 1), last_ddq);
+		newValues.insert(sZpp(timeStep + 1), last_ddz);
+		newValues.insert(sQ(timeStep + 1), last_q);
+		newValues.insert(sZ(timeStep + 1), last_z);
+		newValues.insert(sQp(timeStep + 1), last_dq);
+		newValues.insert(sZp(timeStep + 1), last_dz);
+		for (const auto& kv : newValues)
+			newTimestamps[kv.key] = (timeStep + 1) * dt;
+
+		if (buildWholeFG) wholeFG.push_back(newFactors);
+		wholeValues.insert(newValues);
+
+		// Add to the sliding window, marginalize old states, and optimize:
+		const auto res = smoother.update(newFactors, newValues, newTimestamps);
+
+		newFactors = gtsam::NonlinearFactorGraph();
+		newValues.clear();
+		newTimestamps.clear();
+
+		const gtsam::Values& estimated = smoother.calculateEstimate();
 
 		if (!arg_do_not_show_error_progress.isSet())
 		{
-			const double errorBeforeLM = fgWindow.error(valuesWindow);
-			const double errorAfterLM = fgWindow.error(estimated);
-			const auto numFactorsLM = fgWindow.size();
-
 			std::cout << "n=" << timeStep << "/" << N << " sliding window LM"
 					  << " before RMSE="
-					  << std::sqrt(errorBeforeLM / numFactorsLM)
+					  << std::sqrt(res.errorBefore / res.numFactors)
 					  << " after RMSE="
-					  << std::sqrt(errorAfterLM / numFactorsLM)
-					  << " numFactors=" << numFactorsLM
-					  << " iters:" << lm.iterations()
+					  << std::sqrt(res.errorAfter / res.numFactors)
+					  << " numFactors=" << res.numFactors
+					  << " iters:" << res.iterations
 					  << " q= " << last_q.transpose() << "\n";
 		}
 
-		ASSERT_(lm.iterations() > 0);
+		ASSERT_(res.iterations > 0);
 
-		// save/update the last N values (older are "more refined"):
-		for (const auto& kv : estimated)
-		{
-			// Update list of all values (for final batch):
-			if (wholeValues.find(kv.key) == wholeValues.end())
-				wholeValues.insert(kv.key, kv.value);
-			else
-				wholeValues.update(kv.key, estimated.at<state_t>(kv.key));
-		}
+		// save/update the last N values (older are "more refined"). Without
+		// the whole FG, only those in the window are kept, which are the only
+		// ones the dynamics factors may still need:
+		if (buildWholeFG)
+			wholeValues.update(estimated);
+		else
+			wholeValues = estimated;
 
 		// Update values in vectors for saving to disk:
 		lambda_Values_toQ_DQ_DDQ(estimated);
 	}
 
-	// Build FG with all factors:
-	if (buildWholeFG)
-		for (auto timFactor : factorsByTime) wholeFG += timFactor.second;
-
-#if 0
-  const double errorAfter = smoother.getFactors().error(estimated);
-  const auto numFactors = smoother.getFactors().size();
-
-  std::cout << "ErrorAfter=" << errorAfter
-            << " RMSE=" << std::sqrt(errorAfter / numFactors)
-            << " numFactors=" << numFactors << "\n";
-#endif
-
 	auto lmbdPrintErr = [](const gtsam::Factor* /*factor*/,
 						   double whitenedError, size_t /*index*/) -> bool {
 		return true;  // whitenedError > 1e-3;
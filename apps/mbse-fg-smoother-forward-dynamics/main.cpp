@@ -14,8 +14,7 @@
 #include <gtsam/nonlinear/Values.h>
 #include <gtsam/slam/PriorFactor.h>
 #include <gtsam/nonlinear/NonlinearEquality.h>
-#include <gtsam/nonlinear/BatchFixedLagSmoother.h>
-//#include <gtsam_unstable/nonlinear/IncrementalFixedLagSmoother.h>
+#include <gtsam/nonlinear/LevenbergMarquardtOptimizer.h>
 #include <iostream>
 #include <mbse/AssembledRigidModel.h>
 #include <mbse/ModelDefinition.h>
@@ -25,6 +24,7 @@
 #include <mbse/factors/FactorDynamics.h>
 #include <mbse/factors/FactorEulerInt.h>
 #include <mbse/factors/FactorTrapInt.h>
+#include <mbse/factors/SlidingWindowSmoother.h>
 #include <mbse/model-examples.h>
 
 #include <mrpt/3rdparty/tclap/CmdLine.h>
@@ -159,50 +159,37 @@ void test_smoother()
 	std::cout << "q0: " << q_0.transpose() << "\n";
 	state_t last_q = q_0, last_dq = zeros, last_ddq = zeros;
 
-	std::multimap<double, gtsam::NonlinearFactor::shared_ptr> factorsByTime;
-	std::multimap<double, gtsam::Key> keysByTime;
+	const double lag = arg_lag_time.getValue();	 // seconds
 
-	// Create Prior factors:
-	factorsByTime.emplace(
-		0.0, boost::make_shared<gtsam::NonlinearEquality<state_t>>(Q(0), q_0));
-	factorsByTime.emplace(
-		0.0, boost::make_shared<gtsam::PriorFactor<state_t>>(
-				 V(0), zeros, noise_prior_dq_0));
+	SlidingWindowSmoother::Parameters swParams;
+	swParams.lag = lag;
+	swParams.lm.maxIterations = arg_smoother_iterations.getValue();
+	swParams.lm.absoluteErrorTol = 0;
+	swParams.lm.relativeErrorTol = 1e-8;
 
-	const double lag = arg_lag_time.getValue();	 // seconds
+	SlidingWindowSmoother smoother(swParams);
 
+	// The whole FG (and its values) is only kept if needed at the end:
 	gtsam::NonlinearFactorGraph wholeFG;
 	gtsam::Values wholeValues;
 
-#define USE_BATCH_OPTIMIZER 1
-
-#if USE_BATCH_OPTIMIZER
-	gtsam::BatchFixedLagSmoother smoother(lag);
-
-	smoother.params().maxIterations = arg_smoother_iterations.getValue();
-#else
-	gtsam::IncrementalFixedLagSmoother smoother(lag);
-	
-	// maxIterations = arg_smoother_iterations.getValue();
-	// smoother.params().optimizationParams =  gnparams;
-#endif
-
-	gtsam::Values estimated;
-	gtsam::FixedLagSmoother::KeyTimestampMap new_timestamps;
+	// New factors and variables for the next smoother update:
+	gtsam::NonlinearFactorGraph newFactors;
+	gtsam::Values newValues;
+	SlidingWindowSmoother::KeyTimestampMap newTimestamps;
 
-#if 0
-  new_values.insert(Q(0), last_q);
-  new_values.insert(V(0), last_dq);
-  new_values.insert(A(0), last_ddq);
-#endif
+	// Create Prior factors:
+	newFactors.emplace_shared<gtsam::NonlinearEquality<state_t>>(Q(0), q_0);
+	newFactors.emplace_shared<gtsam::PriorFactor<state_t>>(
+		V(0), zeros, noise_prior_dq_0);
 
-	wholeValues.insert(Q(0), last_q);
-	wholeValues.insert(V(0), last_dq);
-	wholeValues.insert(A(0), last_ddq);
+	newValues.insert(Q(0), last_q);
+	newValues.insert(V(0), last_dq);
+	newValues.insert(A(0), last_ddq);
 
-	new_timestamps[Q(0)] = 0 * dt;
-	new_timestamps[V(0)] = 0 * dt;
-	new_timestamps[A(0)] = 0 * dt;
+	newTimestamps[Q(0)] = 0 * dt;
+	newTimestamps[V(0)] = 0 * dt;
+	newTimestamps[A(0)] = 0 * dt;
 
 	// Save states to files:
 	mrpt::math::CMatrixDouble Qs(N + 1, n + 1), dotQs(N + 1, n + 1),
@@ -241,12 +228,13 @@ void test_smoother()
 	const bool buildWholeFG =
 		arg_show_factor_errors.isSet() || argRunFinalBatch.isSet();
 
-	gtsam::LevenbergMarquardtParams lp =
-		gtsam::LevenbergMarquardtParams::LegacyDefaults();
-
-	lp.maxIterations = arg_smoother_iterations.getValue();
-	lp.absoluteErrorTol = 0;
-	lp.relativeErrorTol = 1e-8;
+	// Latest estimate of a variable still in the sliding window, or `def`
+	// if it was already marginalized out:
+	auto lmbdLatestEstimate = [&smoother](
+								  gtsam::Key key, const state_t& def) {
+		const gtsam::Values& estimated = smoother.calculateEstimate();
+		return estimated.exists(key) ? estimated.at<state_t>(key) : def;
+	};
 
 	for (unsigned int timeStep = 0; timeStep < N; timeStep++, t += dt)
 	{
@@ -254,179 +242,77 @@ void test_smoother()
 			mbse::timelog(), "wholeTimeStep");
 
 		// Create Trapezoidal Integrator factors:
-		factorsByTime.emplace(
-			t, boost::make_shared<FactorTrapInt>(
-				   dt, noise_vel, Q(timeStep), Q(timeStep + 1), V(timeStep),
-				   V(timeStep + 1)));
-		factorsByTime.emplace(
-			t, boost::make_shared<FactorTrapInt>(
-				   dt, noise_acc, V(timeStep), V(timeStep + 1), A(timeStep),
-				   A(timeStep + 1)));
+		newFactors.emplace_shared<FactorTrapInt>(
+			dt, noise_vel, Q(timeStep), Q(timeStep + 1), V(timeStep),
+			V(timeStep + 1));
+		newFactors.emplace_shared<FactorTrapInt>(
+			dt, noise_acc, V(timeStep), V(timeStep + 1), A(timeStep),
+			A(timeStep + 1));
 
 		// Create Dynamics factors:
-		factorsByTime.emplace(
-			t + dt, boost::make_shared<FactorDynamics>(
-						&dynSimul, noise_dyn, Q(timeStep + 1), V(timeStep + 1),
-						A(timeStep + 1)));
+		newFactors.emplace_shared<FactorDynamics>(
+			&dynSimul, noise_dyn, Q(timeStep + 1), V(timeStep + 1),
+			A(timeStep + 1));
 		if (timeStep == 0)
-			factorsByTime.emplace(
-				t, boost::make_shared<FactorDynamics>(
-					   &dynSimul, noise_dyn, Q(timeStep), V(timeStep),
-					   A(timeStep)));
+			newFactors.emplace_shared<FactorDynamics>(
+				&dynSimul, noise_dyn, Q(timeStep), V(timeStep), A(timeStep));
 
 		// Add dependent-coordinates constraint factor:
 		if (!arg_dont_add_q_constraints.isSet())
-			factorsByTime.emplace(
-				t, boost::make_shared<FactorConstraints>(
-					   aMBS, noise_constr_q, Q(timeStep)));
+			newFactors.emplace_shared<FactorConstraints>(
+				aMBS, noise_constr_q, Q(timeStep));
 
 		if (!arg_dont_add_dq_constraints.isSet())
-			factorsByTime.emplace(
-				t, boost::make_shared<FactorConstraintsVel>(
-					   aMBS, noise_constr_dq, Q(timeStep), V(timeStep)));
+			newFactors.emplace_shared<FactorConstraintsVel>(
+				aMBS, noise_constr_dq, Q(timeStep), V(timeStep));
 
-		// Create initial estimates:
-		if (timeStep > 0) last_ddq = wholeValues.at<state_t>(A(timeStep - 1));
+		// Create initial estimates (so we can run the optimizer)
+		if (timeStep > 0)
+			last_ddq = lmbdLatestEstimate(A(timeStep - 1), last_ddq);
 
-		wholeValues.insert(A(timeStep + 1), last_ddq);
-		new_timestamps[A(timeStep + 1)] = (timeStep + 1) * dt;
+		newValues.insert(A(timeStep + 1), last_ddq);
+		newValues.insert(Q(timeStep + 1), last_q);
+		newValues.insert(V(timeStep + 1), last_dq);
 
-		// Create initial estimates (so we can run the optimizer)
-		wholeValues.insert(Q(timeStep + 1), last_q);
-		new_timestamps[Q(timeStep + 1)] = (timeStep + 1) * dt;
-
-		wholeValues.insert(V(timeStep + 1), last_dq);
-		new_timestamps[V(timeStep + 1)] = (timeStep + 1) * dt;
-
-		keysByTime.emplace(t, Q(timeStep));
-		keysByTime.emplace(t, V(timeStep));
-		keysByTime.emplace(t, A(timeStep));
-		keysByTime.emplace(t, Q(timeStep + 1));
-		keysByTime.emplace(t, V(timeStep + 1));
-		keysByTime.emplace(t, A(timeStep + 1));
-
-#if 0
-    mbse::timelog().enter("smoother.update");
-    const auto res = smoother.update(new_factors, new_values, new_timestamps);
-    mbse::timelog().leave("smoother.update");
-
-    std::cout << "n=" << timeStep << "/" << N
-              << " keys: " << smoother.timestamps().size() << " rmse: "
-              << std::sqrt(res.getError() / smoother.getFactors().size())
-              << "\n";
-
-    mbse::timelog().enter("smoother.calculateEstimate");
-    estimated = smoother.calculateEstimate();
-    mbse::timelog().leave("smoother.calculateEstimate");
-
-    // reset containers:
-    new_factors = gtsam::NonlinearFactorGraph();
-    new_values.clear();
-    new_timestamps.clear();
-#else
-		// Optimize a sliding window of the whole FG:
-		gtsam::NonlinearFactorGraph fgWindow;
-		for (auto timFactor : factorsByTime)
-			if (timFactor.first >= (t - lag)) fgWindow += timFactor.second;
-
-		gtsam::Values valuesWindow;
-		uint64_t firstTimeIndexInWindow = std::numeric_limits<uint64_t>::max();
-		for (auto timKey : keysByTime)
-			if (timKey.first >= (t - lag))
-			{
-				const auto symbolIdx = gtsam::Symbol(timKey.second).index();
-				mrpt::keep_min(firstTimeIndexInWindow, symbolIdx);
-
-				if (!valuesWindow.exists(timKey.second))
-					valuesWindow.insert(
-						timKey.second, wholeValues.at(timKey.second));
-			}
-
-		// For any timestep > 0, add anchoring prior factors to trust the
-		// first q,dq values in the window. Not neccesary for t==0 just
-		// before we already have prior factors defined (permanent ones, for
-		// t=0).
-		if (firstTimeIndexInWindow > 0)
+		newTimestamps[A(timeStep + 1)] = (timeStep + 1) * dt;
+		newTimestamps[Q(timeStep + 1)] = (timeStep + 1) * dt;
+		newTimestamps[V(timeStep + 1)] = (timeStep + 1) * dt;
+
+		if (buildWholeFG)
 		{
-			const state_t q_init_win =
-				wholeValues.at<state_t>(Q(firstTimeIndexInWindow));
-			const state_t dq_init_win =
-				wholeValues.at<state_t>(V(firstTimeIndexInWindow));
-
-			// Create Prior factors:
-			fgWindow.emplace_shared<gtsam::NonlinearEquality<state_t>>(
-				Q(firstTimeIndexInWindow), q_init_win);
-			fgWindow.emplace_shared<gtsam::NonlinearEquality<state_t>>(
-				V(firstTimeIndexInWindow), dq_init_win);
+			wholeFG.push_back(newFactors);
+			wholeValues.insert(newValues);
 		}
 
-#if 0
-    lp.iterationHook = [&fgWindow](size_t iter, double errBef,
-                                   double errAfter) {
-      const auto N = fgWindow.size();
-      std::cout << "LM iter #" << iter << " rmse: " << std::sqrt(errBef / N)
-                << " -> " << std::sqrt(errAfter / N) << std::endl;
-    };
-#endif
-		gtsam::LevenbergMarquardtOptimizer lm(fgWindow, valuesWindow, lp);
-		const auto& estimated = lm.optimize();
-
-#if 0
-    std::cout << " === INIT:\n";
-    fgWindow.printErrors(valuesWindow);
-    valuesWindow.print("valuesWindow");
-    std::cout << " === FINAL:\n";
-    fgWindow.printErrors(estimated);
-    estimated.print("estimated:");
-#endif
+		// Add to the sliding window, marginalize old states, and optimize:
+		const auto res = smoother.update(newFactors, newValues, newTimestamps);
+
+		newFactors = gtsam::NonlinearFactorGraph();
+		newValues.clear();
+		newTimestamps.clear();
+
+		const gtsam::Values& estimated = smoother.calculateEstimate();
 
 		if (!arg_do_not_show_error_progress.isSet())
 		{
-			const double errorBeforeLM = fgWindow.error(valuesWindow);
-			const double errorAfterLM = fgWindow.error(estimated);
-			const auto numFactorsLM = fgWindow.size();
-
 			std::cout << "n=" << timeStep << "/" << N
 					  << " sliding window LevMarq."
 						 " ErrorBefore = "
-					  << errorBeforeLM
-					  << " RMSE=" << std::sqrt(errorBeforeLM / numFactorsLM)
-					  << " ErrorAfter  = " << errorAfterLM
-					  << " RMSE=" << std::sqrt(errorAfterLM / numFactorsLM)
-					  << " numFactors=" << numFactorsLM
-					  << " iters:" << lm.iterations() << "\n";
+					  << res.errorBefore
+					  << " RMSE=" << std::sqrt(res.errorBefore / res.numFactors)
+					  << " ErrorAfter  = " << res.errorAfter
+					  << " RMSE=" << std::sqrt(res.errorAfter / res.numFactors)
+					  << " numFactors=" << res.numFactors
+					  << " iters:" << res.iterations << "\n";
 		}
 
-#endif
-
 		// save/update the last N values (older are "more refined"):
-		for (const auto& kv : estimated)
-		{
-			// Update list of all values (for final batch):
-			if (wholeValues.find(kv.key) == wholeValues.end())
-				wholeValues.insert(kv.key, kv.value);
-			else
-				wholeValues.update(kv.key, estimated.at<state_t>(kv.key));
-		}
-		//    wholeValues.print("wholeValues:");
+		if (buildWholeFG) wholeValues.update(estimated);
 
 		// Update values in vectors for saving to disk:
 		lambda_Values_toQ_DQ_DDQ(estimated);
 	}
 
-	// Build FG with all factors:
-	if (buildWholeFG)
-		for (auto timFactor : factorsByTime) wholeFG += timFactor.second;
-
-#if 0
-  const double errorAfter = smoother.getFactors().error(estimated);
-  const auto numFactors = smoother.getFactors().size();
-
-  std::cout << "ErrorAfter=" << errorAfter
-            << " RMSE=" << std::sqrt(errorAfter / numFactors)
-            << " numFactors=" << numFactors << "\n";
-#endif
-
 	auto lmbdPrintErr = [](const gtsam::Factor* /*factor*/,
 						   double whitenedError, size_t /*index*/) -> bool {
 		return true;  // whitenedError > 1e-3;
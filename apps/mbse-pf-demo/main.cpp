@@ -64,6 +64,10 @@ const double IMPERFECT_PF_MODEL_ERROR =
 		? atof(getenv("IMPERFECT_PF_MODEL_ERROR"))
 		: 1;
 
+// Adapt the number of particles with KLD-sampling:
+const bool PF_ADAPTIVE_SAMPLE_SIZE =
+	getenv("PF_ADAPTIVE_SAMPLE_SIZE") != nullptr;
+
 const bool INITIALIZE_UNIFORMLY = true;
 
 const double FINAL_TIME = 10.0;
@@ -182,7 +186,7 @@ int main(int argc, char** argv)
 {
 	try
 	{
-		mbse::timelog().enable(false);
+		mbse::profiler::enable(false);
 
 		ModelDefinition model;
 
@@ -233,6 +237,8 @@ int main(int argc, char** argv)
 		// ------------------------
 		pf.model_options.acc_xy_noise_std = PF_MOTION_MODEL_NOISE_XY;
 		// pf.PF_options.verbose = true;
+		pf.PF_options.adaptiveSampleSize = PF_ADAPTIVE_SAMPLE_SIZE;
+		pf.PF_options.KLD_maxSampleSize = 10 * NUM_PARTS;
 
 		// PF must be initialized with a uniform distribution (no "prior" at
 		// all)
@@ -315,7 +321,7 @@ int main(int argc, char** argv)
 		vector<double> STATS_t, GT_ang0, EST_ang0_mean, EST_ang0_std;
 		mrpt::poses::CPosePDFParticles orientation_averager;
 		orientation_averager.resetDeterministic(
-			mrpt::math::TPose2D(), pf.m_particles.size());
+			mrpt::math::TPose2D(), pf.particles.size());
 #endif
 
 		// Prepare sensor descriptions:
@@ -379,18 +385,21 @@ int main(int argc, char** argv)
 				aMBS_GT->q_[aMBS_GT->points2DOFs_[1].dof_x]));
 
 			// Estimated values:
-			for (size_t i = 0; i < pf.m_particles.size(); i++)
-			{
-				auto part = pf.m_particles[i].d;
+			if (orientation_averager.size() != pf.particles.size())
+				orientation_averager.resetDeterministic(
+					mrpt::math::TPose2D(), pf.particles.size());
 
+			const auto& pt1_dofs = pf.particles.topology->points2DOFs_[1];
+			for (size_t i = 0; i < pf.particles.size(); i++)
+			{
 				const double val_phi = atan2(
-					part->num_model.q_[part->num_model.points2DOFs_[1].dof_y],
-					part->num_model.q_[part->num_model.points2DOFs_[1].dof_x]);
+					pf.particles.q(pt1_dofs.dof_y, i),
+					pf.particles.q(pt1_dofs.dof_x, i));
 
 				orientation_averager.m_particles[i].d.phi = val_phi;
 
 				orientation_averager.m_particles[i].log_w =
-					pf.m_particles[i].log_w;
+					pf.particles.log_w[i];
 			}
 
 			// Estimate a full (x,y,phi) pose just for easy reusing of MRPT
@@ -524,10 +533,12 @@ int main(int argc, char** argv)
 void pf_initialize_uniform_distribution(
 	MultiBodyParticleFilter& pf, ModelDefinition& model)
 {
-	for (size_t i = 0; i < pf.m_particles.size(); i++)
+	AssembledRigidModel mdl(pf.particles.topology);
+	const auto& p2dofs = mdl.getPoints2DOFs();
+
+	for (size_t i = 0; i < pf.particles.size(); i++)
 	{
-		auto part = pf.m_particles[i].d;
-		const auto& p2dofs = part->num_model.getPoints2DOFs();
+		pf.particles.load(i, mdl);
 
 		// We draw a random value for the free DOF(s) of the mechanism:
 		// and uniform values for the rest:
@@ -536,16 +547,20 @@ void pf_initialize_uniform_distribution(
 		{
 			const double R = model.bodies()[0].length();
 			const double ang = rnd.drawUniform(-M_PI, M_PI);
-			const size_t nTotalDOFs = part->num_model.q_.size();
+			const size_t nTotalDOFs = mdl.q_.size();
 			for (size_t k = 0; k < nTotalDOFs; k++)
-				part->num_model.q_[k] = rnd.drawUniform(-20, 20);
+				mdl.q_[k] = rnd.drawUniform(-20, 20);
 
 			const size_t PT_IDX = 1;  // This point is the one we force to be at
 									  // a predefined position:
-			part->num_model.q_[p2dofs[PT_IDX].dof_x] = R * cos(ang);
-			part->num_model.q_[p2dofs[PT_IDX].dof_y] = R * sin(ang);
+			mdl.q_[p2dofs[PT_IDX].dof_x] = R * cos(ang);
+			mdl.q_[p2dofs[PT_IDX].dof_y] = R * sin(ang);
 
-			final_err = part->num_model.refinePosition(1e-13, 30);
+			// Each draw is unrelated to the previous one:
+			mdl.kinematicProjector().invalidate();
+			final_err = mdl.refinePosition(1e-13, 30);
 		} while (final_err > 1e-6);
+
+		pf.particles.store(i, mdl);
 	}
 }
@@ -0,0 +1,64 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include "alloc-counter.h"
+
+#include <cstdlib>
+#include <new>
+
+std::atomic<std::size_t> mbse_bench::num_allocs{0};
+std::atomic<std::size_t> mbse_bench::num_alloc_bytes{0};
+std::atomic<std::size_t> mbse_bench::num_mallocs{0};
+std::atomic<std::size_t> mbse_bench::num_malloc_bytes{0};
+
+#if defined(__GLIBC__)
+const bool mbse_bench::have_malloc_counters = true;
+
+// Symbols of the executable take precedence over those of libc, also for
+// the shared libraries it loads; glibc exports its own implementations as
+// __libc_*():
+extern "C"
+{
+	void* __libc_malloc(std::size_t n);
+	void* __libc_calloc(std::size_t n, std::size_t size);
+	void* __libc_realloc(void* p, std::size_t n);
+
+	void* malloc(std::size_t n)
+	{
+		mbse_bench::num_mallocs++;
+		mbse_bench::num_malloc_bytes += n;
+		return __libc_malloc(n);
+	}
+	void* calloc(std::size_t n, std::size_t size)
+	{
+		mbse_bench::num_mallocs++;
+		mbse_bench::num_malloc_bytes += n * size;
+		return __libc_calloc(n, size);
+	}
+	void* realloc(void* p, std::size_t n)
+	{
+		mbse_bench::num_mallocs++;
+		mbse_bench::num_malloc_bytes += n;
+		return __libc_realloc(p, n);
+	}
+}
+#else
+const bool mbse_bench::have_malloc_counters = false;
+#endif
+
+void* operator new(std::size_t n)
+{
+	mbse_bench::num_allocs++;
+	mbse_bench::num_alloc_bytes += n;
+	if (void* p = std::malloc(n ? n : 1)) return p;
+	throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
@@ -0,0 +1,38 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+/** \file Counters of heap allocations, updated by the replacement global
+ * operator new of the benchmark executable and, with glibc, by replacement
+ * malloc(), calloc() and realloc() that also see the allocations of C
+ * libraries (SuiteSparse, etc.) and of Eigen. */
+
+namespace mbse_bench
+{
+/** Number of calls to operator new since program start */
+extern std::atomic<std::size_t> num_allocs;
+
+/** Total number of bytes requested to operator new since program start */
+extern std::atomic<std::size_t> num_alloc_bytes;
+
+/** Whether the malloc-level counters below are available (glibc only) */
+extern const bool have_malloc_counters;
+
+/** Number of calls to malloc(), calloc() and realloc() since program start,
+ * including those made by operator new */
+extern std::atomic<std::size_t> num_mallocs;
+
+/** Total number of bytes requested to malloc(), calloc() and realloc() */
+extern std::atomic<std::size_t> num_malloc_bytes;
+}  // namespace mbse_bench
@@ -0,0 +1,75 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+// Microbenchmark for the RHS assembly of the equations of motion. It also
+// counts calls to operator new and, where available, to malloc() per call,
+// which must be zero: build_RHS() is called four times per RK4 step and per
+// particle. Eigen allocations are also asserted absent by the BuildRHS unit
+// test.
+
+#include <benchmark/benchmark.h>
+#include <mbse/mbse.h>
+#include <mbse/model-examples.h>
+
+#include "alloc-counter.h"
+
+using mbse_bench::num_allocs;
+using mbse_bench::num_mallocs;
+
+namespace
+{
+/** Exposes the protected build_RHS() of the simulator base class */
+class RHSBuilder : public mbse::CDynamicSimulator_Lagrange_LU_dense
+{
+   public:
+	using mbse::CDynamicSimulator_Lagrange_LU_dense::
+		CDynamicSimulator_Lagrange_LU_dense;
+	using mbse::CDynamicSimulatorBase::build_RHS;
+};
+
+void BM_build_RHS(benchmark::State& state)
+{
+	const auto N = static_cast<size_t>(state.range(0));
+
+	auto aMBS = mbse::buildLongStringMBS(N).assembleRigidMBS();
+	aMBS->dotq_.setRandom();
+	aMBS->update_numeric_Phi_and_Jacobians();
+
+	// Measure the builder alone, without profiler overhead:
+	mbse::profiler::enable(false);
+
+	RHSBuilder builder(aMBS);
+	Eigen::VectorXd Q(aMBS->q_.size()), c(aMBS->Phi_.size());
+
+	const std::size_t allocs_before = num_allocs;
+	const std::size_t mallocs_before = num_mallocs;
+	for (auto _ : state)
+	{
+		builder.build_RHS(&Q[0], &c[0]);
+		benchmark::DoNotOptimize(c.data());
+		benchmark::ClobberMemory();
+	}
+	const std::size_t allocs = num_allocs - allocs_before;
+	const std::size_t mallocs = num_mallocs - mallocs_before;
+
+	mbse::profiler::enable(true);
+
+	state.counters["nDOFs"] = aMBS->q_.size();
+	state.counters["operator_new_per_call"] =
+		static_cast<double>(allocs) / state.iterations();
+	if (mbse_bench::have_malloc_counters)
+		state.counters["malloc_per_call"] =
+			static_cast<double>(mallocs) / state.iterations();
+	if (allocs != 0) state.SkipWithError("build_RHS() called operator new");
+	else if (mallocs != 0) state.SkipWithError("build_RHS() called malloc()");
+}
+}  // namespace
+
+BENCHMARK(BM_build_RHS)->Arg(10)->Arg(50)->Arg(200);
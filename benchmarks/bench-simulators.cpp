@@ -0,0 +1,127 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+// Benchmark of all the dynamic simulators registered in
+// CDynamicSimulatorBase::Create(), against the example models of growing
+// size. Each iteration is one RK4 time step. Besides the time per step, it
+// reports the mean time of each profiled phase (solver_prepare,
+// solve_ddotq internals, etc.), the heap memory requested by prepare() and
+// the heap allocations per step, both counted at the operator new level
+// (C++ containers) and, where available, at the malloc() level (which also
+// includes Eigen and the SuiteSparse solvers).
+
+#include <benchmark/benchmark.h>
+#include <mbse/mbse.h>
+#include <mbse/model-examples.h>
+
+#include <functional>
+#include <map>
+#include <string>
+
+#include "alloc-counter.h"
+
+namespace
+{
+using model_generator_t = std::function<mbse::ModelDefinition()>;
+
+const std::vector<std::pair<std::string, model_generator_t>>& models()
+{
+	static const std::vector<std::pair<std::string, model_generator_t>> m = {
+		{"FourBars", [] { return mbse::buildFourBarsMBS(); }},
+		{"SliderCrank", [] { return mbse::buildSliderCrankMBS(); }},
+		{"Follower", [] { return mbse::buildFollowerMBS(); }},
+		{"Grid_2x2", [] { return mbse::buildParameterizedMBS(2, 2); }},
+		{"Grid_5x5", [] { return mbse::buildParameterizedMBS(5, 5); }},
+		{"Grid_10x10", [] { return mbse::buildParameterizedMBS(10, 10); }},
+		{"String_10", [] { return mbse::buildLongStringMBS(10); }},
+		{"String_50", [] { return mbse::buildLongStringMBS(50); }},
+		{"String_200", [] { return mbse::buildLongStringMBS(200); }}};
+	return m;
+}
+
+void BM_simulator_step(
+	benchmark::State& state, const std::string& solverName,
+	const model_generator_t& modelGenerator)
+{
+	using mbse_bench::num_alloc_bytes;
+	using mbse_bench::num_allocs;
+	using mbse_bench::num_malloc_bytes;
+	using mbse_bench::num_mallocs;
+
+	const double dt = 1e-3;
+
+	try
+	{
+		auto aMBS = modelGenerator().assembleRigidMBS();
+		aMBS->setGravityVector(0, -9.81, 0);
+
+		auto dynSimul = mbse::CDynamicSimulatorBase::Create(solverName, aMBS);
+		dynSimul->params.ode_solver = mbse::ODE_RK4;
+		dynSimul->params.time_step = dt;
+
+		const std::size_t bytes_before = num_alloc_bytes;
+		const std::size_t malloc_bytes_before = num_malloc_bytes;
+		dynSimul->prepare();
+		const std::size_t prepare_bytes = num_alloc_bytes - bytes_before;
+		const std::size_t prepare_malloc_bytes =
+			num_malloc_bytes - malloc_bytes_before;
+
+		// Only profile the time steps:
+		mbse::profiler::clear();
+
+		double t = 0;
+		const std::size_t allocs_before = num_allocs;
+		const std::size_t mallocs_before = num_mallocs;
+		for (auto _ : state)
+		{
+			t = dynSimul->run(t, t + dt);
+			benchmark::DoNotOptimize(aMBS->q_.data());
+		}
+		const std::size_t allocs = num_allocs - allocs_before;
+		const std::size_t mallocs = num_mallocs - mallocs_before;
+
+		state.counters["nDOFs"] = aMBS->q_.size();
+		state.counters["nConstraints"] = aMBS->Phi_.size();
+		state.counters["prepare_new_KiB"] = prepare_bytes / 1024.0;
+		state.counters["operator_new_per_step"] =
+			static_cast<double>(allocs) / state.iterations();
+		if (mbse_bench::have_malloc_counters)
+		{
+			state.counters["prepare_malloc_KiB"] =
+				prepare_malloc_bytes / 1024.0;
+			state.counters["malloc_per_step"] =
+				static_cast<double>(mallocs) / state.iterations();
+		}
+
+		// Mean time per call of each profiled phase, in microseconds:
+		for (const auto& s : mbse::profiler::collectStats())
+		{
+			if (s.kind != mbse::profiler::ScopeKind::Time) continue;
+			state.counters["us:" + s.name] = s.mean() * 1e6;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		state.SkipWithError(e.what());
+	}
+}
+
+[[maybe_unused]] const bool registered = [] {
+	for (const auto& solver : mbse::CDynamicSimulatorBase::RegisteredNames())
+		for (const auto& model : models())
+		{
+			benchmark::RegisterBenchmark(
+				("BM_simulator_step/" + solver + "/" + model.first).c_str(),
+				BM_simulator_step, solver, model.second)
+				->Unit(benchmark::kMicrosecond);
+		}
+	return true;
+}();
+}  // namespace
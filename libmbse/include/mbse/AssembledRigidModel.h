@@ -10,32 +10,19 @@
 
 #pragma once
 
-#include "ModelDefinition.h"
+#include <mbse/KinematicProjector.h>
+#include <mbse/ModelDefinition.h>
+#include <mbse/ModelTopology.h>
 
 namespace mbse
 {
-/** This struct holds the "list of instructions" for creating an actual
- * AssembledRigidModel that models a ModelDefinition */
-struct TSymbolicAssembledModel
-{
-	const ModelDefinition& model;  //!< My "parent" model
-
-	/** Info on Natural Coordinate DOFs in the problem (same lenth than q_) */
-	std::vector<NaturalCoordinateDOF> DOFs;
-
-	/** Additional relative coordinates */
-	std::vector<RelativeDOF> rDOFs;
-
-	TSymbolicAssembledModel(const ModelDefinition& model_) : model(model_) {}
-
-	void clear()
-	{
-		DOFs.clear();
-		rDOFs.clear();
-	}
-};
-
-class AssembledRigidModel
+/** A multibody model ready for simulation: a numeric ModelState, together
+ * with the shared ModelTopology it is evaluated against.
+ *
+ * Copying a topology is never needed: many AssembledRigidModel objects may
+ * be created from the same ModelTopology::Ptr.
+ */
+class AssembledRigidModel : public ModelState
 {
 	friend class ModelDefinition;  // So that class can create instances of
 								   // this class.
@@ -49,20 +36,27 @@ class AssembledRigidModel
 	 */
 	AssembledRigidModel(const TSymbolicAssembledModel& armi);
 
-	/** To be called from constraints' buildSparseStructures() methods.
-	 * \return the index of the newly created row in Phi and its Jacobians.
-	 */
-	size_t addNewRowToConstraints();
+	/** Constructor, from an existing (possibly shared) topology. */
+	AssembledRigidModel(const ModelTopology::Ptr& topology);
+
+	/** The immutable structure of this model, shared with any other
+	 * model created from it */
+	const ModelTopology::Ptr& topology() const { return topology_; }
 
 	inline const std::vector<Point2ToDOF>& getPoints2DOFs() const
 	{
-		return points2DOFs_;
+		return topology_->points2DOFs_;
 	}
 
 	/** Only to be called between objects created from the same symbolic model,
 	 * this method replicates the state of "o" into "this". */
 	void copyStateFrom(const AssembledRigidModel& o);
 
+	/** The kinematic solver used by refinePosition(), finiteDisplacement()
+	 * and computeDependentPosVelAcc(), to tune it or read its statistics */
+	KinematicProjector& kinematicProjector() { return projector_; }
+	const KinematicProjector& kinematicProjector() const { return projector_; }
+
 	/** Copies the opengl object from another instance */
 	void copyOpenGLRepresentationFrom(const AssembledRigidModel& o);
 
@@ -156,107 +150,36 @@ class AssembledRigidModel
 
 	Eigen::Vector3d gravity_;  //!< The gravity vector (default: [0 -9.81 0])
 
-   public:
-	/** A reference to the parent MBS. Used to access the data of bodies, etc.
-	 */
-	const ModelDefinition& mechanism_;
+	ModelTopology::Ptr topology_;
 
-	/** Info on each Euclidean coordinate DOF in the problem
-	 * Note: m_DOFs.size() + m_rDOFs.size() == m_q.size() */
-	std::vector<NaturalCoordinateDOF> DOFs_;
+	/** Persistent kinematic solver, shared by refinePosition(),
+	 * finiteDisplacement() and computeDependentPosVelAcc() across calls */
+	KinematicProjector projector_;
 
-	/** Reverse look-up list of Euclidean points <-> DOFs in the q vector */
-	std::vector<Point2ToDOF> points2DOFs_;
+	/** Constant part of the generalized forces (bodies weights), rebuilt by
+	 * builGeneralizedForces() only after setGravityVector(),
+	 * invalidate_constant_forces() or a non-const access to the bodies of
+	 * this model (see ModelDefinition::bodies_revision()) */
+	mutable Eigen::VectorXd Q_const_;
+	mutable bool Q_const_valid_ = false;
 
-	/** Info on each Relative coordinate DOF in the problem
-	 * Note: m_DOFs.size() + m_rDOFs.size() == m_q.size() */
-	std::vector<RelativeDOF> rDOFs_;
+	/** ModelDefinition::bodies_revision() when Q_const_ was built */
+	mutable size_t Q_const_bodies_revision_ = 0;
 
-	/** Maps: indices in rDOFs_ ==> indices in "q_" */
-	std::vector<dof_index_t> relCoordinate2Index_;
+	void internal_update_constant_forces() const;
+	/** Rebuilds Q_const_ if it is out of date */
+	void check_constant_forces() const;
 
-	/** The list of all constraints (of different kinds/classes).
-	 * \note This list DOES include constant-distance constraints (not like
-	 * in the original list in the parent ModelDefinition)
-	 */
-	std::vector<ConstraintBase::Ptr> constraints_;
-
-	/** @name State vector itself
-		@{ */
-	Eigen::VectorXd q_;	 //!< State vector q with all the unknowns
-	Eigen::VectorXd dotq_;	//!< Velocity vector \f$ \dot{q} \f$
-	/** The previously computed acceleration vector \f$ \ddot{q} \f$  */
-	Eigen::VectorXd ddotq_;
-
-	/** External generalized forces (gravity NOT to be included) */
-	Eigen::VectorXd Q_;
-	/**  @} */
-
-	/** @name Other vectors and matrices, computed as a function of the state
-	 * vector.
-	 * \note You must call update_numeric_Phi_and_Jacobians() to update
-	 * all these fields after updating q,dotq, ddotq.
-	 *
+   public:
+	/** @name References to the (immutable) topology data, kept here for
+	 * convenience.
 	 *  @{ */
-
-	/** The vector of numerical values of Phi, the vector of constraint
-	 * functions Phi=0.
-	 *
-	 * Dimensions: m x 1
-	 */
-	Eigen::VectorXd Phi_;
-
-	/** Numerical values of \dot{\Phi}
-	 *
-	 * Dimensions: m x 1
-	 */
-	Eigen::VectorXd dotPhi_;
-
-	void defineSparseMatricesColumnCount(const size_t nDOFs)
-	{
-		Phi_q_.ncols = nDOFs;
-		dotPhi_q_.ncols = nDOFs;
-		Phiqq_times_ddq_.ncols = nDOFs;
-		dotPhiqq_times_dq_.ncols = nDOFs;
-	}
-
-	void resizeConstraintCount(const size_t m)
-	{
-		// Add rows:
-		Phi_.resize(m);
-		dotPhi_.resize(m);
-
-		// Jacobians and related matrices:
-		Phi_q_.setRowCount(m);
-		dotPhi_q_.setRowCount(m);
-		Phiqq_times_ddq_.setRowCount(m);
-		dotPhiqq_times_dq_.setRowCount(m);
-	}
-
-	/** Jacobian dPhi_dq (as a sparse matrix)
-	 *
-	 * Dimensions: m x n
-	 */
-	CompressedRowSparseMatrix Phi_q_;
-
-	/** Jacobian d((d Phi / dq))/dt (as a sparse matrix)
-	 *
-	 * Dimensions: m x n
-	 */
-	CompressedRowSparseMatrix dotPhi_q_;
-
-	/** Tensor-vector product: \Phiqq \ddq
-	 *
-	 * Dimensions: m x n
-	 */
-	CompressedRowSparseMatrix Phiqq_times_ddq_;
-
-	/** Tensor-vector product: \dotPhiqq \dq
-	 *
-	 * Dimensions: m x n
-	 */
-	CompressedRowSparseMatrix dotPhiqq_times_dq_;
-
+	const ModelDefinition& mechanism_;
+	const std::vector<NaturalCoordinateDOF>& DOFs_;
+	const std::vector<Point2ToDOF>& points2DOFs_;
+	const std::vector<RelativeDOF>& rDOFs_;
+	const std::vector<dof_index_t>& relCoordinate2Index_;
+	const std::vector<ConstraintBase::Ptr>& constraints_;
 	/** @} */
 
 	/** Returns a 3D visualization of the model, which can be later on passed to
@@ -285,6 +208,11 @@ class AssembledRigidModel
 	 * (default: [0 -9.81 0]) */
 	void setGravityVector(const double gx, const double gy, const double gz);
 
+	/** Forces rebuilding the cached bodies weights in the next
+	 * builGeneralizedForces(), e.g. after modifying a body through a
+	 * reference kept from an earlier ModelDefinition::bodies() call */
+	void invalidate_constant_forces() { Q_const_valid_ = false; }
+
 	/** @name Solvers auxiliary methods
 	 *  @{ */
 
@@ -296,17 +224,23 @@ class AssembledRigidModel
 	 * user must free the object when not needed anymore. */
 	cholmod_triplet* buildMassMatrix_sparse_CHOLMOD(cholmod_common& c) const;
 
-	/** Assemble the MBS generalized forces "Q" vector */
+	/** Assemble the MBS generalized forces "Q" vector: the cached gravity
+	 * loads plus the external forces in Q_ */
 	void builGeneralizedForces(Eigen::VectorXd& Q) const;
 
 	void builGeneralizedForces(double* Q) const;
 
+	/** Like builGeneralizedForces(), only for the coordinates in `dofs`:
+	 * Q[i] is the force along coordinate dofs[i] */
+	void builGeneralizedForces(
+		const std::vector<dof_index_t>& dofs, double* Q) const;
+
 	/** Call all constraint objects and command them to update their
 	 * corresponding parts in the sparse Jacobians */
 	void update_numeric_Phi_and_Jacobians();
 
 	/** See constrainst realize_operating_point(). */
-	void realize_operating_point() const;
+	void realize_operating_point();
 
 	/** @} */
 
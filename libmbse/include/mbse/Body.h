@@ -33,6 +33,10 @@ struct Body
 	 */
 	std::vector<point_index_t> points = {std::string::npos, std::string::npos};
 
+	/** Multi-rate simulations (ODE_MultiRate) integrate the coordinates of
+	 * the points of "fast" bodies with shorter substeps */
+	bool fast = false;
+
 	/** In (kg) */
 	inline double mass() const { return mass_; }
 	inline double& mass()
@@ -0,0 +1,82 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#pragma once
+
+#include <mbse/mbse-common.h>
+
+namespace mbse
+{
+/** Linear solver for the columns of the Jacobian Phi_q associated to the
+ * dependent coordinates (Phi_d), given a set of independent coordinates z.
+ * This is the linear system solved in each Newton iteration of the finite
+ * displacement problem, and in the velocity and acceleration projections.
+ *
+ * The sparsity pattern of Phi_d and its KLU symbolic analysis are kept until
+ * the independent coordinates change, and successive numeric factorizations
+ * reuse the previous pivoting order. If Phi_d is not square (redundant
+ * constraints), a dense full-pivoting LU is used instead.
+ *
+ * Copies of this object are empty: a factorization is a cache of one model
+ * state.
+ */
+class DependentCoordinatesSolver
+{
+   public:
+	DependentCoordinatesSolver();
+	~DependentCoordinatesSolver();
+
+	DependentCoordinatesSolver(const DependentCoordinatesSolver&);
+	DependentCoordinatesSolver& operator=(const DependentCoordinatesSolver&);
+
+	/** Sets the independent coordinates (the rest are the dependent ones).
+	 * Does nothing if they did not change since the last call. */
+	void setIndependentCoordinates(
+		const CompressedRowSparseMatrix& Phi_q,
+		const std::vector<size_t>& z_indices);
+
+	/** The indices in "q" of the dependent coordinates, in the order of the
+	 * entries of the solutions of solve() */
+	const std::vector<size_t>& dependentIndices() const { return idxs_d_; }
+
+	/** Numeric factorization of Phi_d, with the current values in Phi_q */
+	void factorize(const CompressedRowSparseMatrix& Phi_q);
+
+	bool isFactorized() const { return factorized_; }
+
+	/** Solves Phi_d * x = b, with the last factorize()'d Phi_d */
+	void solve(const Eigen::VectorXd& b, Eigen::VectorXd& x);
+
+	/** Computes out = Phi_i * v[z_indices], with Phi_i the columns of Phi_q of
+	 * the independent coordinates, and `v` a vector with all coordinates. */
+	void multiplyIndependent(
+		const CompressedRowSparseMatrix& Phi_q, const Eigen::VectorXd& v,
+		Eigen::VectorXd& out) const;
+
+   private:
+	std::vector<size_t> z_indices_, idxs_d_;
+	/** For each non-zero of Phi_q (CRS order), its index in the CCS values of
+	 * Phi_d_, or -1 for the columns of independent coordinates */
+	std::vector<int> crs2ccs_;
+	bool sparse_ = false;  //!< false: dense LU for non-square Phi_d
+	bool factorized_ = false;
+
+	Eigen::SparseMatrix<double> Phi_d_;
+	klu_common common_;
+	klu_symbolic* symbolic_ = nullptr;
+	klu_numeric* numeric_ = nullptr;
+
+	Eigen::MatrixXd Phi_d_dense_;
+	Eigen::FullPivLU<Eigen::MatrixXd> lu_;
+
+	void clear();
+};
+
+}  // namespace mbse
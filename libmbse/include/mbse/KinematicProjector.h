@@ -0,0 +1,135 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#pragma once
+
+#include <mbse/DependentCoordinatesSolver.h>
+#include <mbse/ModelState.h>
+
+namespace mbse
+{
+class ModelTopology;
+
+/** Stateful solver for the kinematic problems of a model state: positions
+ * (finite displacement), velocities and accelerations of the dependent
+ * coordinates, given the independent ones "z".
+ *
+ * It is meant to live across the time steps of an integrator. The index
+ * partition and the last factorization of Phi_d are reused by all later
+ * calls (chord method): Phi_d is only factorized again when a Newton
+ * iteration does not reduce |Phi| by at least Parameters::maxContraction.
+ * Velocities and accelerations are solved by iterative refinement over that
+ * (possibly outdated) factorization, with residuals evaluated with the
+ * current Jacobians, so they are as accurate as with a fresh one.
+ *
+ * Copies keep the parameters, but not the cached factorizations.
+ */
+class KinematicProjector
+{
+   public:
+	struct Parameters
+	{
+		Parameters() = default;
+
+		/** Refactorize when one Newton iteration does not reduce |Phi| at
+		 * least by this factor */
+		double maxContraction = 0.1;
+
+		/** Iterative refinement steps for velocities and accelerations
+		 * before falling back to a fresh factorization */
+		size_t maxRefinementIters = 3;
+
+		/** Tolerance for the velocity and acceleration constraint residuals,
+		 * relative to the norm of the residual before solving (or 1, if
+		 * smaller) */
+		double linearTolerance = 1e-12;
+	};
+
+	/** Counters since construction or the last resetStats() */
+	struct Stats
+	{
+		size_t numFactorizations = 0;
+		size_t numPositionIters = 0;
+		size_t numRefinementIters = 0;
+	};
+
+	KinematicProjector() = default;
+	KinematicProjector(const KinematicProjector& o) : params(o.params) {}
+	KinematicProjector& operator=(const KinematicProjector& o);
+
+	Parameters params;
+
+	/** Sets the independent coordinates (the rest are the dependent ones).
+	 * Cached data is kept if they did not change since the last call. */
+	void setIndependentCoordinates(
+		const ModelTopology& topology, const std::vector<size_t>& z_indices);
+
+	/** The indices in "q" of the dependent coordinates */
+	const std::vector<size_t>& dependentIndices() const
+	{
+		return solver_.dependentIndices();
+	}
+
+	/** Discards the cached factorizations, e.g. after a jump in the state */
+	void invalidate()
+	{
+		valid_ = false;
+		validAll_ = false;
+	}
+
+	/** Newton iterations on the dependent coordinates, keeping the
+	 * independent ones fixed, until |Phi| <= maxPhiNorm. On return, Phi and
+	 * all the Jacobians in `state` are evaluated at the final "q".
+	 * \return The final |Phi| */
+	double solvePositions(
+		const ModelTopology& topology, ModelState& state, double maxPhiNorm,
+		size_t nItersMax);
+
+	/** Like solvePositions(), but over all coordinates (a least-squares
+	 * Newton step on the whole Phi_q), as in the initial position problem.
+	 * Does not need setIndependentCoordinates(). The Jacobian is always
+	 * factorized at the first iteration, and then again whenever |Phi| does
+	 * not drop by params.maxContraction. */
+	double refinePositions(
+		const ModelTopology& topology, ModelState& state, double maxPhiNorm,
+		size_t nItersMax);
+
+	/** Dependent velocities from the independent ones in `state.dotq_`, such
+	 * that Phi_q * dotq = 0. Jacobians in `state` must be up to date. */
+	void solveVelocities(ModelState& state);
+
+	/** Dependent accelerations, such that Phi_q*ddotq + dotPhi_q*dotq = 0.
+	 * On input, `ddotq` holds the independent accelerations (entries of
+	 * the dependent ones are used as initial guess). Jacobians in `state`
+	 * must be up to date. */
+	void solveAccelerations(const ModelState& state, Eigen::VectorXd& ddotq);
+
+	const Stats& stats() const { return stats_; }
+	void resetStats() { stats_ = Stats(); }
+
+   private:
+	DependentCoordinatesSolver solver_;
+	bool valid_ = false;  //!< Whether solver_ holds a usable factorization
+
+	/** For refinePositions() */
+	Eigen::FullPivLU<Eigen::MatrixXd> luAll_;
+	bool validAll_ = false;
+
+	Eigen::VectorXd incr_, rhs_, residual_;	 //!< Workspace
+	Stats stats_;
+
+	void factorize(const ModelState& state);
+
+	/** Iterative refinement of x[dependent] so that Phi_q * x + c = 0 */
+	void solveLinear(
+		const ModelState& state, const Eigen::VectorXd& c, Eigen::VectorXd& x);
+};
+
+}  // namespace mbse
@@ -117,7 +117,19 @@ class ModelDefinition
 	const std::vector<Body>& bodies() const { return bodies_; }
 
 	std::vector<ConstraintBase::Ptr>& constraints() { return constraints_; }
-	std::vector<Body>& bodies() { return bodies_; }
+
+	/** Non-const access to the bodies: each call increments
+	 * bodies_revision(), so modify them through a fresh call to this method
+	 * (or call AssembledRigidModel::invalidate_constant_forces() afterwards)
+	 * for assembled models to see the changes in their cached weights */
+	std::vector<Body>& bodies()
+	{
+		++bodies_revision_;
+		return bodies_;
+	}
+
+	/** A counter incremented on each non-const access to the bodies */
+	size_t bodies_revision() const { return bodies_revision_; }
 
    protected:
 	/** @name Data
@@ -131,6 +143,8 @@ class ModelDefinition
 	 */
 	std::vector<ConstraintBase::Ptr> constraints_;
 
+	size_t bodies_revision_ = 0;  //!< See bodies_revision()
+
 	/** @} */  // end data --------------
 
 	mutable bool already_added_fixed_len_constraints_ = false;
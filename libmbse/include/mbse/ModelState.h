@@ -0,0 +1,100 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#pragma once
+
+#include <mbse/mbse-common.h>
+#include <cstdint>
+#include <vector>
+
+namespace mbse
+{
+class ModelTopology;
+
+/** The numeric state of a multibody model: coordinates, velocities,
+ * accelerations, external forces, and the numeric values of the constraint
+ * vector and its Jacobians, all evaluated at that state.
+ *
+ * A ModelState holds no topology: it is always interpreted against the
+ * ModelTopology it was created from, which may be shared by any number of
+ * states (e.g. particles, threads, or linearization points).
+ *
+ * \sa ModelTopology, AssembledRigidModel
+ */
+struct ModelState
+{
+	/** Creates a state with the sizes and sparsity patterns of the given
+	 * topology, and the initial coordinates of the model */
+	explicit ModelState(const ModelTopology& topology);
+
+	/** @name State vector itself
+		@{ */
+	Eigen::VectorXd q_;	 //!< State vector q with all the unknowns
+	Eigen::VectorXd dotq_;	//!< Velocity vector \f$ \dot{q} \f$
+	/** The previously computed acceleration vector \f$ \ddot{q} \f$  */
+	Eigen::VectorXd ddotq_;
+
+	/** External generalized forces (gravity NOT to be included) */
+	Eigen::VectorXd Q_;
+	/**  @} */
+
+	/** @name Other vectors and matrices, computed as a function of the state
+	 * vector.
+	 * \note You must call update_numeric_Phi_and_Jacobians() to update
+	 * all these fields after updating q,dotq, ddotq.
+	 *
+	 *  @{ */
+
+	/** The vector of numerical values of Phi, the vector of constraint
+	 * functions Phi=0.
+	 *
+	 * Dimensions: m x 1
+	 */
+	Eigen::VectorXd Phi_;
+
+	/** Numerical values of \dot{\Phi}
+	 *
+	 * Dimensions: m x 1
+	 */
+	Eigen::VectorXd dotPhi_;
+
+	/** Jacobian dPhi_dq (as a sparse matrix)
+	 *
+	 * Dimensions: m x n
+	 */
+	CompressedRowSparseMatrix Phi_q_;
+
+	/** Jacobian d((d Phi / dq))/dt (as a sparse matrix)
+	 *
+	 * Dimensions: m x n
+	 */
+	CompressedRowSparseMatrix dotPhi_q_;
+
+	/** Tensor-vector product: \Phiqq \ddq
+	 *
+	 * Dimensions: m x n
+	 */
+	CompressedRowSparseMatrix Phiqq_times_ddq_;
+
+	/** Tensor-vector product: \dotPhiqq \dq
+	 *
+	 * Dimensions: m x n
+	 */
+	CompressedRowSparseMatrix dotPhiqq_times_dq_;
+
+	/** @} */
+
+	/** Flags set by ConstraintBase::realizeOperatingPoint() to select among
+	 * alternative formulations of some constraints. One entry per flag
+	 * allocated with ModelTopology::addOperatingPointFlag() */
+	std::vector<uint8_t> operatingPointFlags_;
+};
+
+}  // namespace mbse
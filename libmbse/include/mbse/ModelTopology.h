@@ -0,0 +1,136 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#pragma once
+
+#include <mbse/ModelDefinition.h>
+#include <mbse/ModelState.h>
+
+namespace mbse
+{
+/** This struct holds the "list of instructions" for creating an actual
+ * AssembledRigidModel that models a ModelDefinition */
+struct TSymbolicAssembledModel
+{
+	const ModelDefinition& model;  //!< My "parent" model
+
+	/** Info on Natural Coordinate DOFs in the problem (same lenth than q_) */
+	std::vector<NaturalCoordinateDOF> DOFs;
+
+	/** Additional relative coordinates */
+	std::vector<RelativeDOF> rDOFs;
+
+	TSymbolicAssembledModel(const ModelDefinition& model_) : model(model_) {}
+
+	void clear()
+	{
+		DOFs.clear();
+		rDOFs.clear();
+	}
+};
+
+/** The immutable structure of an assembled multibody model: coordinates,
+ * constraints, and the sparsity pattern of the constraint Jacobians.
+ *
+ * Once constructed, a topology is never modified, so it can be safely shared
+ * (via ModelTopology::Ptr) between many ModelState objects, evaluated from
+ * different threads at once.
+ *
+ * \sa ModelState, AssembledRigidModel
+ */
+class ModelTopology
+{
+   public:
+	using Ptr = std::shared_ptr<const ModelTopology>;
+
+	/** Constructor, from a symbolic assembled model.
+	 * The object "armi" can be destroyed safely after this call. The parent
+	 * model in armi.model cannot.
+	 */
+	ModelTopology(const TSymbolicAssembledModel& armi);
+
+	/** Evaluates Phi, dotPhi and all the constraint Jacobians at the given
+	 * state, which must have been created from this topology. */
+	void update_numeric_Phi_and_Jacobians(ModelState& state) const;
+
+	/** Lets each constraint select its operating point for the given state.
+	 * \sa ConstraintBase::realizeOperatingPoint() */
+	void realize_operating_point(ModelState& state) const;
+
+	/** Number of generalized coordinates (length of "q") */
+	size_t numCoords() const { return initial_q_.size(); }
+
+	/** Number of scalar constraint equations (length of "Phi") */
+	size_t numConstraints() const { return Phi_q_.getNumRows(); }
+
+	inline const std::vector<Point2ToDOF>& getPoints2DOFs() const
+	{
+		return points2DOFs_;
+	}
+
+	/** @name Only for use while building the topology, from constraints'
+	 * buildSparseStructures() methods.
+	 *  @{ */
+
+	/** \return the index of the newly created row in Phi and its Jacobians.
+	 */
+	size_t addNewRowToConstraints();
+
+	/** \return the index of a new entry in
+	 * ModelState::operatingPointFlags_ */
+	size_t addOperatingPointFlag() { return numOperatingPointFlags_++; }
+
+	/** @} */
+
+	/** A reference to the parent MBS. Used to access the data of bodies, etc.
+	 */
+	const ModelDefinition& mechanism_;
+
+	/** Info on each Euclidean coordinate DOF in the problem
+	 * Note: m_DOFs.size() + m_rDOFs.size() == m_q.size() */
+	std::vector<NaturalCoordinateDOF> DOFs_;
+
+	/** Reverse look-up list of Euclidean points <-> DOFs in the q vector */
+	std::vector<Point2ToDOF> points2DOFs_;
+
+	/** Info on each Relative coordinate DOF in the problem
+	 * Note: m_DOFs.size() + m_rDOFs.size() == m_q.size() */
+	std::vector<RelativeDOF> rDOFs_;
+
+	/** Maps: indices in rDOFs_ ==> indices in "q_" */
+	std::vector<dof_index_t> relCoordinate2Index_;
+
+	/** The list of all constraints (of different kinds/classes).
+	 * \note This list DOES include constant-distance constraints (not like
+	 * in the original list in the parent ModelDefinition)
+	 */
+	std::vector<ConstraintBase::Ptr> constraints_;
+
+	/** For each entry in constraints_: its first row in Phi (and in all the
+	 * Jacobians) and its number of rows */
+	std::vector<std::pair<size_t, size_t>> constraintRows_;
+
+	/** Initial value of "q", from the coordinates in the model definition */
+	Eigen::VectorXd initial_q_;
+
+	/** @name Sparsity patterns of the Jacobians. Values are always zero;
+	 * numeric values live in each ModelState.
+	 *  @{ */
+	CompressedRowSparseMatrix Phi_q_, dotPhi_q_, Phiqq_times_ddq_,
+		dotPhiqq_times_dq_;
+	/** @} */
+
+	size_t numOperatingPointFlags() const { return numOperatingPointFlags_; }
+
+   private:
+	size_t numOperatingPointFlags_ = 0;
+};
+
+}  // namespace mbse
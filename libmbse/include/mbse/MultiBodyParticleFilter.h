@@ -18,48 +18,42 @@
 #include <mbse/dynamics/dynamic-simulators.h>
 #include <mbse/virtual-sensors.h>
 #include <mrpt/bayes/CParticleFilter.h>
-#include <mrpt/bayes/CParticleFilterCapable.h>
-#include <mrpt/bayes/CParticleFilterData.h>
 #include <mrpt/random.h>
 
 namespace mbse
 {
-/** A "particle" holding a MultiBody assembly + its state */
-template <class DYN_SIMUL>
-struct TMBState_Particle
+/** Struct-of-arrays storage of a set of particles, all of them states of
+ * the same (shared) ModelTopology. Particle `i` is column `i` of `q` and
+ * `dotq`, so each particle state is contiguous in memory, and its weight is
+ * `log_w[i]`.
+ */
+struct ParticleBatch
 {
-	TMBState_Particle(const TSymbolicAssembledModel& sym_model)
-		: sym_assembly_model(sym_model),
-		  num_model_ptr(new AssembledRigidModel(sym_assembly_model)),
-		  num_model(*num_model_ptr.get()),
-		  dyn_simul(new DYN_SIMUL(num_model_ptr))
-	{
-		dyn_simul->prepare();
-	}
-
-	TSymbolicAssembledModel
-		sym_assembly_model;	 //!< Symbolic assembly instructions
-	std::shared_ptr<AssembledRigidModel> num_model_ptr;
-	AssembledRigidModel& num_model;
-	CDynamicSimulatorIndepBase::Ptr dyn_simul;
-
-	/** copy ctor */
-	TMBState_Particle(const TMBState_Particle& o)
-		: sym_assembly_model(o.sym_assembly_model),
-		  num_model_ptr(new AssembledRigidModel(sym_assembly_model)),
-		  num_model(*num_model_ptr.get()),
-		  dyn_simul(new DYN_SIMUL(num_model_ptr))
-	{
-		num_model.copyStateFrom(o.num_model);
-		dyn_simul->prepare();
-	}
+	ParticleBatch() = default;
+	ParticleBatch(const ModelTopology::Ptr& topology, size_t nParticles);
 
-	/** copy operator: doesn't copy the entire objects, just the state! */
-	TMBState_Particle& operator=(const TMBState_Particle& o)
-	{
-		num_model.copyStateFrom(o.num_model);
-		return *this;
-	}
+	ModelTopology::Ptr topology;
+
+	Eigen::MatrixXd q;	//!< Coordinates, one column per particle (n x N)
+	Eigen::MatrixXd dotq;  //!< Velocities, one column per particle (n x N)
+	std::vector<double> log_w;	//!< Log-weight of each particle
+
+	size_t size() const { return log_w.size(); }
+
+	/** Changes the number of particles, keeping the first ones. New
+	 * particles get the initial coordinates of the model at rest. */
+	void resize(size_t nParticles);
+
+	/** Copies the state of particle `i` into `model` (created from the same
+	 * topology) */
+	void load(size_t i, AssembledRigidModel& model) const;
+
+	/** Copies the state of `model` into particle `i` */
+	void store(size_t i, const AssembledRigidModel& model);
+
+	/** Replaces the set of particles by copies of particles `idxs` (which
+	 * may be repeated), with all log-weights set to zero. */
+	void gather(const std::vector<size_t>& idxs);
 };
 
 // select the kind of solver:
@@ -67,41 +61,77 @@ typedef CDynamicSimulator_Indep_dense MBPF_SIMULATOR_TYPE;
 
 /** A particle-based representation of a probability density function (PDF) over
  * the state of a mechanical system.
+ *
+ * Particles only hold their state vectors (see ParticleBatch). They are
+ * propagated by a small pool of models and prepared solvers, one per thread,
+ * into which each particle state is loaded in turn.
  */
 class MultiBodyParticleFilter
-	: public mrpt::bayes::CParticleFilterData<
-		  TMBState_Particle<MBPF_SIMULATOR_TYPE>>,
-	  public mrpt::bayes::CParticleFilterDataImpl<
-		  MultiBodyParticleFilter,
-		  mrpt::bayes::CParticleFilterData<
-			  TMBState_Particle<MBPF_SIMULATOR_TYPE>>::CParticleList>
 {
    public:
-	typedef TMBState_Particle<MBPF_SIMULATOR_TYPE> particle_t;
-
 	/** Initializes a set of M particles for the given multibody system */
 	MultiBodyParticleFilter(const size_t M, const ModelDefinition& mbs);
 
 	/** Dtor */
 	~MultiBodyParticleFilter();
 
+	/** The particles */
+	ParticleBatch particles;
+
+	size_t particlesCount() const { return particles.size(); }
+
 	struct TOutputInfo
 	{
 		bool resampling_done;  //!< =true if resampling was required
 		double ESS;
+		size_t num_particles;  //!< Number of particles after this step
 
-		TOutputInfo() : resampling_done(false), ESS(1) {}
+		TOutputInfo() : resampling_done(false), ESS(1), num_particles(0) {}
 	};
 
 	/** Runs one step of the PF (SIR) algorithm.
 	 * Simulation runs for "t_increment", but several steps are runned if that
 	 * value is greater than "max_t_step".
+	 *
+	 * Particles are propagated and weighted in parallel if built with OpenMP.
+	 * Each particle draws its process noise from its own random stream, so
+	 * results only depend on the seed, not on the number of threads.
+	 *
+	 * If PF_options.adaptiveSampleSize is set, the number of particles after
+	 * each resampling is chosen by KLD-sampling (see
+	 * KLD_numberOfParticles()).
 	 */
 	void run_PF_step(
 		const double t_ini, const double t_end, const double max_t_step,
 		const std::vector<CVirtualSensor::Ptr>& sensor_descriptions,
 		const std::vector<double>& sensor_readings, TOutputInfo& out_info);
 
+	/** Computes which particles survive a resampling, as `nNewParticles`
+	 * indices into `log_w`, with any of the algorithms in
+	 * PF_options.resamplingMethod. All of them run in O(N+nNewParticles),
+	 * and only indices are computed: use ParticleBatch::gather() to apply
+	 * them. */
+	static void computeResamplingIndices(
+		mrpt::bayes::CParticleFilter::TParticleResamplingAlgorithm method,
+		const std::vector<double>& log_w, size_t nNewParticles,
+		mrpt::random::CRandomGenerator& rng, std::vector<size_t>& out_idxs);
+
+	/** KLD-sampling: number of particles needed to represent a posterior
+	 * that occupies `nBins` bins, with the KLD_* parameters in PF_options.
+	 */
+	size_t KLD_numberOfParticles(size_t nBins) const;
+
+	/** Number of different bins (of size PF_options.KLD_binSize) occupied
+	 * by particles `idxs`, in the space of the independent coordinates of
+	 * the mechanism */
+	size_t countOccupiedBins(const std::vector<size_t>& idxs) const;
+
+	/** Normalizes the log-weights so the maximum is zero */
+	void normalizeWeights();
+
+	/** Effective sample size, normalized to [0,1] */
+	double ESS() const;
+
 	void getAs3DRepresentation(
 		mrpt::opengl::CSetOfObjects::Ptr& outObj,
 		const Body::TRenderParams& rp) const;
@@ -119,7 +149,30 @@ class MultiBodyParticleFilter
 	mrpt::bayes::CParticleFilter::TParticleFilterOptions
 		PF_options;	 //!< Parameters for the PF algorithm.
 
-	mrpt::random::CRandomGenerator random_generator;
+	/** Re-seeds the process noise streams of all particles, and the MRPT
+	 * global generator (used for resampling), for reproducible runs. */
+	void seedRandomGenerators(const uint32_t seed);
+
+   private:
+	uint64_t rng_seed_ = 0;	 //!< Seed of all particle noise streams
+	uint64_t rng_step_ = 0;	 //!< Number of PF steps run since seeding
+
+	/** A model and its prepared solver, to propagate particles */
+	struct Worker
+	{
+		std::shared_ptr<AssembledRigidModel> model;
+		CDynamicSimulatorIndepBase::Ptr dyn_simul;
+	};
+	/** Indices in "q" of the independent coordinates, for KLD-sampling */
+	std::vector<size_t> kld_coords_;
+
+	/** One worker per thread, created on demand */
+	std::vector<Worker> workers_;
+
+	Worker& worker(size_t threadIdx);
+
+	/** Only for rendering: one model per particle, created on demand */
+	mutable std::vector<std::shared_ptr<AssembledRigidModel>> render_models_;
 
 };	// end class MultiBodyParticleFilter
 
@@ -15,7 +15,8 @@
 
 namespace mbse
 {
-class AssembledRigidModel;
+class ModelTopology;
+struct ModelState;
 
 /** The virtual base class of all constraint types. */
 class ConstraintBase
@@ -25,17 +26,19 @@ class ConstraintBase
 	using Ptr = std::shared_ptr<ConstraintBase>;
 
 	/** Alloc space for the needed rows, columns, etc. in the constraint vector
-	 * and its Jacobians Each class should save a reference/pointer to the newly
+	 * and its Jacobians Each class should save the indices of the newly
 	 * created elements, so they can be quickly updated in the \a update()
-	 * method when invoked in the future. This method is called after the MBS is
-	 * completely defined by the user, and before starting any kinematic/dynamic
-	 * simulation.
+	 * method when invoked in the future. This method is called once per
+	 * ModelTopology, after the MBS is completely defined by the user, and
+	 * before starting any kinematic/dynamic simulation.
 	 */
-	virtual void buildSparseStructures(AssembledRigidModel& arm) const = 0;
+	virtual void buildSparseStructures(ModelTopology& topology) const = 0;
 
 	/** Update the previously allocated values given the current state of the
-	 * MBS. This is called a very large number of times during simulations. */
-	virtual void update(AssembledRigidModel& arm) const = 0;
+	 * MBS. This is called a very large number of times during simulations.
+	 * It must not modify the constraint object, so it can be invoked
+	 * concurrently for different states sharing one topology. */
+	virtual void update(ModelState& state) const = 0;
 
 	/** Prints info on the constraint for debugging and inspection purposes */
 	virtual void print(std::ostream& o) const = 0;
@@ -49,7 +52,9 @@ class ConstraintBase
 	/** Checks current working point and select between one of several possible
 	 * linearization or working points. Avoids errors in numerical derivation.
 	 */
-	virtual void realizeOperatingPoint(const AssembledRigidModel& arm) const {}
+	virtual void realizeOperatingPoint([[maybe_unused]] ModelState& state) const
+	{
+	}
 
 	/** Creates a 3D representation of the constraint, if applicable (e.g.the
 	 * line of a fixed slider).
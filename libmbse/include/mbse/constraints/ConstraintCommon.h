@@ -10,7 +10,8 @@
 
 #pragma once
 
-#include <mbse/AssembledRigidModel.h>
+#include <mbse/ModelTopology.h>
+#include <mbse/ModelState.h>
 #include <mrpt/core/exceptions.h>
 #include <cstdlib>
 #include <array>
@@ -24,22 +25,22 @@ template <
 class ConstraintCommon
 {
    public:
-	void commonbuildSparseStructures(AssembledRigidModel& arm) const;
+	void commonbuildSparseStructures(ModelTopology& topology) const;
 
 	/** Get references to the point coordinates (either fixed or variables in
 	 * q) */
 	const double& actual_coord(
-		const AssembledRigidModel& arm, size_t idx, const PointDOF dof) const
+		const ModelState& state, size_t idx, const PointDOF dof) const
 	{
 		switch (dof)
 		{
 			case PointDOF::X:
 				return (pointDOFs_[idx].dof_x != INVALID_DOF)
-						   ? arm.q_[pointDOFs_[idx].dof_x]
+						   ? state.q_[pointDOFs_[idx].dof_x]
 						   : points_[idx]->coords.x;
 			case PointDOF::Y:
 				return (pointDOFs_[idx].dof_y != INVALID_DOF)
-						   ? arm.q_[pointDOFs_[idx].dof_y]
+						   ? state.q_[pointDOFs_[idx].dof_y]
 						   : points_[idx]->coords.y;
 			default:
 				throw std::invalid_argument("actual_coord(): Invalid dof");
@@ -49,17 +50,17 @@ class ConstraintCommon
 	/** Get references to the point velocities (either fixed zero or variables
 	 * in q) */
 	const double& actual_vel(
-		const AssembledRigidModel& arm, size_t idx, const PointDOF dof) const
+		const ModelState& state, size_t idx, const PointDOF dof) const
 	{
 		switch (dof)
 		{
 			case PointDOF::X:
 				return (pointDOFs_[idx].dof_x != INVALID_DOF)
-						   ? arm.dotq_[pointDOFs_[idx].dof_x]
+						   ? state.dotq_[pointDOFs_[idx].dof_x]
 						   : dummy_zero_;
 			case PointDOF::Y:
 				return (pointDOFs_[idx].dof_y != INVALID_DOF)
-						   ? arm.dotq_[pointDOFs_[idx].dof_y]
+						   ? state.dotq_[pointDOFs_[idx].dof_y]
 						   : dummy_zero_;
 			default:
 				throw std::invalid_argument("actual_vel(): Invalid dof");
@@ -69,17 +70,17 @@ class ConstraintCommon
 	/** Get references to the point accelerations (either fixed zero or
 	 * variables in q) */
 	const double& actual_acc(
-		const AssembledRigidModel& arm, size_t idx, const PointDOF dof) const
+		const ModelState& state, size_t idx, const PointDOF dof) const
 	{
 		switch (dof)
 		{
 			case PointDOF::X:
 				return (pointDOFs_[idx].dof_x != INVALID_DOF)
-						   ? arm.ddotq_[pointDOFs_[idx].dof_x]
+						   ? state.ddotq_[pointDOFs_[idx].dof_x]
 						   : dummy_zero_;
 			case PointDOF::Y:
 				return (pointDOFs_[idx].dof_y != INVALID_DOF)
-						   ? arm.ddotq_[pointDOFs_[idx].dof_y]
+						   ? state.ddotq_[pointDOFs_[idx].dof_y]
 						   : dummy_zero_;
 			default:
 				throw std::invalid_argument("actual_acc(): Invalid dof");
@@ -109,14 +110,14 @@ class ConstraintCommon
 	/** Returns all constant references to X,Y coordinates and velocities of a
 	 * point, no matter if the point is fixed (constant) or part of m_q
 	 * (generalized coordinates) */
-	PointRef actual_coords(const AssembledRigidModel& arm, size_t idx) const
+	PointRef actual_coords(const ModelState& state, size_t idx) const
 	{
-		return {actual_coord(arm, idx, PointDOF::X),
-				actual_coord(arm, idx, PointDOF::Y),
-				actual_vel(arm, idx, PointDOF::X),
-				actual_vel(arm, idx, PointDOF::Y),
-				actual_acc(arm, idx, PointDOF::X),
-				actual_acc(arm, idx, PointDOF::Y)};
+		return {actual_coord(state, idx, PointDOF::X),
+				actual_coord(state, idx, PointDOF::Y),
+				actual_vel(state, idx, PointDOF::X),
+				actual_vel(state, idx, PointDOF::Y),
+				actual_acc(state, idx, PointDOF::X),
+				actual_acc(state, idx, PointDOF::Y)};
 	}
 
 	struct RelCoordRef
@@ -132,10 +133,10 @@ class ConstraintCommon
 	 * idxRelativeCoord starts counting at 0 for the first relative coordinate.
 	 */
 	RelCoordRef actual_rel_coords(
-		const AssembledRigidModel& arm, size_t idxRelativeCoord) const
+		const ModelState& state, size_t idxRelativeCoord) const
 	{
 		const auto idx = relativeCoordIndexInQ_.at(idxRelativeCoord);
-		return {arm.q_[idx], arm.dotq_[idx], arm.ddotq_[idx]};
+		return {state.q_[idx], state.dotq_[idx], state.ddotq_[idx]};
 	}
 
    protected:
@@ -160,8 +161,9 @@ class ConstraintCommon
 		}
 	}
 
-	using array_dptr_t = std::array<double*, NUM_POINTS>;
-	using array_relative_dptr_t = std::array<double*, NUM_RELATIVE_COORDS>;
+	/** Indices of Jacobian entries in CompressedRowSparseMatrix::values */
+	using array_entry_t = std::array<std::size_t, NUM_POINTS>;
+	using array_relative_entry_t = std::array<std::size_t, NUM_RELATIVE_COORDS>;
 
 	/** Assigned constraint indices, i.e. row indices in the Jacobian dQ_dq
 	 */
@@ -207,39 +209,41 @@ class ConstraintCommon
 
 	struct JacobRowEntries
 	{
-		/** Pointers to entries in the sparse Jacobian dPhi_dq */
-		array_dptr_t dPhi_dx, dPhi_dy;
-		array_relative_dptr_t dPhi_drel;  //!< Jacobians wrt rel coords
+		/** Entries in the sparse Jacobian dPhi_dq */
+		array_entry_t dPhi_dx, dPhi_dy;
+		array_relative_entry_t dPhi_drel;  //!< Jacobians wrt rel coords
 
-		/** Pointers to entries in the sparse Jacobian \dot{dPhi_dq} */
-		array_dptr_t dot_dPhi_dx, dot_dPhi_dy;
-		array_relative_dptr_t dot_dPhi_drel;  //!< Jacobians wrt rel coords
+		/** Entries in the sparse Jacobian \dot{dPhi_dq} */
+		array_entry_t dot_dPhi_dx, dot_dPhi_dy;
+		array_relative_entry_t dot_dPhi_drel;  //!< Jacobians wrt rel coords
 
-		/** Pointers to entries in the sparse Jacobian Phiqq_times_ddq */
-		array_dptr_t Phiqq_times_ddq_dx, Phiqq_times_ddq_dy;
-		array_relative_dptr_t Phiqq_times_ddq_drel;
+		/** Entries in the sparse Jacobian Phiqq_times_ddq */
+		array_entry_t Phiqq_times_ddq_dx, Phiqq_times_ddq_dy;
+		array_relative_entry_t Phiqq_times_ddq_drel;
 
-		/** Pointers to entries in the sparse Jacobian dotPhiqq_times_dq */
-		array_dptr_t dotPhiqq_times_dq_dx, dotPhiqq_times_dq_dy;
-		array_relative_dptr_t dotPhiqq_times_dq_drel;
+		/** Entries in the sparse Jacobian dotPhiqq_times_dq */
+		array_entry_t dotPhiqq_times_dq_dx, dotPhiqq_times_dq_dy;
+		array_relative_entry_t dotPhiqq_times_dq_drel;
 
 		JacobRowEntries()
 		{
-			dPhi_dx.fill(nullptr);
-			dPhi_dy.fill(nullptr);
-			dPhi_drel.fill(nullptr);
+			const auto none = CompressedRowSparseMatrix::INVALID_ENTRY;
 
-			dot_dPhi_dx.fill(nullptr);
-			dot_dPhi_dy.fill(nullptr);
-			dot_dPhi_drel.fill(nullptr);
+			dPhi_dx.fill(none);
+			dPhi_dy.fill(none);
+			dPhi_drel.fill(none);
 
-			Phiqq_times_ddq_dx.fill(nullptr);
-			Phiqq_times_ddq_dy.fill(nullptr);
-			Phiqq_times_ddq_drel.fill(nullptr);
+			dot_dPhi_dx.fill(none);
+			dot_dPhi_dy.fill(none);
+			dot_dPhi_drel.fill(none);
 
-			dotPhiqq_times_dq_dx.fill(nullptr);
-			dotPhiqq_times_dq_dy.fill(nullptr);
-			dotPhiqq_times_dq_drel.fill(nullptr);
+			Phiqq_times_ddq_dx.fill(none);
+			Phiqq_times_ddq_dy.fill(none);
+			Phiqq_times_ddq_drel.fill(none);
+
+			dotPhiqq_times_dq_dx.fill(none);
+			dotPhiqq_times_dq_dy.fill(none);
+			dotPhiqq_times_dq_drel.fill(none);
 		}
 	};
 
@@ -247,10 +251,10 @@ class ConstraintCommon
 
 	mutable std::array<JacobRowEntries, NUM_JACOB_ROWS> jacob;
 
-	/** Sets a value, if the pointer is !=nullptr */
-	static void set(double* ptr, double val)
+	/** Sets a value in a sparse matrix, if the entry index is valid */
+	static void set(CompressedRowSparseMatrix& m, std::size_t idx, double val)
 	{
-		if (ptr) *ptr = val;
+		m.setEntry(idx, val);
 	}
 };
 
@@ -260,7 +264,7 @@ template <
 	std::size_t NUM_POINTS, std::size_t NUM_RELATIVE_COORDS,
 	std::size_t NUM_JACOB_ROWS>
 void ConstraintCommon<NUM_POINTS, NUM_RELATIVE_COORDS, NUM_JACOB_ROWS>::
-	commonbuildSparseStructures(AssembledRigidModel& a) const
+	commonbuildSparseStructures(ModelTopology& a) const
 {
 	for (size_t ip = 0; ip < NUM_POINTS; ip++)
 	{
@@ -276,11 +280,13 @@ void ConstraintCommon<NUM_POINTS, NUM_RELATIVE_COORDS, NUM_JACOB_ROWS>::
 		idx_constr_[ic] = jRow;
 		auto& j = jacob[ic];
 
-		auto& Phi_q = a.Phi_q_.matrix;
-		auto& dotPhi_q = a.dotPhi_q_.matrix;
-		auto& Phiqq_times_ddq = a.Phiqq_times_ddq_.matrix;
-		auto& dotPhiqq_times_dq = a.dotPhiqq_times_dq_.matrix;
+		auto& Phi_q = a.Phi_q_;
+		auto& dotPhi_q = a.dotPhi_q_;
+		auto& Phiqq_times_ddq = a.Phiqq_times_ddq_;
+		auto& dotPhiqq_times_dq = a.dotPhiqq_times_dq_;
 
+		// Entry indices are resolved once the sparse matrices are frozen,
+		// after all constraints have defined their entries.
 		for (size_t ip = 0; ip < NUM_POINTS; ip++)
 		{
 			// Only for variables, not fixed points
@@ -290,20 +296,22 @@ void ConstraintCommon<NUM_POINTS, NUM_RELATIVE_COORDS, NUM_JACOB_ROWS>::
 			const auto idxY = pointDOFs_[ip].dof_y;
 
 			// Add columns to sparse row in Phi_q:
-			j.dPhi_dx[ip] = &Phi_q[jRow][idxX];
-			j.dPhi_dy[ip] = &Phi_q[jRow][idxY];
+			Phi_q.bindEntry(jRow, idxX, &j.dPhi_dx[ip]);
+			Phi_q.bindEntry(jRow, idxY, &j.dPhi_dy[ip]);
 
 			// Add columns to sparse row in \dot{Phi_q}:
-			j.dot_dPhi_dx[ip] = &dotPhi_q[jRow][idxX];
-			j.dot_dPhi_dy[ip] = &dotPhi_q[jRow][idxY];
+			dotPhi_q.bindEntry(jRow, idxX, &j.dot_dPhi_dx[ip]);
+			dotPhi_q.bindEntry(jRow, idxY, &j.dot_dPhi_dy[ip]);
 
 			// Add columns to sparse row in Phiqq_times_ddq:
-			j.Phiqq_times_ddq_dx[ip] = &Phiqq_times_ddq[jRow][idxX];
-			j.Phiqq_times_ddq_dy[ip] = &Phiqq_times_ddq[jRow][idxY];
+			Phiqq_times_ddq.bindEntry(jRow, idxX, &j.Phiqq_times_ddq_dx[ip]);
+			Phiqq_times_ddq.bindEntry(jRow, idxY, &j.Phiqq_times_ddq_dy[ip]);
 
 			// Add columns to sparse row in dotPhiqq_times_dq:
-			j.dotPhiqq_times_dq_dx[ip] = &dotPhiqq_times_dq[jRow][idxX];
-			j.dotPhiqq_times_dq_dy[ip] = &dotPhiqq_times_dq[jRow][idxY];
+			dotPhiqq_times_dq.bindEntry(
+				jRow, idxX, &j.dotPhiqq_times_dq_dx[ip]);
+			dotPhiqq_times_dq.bindEntry(
+				jRow, idxY, &j.dotPhiqq_times_dq_dy[ip]);
 		}
 
 		for (size_t irc = 0; irc < NUM_RELATIVE_COORDS; irc++)
@@ -311,16 +319,18 @@ void ConstraintCommon<NUM_POINTS, NUM_RELATIVE_COORDS, NUM_JACOB_ROWS>::
 			const auto idxRel = relativeCoordIndexInQ_[irc];
 
 			// Add columns to sparse row in Phi_q:
-			j.dPhi_drel[irc] = &Phi_q[jRow][idxRel];
+			Phi_q.bindEntry(jRow, idxRel, &j.dPhi_drel[irc]);
 
 			// Add columns to sparse row in \dot{Phi_q}:
-			j.dot_dPhi_drel[irc] = &dotPhi_q[jRow][idxRel];
+			dotPhi_q.bindEntry(jRow, idxRel, &j.dot_dPhi_drel[irc]);
 
 			// Add columns to sparse row in Phiqq_times_ddq:
-			j.Phiqq_times_ddq_drel[irc] = &Phiqq_times_ddq[jRow][idxRel];
+			Phiqq_times_ddq.bindEntry(
+				jRow, idxRel, &j.Phiqq_times_ddq_drel[irc]);
 
 			// Add columns to sparse row in dotPhiqq_times_dq:
-			j.dotPhiqq_times_dq_drel[irc] = &dotPhiqq_times_dq[jRow][idxRel];
+			dotPhiqq_times_dq.bindEntry(
+				jRow, idxRel, &j.dotPhiqq_times_dq_drel[irc]);
 		}
 	}
 }
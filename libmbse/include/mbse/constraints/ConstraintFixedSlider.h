@@ -34,8 +34,8 @@ class ConstraintFixedSlider : public ConstraintBase, public ConstraintCommon<1>
 		line_pt[1] = pt1;
 	}
 
-	void buildSparseStructures(AssembledRigidModel& arm) const override;
-	void update(AssembledRigidModel& arm) const override;
+	void buildSparseStructures(ModelTopology& topology) const override;
+	void update(ModelState& state) const override;
 	void print(std::ostream& o) const override;
 
 	Ptr clone() const override { return std::make_shared<me_t>(*this); }
@@ -31,8 +31,8 @@ class ConstraintMobileSlider : public ConstraintBase, public ConstraintCommon<3>
 	{
 	}
 
-	void buildSparseStructures(AssembledRigidModel& arm) const override;
-	void update(AssembledRigidModel& arm) const override;
+	void buildSparseStructures(ModelTopology& topology) const override;
+	void update(ModelState& state) const override;
 	void print(std::ostream& o) const override;
 
 	Ptr clone() const override { return std::make_shared<me_t>(*this); }
@@ -43,8 +43,8 @@ class ConstraintRelativeAngle
 	{
 	}
 
-	void buildSparseStructures(AssembledRigidModel& arm) const override;
-	void update(AssembledRigidModel& arm) const override;
+	void buildSparseStructures(ModelTopology& topology) const override;
+	void update(ModelState& state) const override;
 	void print(std::ostream& o) const override;
 
 	Ptr clone() const override { return std::make_shared<me_t>(*this); }
@@ -41,18 +41,21 @@ class ConstraintRelativeAngleAbsolute
 	{
 	}
 
-	void buildSparseStructures(AssembledRigidModel& arm) const override;
-	void update(AssembledRigidModel& arm) const override;
+	void buildSparseStructures(ModelTopology& topology) const override;
+	void update(ModelState& state) const override;
 	void print(std::ostream& o) const override;
 
 	Ptr clone() const override { return std::make_shared<me_t>(*this); }
 
-	void realizeOperatingPoint(const AssembledRigidModel& arm) const override;
+	void realizeOperatingPoint(ModelState& state) const override;
 
    protected:
 	/** Proxy for length between the two points */
 	mutable double L_ = .0;
-	mutable bool useCos_ = true;
+
+	/** Index of our flag in ModelState::operatingPointFlags_, which selects
+	 * the sin() (!=0) or cos() (=0) formulation */
+	mutable size_t opFlagIdx_ = 0;
 };
 
 }  // namespace mbse
@@ -17,7 +17,7 @@ namespace mbse
 {
 /** Constraint: relative position of one point wrt a system of coordinates built
  * from other three points. The relative position is automatically calculated
- * from "q" upon the first call to buildSparseStructures().
+ * from the initial point coordinates in buildSparseStructures().
  *
  * See: Alejo Avello's book, section 4.4.1
  */
@@ -40,8 +40,8 @@ class ConstraintRelativePosition
 	{
 	}
 
-	void buildSparseStructures(AssembledRigidModel& arm) const override;
-	void update(AssembledRigidModel& arm) const override;
+	void buildSparseStructures(ModelTopology& topology) const override;
+	void update(ModelState& state) const override;
 	void print(std::ostream& o) const override;
 
 	Ptr clone() const override { return std::make_shared<me_t>(*this); }
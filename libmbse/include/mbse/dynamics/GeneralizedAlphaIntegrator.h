@@ -0,0 +1,138 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#pragma once
+
+#include <mbse/mbse-common.h>
+
+namespace mbse
+{
+class AssembledRigidModel;
+
+/** Implicit generalized-alpha integrator for the index-3 equations of
+ * motion (Arnold & Bruls, 2007):
+ *
+ *  M \ddot{q} + Phi_q^t \lambda = Q
+ *  Phi(q) = 0
+ *
+ * The numerical damping of high frequencies is set with the spectral radius
+ * at infinity `rhoInfinity`: 1 is the (undamped) trapezoidal rule, 0
+ * annihilates the highest frequencies in one step.
+ *
+ * Each step is solved with a modified Newton method. Scaling the dynamic
+ * equations by the inverse of d\ddot{q}/dq and the multipliers accordingly,
+ * the iteration matrix becomes
+ *
+ *  [   M    Phi_q^t ]
+ *  [ Phi_q     0    ]
+ *
+ * which does not depend on the time step. Its sparse KLU factorization is
+ * reused across iterations and time steps, and only refreshed (with the
+ * current Phi_q) when one iteration does not reduce the correction at least
+ * by Parameters::maxContraction. The generalized forces are taken as
+ * constant during each iteration (no tangent stiffness or damping terms).
+ *
+ * Copies keep the parameters, but not the integrator state or the cached
+ * factorization.
+ */
+class GeneralizedAlphaIntegrator
+{
+   public:
+	struct Parameters
+	{
+		Parameters() = default;
+
+		/** Spectral radius at infinity, in [0,1] (numerical damping) */
+		double rhoInfinity = 0.8;
+
+		/** Convergence: max. absolute Newton correction of "q" */
+		double tolerance = 1e-10;
+
+		/** Newton iterations before retrying the step with a fresh
+		 * factorization */
+		size_t maxIters = 20;
+
+		/** Refactorize when one iteration does not reduce the correction at
+		 * least by this factor */
+		double maxContraction = 0.25;
+
+		/** Numeric factorizations reuse the previous pivoting
+		 * (klu_refactor) while the reciprocal condition estimate stays
+		 * above this value */
+		double minRcond = 1e-12;
+	};
+
+	/** Counters since construction or the last resetStats() */
+	struct Stats
+	{
+		size_t numSteps = 0;
+		size_t numIters = 0;
+		size_t numFactorizations = 0;
+	};
+
+	GeneralizedAlphaIntegrator() { klu_defaults(&common_); }
+	GeneralizedAlphaIntegrator(const GeneralizedAlphaIntegrator& o)
+		: GeneralizedAlphaIntegrator()
+	{
+		params = o.params;
+	}
+	GeneralizedAlphaIntegrator& operator=(const GeneralizedAlphaIntegrator& o);
+	~GeneralizedAlphaIntegrator();
+
+	Parameters params;
+
+	/** Discards the integrator state (the next step starts from consistent
+	 * accelerations computed at the current state) and the cached
+	 * factorization. Must be called if the model structure changes. */
+	void reset();
+
+	/** Advances `arm` (q, dotq and ddotq) by one time step of length dt.
+	 * The integrator state is kept for the next step, unless q or dotq are
+	 * modified in between, in which case it is re-initialized. */
+	void step(AssembledRigidModel& arm, double dt);
+
+	/** The Lagrange multipliers at the end of the last step */
+	const Eigen::VectorXd& lambda() const { return lambda_; }
+
+	const Stats& stats() const { return stats_; }
+	void resetStats() { stats_ = Stats(); }
+
+   private:
+	/** Builds the pattern of the iteration matrix and its symbolic
+	 * analysis */
+	void prepare(AssembledRigidModel& arm);
+	/** Numeric factorization with the current Phi_q */
+	void factorize(const AssembledRigidModel& arm);
+	/** Consistent \ddot{q} and \lambda at the current state */
+	void initialize(AssembledRigidModel& arm);
+
+	bool prepared_ = false;
+	bool factorized_ = false;
+	bool initialized_ = false;
+
+	Eigen::SparseMatrix<double> M_;	 //!< The MBS constant mass matrix
+	Eigen::SparseMatrix<double> A_;	 //!< Iteration matrix (CCS)
+	/** Places of the non-zero entries of the Jacobian in A_ (CRS order) */
+	std::vector<double*> A_ptrs_Phi_q_;
+
+	klu_common common_;
+	klu_numeric* numeric_ = nullptr;
+	klu_symbolic* symbolic_ = nullptr;
+
+	/** Acceleration-like variable of the method, the last \ddot{q} and
+	 * \lambda, and the state they belong to */
+	Eigen::VectorXd a_, ddotq_, lambda_, q_end_, dotq_end_;
+	/** Workspace: state at the beginning of the step, forces and RHS */
+	Eigen::VectorXd q0_, dotq0_, ddotq0_, lambda0_, a_next_, Q_, rhs_;
+
+	Stats stats_;
+};
+
+}  // namespace mbse
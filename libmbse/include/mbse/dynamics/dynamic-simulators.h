@@ -11,6 +11,7 @@
 #pragma once
 
 #include <mbse/mbse-common.h>
+#include <mbse/dynamics/GeneralizedAlphaIntegrator.h>
 #include <list>
 
 namespace mbse
@@ -56,13 +57,25 @@ enum ODE_integrator_t
 {
 	ODE_Euler = 0,	//!< Simple, explicit, Euler method
 	ODE_Trapezoidal,  //!< Implicit 2nd order method
-	ODE_RK4	 //!< Explicit Runge-Kutta 4th order method
+	ODE_RK4,  //!< Explicit Runge-Kutta 4th order method
+	/** Explicit, adaptive-step, embedded Runge-Kutta 5(4) method
+	 * (Dormand-Prince) with error control on q and dq */
+	ODE_RK45,
+	/** Implicit generalized-alpha method on the index-3 DAE, with tunable
+	 * numerical damping (see GeneralizedAlphaIntegrator) */
+	ODE_GeneralizedAlpha,
+	/** Multi-rate: the fast coordinates (see
+	 * CDynamicSimulatorBase::setFastCoordinates()) take
+	 * TParameters::multirate_substeps RK4 steps per time step, while the
+	 * rest of the model takes one 2nd order step */
+	ODE_MultiRate
 };
 
 /** State of the simulation, passed to a user-provided function */
 struct TSimulationState
 {
-	double t;
+	double t;  //!< Time at the beginning of the last step
+	double dt;	//!< Length of the last step (variable for ODE_RK45)
 	const AssembledRigidModel* const
 		arm;  //!< From this object you can retrieve the current "q"
 			  //!< coordinates, velocities, bodies, etc.
@@ -90,6 +103,9 @@ class CDynamicSimulatorBase
 		const std::string& name,
 		const std::shared_ptr<AssembledRigidModel> arm_ptr);
 
+	/** The class names accepted by Create() */
+	static std::vector<std::string> RegisteredNames();
+
 	CDynamicSimulatorBase(std::shared_ptr<AssembledRigidModel> arm_ptr);
 	virtual ~CDynamicSimulatorBase();
 
@@ -100,9 +116,20 @@ class CDynamicSimulatorBase
 		/**  Method for numerical integration of ODE system */
 		ODE_integrator_t ode_solver = ODE_Euler;
 
-		/** For fixed-time integrators, the fixed time step */
+		/** For fixed-time integrators, the fixed time step. For adaptive
+		 * ones (ODE_RK45), the initial time step */
 		double time_step = 1e-3;
 
+		/** Tolerances of adaptive integrators: the local error of each entry
+		 * x of q and dq is kept below abs_tol + rel_tol * |x| */
+		double abs_tol = 1e-6, rel_tol = 1e-6;
+
+		/** Limits to the step of adaptive integrators (0: no upper limit) */
+		double min_time_step = 1e-9, max_time_step = 0;
+
+		/** ODE_MultiRate: substeps of the fast coordinates per time step */
+		size_t multirate_substeps = 10;
+
 		/** Called AFTER each new simulation step */
 		simul_callback_t user_callback;
 	};
@@ -122,6 +149,36 @@ class CDynamicSimulatorBase
 		double t, Eigen::VectorXd& ddot_q,
 		Eigen::VectorXd* lagrangre = nullptr);
 
+	/** Solves the accelerations for a batch of states, e.g. the perturbed
+	 * states of a finite-difference Jacobian. Each column of `q` and `dq` is
+	 * one state, and the same column of `ddot_q` receives its accelerations.
+	 * External forces are taken from the columns of `Q` if given, or from the
+	 * model (`Q_`) for all states otherwise. The model coordinates,
+	 * velocities and external forces are restored on return.
+	 *
+	 * The default implementation calls solve_ddotq() once per state.
+	 * Constant-mass formulations override it to reuse the mass matrix
+	 * factorization and spread the states over several threads.
+	 *  You MUST call prepare() before this method.
+	 */
+	virtual void solve_ddotq_batch(
+		double t, const Eigen::MatrixXd& q, const Eigen::MatrixXd& dq,
+		Eigen::MatrixXd& ddot_q, const Eigen::MatrixXd* Q = nullptr);
+
+	/** Whether this formulation solves the Lagrange equations
+	 *
+	 * [   M    Phi_q^t  ] [ ddot_q ] = [ Q ]
+	 * [ Phi_q     0     ] [ lambda ]   [ c ]
+	 *
+	 * with "c" as in build_RHS(), so solve_ddotq() returns their multipliers
+	 * and solve_kkt() can reuse its factorization. */
+	virtual bool is_lagrange_kkt_solver() const { return false; }
+
+	/** In-place solve of the system above, for each column of `rhs`, with
+	 * the factorization of the last solve_ddotq() call. Only for formulations
+	 * with is_lagrange_kkt_solver() */
+	virtual void solve_kkt(Eigen::MatrixXd& rhs);
+
 	/** Integrators will call this before solve_ddotq() once per time step */
 	virtual void pre_iteration(double t) {}
 
@@ -141,6 +198,49 @@ class CDynamicSimulatorBase
 
 	AssembledRigidModel* get_model_non_const() const { return arm_ptr_.get(); }
 
+	/** Gains of the Baumgarte stabilization in build_RHS(), i.e.
+	 * \f$ c = -\dot{\Phi}_q \dot{q} - k_{vel} \dot{\Phi} - k_{pos} \Phi \f$
+	 * Both are zero if stabilization is disabled at build time. */
+	static const double BAUMGARTE_K_VEL, BAUMGARTE_K_POS;
+
+	/** The integrator used with ODE_GeneralizedAlpha, to tune it or read
+	 * its statistics */
+	GeneralizedAlphaIntegrator& generalizedAlpha() { return gen_alpha_; }
+	const GeneralizedAlphaIntegrator& generalizedAlpha() const
+	{
+		return gen_alpha_;
+	}
+
+	/** \name Multi-rate integration (ODE_MultiRate)
+		 @{ */
+
+	/** Sets the coordinates to be integrated with the short (fast) substeps,
+	 * before calling prepare(). If none are set, those of the points of all
+	 * the bodies tagged with Body::fast are used. */
+	void setFastCoordinates(const std::vector<dof_index_t>& dofs);
+
+	/** The fast coordinates in use (valid after prepare() with
+	 * ODE_MultiRate, or after the first ODE_MultiRate step) */
+	const std::vector<dof_index_t>& fastCoordinates() const
+	{
+		return mr_fast_dofs_;
+	}
+
+	/** Counters of ODE_MultiRate since prepare() */
+	struct TMultiRateStats
+	{
+		size_t macro_steps = 0;
+		size_t full_solves = 0;	 //!< Calls to internal_solve_ddotq()
+		size_t fast_solves = 0;	 //!< Solves of the fast subsystem alone
+		/** Evaluations of single constraints (Phi and its Jacobians), all
+		 * of them for each full solve */
+		size_t constraint_evals = 0;
+	};
+
+	const TMultiRateStats& multiRateStats() const { return mr_stats_; }
+
+	/** @} */
+
 	/** \name Sensors
 		 @{ */
 
@@ -167,6 +267,11 @@ class CDynamicSimulatorBase
 	 */
 	void build_RHS(double* Q, double* c);
 
+	/** Like the "c" part of build_RHS(), only for the given rows of Phi:
+	 * c[i] is the entry of row rows[i]. Only these rows of the constraints
+	 * and their Jacobians need to be up to date. */
+	void build_RHS_c_rows(const std::vector<size_t>& rows, double* c) const;
+
 	/** Prepare the linear systems and anything else required to really call
 	 * solve_ddotq() */
 	virtual void internal_prepare() = 0;
@@ -176,6 +281,12 @@ class CDynamicSimulatorBase
 		double t, Eigen::VectorXd& ddot_q,
 		Eigen::VectorXd* lagrangre = nullptr) = 0;
 
+	/** Whether run() can integrate this formulation with `integr` */
+	virtual bool supports_ode_solver(const ODE_integrator_t integr) const
+	{
+		return true;
+	}
+
 	/** Implement a especific combination of dynamic formulation + integrator.
 	 *  \return false if it's not implemented, so it should fallback to generic
 	 * integrator + internal_solve_ddotq()
@@ -186,14 +297,129 @@ class CDynamicSimulatorBase
 		return false;
 	}
 
+	/** \name Generic adaptive integrator
+		 @{ */
+
+	/** One accepted step of the Dormand-Prince 5(4) integrator from time t,
+	 * no longer than max_dt. Rejected attempts are retried with a shorter
+	 * step. The accelerations at the end of the step are kept in rk_acc_[6]
+	 * and reused as the first stage of the next step if the state has not
+	 * been modified in between (FSAL: "first same as last") and
+	 * integrator_can_reuse_last_acc() allows it.
+	 * \return The length of the step actually taken.
+	 */
+	double integrate_RK45(double t, double max_dt);
+
+	/** Accelerations of the ODE: \ddot{q} here, \ddot{z} for formulations in
+	 * independent coordinates. `step_start` is true for the first evaluation
+	 * of a time step. */
+	virtual void integrator_solve_acc(
+		double t, Eigen::VectorXd& acc, bool step_start)
+	{
+		this->internal_solve_ddotq(t, acc);
+	}
+
+	/** out_dq = dq + dacc, where dacc is in the space of the accelerations
+	 * returned by integrator_solve_acc(). out_dq may be the same than dq. */
+	virtual void integrator_dq_plus_dacc(
+		const Eigen::VectorXd& dq, const Eigen::VectorXd& dacc,
+		Eigen::VectorXd& out_dq) const
+	{
+		out_dq = dq + dacc;
+	}
+
+	/** Called after setting q and dq of each intermediary integrator state */
+	virtual void integrator_correct_state() {}
+
+	/** Whether the accelerations at the end of a step may be reused as the
+	 * first ones of the next step, instead of calling integrator_solve_acc()
+	 * with `step_start=true` */
+	virtual bool integrator_can_reuse_last_acc() const { return true; }
+
+	/** @} */
+
+	/** \name Multi-rate integrator
+		 @{ */
+
+	/** One time step of ODE_MultiRate, from t to t+dt:
+	 *  - The accelerations of the whole model at the end of the step are
+	 *    solved once, at a state predicted from those at its beginning.
+	 *  - The slow coordinates follow the cubic polynomial with those
+	 *    accelerations at both ends (2nd order).
+	 *  - The fast coordinates are integrated with RK4 substeps. Each one
+	 *    solves only the fast subsystem, with the motion of the slow
+	 *    coordinates interpolated as above:
+	 *
+	 *    [   M_ff     Phi_rf^t ] [ ddot_q_f ] = [ Q_f - M_fs ddot_q_s ]
+	 *    [ Phi_rf        0     ] [  lambda  ]   [ c_r - Phi_rs ddot_q_s ]
+	 *
+	 *    with "r" the constraints involving any fast coordinate.
+	 *  - Finally, the fast coordinates are projected onto those constraints,
+	 *    at the position and velocity levels, and their accelerations are
+	 *    solved again at the resulting state.
+	 * The accelerations at the end of the step are reused for the next one
+	 * if the state is not modified in between.
+	 */
+	void integrate_multirate(double t, double dt);
+
+	/** @} */
+
 	// Auxiliary variables of the ODE integrators (declared here to avoid
 	// reallocating mem)
 	Eigen::VectorXd q0;	 // Backup of state.
 	Eigen::VectorXd k1, k2, k3, k4;
 	Eigen::VectorXd v1, v2, v3, v4;	 // \dot{q}
+	Eigen::VectorXd rk_vel_[7], rk_acc_[7];	 //!< RK45 stages
+	Eigen::VectorXd rk_q_, rk_dacc_, rk_err_dq_;
+	Eigen::VectorXd rk_q_end_, rk_dq_end_;	//!< State after the last step
+	double rk_t_end_ = 0;
+	bool rk_fsal_ = false;	//!< rk_acc_[6] valid at (rk_q_end_,rk_dq_end_)
+	double rk_dt_ = 0;	//!< Next step proposed by the RK45 error control
+
+	GeneralizedAlphaIntegrator gen_alpha_;
+
+	/** Multi-rate partition, only built for ODE_MultiRate */
+	bool mr_prepared_ = false;
+	std::vector<dof_index_t> mr_fast_dofs_, mr_slow_dofs_;
+	bool mr_user_fast_dofs_ = false;  //!< Set by setFastCoordinates()
+	/** Index in mr_fast_dofs_ of each coordinate, or INVALID_DOF if slow */
+	std::vector<dof_index_t> mr_fast_index_;
+	std::vector<size_t> mr_rows_;  //!< Constraints with fast coordinates
+	/** The entries in ModelTopology::constraints_ with rows in mr_rows_ */
+	std::vector<size_t> mr_constraints_;
+	/** Constant mass matrix, rows of the fast coordinates and columns of
+	 * the slow ones */
+	Eigen::SparseMatrix<double> mr_M_fs_;
+	Eigen::MatrixXd mr_A_;	//!< Matrix of the fast subsystem
+	Eigen::PartialPivLU<Eigen::MatrixXd> mr_lu_;  //!< Factorization of mr_A_
+	/** Interpolation of the slow part: state and accelerations at the
+	 * beginning of the step, and acceleration rate */
+	Eigen::VectorXd mr_q0_, mr_dq0_, mr_acc0_, mr_jerk_;
+	/** Fast part: RK4 stages, and the full acceleration and its workspace */
+	Eigen::VectorXd mr_qf_, mr_vf_[4], mr_af_[4], mr_acc_;
+	Eigen::VectorXd mr_rhs_;
+	/** State after the last step, and its accelerations */
+	Eigen::VectorXd mr_q_end_, mr_dq_end_, mr_acc_end_;
+	bool mr_acc_end_valid_ = false;
+	TMultiRateStats mr_stats_;
+
    private:
 	Eigen::VectorXd ddotq1, ddotq2, ddotq3, ddotq4;	 // \ddot{q}
 
+	/** Builds the multi-rate partition */
+	void prepare_multirate();
+	/** Sets the slow coordinates (and their accelerations in mr_acc_) at
+	 * time tau since the beginning of the step */
+	void multirate_set_slow_state(double tau);
+	/** Updates the constraints in mr_constraints_, and builds and factorizes
+	 * the matrix of the fast subsystem */
+	void multirate_build_fast_matrix();
+	/** Accelerations of the fast coordinates, given those of the slow ones in
+	 * mr_acc_ */
+	void multirate_solve_fast(Eigen::VectorXd& acc_f);
+	/** Projects the fast coordinates onto their constraints */
+	void multirate_project_fast();
+
    protected:
 	bool init_;	 //!< Used to indicate if user has called prepare()
 
@@ -226,6 +452,20 @@ class CDynamicSimulatorIndepBase : public CDynamicSimulatorBase
 	 */
 	void solve_ddotz(double t, Eigen::VectorXd& ddot_z);
 
+	/** Solves the independent accelerations for a batch of states, e.g. the
+	 * perturbed states of a finite-difference Jacobian. Each column of `q`
+	 * and `dq` is one state, already consistent with the constraints, and
+	 * the same column of `ddot_z` receives its accelerations. All states use
+	 * the current independent coordinates, and the model coordinates and
+	 * velocities are restored on return.
+	 *
+	 * The default implementation calls solve_ddotz() once per state.
+	 *  You MUST call prepare() before this method.
+	 */
+	virtual void solve_ddotz_batch(
+		double t, const Eigen::MatrixXd& q, const Eigen::MatrixXd& dq,
+		Eigen::MatrixXd& ddot_z);
+
 	/** Performs the addition of velocities: out_dq = dq +
 	 * independent2dependent(dz) */
 	virtual void dq_plus_dz(
@@ -254,6 +494,29 @@ class CDynamicSimulatorIndepBase : public CDynamicSimulatorBase
 	/** Solve for the current accelerations of independent coords */
 	virtual void internal_solve_ddotz(double t, Eigen::VectorXd& ddot_z) = 0;
 
+	// The generic integrators work on \ddot{z}:
+	void integrator_solve_acc(
+		double t, Eigen::VectorXd& acc, bool step_start) override;
+	void integrator_dq_plus_dacc(
+		const Eigen::VectorXd& dq, const Eigen::VectorXd& dacc,
+		Eigen::VectorXd& out_dq) const override
+	{
+		this->dq_plus_dz(dq, dacc, out_dq);
+	}
+	void integrator_correct_state() override
+	{
+		this->correct_dependent_q_dq();
+	}
+	// Only the integrators in run() work on \ddot{z}:
+	bool supports_ode_solver(const ODE_integrator_t integr) const override
+	{
+		return integr == ODE_Euler || integr == ODE_RK4 || integr == ODE_RK45;
+	}
+
+	// Each step must start with a chance to re-select the independent
+	// coordinates, so \ddot{z} from the former step can't be reused:
+	bool integrator_can_reuse_last_acc() const override { return false; }
+
 	// Auxiliary variables of the ODE integrators (declared here to avoid
 	// reallocating mem)
 	Eigen::VectorXd ddotz1, ddotz2, ddotz3, ddotz4;	 // \ddot{z}
@@ -265,6 +528,19 @@ class CDynamicSimulator_Lagrange_LU_dense : public CDynamicSimulatorBase
 	CDynamicSimulator_Lagrange_LU_dense(
 		const std::shared_ptr<AssembledRigidModel> arm_ptr);
 
+	/** Batch version using the range-space (Schur complement) form of the
+	 * Lagrange equations with the constant Cholesky factor of M:
+	 *  lambda = (Phi_q M^-1 Phi_q^T)^-1 (Phi_q M^-1 Q - c)
+	 *  ddot_q = M^-1 (Q - Phi_q^T lambda)
+	 * Falls back to the base class if M is singular (e.g. for models with
+	 * relative coordinates, which carry no mass). */
+	void solve_ddotq_batch(
+		double t, const Eigen::MatrixXd& q, const Eigen::MatrixXd& dq,
+		Eigen::MatrixXd& ddot_q, const Eigen::MatrixXd* Q = nullptr) override;
+
+	bool is_lagrange_kkt_solver() const override { return true; }
+	void solve_kkt(Eigen::MatrixXd& rhs) override;
+
    private:
 	void internal_prepare() override;
 	void internal_solve_ddotq(
@@ -272,6 +548,8 @@ class CDynamicSimulator_Lagrange_LU_dense : public CDynamicSimulatorBase
 		Eigen::VectorXd* lagrangre = nullptr) override;
 
 	Eigen::MatrixXd mass_;	//!< The MBS constant mass matrix
+	Eigen::LLT<Eigen::MatrixXd> mass_llt_;	//!< Only for solve_ddotq_batch()
+	Eigen::PartialPivLU<Eigen::MatrixXd> A_lu_;	 //!< Last augmented matrix
 };
 
 class CDynamicSimulator_R_matrix_dense : public CDynamicSimulatorBase
@@ -317,6 +595,12 @@ class CDynamicSimulator_Indep_dense : public CDynamicSimulatorIndepBase
 		can_choose_indep_coords_ = false;
 	}
 
+	/** Batch version with the constant mass matrix, spreading the states
+	 * over several threads */
+	void solve_ddotz_batch(
+		double t, const Eigen::MatrixXd& q, const Eigen::MatrixXd& dq,
+		Eigen::MatrixXd& ddot_z) override;
+
    private:
 	void internal_prepare() override;
 	void internal_solve_ddotz(double t, Eigen::VectorXd& ddot_z) override;
@@ -327,6 +611,81 @@ class CDynamicSimulator_Indep_dense : public CDynamicSimulatorIndepBase
 	std::vector<size_t> indep_idxs_;
 };
 
+/** Sparse version of CDynamicSimulator_Indep_dense: the R matrix columns are
+ * obtained from sparse KLU solves with the square matrix [Phi_q; B], without
+ * ever forming its inverse, and the projected mass matrix R^t M R is built
+ * from the sparse mass matrix.
+ *
+ * When the solver is allowed to choose the independent coordinates, they
+ * are only re-selected (from a sparse rank-revealing QR of Phi_q) if
+ * [Phi_q; B] becomes singular or ill-conditioned.
+ */
+class CDynamicSimulator_Indep_sparse : public CDynamicSimulatorIndepBase
+{
+   public:
+	CDynamicSimulator_Indep_sparse(
+		const std::shared_ptr<AssembledRigidModel> arm_ptr);
+	virtual ~CDynamicSimulator_Indep_sparse();
+
+	void dq_plus_dz(
+		const Eigen::VectorXd& dq, const Eigen::VectorXd& dz,
+		Eigen::VectorXd& out_dq) const override;
+	/** Compute dependent velocities and positions from the independent ones */
+	void correct_dependent_q_dq() override;
+
+	// See base class docs
+	const std::vector<size_t>& independent_coordinate_indices() const override
+	{
+		return indep_idxs_;
+	}
+	/** Manual selection of independent coordinates. Calling this method also
+	 * sets can_choose_indep_coords_=false */
+	void independent_coordinate_indices(
+		const std::vector<size_t>& idxs) override
+	{
+		indep_idxs_ = idxs;
+		can_choose_indep_coords_ = false;
+		pattern_ok_ = false;
+	}
+
+	/** Reciprocal condition number estimate of [Phi_q; B] below which the
+	 * independent coordinates are re-selected (if allowed, i.e. at the
+	 * beginning of a time step; within a step, an ill-conditioned but
+	 * non-singular matrix is used as is). */
+	double min_rcond = 1e-10;
+
+   private:
+	void internal_prepare() override;
+	void internal_solve_ddotz(double t, Eigen::VectorXd& ddot_z) override;
+
+	/** Picks indep_idxs_ from the pivoting of a sparse QR of Phi_q, or from
+	 * a dense full-pivoting LU if `dense` is true */
+	void choose_independent_coordinates(bool dense);
+	/** Rebuilds the CCS pattern of [Phi_q; B] and its symbolic analysis */
+	void build_pattern();
+	/** Numeric factorization of [Phi_q; B]. \return false if singular or
+	 * ill-conditioned */
+	bool factorize();
+
+	Eigen::SparseMatrix<double> mass_;	//!< The MBS constant mass matrix
+	/** The indices in "q" of those coordinates to be used as "independent" (z)
+	 */
+	std::vector<size_t> indep_idxs_;
+
+	Eigen::SparseMatrix<double> A_;	 //!< [Phi_q; B] (CCS)
+	/** For each non-zero of the CRS Phi_q, its place in A_.valuePtr() */
+	std::vector<double*> A_ptrs_Phi_q_;
+	bool pattern_ok_ = false;
+
+	Eigen::MatrixXd rhs_;  //!< Solves in-place: [0;I | c;0] => [R | S*c]
+	Eigen::MatrixXd MR_, RtMR_;
+	Eigen::VectorXd Q_, c_;
+
+	klu_common common_;
+	klu_numeric* numeric_ = nullptr;
+	klu_symbolic* symbolic_ = nullptr;
+};
+
 class CDynamicSimulator_Lagrange_CHOLMOD : public CDynamicSimulatorBase
 {
    public:
@@ -365,17 +724,17 @@ class CDynamicSimulator_Lagrange_UMFPACK : public CDynamicSimulatorBase
 
 	TOrderingMethods ordering;
 
+	bool is_lagrange_kkt_solver() const override { return true; }
+	void solve_kkt(Eigen::MatrixXd& rhs) override;
+
    private:
 	void internal_prepare() override;
 	void internal_solve_ddotq(
 		double t, Eigen::VectorXd& ddot_q,
 		Eigen::VectorXd* lagrangre = nullptr) override;
 
-	std::vector<Eigen::Triplet<double>> mass_tri_;
-	std::vector<Eigen::Triplet<double>>
-		A_tri_;	 //!< Augmented matrix (triplet form)
-	std::vector<double*> A_tri_ptrs_Phi_q_;	 //!< Placeholders for the non-zero
-											 //!< entries of the Jacobian.
+	/** Places of the non-zero entries of the Jacobian in A_ (CRS order) */
+	std::vector<double*> A_ptrs_Phi_q_;
 	Eigen::SparseMatrix<double> A_;	 //!< Augmented matrix (CCS)
 
 	void* numeric_;
@@ -394,17 +753,21 @@ class CDynamicSimulator_Lagrange_KLU : public CDynamicSimulatorBase
 
 	TOrderingMethods ordering;
 
+	bool is_lagrange_kkt_solver() const override { return true; }
+	void solve_kkt(Eigen::MatrixXd& rhs) override;
+
+	/** Numeric factorizations reuse the previous pivoting (klu_refactor)
+	 * while the reciprocal condition estimate stays above this value */
+	double min_rcond = 1e-12;
+
    private:
 	void internal_prepare() override;
 	void internal_solve_ddotq(
 		double t, Eigen::VectorXd& ddot_q,
 		Eigen::VectorXd* lagrangre = nullptr) override;
 
-	std::vector<Eigen::Triplet<double>> mass_tri_;
-	std::vector<Eigen::Triplet<double>>
-		A_tri_;	 //!< Augmented matrix (triplet form)
-	std::vector<double*> A_tri_ptrs_Phi_q_;	 //!< Placeholders for the non-zero
-											 //!< entries of the Jacobian.
+	/** Places of the non-zero entries of the Jacobian in A_ (CRS order) */
+	std::vector<double*> A_ptrs_Phi_q_;
 	Eigen::SparseMatrix<double> A_;	 //!< Augmented matrix (CCS)
 
 	klu_common common_;
@@ -412,6 +775,95 @@ class CDynamicSimulator_Lagrange_KLU : public CDynamicSimulatorBase
 	klu_symbolic* symbolic_;
 };
 
+/** Lagrange equations solved with a recursive O(n) elimination over the
+ * topology of the model:
+ *
+ * [   M    Phi_q^t  ] [ ddot_q ] = [ Q ]
+ * [ Phi_q     0     ] [ lambda ]   [ c ]
+ *
+ * In internal_prepare(), the coordinates of each point become one node of a
+ * spanning tree of the model (a forest, if several parts are only joined
+ * through fixed points). Each node also takes the constraints that link it
+ * to its parent node or only to fixed points. The system is then solved
+ * with one leaves-to-root pass, eliminating small (up to 4x4) dense blocks,
+ * and one root-to-leaves pass, so open chains and trees cost O(n).
+ *
+ * Kinematic loops are closed with the constraints (and mass couplings)
+ * that do not fit the tree ("cut joints"), which are added as a low-rank
+ * correction (Woodbury identity). Each of them adds one or two tree solves
+ * per step, so near-trees are still O(n).
+ *
+ * Models with relative coordinates are not supported.
+ */
+class CDynamicSimulator_Lagrange_Tree : public CDynamicSimulatorBase
+{
+   public:
+	CDynamicSimulator_Lagrange_Tree(
+		const std::shared_ptr<AssembledRigidModel> arm_ptr);
+
+	/** Rank of the correction for the terms that do not fit the spanning
+	 * tree: 0 for open chains and trees. Valid after prepare() */
+	size_t num_cut_terms() const { return lowrank_U_.size(); }
+
+	bool is_lagrange_kkt_solver() const override { return true; }
+	void solve_kkt(Eigen::MatrixXd& rhs) override;
+
+   private:
+	void internal_prepare() override;
+	void internal_solve_ddotq(
+		double t, Eigen::VectorXd& ddot_q,
+		Eigen::VectorXd* lagrangre = nullptr) override;
+
+	/** Blocks of the tree: a node has up to 2 coordinates + 2 constraints */
+	using block_t =
+		Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, 4, 4>;
+	using block_vector_t = Eigen::Matrix<double, Eigen::Dynamic, 1, 0, 4, 1>;
+
+	static constexpr size_t INVALID_NODE = static_cast<size_t>(-1);
+
+	struct TNode
+	{
+		/** Unknowns of this node (indices in [ddot_q; lambda]), the
+		 * coordinates first */
+		std::vector<size_t> vars;
+		size_t parent = INVALID_NODE;
+		block_t D_base, K_up_base;	//!< Mass matrix part of D and K_up
+		block_t D;	//!< Diagonal block, updated with its children
+		block_t K_up;  //!< Coupling block K(this, parent)
+		block_t W;	//!< D^-1 * K_up
+		Eigen::FullPivLU<block_t> D_lu;
+	};
+	/** All nodes, with children always before their parents */
+	std::vector<TNode> nodes_;
+
+	/** Where each CRS value of Phi_q goes in the tree blocks */
+	struct TScatter
+	{
+		size_t node;
+		uint8_t row, col;  //!< (constraint, coordinate) in D or K_up
+		bool diag;	//!< In D (and its transpose), or in K_up
+	};
+	std::vector<TScatter> Phi_q_scatter_;  //!< Same order than CRS values
+
+	/** The terms not in the tree, as K - K_tree = sum_i U_i * B_i, with
+	 * sparse columns U_i and rows B_i */
+	using sparse_vector_t = std::vector<std::pair<size_t, double>>;
+	std::vector<sparse_vector_t> lowrank_U_, lowrank_B_;
+	/** Cut constraints: their row, and their first term in lowrank_U_ */
+	std::vector<std::pair<size_t, size_t>> cut_rows_;
+
+	Eigen::MatrixXd Z_;	 //!< K_tree^-1 * U
+	Eigen::FullPivLU<Eigen::MatrixXd> S_lu_;  //!< I + B * Z
+	Eigen::VectorXd rhs_, Bx_;	//!< Workspace
+
+	/** Numeric factorization of the tree blocks and the correction */
+	void factorize();
+	/** In-place x = K_tree^-1 * x */
+	void solve_tree(Eigen::Ref<Eigen::VectorXd> x) const;
+	/** In-place x = K^-1 * x, with the tree and the low-rank correction */
+	void solve_factorized(Eigen::Ref<Eigen::VectorXd> x);
+};
+
 class CDynamicSimulatorBasePenalty : public CDynamicSimulatorBase
 {
    public:
@@ -442,9 +894,13 @@ class CDynamicSimulator_AugmentedLagrangian_KLU
 	CDynamicSimulator_AugmentedLagrangian_KLU(
 		const std::shared_ptr<AssembledRigidModel> arm_ptr);
 	virtual ~CDynamicSimulator_AugmentedLagrangian_KLU();
-    
+
 	TOrderingMethods ordering;
 
+	/** Numeric factorizations reuse the previous pivoting (klu_refactor)
+	 * while the reciprocal condition estimate stays above this value */
+	double min_rcond = 1e-12;
+
 	const Eigen::SparseMatrix<double>& getA() const { return A_; }
 
    private:
@@ -456,16 +912,17 @@ class CDynamicSimulator_AugmentedLagrangian_KLU
 	struct TSparseDotProduct
 	{
 		std::vector<std::pair<const double*, const double*>> lst_terms;
-		double *out_ptr1,
-			*out_ptr2;	//!< Store the result of the dot product in these
-						//!< pointers, if they are not nullptr.
+		double *out_ptr1 = nullptr,
+			   *out_ptr2 = nullptr;	 //!< Store the result of the dot product
+									 //!< in these entries of A_, if they
+									 //!< are not nullptr.
+		double base1 = 0, base2 = 0;  //!< Mass matrix part of those entries
+		int row = 0, col = 0;
 	};
 
-	std::vector<Eigen::Triplet<double>> A_tri_,
-		M_tri_;	 //!< Augmented matrix (triplet form)
 	std::vector<TSparseDotProduct>
 		PhiqtPhi_;	//!< Quick list of operations needed to update the product
-					//!< Phi_q^t * Phi_q and store it into A_tri_.
+					//!< Phi_q^t * Phi_q and store it into A_.
 	Eigen::SparseMatrix<double> A_, M_;	 //!< Augmented matrix (CCS)
 
 	klu_common common_;
@@ -533,4 +990,51 @@ class CDynamicSimulator_ALi3_Dense : public CDynamicSimulatorBasePenalty
 	Eigen::VectorXd Lambda_;
 };
 
+/** Sparse version of CDynamicSimulator_ALi3_Dense. The pattern of
+ * A = M + alpha * Phi_q^t * Phi_q is built once, together with a symbolic
+ * CHOLMOD Cholesky analysis, in internal_prepare(). Afterwards, each
+ * iteration only updates the values of A in place and factorizes it
+ * numerically. Velocity and acceleration projections reuse that
+ * factorization. */
+class CDynamicSimulator_ALi3_Sparse : public CDynamicSimulatorBasePenalty
+{
+   public:
+	CDynamicSimulator_ALi3_Sparse(
+		const std::shared_ptr<AssembledRigidModel> arm_ptr);
+	virtual ~CDynamicSimulator_ALi3_Sparse();
+
+	TOrderingMethods ordering = orderAMD;  //!< Fill-reducing ordering of A
+
+   private:
+	void internal_prepare() override;
+	void internal_solve_ddotq(
+		double t, Eigen::VectorXd& ddot_q,
+		Eigen::VectorXd* lagrangre = nullptr) override;
+
+	bool internal_integrate(
+		double t, double dt, const ODE_integrator_t integr) override;
+
+	/** Sets A = M + scale * alpha * Phi_q^t * Phi_q, with the current Phi_q,
+	 * and factorizes it */
+	void update_and_factorize_A(double scale);
+
+	struct TSparseDotProduct
+	{
+		/** Pairs of entries of Phi_q (indices in its CRS values) */
+		std::vector<std::pair<size_t, size_t>> lst_terms;
+		double* out_ptr = nullptr;	//!< Entry of A_ (upper triangle)
+		double base = 0;  //!< Mass matrix part of that entry
+	};
+	std::vector<TSparseDotProduct> PhiqtPhi_;
+
+	Eigen::SparseMatrix<double> M_;	 //!< The MBS constant mass matrix
+	/** Upper triangle of M + alpha * Phi_q^t * Phi_q (fixed pattern) */
+	Eigen::SparseMatrix<double> A_;
+	Eigen::CholmodDecomposition<Eigen::SparseMatrix<double>, Eigen::Upper>
+		A_chol_;
+
+	Eigen::VectorXd Lambda_;
+	Eigen::VectorXd Q_, b_, rhs_;  //!< Workspace
+};
+
 }  // namespace mbse
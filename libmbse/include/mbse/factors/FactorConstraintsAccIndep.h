@@ -32,7 +32,6 @@ class FactorConstraintsAccIndep
 	// Class parameters (pointer to type "ConstraintBase")
 	AssembledRigidModel::Ptr arm_;
 	std::vector<size_t> indCoordsIndices_;
-	gtsam::Matrix matrix_Iidx_;
 
    public:
 	// shorthand for a smart pointer to a factor
@@ -0,0 +1,107 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#pragma once
+
+#include <mbse/factors/factor-common.h>
+#include <gtsam/nonlinear/NonlinearFactor.h>
+#include <gtsam/nonlinear/NonlinearFactorGraph.h>
+#include <mbse/AssembledRigidModel.h>
+
+namespace mbse
+{
+/** Factor for the position constraints Phi_i(q)=0 of one single constraint
+ * (one entry in ModelTopology::constraints_), over the per-point block
+ * variables of StateBlocks.
+ *
+ * Unlike FactorConstraints, which ties all the coordinates of a timestep
+ * together, each of these factors only involves the points referenced by
+ * its constraint. Use addConstraintFactors() to create the factors of all
+ * constraints.
+ *
+ * \note The other factors of the library (FactorDynamics, the integrators,
+ * FactorConstraintsVel) are written over the whole-state q(k). Linking the
+ * blocks back to it would make them as dense as FactorConstraints, so these
+ * factors are meant for graphs built over the blocks only, e.g. position
+ * problems.
+ */
+class FactorConstraintsPoints : public gtsam::NoiseModelFactor
+{
+   private:
+	using This = FactorConstraintsPoints;
+	using Base = gtsam::NoiseModelFactor;
+
+	AssembledRigidModel::Ptr arm_;
+	StateBlocks::Ptr blocks_;
+	size_t constraintIndex_ = 0;
+	std::vector<size_t> blockIdxs_;	 //!< The block of each key
+
+   public:
+	// shorthand for a smart pointer to a factor
+	using shared_ptr = std::shared_ptr<This>;
+
+	/** default constructor - only use for serialization */
+	FactorConstraintsPoints() = default;
+
+	/** Constructor, for constraint `constraintIndex` in
+	 * ModelTopology::constraints_ at timestep `timeStep`. The noise model
+	 * must have as many rows as the constraint. */
+	FactorConstraintsPoints(
+		const AssembledRigidModel::Ptr& arm, const StateBlocks::Ptr& blocks,
+		const gtsam::SharedNoiseModel& noiseModel, size_t constraintIndex,
+		size_t timeStep);
+
+	virtual ~FactorConstraintsPoints() override;
+
+	// @return a deep copy of this factor
+	virtual gtsam::NonlinearFactor::shared_ptr clone() const override;
+	/** implement functions needed for Testable */
+	/** print */
+	virtual void print(
+		const std::string& s, const gtsam::KeyFormatter& keyFormatter =
+								  gtsam::DefaultKeyFormatter) const override;
+
+	/** equals */
+	virtual bool equals(
+		const gtsam::NonlinearFactor& expected,
+		double tol = 1e-9) const override;
+
+	/** vector of errors */
+	gtsam::Vector unwhitenedError(
+		const gtsam::Values& x,
+		boost::optional<std::vector<gtsam::Matrix>&> H =
+			boost::none) const override;
+
+	size_t constraintIndex() const { return constraintIndex_; }
+
+   private:
+	/** Serialization function */
+	friend class boost::serialization::access;
+	template <class ARCHIVE>
+	void serialize(ARCHIVE& ar, const unsigned int /*version*/)
+	{
+#ifdef GTSAM_ENABLE_BOOST_SERIALIZATION
+		ar& boost::serialization::make_nvp(
+			"FactorConstraintsPoints",
+			boost::serialization::base_object<Base>(*this));
+#endif
+	}
+};
+
+/** Adds to `fg` one FactorConstraintsPoints per constraint of the model, for
+ * timestep `timeStep`.
+ *
+ * \param sigmaConstr Standard deviation of the constraint factors.
+ */
+void addConstraintFactors(
+	gtsam::NonlinearFactorGraph& fg, const AssembledRigidModel::Ptr& arm,
+	const StateBlocks::Ptr& blocks, size_t timeStep, double sigmaConstr);
+
+}  // namespace mbse
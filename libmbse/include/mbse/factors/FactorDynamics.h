@@ -35,6 +35,7 @@ class FactorDynamics
 	using Base = gtsam::NoiseModelFactor3<state_t, state_t, state_t>;
 
 	CDynamicSimulatorBase* dynamic_solver_ = nullptr;
+	bool numericJacobians_ = false;
 
    public:
 	// shorthand for a smart pointer to a factor
@@ -82,6 +83,14 @@ class FactorDynamics
 	/** number of variables attached to this factor */
 	std::size_t size() const { return 3; }
 
+	/** If enabled, the Jacobians wrt q_k and dq_k are estimated by finite
+	 * differences (2n extra solve_ddotq() calls each) instead of analytically.
+	 * Only intended to validate the analytic Jacobians. Default: false.
+	 * Formulations without CDynamicSimulatorBase::is_lagrange_kkt_solver()
+	 * always use finite differences. */
+	void setNumericJacobians(bool numeric) { numericJacobians_ = numeric; }
+	bool numericJacobians() const { return numericJacobians_; }
+
    private:
 	/** Serialization function */
 	friend class boost::serialization::access;
@@ -0,0 +1,88 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#pragma once
+
+#include <gtsam/nonlinear/FixedLagSmoother.h>
+#include <gtsam/nonlinear/LevenbergMarquardtParams.h>
+#include <gtsam/nonlinear/NonlinearFactorGraph.h>
+#include <gtsam/nonlinear/Values.h>
+
+namespace mbse
+{
+/** Incremental fixed-lag smoother over a sliding window of a factor graph.
+ *
+ * Each call to update() adds new factors and variables, marginalizes out
+ * the variables older than `lag` seconds (replacing all their factors by a
+ * linear Gaussian prior on the remaining variables), and re-optimizes the
+ * window with Levenberg-Marquardt, warm-started from the previous solution.
+ *
+ * Since the window only ever holds the variables and factors within the
+ * lag, the cost per update() does not grow with the length of the run.
+ */
+class SlidingWindowSmoother
+{
+   public:
+	using KeyTimestampMap = gtsam::FixedLagSmoother::KeyTimestampMap;
+
+	struct Parameters
+	{
+		Parameters();
+
+		/** Variables older than this (seconds) wrt the most recent one are
+		 * marginalized out */
+		double lag = 0.1;
+
+		/** Optimizer parameters for each update() */
+		gtsam::LevenbergMarquardtParams lm;
+	};
+
+	struct UpdateResult
+	{
+		double errorBefore = 0;	 //!< Window error before optimizing
+		double errorAfter = 0;	//!< Window error after optimizing
+		size_t iterations = 0;	//!< LM iterations
+		size_t numFactors = 0;	//!< Factors in the window (incl. priors)
+		size_t numMarginalized = 0;	 //!< Variables marginalized in this call
+	};
+
+	SlidingWindowSmoother() = default;
+	explicit SlidingWindowSmoother(const Parameters& p) : params(p) {}
+
+	Parameters params;
+
+	/** Adds new factors, and initial estimates and timestamps for the new
+	 * variables they involve, then marginalizes old variables and
+	 * optimizes the window. */
+	UpdateResult update(
+		const gtsam::NonlinearFactorGraph& newFactors,
+		const gtsam::Values& newValues, const KeyTimestampMap& newTimestamps);
+
+	/** Current estimate of all the variables in the window */
+	const gtsam::Values& calculateEstimate() const { return values_; }
+
+	/** All factors in the window, including marginal priors */
+	const gtsam::NonlinearFactorGraph& getFactors() const { return factors_; }
+
+	/** Timestamps of all the variables in the window */
+	const KeyTimestampMap& timestamps() const { return timestamps_; }
+
+   private:
+	gtsam::NonlinearFactorGraph factors_;
+	gtsam::Values values_;
+	KeyTimestampMap timestamps_;
+	double latestTime_ = 0;
+
+	/** Marginalizes out the variables older than the lag, returning how
+	 * many were removed. */
+	size_t marginalizeOldVariables();
+};
+
+}  // namespace mbse
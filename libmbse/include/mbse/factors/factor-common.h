@@ -12,10 +12,68 @@
 
 #include <gtsam/base/Vector.h>
 #include <gtsam/base/VectorSpace.h>
+#include <gtsam/inference/Key.h>
+#include <gtsam/nonlinear/Values.h>
+#include <mbse/ModelTopology.h>
 
 namespace mbse
 {
 /** Type for system internal states q_{k}, dq_{k}, ddq_{k} */
 using state_t = gtsam::Vector;
 
+/** A partition of the generalized coordinates "q" of a model into small
+ * blocks: one 2-vector (x,y) per non-fixed point, and one scalar per
+ * relative coordinate.
+ *
+ * Used to build factor graphs where each timestep "k" has one variable per
+ * block, instead of a single variable with the whole "q", so that factors
+ * only involve the points they actually depend on (see
+ * FactorConstraintsPoints). Block variables are of type state_t, with the
+ * block size (2 for points, 1 for relative coordinates).
+ *
+ * Variable keys are `gtsam::Symbol(symbolChar, k * numBlocks() + block)`.
+ */
+class StateBlocks
+{
+   public:
+	using Ptr = std::shared_ptr<const StateBlocks>;
+
+	StateBlocks(const ModelTopology& topology, unsigned char symbolChar = 'p');
+
+	/** Number of blocks per timestep */
+	size_t numBlocks() const { return blocks_.size(); }
+
+	/** Indices in "q" of the coordinates in the given block */
+	const std::vector<dof_index_t>& blockDOFs(size_t block) const
+	{
+		return blocks_.at(block);
+	}
+
+	/** The block that holds coordinate q[dof] */
+	size_t blockOfDOF(dof_index_t dof) const { return dof2block_.at(dof); }
+
+	/** The block variable key for the given timestep */
+	gtsam::Key key(size_t timeStep, size_t block) const;
+
+	/** Sorted list of the blocks referenced by the Jacobian rows of
+	 * constraint `constraintIndex` in ModelTopology::constraints_ */
+	std::vector<size_t> constraintBlocks(size_t constraintIndex) const
+	{
+		return constraintBlocks_.at(constraintIndex);
+	}
+
+	/** Splits "q" into block variables, inserted into `values` */
+	void insert(gtsam::Values& values, size_t timeStep, const state_t& q) const;
+
+	/** Rebuilds "q" from the block variables in `values`. `q` must already
+	 * have the full length, so that coordinates not in `values` are kept. */
+	void gather(const gtsam::Values& values, size_t timeStep, state_t& q) const;
+
+   private:
+	unsigned char symbolChar_;
+	std::vector<std::vector<dof_index_t>> blocks_;
+	std::vector<size_t> dof2block_;
+	std::vector<std::vector<size_t>> constraintBlocks_;
+};
+
 }  // namespace mbse
@@ -14,17 +14,21 @@
  * lib.
  */
 
+#include <algorithm>
 #include <variant>
+#include <vector>
 #include <memory>  // for auto_ptr
 #include <mrpt/poses/CPose3D.h>
 #include <mrpt/core/exceptions.h>
 #include <mrpt/img/TColor.h>
 #include <mrpt/system/CTimeLogger.h>
+#include <mbse/profiler.h>
 
 #include <Eigen/Dense>	// provided by MRPT or standalone
 #if EIGEN_VERSION_AT_LEAST(3, 1, 0)
 #include <Eigen/Sparse>
 #include <Eigen/UmfPackSupport>
+#include <Eigen/CholmodSupport>
 #else
 #error "This library needs Eigen 3.1.0 or newer!"
 #endif
@@ -34,6 +38,8 @@
 
 namespace mbse
 {
+/** Per-thread MRPT time logger, available for applications. The library
+ * itself is instrumented with the MBSE_PROFILE_*() macros (see profiler.h) */
 extern mrpt::system::CTimeLogger& timelog();
 
 using dof_index_t = std::size_t;
@@ -145,37 +151,173 @@ struct Point2ToDOF
 	Point2ToDOF() = default;
 };
 
+/** A sparse matrix in Compressed Row Storage (CRS) format, with contiguous
+ * `row_ptr`, `col_idx` and `values` arrays.
+ *
+ * The matrix has two phases:
+ *  - Build phase: rows are added with setRowCount() and the sparsity pattern
+ *    is defined with insertEntry() / bindEntry().
+ *  - Frozen phase: after freeze(), the pattern is fixed and only numeric
+ *    values may change. Entry indices handed out via bindEntry() remain
+ *    valid, also in copies of the matrix, since they share the pattern.
+ *
+ * Column indices within each row are sorted in increasing order.
+ */
 struct CompressedRowSparseMatrix
 {
-	using row_t = std::map<size_t, double>;
+	/** Index of the first entry of each row in `col_idx` and `values`.
+	 *  Row `r` spans `[row_ptr[r], row_ptr[r+1])`. Size: nrows+1 */
+	std::vector<std::size_t> row_ptr;
+	std::vector<std::size_t> col_idx;  //!< Column of each nonzero
+	std::vector<double> values;	 //!< Value of each nonzero
+
+	/** Defines the number of rows. Only in the build phase. */
+	void setRowCount(std::size_t n)
+	{
+		ASSERTMSG_(!frozen_, "Cannot add rows to a frozen sparse matrix");
+		build_cols_.resize(n);
+	}
+
+	std::size_t ncols = 0;	//!< The number of cols in a sparse matrix can be
+							//!< set freely by the user (we don't check for
+							//!< columns out of this limit anyway)
+
+	std::size_t getNumRows() const
+	{
+		return frozen_ ? row_ptr.size() - 1 : build_cols_.size();
+	}
+	std::size_t getNumCols() const { return ncols; }
+	std::size_t getNumNonZeros() const { return values.size(); }
+	bool isFrozen() const { return frozen_; }
+
+	/** Adds entry (row,col) to the sparsity pattern, if not already present.
+	 * Only in the build phase. */
+	void insertEntry(std::size_t row, std::size_t col)
+	{
+		ASSERTMSG_(!frozen_, "Cannot modify a frozen sparse matrix");
+		ASSERT_LT_(row, build_cols_.size());
+		auto& cols = build_cols_[row];
+		if (std::find(cols.begin(), cols.end(), col) == cols.end())
+			cols.push_back(col);
+	}
+
+	/** Like insertEntry(), and also requests `*target` to be set to the
+	 * index in `values` of entry (row,col) when freeze() is called.
+	 * The memory at `target` must remain valid until then. */
+	void bindEntry(std::size_t row, std::size_t col, std::size_t* target)
+	{
+		insertEntry(row, col);
+		*target = INVALID_ENTRY;
+		bindings_.push_back({row, col, target});
+	}
+
+	/** Sets the value of an entry, given its index in `values`. Does nothing
+	 * if `idx` is INVALID_ENTRY. */
+	void setEntry(std::size_t idx, double val)
+	{
+		if (idx != INVALID_ENTRY) values[idx] = val;
+	}
 
-	/** Important: Use deque<> to avoid mem reallocations since we use
-	 * *pointers* to elements inside here */
-	std::deque<row_t> matrix;
+	static constexpr std::size_t INVALID_ENTRY = static_cast<std::size_t>(-1);
 
-	/** Defines the number of rows. */
-	void setRowCount(size_t n) { matrix.resize(n); }
+	/** Ends the build phase: builds the CRS arrays, zeroes all values and
+	 * resolves all pending bindEntry() requests. */
+	void freeze()
+	{
+		ASSERTMSG_(!frozen_, "Sparse matrix is already frozen");
+		const std::size_t nrows = build_cols_.size();
+		row_ptr.assign(nrows + 1, 0);
+		for (std::size_t r = 0; r < nrows; r++)
+			row_ptr[r + 1] = row_ptr[r] + build_cols_[r].size();
 
-	size_t ncols;  //!< The number of cols in a sparse matrix can be set freely
-				   //!< by the user (we don't check for columns out of this
-				   //!< limit anyway)
+		col_idx.resize(row_ptr[nrows]);
+		for (std::size_t r = 0; r < nrows; r++)
+		{
+			auto& cols = build_cols_[r];
+			std::sort(cols.begin(), cols.end());
+			std::copy(cols.begin(), cols.end(), col_idx.begin() + row_ptr[r]);
+		}
+		values.assign(col_idx.size(), 0.0);
+		frozen_ = true;
 
-	size_t getNumRows() const { return matrix.size(); }
-	size_t getNumCols() const { return ncols; }
+		for (const auto& b : bindings_) *b.target = entryIndex(b.row, b.col);
+
+		build_cols_.clear();
+		build_cols_.shrink_to_fit();
+		bindings_.clear();
+		bindings_.shrink_to_fit();
+	}
+
+	/** Returns the index in `col_idx` and `values` of entry (row,col), which
+	 * must exist in the frozen sparsity pattern. */
+	std::size_t entryIndex(std::size_t row, std::size_t col) const
+	{
+		ASSERT_(frozen_);
+		const auto itBeg = col_idx.begin() + row_ptr[row];
+		const auto itEnd = col_idx.begin() + row_ptr[row + 1];
+		const auto it = std::lower_bound(itBeg, itEnd, col);
+		ASSERTMSG_(
+			it != itEnd && *it == col,
+			"Entry not present in the sparse matrix pattern");
+		return static_cast<std::size_t>(it - col_idx.begin());
+	}
+
+	/** Returns the dot product of row `row` with the dense vector `x`, which
+	 * must have getNumCols() entries. Does not allocate memory. */
+	double rowDot(std::size_t row, const double* x) const
+	{
+		double r = 0;
+		for (std::size_t k = row_ptr[row]; k < row_ptr[row + 1]; k++)
+			r += values[k] * x[col_idx[k]];
+		return r;
+	}
+
+	/** Sparse matrix-vector product: y = A * x. `y` must have getNumRows()
+	 * entries. Does not allocate memory. */
+	void multiply(const double* x, double* y) const
+	{
+		const std::size_t nrows = getNumRows();
+		for (std::size_t row = 0; row < nrows; row++) y[row] = rowDot(row, x);
+	}
+
+	/** Transposed sparse matrix-vector product: y += A^T * x. `y` must have
+	 * getNumCols() entries. Does not allocate memory. */
+	void multiplyTransposedAdd(const double* x, double* y) const
+	{
+		const std::size_t nrows = getNumRows();
+		for (std::size_t row = 0; row < nrows; row++)
+			for (std::size_t k = row_ptr[row]; k < row_ptr[row + 1]; k++)
+				y[col_idx[k]] += values[k] * x[row];
+	}
+
+	/** Adds `scale * A` to the dense matrix or block `M`, which must have
+	 * (at least) getNumRows() x getNumCols() entries. Only the nonzeros are
+	 * visited, without temporaries. */
+	template <class MATRIX>
+	void addToDense(MATRIX&& M, double scale = 1.0) const
+	{
+		ASSERT_(frozen_);
+		const std::size_t nrows = getNumRows();
+		for (std::size_t row = 0; row < nrows; row++)
+			for (std::size_t k = row_ptr[row]; k < row_ptr[row + 1]; k++)
+				M(row, col_idx[k]) += scale * values[k];
+	}
 
 	/** Create a dense version of this sparse matrix */
 	template <class MATRIX>
 	void asDense(MATRIX& M) const
 	{
+		ASSERT_(frozen_);
 		ASSERT_GT_(getNumRows(), 0U);
 		ASSERT_GT_(getNumCols(), 0U);
 		M.resize(getNumRows(), getNumCols());
 		M.fill(0);
-		for (size_t row = 0; row < matrix.size(); row++)
-			for (const auto& row_val : matrix[row])
+		const std::size_t nrows = getNumRows();
+		for (std::size_t row = 0; row < nrows; row++)
+			for (std::size_t k = row_ptr[row]; k < row_ptr[row + 1]; k++)
 			{
-				ASSERT_LT_(row_val.first, ncols);
-				M(row, row_val.first) = row_val.second;
+				ASSERT_LT_(col_idx[k], ncols);
+				M(row, col_idx[k]) = values[k];
 			}
 	}
 
@@ -187,6 +329,19 @@ struct CompressedRowSparseMatrix
 		asDense(m);
 		return m;
 	}
+
+   private:
+	struct PendingBinding
+	{
+		std::size_t row, col;
+		std::size_t* target;
+	};
+
+	bool frozen_ = false;
+	/** Build phase only: column indices of each row */
+	std::vector<std::vector<std::size_t>> build_cols_;
+	/** Build phase only: pending bindEntry() requests */
+	std::vector<PendingBinding> bindings_;
 };
 
 }  // namespace mbse
@@ -88,6 +88,23 @@ bool save_matrix(cholmod_sparse* tri, const char* filename, cholmod_common* c);
 bool save_matrix_dense(
 	cholmod_sparse* tri, const char* filename, cholmod_common* c);
 
+/** Returns a pointer to the (existing) entry (row,col) in the values of a
+ * compressed sparse matrix. Used to precompute where to scatter updated
+ * numeric values, so the matrix can be updated in place without rebuilding
+ * it from triplets. */
+double* ccs_entry_ptr(Eigen::SparseMatrix<double>& A, int row, int col);
+
+/** KLU numeric factorization of A, reusing the pivoting of a previous one
+ * (if `numeric` is not null) with the cheaper klu_refactor(). A full
+ * klu_factor() is only done if there is no previous factorization, or if
+ * the reciprocal condition estimate (left in common.rcond) drops below
+ * `min_rcond`.
+ * \return false if the matrix is singular.
+ */
+bool klu_factor_or_refactor(
+	Eigen::SparseMatrix<double>& A, klu_symbolic* symbolic,
+	klu_numeric*& numeric, klu_common& common, double min_rcond = 1e-12);
+
 template <typename T, class MATRIX>
 void insert_submatrix(
 	Eigen::SparseMatrix<T>& A, const size_t row, const size_t col,
@@ -174,6 +191,18 @@ void overwrite_subset(
 		v(idxsToOverwrite[i]) = subvector(i);
 }
 
+/** Adds `scale` at (i, indCoordsIndices[i]) of the dense matrix or block
+ * `M`, i.e. `M += scale * selector_matrix(indCoordsIndices, n)` without
+ * building the (mostly zeros) selector matrix. */
+template <class MATRIX>
+void add_selector_matrix(
+	MATRIX&& M, const std::vector<size_t>& indCoordsIndices,
+	double scale = 1.0)
+{
+	for (size_t i = 0; i < indCoordsIndices.size(); i++)
+		M(i, indCoordsIndices[i]) += scale;
+}
+
 /** Builds the selector, boolean (1s and 0s) matrix of independent indices. See
  * paper, sect. 6.7. */
 template <typename MATRIX = Eigen::MatrixXd>
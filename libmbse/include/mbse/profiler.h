@@ -0,0 +1,180 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#pragma once
+
+/** \file Lightweight scoped profiler for the hot paths of the library.
+ *
+ * Scopes are identified by small integer IDs, registered once per call site
+ * (the string name is only hashed the first time a site runs). Each thread
+ * accumulates its statistics in its own slots, so recording never takes a
+ * lock. Collected data can be exported as JSON or as a Chrome trace
+ * (chrome://tracing, Perfetto).
+ *
+ * Use the MBSE_PROFILE_*() macros; they expand to nothing when the library
+ * is built with `MBSE_WITH_PROFILER=OFF`. At runtime, recording can be
+ * toggled with profiler::enable().
+ */
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace mbse::profiler
+{
+using scope_id_t = uint16_t;
+
+/** Maximum number of distinct scope names */
+constexpr scope_id_t MAX_SCOPES = 512;
+
+enum class ScopeKind : uint8_t
+{
+	Time = 0,  //!< enter()/leave() pairs, statistics in seconds
+	Value  //!< Arbitrary values passed to recordValue()
+};
+
+/** Returns the ID for a scope name, registering it the first time.
+ * Thread-safe, but slow: call it once per call site (the macros do so). */
+scope_id_t registerScope(const char* name, ScopeKind kind = ScopeKind::Time);
+
+/** Enables/disables recording at runtime (default: enabled) */
+void enable(bool enabled = true);
+bool isEnabled();
+
+void enter(scope_id_t id);
+void leave(scope_id_t id);
+void recordValue(scope_id_t id, double value);
+
+/** Number of trace events kept per thread for exportChromeTrace().
+ * Default: 0 (tracing disabled, only aggregated statistics). Set it before
+ * running the code to be profiled. */
+void setTraceCapacity(std::size_t maxEventsPerThread);
+
+/** Aggregated statistics of one scope, merged over all threads */
+struct ScopeStats
+{
+	std::string name;
+	ScopeKind kind = ScopeKind::Time;
+	uint64_t count = 0;
+	double total = 0, min = 0, max = 0;
+
+	double mean() const { return count ? total / count : 0; }
+};
+
+/** Merges the statistics of all threads, skipping never-run scopes */
+std::vector<ScopeStats> collectStats();
+
+/** Statistics of one scope by name (all zeros if it never ran) */
+ScopeStats getStats(const std::string& name);
+
+/** Resets all statistics and trace events. Do not call it while profiled
+ * code is running in other threads. */
+void clear();
+
+/** Writes a human-readable table of collectStats() */
+void printStats(std::ostream& o);
+
+/** Writes collectStats() as a JSON document */
+void exportJSON(std::ostream& o);
+
+/** Writes recorded events in the Chrome "Trace Event Format" (JSON). */
+void exportChromeTrace(std::ostream& o);
+
+/** RAII helper: enter() on construction, leave() on destruction or stop() */
+class Scope
+{
+   public:
+	explicit Scope(scope_id_t id) : id_(id) { enter(id_); }
+	~Scope() { stop(); }
+
+	void stop()
+	{
+		if (running_) leave(id_);
+		running_ = false;
+	}
+
+	Scope(const Scope&) = delete;
+	Scope& operator=(const Scope&) = delete;
+
+   private:
+	scope_id_t id_;
+	bool running_ = true;
+};
+
+/** Placeholder for Scope when the profiler is compiled out */
+struct NullScope
+{
+	void stop() {}
+};
+
+}  // namespace mbse::profiler
+
+#define MBSE_PROFILE_CONCAT_(a, b) a##b
+#define MBSE_PROFILE_CONCAT(a, b) MBSE_PROFILE_CONCAT_(a, b)
+
+#if defined(SPARSEMBS_HAVE_PROFILER)
+
+#define MBSE_PROFILE_ID_(NAME, KIND)                                    \
+	[]() {                                                              \
+		static const ::mbse::profiler::scope_id_t mbse_prof_id_ =       \
+			::mbse::profiler::registerScope(NAME, KIND);                \
+		return mbse_prof_id_;                                           \
+	}()
+
+/** Starts timing the named scope (a string literal) */
+#define MBSE_PROFILE_ENTER(NAME) \
+	::mbse::profiler::enter(     \
+		MBSE_PROFILE_ID_(NAME, ::mbse::profiler::ScopeKind::Time))
+
+/** Stops timing the named scope */
+#define MBSE_PROFILE_LEAVE(NAME) \
+	::mbse::profiler::leave(     \
+		MBSE_PROFILE_ID_(NAME, ::mbse::profiler::ScopeKind::Time))
+
+/** Times the rest of the enclosing block */
+#define MBSE_PROFILE_SCOPE(NAME)                                    \
+	::mbse::profiler::Scope MBSE_PROFILE_CONCAT(                    \
+		mbse_prof_scope_, __LINE__)(                                \
+		MBSE_PROFILE_ID_(NAME, ::mbse::profiler::ScopeKind::Time))
+
+/** Like MBSE_PROFILE_SCOPE(), with a named variable to call stop() on */
+#define MBSE_PROFILE_SCOPE_VAR(VAR, NAME) \
+	::mbse::profiler::Scope VAR(          \
+		MBSE_PROFILE_ID_(NAME, ::mbse::profiler::ScopeKind::Time))
+
+/** Accumulates statistics of an arbitrary value (e.g. iteration counts) */
+#define MBSE_PROFILE_VALUE(NAME, VALUE)                               \
+	::mbse::profiler::recordValue(                                    \
+		MBSE_PROFILE_ID_(NAME, ::mbse::profiler::ScopeKind::Value),   \
+		static_cast<double>(VALUE))
+
+#else
+
+#define MBSE_PROFILE_ENTER(NAME) \
+	do                           \
+	{                            \
+	} while (0)
+#define MBSE_PROFILE_LEAVE(NAME) \
+	do                           \
+	{                            \
+	} while (0)
+#define MBSE_PROFILE_SCOPE(NAME) \
+	do                           \
+	{                            \
+	} while (0)
+#define MBSE_PROFILE_SCOPE_VAR(VAR, NAME) ::mbse::profiler::NullScope VAR
+#define MBSE_PROFILE_VALUE(NAME, VALUE) \
+	do                                  \
+	{                                   \
+		(void)(VALUE);                  \
+	} while (0)
+
+#endif
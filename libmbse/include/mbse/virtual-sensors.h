@@ -16,6 +16,8 @@
 
 namespace mbse
 {
+struct ParticleBatch;  // in MultiBodyParticleFilter.h
+
 /** Base of all types of virtual sensors */
 class CVirtualSensor
 {
@@ -27,6 +29,15 @@ class CVirtualSensor
 	virtual double simulate_reading(
 		const AssembledRigidModel& mb_state) const = 0;
 
+	/** Simulates the readings of this sensor for all the particles in a
+	 * batch, storing the prediction for particle `i` in `out[i]`, which must
+	 * have `particles.size()` entries.
+	 * The default implementation loads each particle into a model and calls
+	 * simulate_reading(). Sensors override it to work directly on the
+	 * contiguous particle states. */
+	virtual void simulate_readings(
+		const ParticleBatch& particles, Eigen::Ref<Eigen::VectorXd> out) const;
+
 	/** Returns the log-likelihhod of the given read value for the current
 	 * mechanism state */
 	double evaluate_log_likelihood(
@@ -38,6 +49,12 @@ class CVirtualSensor
 				   (sensor_reading - sensor_prediction) / sensor_noise_std);
 	}
 
+	/** Batch version of evaluate_log_likelihood(): `out[i]` is the
+	 * log-likelihood of `sensor_reading` for particle `i` */
+	void evaluate_log_likelihoods(
+		const double sensor_reading, const ParticleBatch& particles,
+		Eigen::Ref<Eigen::VectorXd> out) const;
+
 	/** One standard deviation (1sigma) of the sensor Gaussian noise model
 	 * (units are sensor-specific) */
 	double sensor_noise_std;
@@ -56,6 +73,12 @@ class CVirtualSensor_Gyro : public CVirtualSensor
 	virtual double simulate_reading(
 		const AssembledRigidModel& mb_state) const override;
 
+	/** Vectorized over particles: the coordinates of the two body points are
+	 * gathered into contiguous arrays first. */
+	void simulate_readings(
+		const ParticleBatch& particles,
+		Eigen::Ref<Eigen::VectorXd> out) const override;
+
 	CVirtualSensor_Gyro(const size_t body_idx) : body_idx_(body_idx) {}
 
    protected:
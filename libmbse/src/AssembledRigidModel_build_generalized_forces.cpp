@@ -30,47 +30,59 @@ void AssembledRigidModel::builGeneralizedForces(Eigen::VectorXd& Q) const
 -------------------------------------------------------------------*/
 void AssembledRigidModel::builGeneralizedForces(double* q) const
 {
-	timelog().enter("builGeneralizedForces");
-
 	const size_t nDOFs = q_.size();
+	check_constant_forces();
+
+	// External forces:
+	// --------------------------------
+	ASSERT_EQUAL_(static_cast<size_t>(Q_.rows()), nDOFs);
+
 	Eigen::Map<Eigen::VectorXd> Q(q, nDOFs);
-	Q.setZero();
+	Q = Q_const_ + Q_;
+}
+
+void AssembledRigidModel::builGeneralizedForces(
+	const std::vector<dof_index_t>& dofs, double* Q) const
+{
+	check_constant_forces();
+	ASSERT_EQUAL_(Q_.rows(), Q_const_.rows());
+
+	for (size_t i = 0; i < dofs.size(); i++)
+		Q[i] = Q_const_[dofs[i]] + Q_[dofs[i]];
+}
+
+void AssembledRigidModel::check_constant_forces() const
+{
+	if (!Q_const_valid_ || Q_const_.size() != q_.size() ||
+		Q_const_bodies_revision_ != mechanism_.bodies_revision())
+		internal_update_constant_forces();
+}
+
+/* -------------------------------------------------------------------
+				  internal_update_constant_forces
+-------------------------------------------------------------------*/
+void AssembledRigidModel::internal_update_constant_forces() const
+{
+	MBSE_PROFILE_ENTER("builGeneralizedForces.constant");
+
+	const size_t nDOFs = q_.size();
+	Q_const_.setZero(nDOFs);
+	Q_const_bodies_revision_ = mechanism_.bodies_revision();
 
 	// Gravity force:
 	// --------------------------------
 	// For each body:
 	for (const Body& body : mechanism_.bodies())
 	{
-		// Compute the body local coordinates (a,b) of the point at
-		// where the force is applied:
-		TPoint2D force_local_point;
-
 		const Point2& p0_info = mechanism_.getPointInfo(body.points[0]);
 		const Point2& p1_info = mechanism_.getPointInfo(body.points[1]);
 
 		const Point2ToDOF& p0_dofs = points2DOFs_[body.points[0]];
 		const Point2ToDOF& p1_dofs = points2DOFs_[body.points[1]];
 
-		if (0)
-		{
-			// Get the current global coordinates of the body points:
-			const TPoint2D p0(
-				(p0_dofs.dof_x != INVALID_DOF) ? q_[p0_dofs.dof_x]
-											   : p0_info.coords.x,
-				(p0_dofs.dof_y != INVALID_DOF) ? q_[p0_dofs.dof_y]
-											   : p0_info.coords.y);
-			const TPoint2D p1(
-				(p1_dofs.dof_x != INVALID_DOF) ? q_[p1_dofs.dof_x]
-											   : p1_info.coords.x,
-				(p1_dofs.dof_y != INVALID_DOF) ? q_[p1_dofs.dof_y]
-											   : p1_info.coords.y);
-		}
-		else
-		{
-			// Gravity force is always applied at the cog, whose coordinates are
-			// ALREADY stored as LOCAL COORDINATES:
-			force_local_point = body.cog();
-		}
+		// Gravity force is always applied at the cog, whose coordinates are
+		// ALREADY stored as LOCAL COORDINATES:
+		const TPoint2D force_local_point = body.cog();
 
 		// Cp matrix. Eq. (62), pag. 105 from J. Cuadrado's manual.
 		const double a = force_local_point.x;
@@ -98,15 +110,11 @@ void AssembledRigidModel::builGeneralizedForces(double* q) const
 			p0_dofs.dof_x;	// Will be INVALID_DOF if it's a fixed point
 		const dof_index_t idx_x1 = p1_dofs.dof_x;
 
-		if (!p0_fixed) Q.segment<2>(idx_x0) += Qi.head<2>();
-		if (!p1_fixed) Q.segment<2>(idx_x1) += Qi.tail<2>();
+		if (!p0_fixed) Q_const_.segment<2>(idx_x0) += Qi.head<2>();
+		if (!p1_fixed) Q_const_.segment<2>(idx_x1) += Qi.tail<2>();
 	}
 
-	// External forces:
-	// --------------------------------
-	ASSERT_EQUAL_(Q.rows(), Q_.rows());
-	ASSERT_EQUAL_(Q.cols(), Q_.cols());
-	Q += Q_;
+	Q_const_valid_ = true;
 
-	timelog().leave("builGeneralizedForces");
+	MBSE_PROFILE_LEAVE("builGeneralizedForces.constant");
 }
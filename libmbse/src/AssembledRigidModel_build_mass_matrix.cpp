@@ -25,8 +25,7 @@ using namespace std;
 cholmod_triplet* AssembledRigidModel::buildMassMatrix_sparse_CHOLMOD(
 	cholmod_common& c) const
 {
-	const auto tle = mrpt::system::CTimeLoggerEntry(
-		timelog(), "buildMassMatrix_sparse_CHOLMOD");
+	MBSE_PROFILE_SCOPE("buildMassMatrix_sparse_CHOLMOD");
 
 	const size_t nDOFs = q_.size();
 	const size_t nConstr = Phi_.size();
@@ -38,7 +37,7 @@ cholmod_triplet* AssembledRigidModel::buildMassMatrix_sparse_CHOLMOD(
 	const int stype = 1;  // Symmetric, stored in upper triangular only.
 
 	// Build in triplet form:
-	timelog().enter("buildMassMatrix_sparse_CHOLMOD.triplet");
+	MBSE_PROFILE_ENTER("buildMassMatrix_sparse_CHOLMOD.triplet");
 
 	cholmod_triplet* triplet_M = cholmod_allocate_triplet(
 		nDOFs, nDOFs, estimated_nnz, stype, CHOLMOD_REAL, &c);
@@ -69,12 +68,12 @@ cholmod_triplet* AssembledRigidModel::buildMassMatrix_sparse_CHOLMOD(
 
 	}  // end for each body
 
-	timelog().leave("buildMassMatrix_sparse_CHOLMOD.triplet");
+	MBSE_PROFILE_LEAVE("buildMassMatrix_sparse_CHOLMOD.triplet");
 
 	// Convert to compressed form:
-	// timelog().enter("buildMassMatrix_sparse_CHOLMOD.ccs");
+	// MBSE_PROFILE_ENTER("buildMassMatrix_sparse_CHOLMOD.ccs");
 	// cholmod_sparse *M = cholmod_triplet_to_sparse(triplet_M, triplet_M->nnz,
-	// &c); timelog().leave("buildMassMatrix_sparse_CHOLMOD.ccs"); ASSERT_(M)
+	// &c); MBSE_PROFILE_LEAVE("buildMassMatrix_sparse_CHOLMOD.ccs"); ASSERT_(M)
 	// cholmod_free_triplet(&triplet_M, &c); // Free triplet form
 
 	return triplet_M;
@@ -85,8 +84,7 @@ cholmod_triplet* AssembledRigidModel::buildMassMatrix_sparse_CHOLMOD(
 -------------------------------------------------------------------*/
 Eigen::MatrixXd AssembledRigidModel::buildMassMatrix_dense() const
 {
-	const auto tle =
-		mrpt::system::CTimeLoggerEntry(timelog(), "buildMassMatrix_dense");
+	MBSE_PROFILE_SCOPE("buildMassMatrix_dense");
 
 	Eigen::MatrixXd M;
 
@@ -133,8 +131,7 @@ Eigen::MatrixXd AssembledRigidModel::buildMassMatrix_dense() const
 std::vector<Eigen::Triplet<double>>
 	AssembledRigidModel::buildMassMatrix_sparse() const
 {
-	const auto tle =
-		mrpt::system::CTimeLoggerEntry(timelog(), "buildMassMatrix_sparse");
+	MBSE_PROFILE_SCOPE("buildMassMatrix_sparse");
 
 	std::vector<Eigen::Triplet<double>> tri;
 
@@ -9,8 +9,6 @@
   +-------------------------------------------------------------------------+ */
 
 #include <mbse/AssembledRigidModel.h>
-#include <mbse/constraints/ConstraintRelativeAngle.h>
-#include <mbse/constraints/ConstraintRelativeAngleAbsolute.h>
 #include <mrpt/opengl.h>
 #include <iostream>
 
@@ -24,126 +22,21 @@ const double DEFAULT_GRAVITY[3] = {0, -9.81, 0};
 
 /** Constructor */
 AssembledRigidModel::AssembledRigidModel(const TSymbolicAssembledModel& armi)
-	: mechanism_(armi.model)
+	: AssembledRigidModel(std::make_shared<const ModelTopology>(armi))
 {
-	for (int i = 0; i < 3; i++) gravity_[i] = DEFAULT_GRAVITY[i];
-
-	const auto nEuclideanDOFs = armi.DOFs.size();
-	const auto nRelativeDOFs = armi.rDOFs.size();
-
-	const auto nDOFs = nEuclideanDOFs + nRelativeDOFs;
-
-	ASSERTMSG_(
-		nEuclideanDOFs > 0,
-		"Trying to assemble model with 0 Natural Coordinate DOFs");
-
-	q_.setZero(nDOFs);
-	dotq_.setZero(nDOFs);
-	ddotq_.setZero(nDOFs);
-	Q_.setZero(nDOFs);
-
-	// Keep a copy of DOF info:
-	DOFs_ = armi.DOFs;
-	rDOFs_ = armi.rDOFs;
-
-	// Build reverse-lookup table & initialize initial values for "q":
-	points2DOFs_.resize(armi.model.getPointCount());
-
-	for (dof_index_t i = 0; i < nEuclideanDOFs; i++)
-	{
-		const size_t pt_idx = DOFs_.at(i).point_index;
-		const Point2& pt = mechanism_.getPointInfo(pt_idx);
-		switch (DOFs_.at(i).point_dof)
-		{
-			case PointDOF::X:
-				q_[i] = pt.coords.x;
-				points2DOFs_.at(pt_idx).dof_x = i;
-				break;
-			case PointDOF::Y:
-				q_[i] = pt.coords.y;
-				points2DOFs_.at(pt_idx).dof_y = i;
-				break;
-			// case 2: //z
-			//	q_[i] = pt.coords.z;
-			//	break;
-			default:
-				THROW_EXCEPTION("Unexpected value for DOFs_[i].point_dof");
-		};
-	}
-
-	// Save the number of DOFs as the number of columsn in sparse Jacobians:
-	defineSparseMatricesColumnCount(nDOFs);
-
-	// Generate constraint equations & create structure of sparse Jacobians:
-	// ----------------------------------------------------------------------
-	const std::vector<ConstraintBase::Ptr>& parent_constraints =
-		mechanism_.constraints();
-
-	// 1/2: Constraints
-	const size_t nConst = parent_constraints.size();
-	constraints_.resize(nConst);
-	for (size_t i = 0; i < nConst; i++)
-	{
-		constraints_[i] = parent_constraints[i]->clone();
-	}
-
-	// 2/2: Constraints from relative coordinates:
-	relCoordinate2Index_.resize(rDOFs_.size());
-	for (size_t i = 0; i < rDOFs_.size(); i++)
-	{
-		const auto& relConstr = rDOFs_[i];
-		const dof_index_t idxInQ = nEuclideanDOFs + i;
-
-		if (std::holds_alternative<RelativeAngleDOF>(relConstr))
-		{
-			const auto& c = std::get<RelativeAngleDOF>(relConstr);
-
-			// Add constraint:
-			auto co = std::make_shared<ConstraintRelativeAngle>(
-				c.point_idx0, c.point_idx1, c.point_idx2, idxInQ);
-			constraints_.push_back(co);
-
-			// reverse look up table:
-			relCoordinate2Index_[i] = idxInQ;
-		}
-		else if (std::holds_alternative<RelativeAngleAbsoluteDOF>(relConstr))
-		{
-			const auto& c = std::get<RelativeAngleAbsoluteDOF>(relConstr);
-
-			// Add constraint:
-			auto co = std::make_shared<ConstraintRelativeAngleAbsolute>(
-				c.point_idx0, c.point_idx1, idxInQ);
-			constraints_.push_back(co);
-
-			// reverse look up table:
-			relCoordinate2Index_[i] = idxInQ;
-
-			// Initial value from coordinates:
-			const auto pt0 = getPointCurrentCoords(c.point_idx0);
-			const auto pt1 = getPointCurrentCoords(c.point_idx1);
-			const auto ptV = pt1 - pt0;
-			if (ptV.norm() != 0)
-			{
-				auto expectedAng = std::atan2(ptV.y, ptV.x);
-				if (std::abs(q_[idxInQ] - expectedAng) > 0.01)
-				{
-					printf(
-						"*WARNING* RelativeAngleAbsoluteDOF at q[%i]=%f deg: "
-						"Overriding with angle from coordinates = %f deg.\n",
-						static_cast<int>(idxInQ), mrpt::RAD2DEG(q_[idxInQ]),
-						mrpt::RAD2DEG(expectedAng));
-					q_[idxInQ] = expectedAng;
-				}
-			}
-		}
-		else
-		{
-			THROW_EXCEPTION("Unknown type of relative coordinate");
-		}
-	}
+}
 
-	// Final step: build structures
-	for (auto& c : constraints_) c->buildSparseStructures(*this);
+AssembledRigidModel::AssembledRigidModel(const ModelTopology::Ptr& topology)
+	: ModelState(*topology),
+	  topology_(topology),
+	  mechanism_(topology->mechanism_),
+	  DOFs_(topology->DOFs_),
+	  points2DOFs_(topology->points2DOFs_),
+	  rDOFs_(topology->rDOFs_),
+	  relCoordinate2Index_(topology->relCoordinate2Index_),
+	  constraints_(topology->constraints_)
+{
+	for (int i = 0; i < 3; i++) gravity_[i] = DEFAULT_GRAVITY[i];
 }
 
 void AssembledRigidModel::getGravityVector(
@@ -160,22 +53,19 @@ void AssembledRigidModel::setGravityVector(
 	gravity_[0] = gx;
 	gravity_[1] = gy;
 	gravity_[2] = gz;
+	Q_const_valid_ = false;
 }
 
 /** Call all constraint objects and command them to update their corresponding
  * parts in the sparse Jacobians */
 void AssembledRigidModel::update_numeric_Phi_and_Jacobians()
 {
-	// Update numeric values of the constraint Jacobians:
-	for (size_t i = 0; i < constraints_.size(); i++)
-		constraints_[i]->update(*this);
+	topology_->update_numeric_Phi_and_Jacobians(*this);
 }
 
-void AssembledRigidModel::realize_operating_point() const
+void AssembledRigidModel::realize_operating_point()
 {
-	// Update numeric values of the constraint Jacobians:
-	for (size_t i = 0; i < constraints_.size(); i++)
-		constraints_[i]->realizeOperatingPoint(*this);
+	topology_->realize_operating_point(*this);
 }
 
 /** Returns a 3D visualization of the model */
@@ -298,14 +188,6 @@ void AssembledRigidModel::update3DRepresentation(
 	}
 }
 
-size_t AssembledRigidModel::addNewRowToConstraints()
-{
-	const size_t idx = Phi_.size();
-	const size_t m = idx + 1;  // new size
-	resizeConstraintCount(m);
-	return idx;
-}
-
 /** Only to be called between objects created from the same symbolic model, this
  * method replicates the state of "o" into "this". */
 void AssembledRigidModel::copyStateFrom(const AssembledRigidModel& o)
@@ -322,6 +204,10 @@ void AssembledRigidModel::copyStateFrom(const AssembledRigidModel& o)
 
 	this->q_ = o.q_;
 	this->dotq_ = o.dotq_;
+	this->operatingPointFlags_ = o.operatingPointFlags_;
+
+	// The cached factorizations belong to the previous state:
+	projector_.invalidate();
 
 #ifdef _DEBUG
 	ASSERT_(
@@ -420,7 +306,7 @@ mrpt::opengl::CSetOfObjects::Ptr
 void AssembledRigidModel::evaluateEnergy(
 	AssembledRigidModel::TEnergyValues& e) const
 {
-	timelog().enter("evaluateEnergy");
+	MBSE_PROFILE_ENTER("evaluateEnergy");
 
 	e = TEnergyValues();  // Reset to zero
 
@@ -458,7 +344,7 @@ void AssembledRigidModel::evaluateEnergy(
 
 	e.E_total = e.E_kin + e.E_pot;
 
-	timelog().leave("evaluateEnergy");
+	MBSE_PROFILE_LEAVE("evaluateEnergy");
 }
 
 void AssembledRigidModel::printCoordinates(std::ostream& o) const
@@ -0,0 +1,170 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include <mbse/DependentCoordinatesSolver.h>
+#include <mbse/mbse-utils.h>
+
+using namespace mbse;
+
+DependentCoordinatesSolver::DependentCoordinatesSolver()
+{
+	klu_defaults(&common_);
+}
+
+DependentCoordinatesSolver::~DependentCoordinatesSolver() { clear(); }
+
+DependentCoordinatesSolver::DependentCoordinatesSolver(
+	const DependentCoordinatesSolver&)
+	: DependentCoordinatesSolver()
+{
+}
+
+DependentCoordinatesSolver& DependentCoordinatesSolver::operator=(
+	const DependentCoordinatesSolver&)
+{
+	clear();
+	return *this;
+}
+
+void DependentCoordinatesSolver::clear()
+{
+	if (numeric_) klu_free_numeric(&numeric_, &common_);
+	if (symbolic_) klu_free_symbolic(&symbolic_, &common_);
+	z_indices_.clear();
+	idxs_d_.clear();
+	crs2ccs_.clear();
+	factorized_ = false;
+}
+
+void DependentCoordinatesSolver::setIndependentCoordinates(
+	const CompressedRowSparseMatrix& Phi_q,
+	const std::vector<size_t>& z_indices)
+{
+	if (!crs2ccs_.empty() && z_indices == z_indices_) return;
+
+	clear();
+	z_indices_ = z_indices;
+
+	const size_t nCoords = Phi_q.getNumCols();
+	const size_t nConstraints = Phi_q.getNumRows();
+
+	// Column in Phi_d of each coordinate, or -1 if independent:
+	std::vector<int> dep_col(nCoords, 0);
+	for (const size_t z : z_indices) dep_col.at(z) = -1;
+
+	idxs_d_.reserve(nCoords - z_indices.size());
+	for (size_t i = 0; i < nCoords; i++)
+	{
+		if (dep_col[i] < 0) continue;
+		dep_col[i] = static_cast<int>(idxs_d_.size());
+		idxs_d_.push_back(i);
+	}
+
+	// Sparsity pattern of Phi_d:
+	std::vector<Eigen::Triplet<double>> tri;
+	tri.reserve(Phi_q.getNumNonZeros());
+	for (size_t r = 0; r < nConstraints; r++)
+		for (size_t k = Phi_q.row_ptr[r]; k < Phi_q.row_ptr[r + 1]; k++)
+			if (const int c = dep_col[Phi_q.col_idx[k]]; c >= 0)
+				tri.emplace_back(r, c, 0.0);
+
+	Phi_d_.resize(nConstraints, idxs_d_.size());
+	Phi_d_.setFromTriplets(tri.begin(), tri.end());
+
+	crs2ccs_.assign(Phi_q.getNumNonZeros(), -1);
+	for (size_t r = 0; r < nConstraints; r++)
+	{
+		for (size_t k = Phi_q.row_ptr[r]; k < Phi_q.row_ptr[r + 1]; k++)
+		{
+			const int c = dep_col[Phi_q.col_idx[k]];
+			if (c < 0) continue;
+			const int* rows = Phi_d_.innerIndexPtr();
+			const int* it = std::lower_bound(
+				rows + Phi_d_.outerIndexPtr()[c],
+				rows + Phi_d_.outerIndexPtr()[c + 1], static_cast<int>(r));
+			crs2ccs_[k] = static_cast<int>(it - rows);
+		}
+	}
+
+	sparse_ = (nConstraints == idxs_d_.size()) && nConstraints > 0;
+	if (sparse_)
+	{
+		symbolic_ = klu_analyze(
+			Phi_d_.rows(), Phi_d_.outerIndexPtr(), Phi_d_.innerIndexPtr(),
+			&common_);
+		// Singular patterns: fall back to dense LU
+		if (!symbolic_) sparse_ = false;
+	}
+}
+
+void DependentCoordinatesSolver::factorize(
+	const CompressedRowSparseMatrix& Phi_q)
+{
+	ASSERTMSG_(
+		!crs2ccs_.empty() || Phi_q.getNumNonZeros() == 0,
+		"setIndependentCoordinates() must be called first");
+
+	// Scatter the current Jacobian values into Phi_d:
+	double* vals = Phi_d_.valuePtr();
+	for (size_t k = 0; k < crs2ccs_.size(); k++)
+		if (crs2ccs_[k] >= 0) vals[crs2ccs_[k]] = Phi_q.values[k];
+
+	factorized_ = false;
+
+	if (sparse_)
+	{
+		// Reuse the pivoting of the last factorization, unless it became
+		// numerically unacceptable:
+		if (klu_factor_or_refactor(Phi_d_, symbolic_, numeric_, common_))
+		{
+			factorized_ = true;
+			return;
+		}
+		// Singular: use the dense LU for this one.
+	}
+
+	Phi_d_dense_ = Eigen::MatrixXd(Phi_d_);
+	lu_.compute(Phi_d_dense_);
+	factorized_ = true;
+}
+
+void DependentCoordinatesSolver::solve(
+	const Eigen::VectorXd& b, Eigen::VectorXd& x)
+{
+	ASSERT_(factorized_);
+
+	if (sparse_ && numeric_)
+	{
+		// KLU leaves the solution in the same place than the input RHS:
+		x = b;
+		klu_solve(symbolic_, numeric_, x.size(), 1, x.data(), &common_);
+		if (common_.status != KLU_OK)
+			THROW_EXCEPTION("Error: KLU couldn't solve the linear system.");
+	}
+	else
+	{
+		x = lu_.solve(b);
+	}
+}
+
+void DependentCoordinatesSolver::multiplyIndependent(
+	const CompressedRowSparseMatrix& Phi_q, const Eigen::VectorXd& v,
+	Eigen::VectorXd& out) const
+{
+	const size_t nConstraints = Phi_q.getNumRows();
+	out.setZero(nConstraints);
+	for (size_t r = 0; r < nConstraints; r++)
+	{
+		double acc = 0;
+		for (size_t k = Phi_q.row_ptr[r]; k < Phi_q.row_ptr[r + 1]; k++)
+			if (crs2ccs_[k] < 0) acc += Phi_q.values[k] * v[Phi_q.col_idx[k]];
+		out[r] = acc;
+	}
+}
@@ -0,0 +1,185 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include <mbse/KinematicProjector.h>
+#include <mbse/ModelTopology.h>
+
+using namespace mbse;
+
+KinematicProjector& KinematicProjector::operator=(const KinematicProjector& o)
+{
+	params = o.params;
+	solver_ = DependentCoordinatesSolver();
+	invalidate();
+	return *this;
+}
+
+void KinematicProjector::setIndependentCoordinates(
+	const ModelTopology& topology, const std::vector<size_t>& z_indices)
+{
+	solver_.setIndependentCoordinates(topology.Phi_q_, z_indices);
+	// A change of coordinates drops the factorization:
+	if (!solver_.isFactorized()) valid_ = false;
+}
+
+void KinematicProjector::factorize(const ModelState& state)
+{
+	solver_.factorize(state.Phi_q_);
+	valid_ = true;
+	stats_.numFactorizations++;
+}
+
+double KinematicProjector::solvePositions(
+	const ModelTopology& topology, ModelState& state, double maxPhiNorm,
+	size_t nItersMax)
+{
+	MBSE_PROFILE_ENTER("KinematicProjector.positions");
+
+	const std::vector<size_t>& idxs_d = solver_.dependentIndices();
+	const size_t nDepCoords = idxs_d.size();
+
+	topology.update_numeric_Phi_and_Jacobians(state);
+	double phi_norm = state.Phi_.norm();
+
+	size_t iter = 0;
+	for (; iter < nItersMax && phi_norm > maxPhiNorm; iter++)
+	{
+		if (!valid_) factorize(state);
+
+		// Solve for increment:
+		solver_.solve(state.Phi_, incr_);
+		for (size_t i = 0; i < nDepCoords; i++)
+			state.q_[idxs_d[i]] -= incr_[i];
+
+		// Re-evaluate error:
+		topology.update_numeric_Phi_and_Jacobians(state);
+		const double new_phi_norm = state.Phi_.norm();
+
+		// Chord method: keep the factorization while it converges fast
+		if (new_phi_norm > maxPhiNorm &&
+			new_phi_norm > params.maxContraction * phi_norm)
+			valid_ = false;
+
+		phi_norm = new_phi_norm;
+	}
+
+	stats_.numPositionIters += iter;
+	MBSE_PROFILE_VALUE("KinematicProjector.positions.iters", iter);
+	MBSE_PROFILE_LEAVE("KinematicProjector.positions");
+
+	return phi_norm;
+}
+
+double KinematicProjector::refinePositions(
+	const ModelTopology& topology, ModelState& state, double maxPhiNorm,
+	size_t nItersMax)
+{
+	MBSE_PROFILE_ENTER("KinematicProjector.refine");
+
+	topology.update_numeric_Phi_and_Jacobians(state);
+	double phi_norm = state.Phi_.norm();
+
+	// These calls come after arbitrary jumps in the state (e.g. factor graph
+	// updates), so a factorization from a former call is not reused:
+	validAll_ = false;
+
+	size_t iter = 0;
+	for (; iter < nItersMax && phi_norm > maxPhiNorm; iter++)
+	{
+		if (!validAll_)
+		{
+			luAll_.compute(state.Phi_q_.asDense());
+			validAll_ = true;
+			stats_.numFactorizations++;
+		}
+
+		state.q_ -= luAll_.solve(state.Phi_);
+
+		topology.update_numeric_Phi_and_Jacobians(state);
+		const double new_phi_norm = state.Phi_.norm();
+
+		// Chord method within this call only:
+		if (new_phi_norm > maxPhiNorm &&
+			new_phi_norm > params.maxContraction * phi_norm)
+			validAll_ = false;
+
+		phi_norm = new_phi_norm;
+	}
+
+	stats_.numPositionIters += iter;
+	MBSE_PROFILE_VALUE("KinematicProjector.refine.iters", iter);
+	MBSE_PROFILE_LEAVE("KinematicProjector.refine");
+
+	return phi_norm;
+}
+
+void KinematicProjector::solveLinear(
+	const ModelState& state, const Eigen::VectorXd& c, Eigen::VectorXd& x)
+{
+	const std::vector<size_t>& idxs_d = solver_.dependentIndices();
+	const size_t nDepCoords = idxs_d.size();
+	const auto& Phi_q = state.Phi_q_;
+
+	residual_.resize(Phi_q.getNumRows());
+
+	bool fresh = !valid_;
+	if (fresh) factorize(state);
+
+	double tol = -1;
+	size_t iters = 0;
+	for (;;)
+	{
+		// r = Phi_q * x + c, with the current Jacobian:
+		Phi_q.multiply(&x[0], &residual_[0]);
+		residual_ += c;
+		const double r_norm = residual_.norm();
+
+		if (tol < 0) tol = params.linearTolerance * std::max(1.0, r_norm);
+		if (r_norm <= tol) break;
+
+		if (iters >= params.maxRefinementIters)
+		{
+			// Not converging with this factorization: use a fresh one.
+			if (fresh) break;
+			factorize(state);
+			fresh = true;
+			iters = 0;
+		}
+
+		solver_.solve(residual_, incr_);
+		for (size_t i = 0; i < nDepCoords; i++) x[idxs_d[i]] -= incr_[i];
+
+		iters++;
+		stats_.numRefinementIters++;
+	}
+}
+
+void KinematicProjector::solveVelocities(ModelState& state)
+{
+	MBSE_PROFILE_ENTER("KinematicProjector.velocities");
+
+	rhs_.setZero(state.Phi_q_.getNumRows());
+	solveLinear(state, rhs_, state.dotq_);
+
+	MBSE_PROFILE_LEAVE("KinematicProjector.velocities");
+}
+
+void KinematicProjector::solveAccelerations(
+	const ModelState& state, Eigen::VectorXd& ddotq)
+{
+	MBSE_PROFILE_ENTER("KinematicProjector.accelerations");
+
+	// c = dotPhi_q * dotq
+	rhs_.resize(state.dotPhi_q_.getNumRows());
+	state.dotPhi_q_.multiply(&state.dotq_[0], &rhs_[0]);
+	solveLinear(state, rhs_, ddotq);
+
+	MBSE_PROFILE_LEAVE("KinematicProjector.accelerations");
+}
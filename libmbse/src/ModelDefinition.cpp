@@ -35,6 +35,7 @@ Body& ModelDefinition::addBody(const std::string& name)
 
 	// Create:
 	bodies_.resize(bodies_.size() + 1);
+	++bodies_revision_;
 
 	// Set name & return:
 	Body& new_body = *bodies_.rbegin();
@@ -45,7 +46,13 @@ Body& ModelDefinition::addBody(const std::string& name)
 
 /** Completely erases all defined points, joints, bodies, parameters, etc of
  * this object and leaves it blank. */
-void ModelDefinition::clear() { *this = ModelDefinition(); }
+void ModelDefinition::clear()
+{
+	// Keep the revision monotonic, for models assembled before clear():
+	const size_t revision = bodies_revision_;
+	*this = ModelDefinition();
+	bodies_revision_ = revision + 1;
+}
 
 MRPT_TODO("Initial position problem should refine these positions if needed.")
 
@@ -411,6 +418,9 @@ ModelDefinition ModelDefinition::FromYAML(const mrpt::containers::yaml& c)
 			"cog.y");
 		b.cog().y = e.eval();
 
+		if (auto it = yb.find("fast"); it != yb.end())
+			b.fast = (*it).second.as<bool>();
+
 		expVars.erase("mass");
 		expVars.erase("length");
 		expVars.erase("I0");
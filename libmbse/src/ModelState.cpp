@@ -0,0 +1,34 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include <mbse/ModelState.h>
+#include <mbse/ModelTopology.h>
+
+using namespace mbse;
+
+ModelState::ModelState(const ModelTopology& topology)
+	: Phi_q_(topology.Phi_q_),
+	  dotPhi_q_(topology.dotPhi_q_),
+	  Phiqq_times_ddq_(topology.Phiqq_times_ddq_),
+	  dotPhiqq_times_dq_(topology.dotPhiqq_times_dq_)
+{
+	const size_t n = topology.numCoords();
+	const size_t m = topology.numConstraints();
+
+	q_ = topology.initial_q_;
+	dotq_.setZero(n);
+	ddotq_.setZero(n);
+	Q_.setZero(n);
+
+	Phi_.setZero(m);
+	dotPhi_.setZero(m);
+
+	operatingPointFlags_.assign(topology.numOperatingPointFlags(), 0);
+}
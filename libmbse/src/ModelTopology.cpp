@@ -0,0 +1,177 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include <mbse/ModelTopology.h>
+#include <mbse/constraints/ConstraintRelativeAngle.h>
+#include <mbse/constraints/ConstraintRelativeAngleAbsolute.h>
+#include <mrpt/core/bits_math.h>
+#include <cstdio>
+
+using namespace mbse;
+
+/** Constructor */
+ModelTopology::ModelTopology(const TSymbolicAssembledModel& armi)
+	: mechanism_(armi.model)
+{
+	const auto nEuclideanDOFs = armi.DOFs.size();
+	const auto nRelativeDOFs = armi.rDOFs.size();
+
+	const auto nDOFs = nEuclideanDOFs + nRelativeDOFs;
+
+	ASSERTMSG_(
+		nEuclideanDOFs > 0,
+		"Trying to assemble model with 0 Natural Coordinate DOFs");
+
+	initial_q_.setZero(nDOFs);
+
+	// Keep a copy of DOF info:
+	DOFs_ = armi.DOFs;
+	rDOFs_ = armi.rDOFs;
+
+	// Build reverse-lookup table & initialize initial values for "q":
+	points2DOFs_.resize(armi.model.getPointCount());
+
+	for (dof_index_t i = 0; i < nEuclideanDOFs; i++)
+	{
+		const size_t pt_idx = DOFs_.at(i).point_index;
+		const Point2& pt = mechanism_.getPointInfo(pt_idx);
+		switch (DOFs_.at(i).point_dof)
+		{
+			case PointDOF::X:
+				initial_q_[i] = pt.coords.x;
+				points2DOFs_.at(pt_idx).dof_x = i;
+				break;
+			case PointDOF::Y:
+				initial_q_[i] = pt.coords.y;
+				points2DOFs_.at(pt_idx).dof_y = i;
+				break;
+			// case 2: //z
+			//	initial_q_[i] = pt.coords.z;
+			//	break;
+			default:
+				THROW_EXCEPTION("Unexpected value for DOFs_[i].point_dof");
+		};
+	}
+
+	// Save the number of DOFs as the number of columsn in sparse Jacobians:
+	Phi_q_.ncols = nDOFs;
+	dotPhi_q_.ncols = nDOFs;
+	Phiqq_times_ddq_.ncols = nDOFs;
+	dotPhiqq_times_dq_.ncols = nDOFs;
+
+	// Generate constraint equations & create structure of sparse Jacobians:
+	// ----------------------------------------------------------------------
+	const std::vector<ConstraintBase::Ptr>& parent_constraints =
+		mechanism_.constraints();
+
+	// 1/2: Constraints
+	const size_t nConst = parent_constraints.size();
+	constraints_.resize(nConst);
+	for (size_t i = 0; i < nConst; i++)
+	{
+		constraints_[i] = parent_constraints[i]->clone();
+	}
+
+	// 2/2: Constraints from relative coordinates:
+	relCoordinate2Index_.resize(rDOFs_.size());
+	for (size_t i = 0; i < rDOFs_.size(); i++)
+	{
+		const auto& relConstr = rDOFs_[i];
+		const dof_index_t idxInQ = nEuclideanDOFs + i;
+
+		if (std::holds_alternative<RelativeAngleDOF>(relConstr))
+		{
+			const auto& c = std::get<RelativeAngleDOF>(relConstr);
+
+			// Add constraint:
+			auto co = std::make_shared<ConstraintRelativeAngle>(
+				c.point_idx0, c.point_idx1, c.point_idx2, idxInQ);
+			constraints_.push_back(co);
+
+			// reverse look up table:
+			relCoordinate2Index_[i] = idxInQ;
+		}
+		else if (std::holds_alternative<RelativeAngleAbsoluteDOF>(relConstr))
+		{
+			const auto& c = std::get<RelativeAngleAbsoluteDOF>(relConstr);
+
+			// Add constraint:
+			auto co = std::make_shared<ConstraintRelativeAngleAbsolute>(
+				c.point_idx0, c.point_idx1, idxInQ);
+			constraints_.push_back(co);
+
+			// reverse look up table:
+			relCoordinate2Index_[i] = idxInQ;
+
+			// Initial value from coordinates:
+			const auto pt0 = mechanism_.getPointInfo(c.point_idx0).coords;
+			const auto pt1 = mechanism_.getPointInfo(c.point_idx1).coords;
+			const auto ptV = pt1 - pt0;
+			if (ptV.norm() != 0)
+			{
+				auto expectedAng = std::atan2(ptV.y, ptV.x);
+				if (std::abs(initial_q_[idxInQ] - expectedAng) > 0.01)
+				{
+					printf(
+						"*WARNING* RelativeAngleAbsoluteDOF at q[%i]=%f deg: "
+						"Overriding with angle from coordinates = %f deg.\n",
+						static_cast<int>(idxInQ),
+						mrpt::RAD2DEG(initial_q_[idxInQ]),
+						mrpt::RAD2DEG(expectedAng));
+					initial_q_[idxInQ] = expectedAng;
+				}
+			}
+		}
+		else
+		{
+			THROW_EXCEPTION("Unknown type of relative coordinate");
+		}
+	}
+
+	// Final step: build structures
+	constraintRows_.reserve(constraints_.size());
+	for (auto& c : constraints_)
+	{
+		const size_t firstRow = Phi_q_.getNumRows();
+		c->buildSparseStructures(*this);
+		constraintRows_.emplace_back(firstRow, Phi_q_.getNumRows() - firstRow);
+	}
+
+	// Fix the sparsity pattern and let constraints know their value slots:
+	Phi_q_.freeze();
+	dotPhi_q_.freeze();
+	Phiqq_times_ddq_.freeze();
+	dotPhiqq_times_dq_.freeze();
+}
+
+size_t ModelTopology::addNewRowToConstraints()
+{
+	const size_t idx = Phi_q_.getNumRows();
+	const size_t m = idx + 1;  // new size
+
+	Phi_q_.setRowCount(m);
+	dotPhi_q_.setRowCount(m);
+	Phiqq_times_ddq_.setRowCount(m);
+	dotPhiqq_times_dq_.setRowCount(m);
+
+	return idx;
+}
+
+/** Call all constraint objects and command them to update their corresponding
+ * parts in the sparse Jacobians */
+void ModelTopology::update_numeric_Phi_and_Jacobians(ModelState& state) const
+{
+	for (const auto& c : constraints_) c->update(state);
+}
+
+void ModelTopology::realize_operating_point(ModelState& state) const
+{
+	for (const auto& c : constraints_) c->realizeOperatingPoint(state);
+}
@@ -11,6 +11,15 @@
 #include <mbse/MultiBodyParticleFilter.h>
 
 #include <mrpt/math/distributions.h>
+#include <mrpt/random/RandomGenerators.h>
+
+#include <algorithm>
+#include <exception>
+#include <limits>
+
+#ifdef SPARSEMBS_HAVE_OPENMP
+#include <omp.h>
+#endif
 
 using namespace mbse;
 using namespace Eigen;
@@ -18,6 +27,196 @@ using namespace mrpt::math;
 using namespace mrpt;
 using namespace std;
 
+namespace
+{
+/** Per-thread scratch space for the RK4 forward model */
+struct RK4Workspace
+{
+	Eigen::VectorXd q0;	 // Backup of state.
+	Eigen::VectorXd v1, v2, v3, v4;	 // \dot{q}
+	Eigen::VectorXd ddotz1, ddotz2, ddotz3, ddotz4;	 // \ddot{z}
+	Eigen::VectorXd q_incr, dotz_incr;
+	Eigen::VectorXd dotz_noise;
+};
+
+uint64_t splitmix64(uint64_t z)
+{
+	z += 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/** Seed of the noise stream of one particle during one PF step */
+uint32_t particle_stream_seed(uint64_t seed, uint64_t step, uint64_t particle)
+{
+	return static_cast<uint32_t>(
+		splitmix64(splitmix64(splitmix64(seed) ^ step) ^ particle));
+}
+
+/** Integrates one particle from t to t+t_step with RK4, then adds process
+ * noise to the independent accelerations. */
+void propagate_particle(
+	AssembledRigidModel& mdl, CDynamicSimulatorIndepBase& dyn, const double t,
+	const double t_step, const double noise_std, RK4Workspace& ws,
+	mrpt::random::CRandomGenerator& rng)
+{
+	const double t_step2 = t_step * 0.5;
+	const double t_step6 = t_step / 6.0;
+
+	// ODE_RK4:
+	// --------------------------------
+	ws.q0 = mdl.q_;	 // Make backup copy of state (velocities in "v1")
+
+	// k1 = f(t,y);
+	ws.v1 = mdl.dotq_;
+
+	dyn.can_choose_indep_coords_ = true;
+	dyn.solve_ddotz(t, ws.ddotz1);
+	dyn.can_choose_indep_coords_ = false;
+
+	// k2 = f(t+At/2,y+At/2*k1)
+	// \dot{q}= \dot{q}_0 + At/2 * \ddot{q}_1
+	dyn.dq_plus_dz(ws.v1, t_step2 * ws.ddotz1, mdl.dotq_);
+	mdl.q_ = ws.q0 + t_step2 * ws.v1;
+	dyn.correct_dependent_q_dq();
+
+	ws.v2 = mdl.dotq_;
+	dyn.solve_ddotz(t + t_step2, ws.ddotz2);
+
+	// k3 = f(t+At/2,y+At/2*k2)
+	dyn.dq_plus_dz(ws.v1, t_step2 * ws.ddotz2, mdl.dotq_);
+	mdl.q_ = ws.q0 + t_step2 * ws.v2;
+	dyn.correct_dependent_q_dq();
+
+	ws.v3 = mdl.dotq_;
+	dyn.solve_ddotz(t + t_step2, ws.ddotz3);
+
+	// k4 = f(t+At  ,y+At*k3)
+	dyn.dq_plus_dz(ws.v1, t_step * ws.ddotz3, mdl.dotq_);
+	mdl.q_ = ws.q0 + t_step * ws.v3;
+	dyn.correct_dependent_q_dq();
+
+	ws.v4 = mdl.dotq_;
+	dyn.solve_ddotz(t + t_step, ws.ddotz4);
+
+	// Runge-Kutta 4th order formula:
+	ws.q_incr = t_step6 * (ws.v1 + 2 * ws.v2 + 2 * ws.v3 + ws.v4);
+	ws.dotz_incr =
+		t_step6 * (ws.ddotz1 + 2 * ws.ddotz2 + 2 * ws.ddotz3 + ws.ddotz4);
+
+	// generate noise:
+	ws.dotz_noise.resize(ws.dotz_incr.size());
+	rng.drawGaussian1DMatrix(ws.dotz_noise, 0, noise_std);
+
+	// Add (noisy) increment:
+	mdl.q_ = ws.q0 + ws.q_incr;
+	dyn.dq_plus_dz(ws.v1, ws.dotz_incr + ws.dotz_noise, mdl.dotq_);
+	dyn.correct_dependent_q_dq();
+}
+
+/** Picks, for each of the sorted values `u` in [0,1), the particle whose
+ * interval in the cumulative distribution of weights `w` (which add up to 1)
+ * contains it. O(N+M). */
+void pick_from_sorted_uniforms(
+	const std::vector<double>& w, const std::vector<double>& u,
+	std::vector<size_t>& out_idxs)
+{
+	const size_t N = w.size();
+	size_t i = 0;
+	double cdf = w[0];
+	for (const double uk : u)
+	{
+		while (uk >= cdf && i + 1 < N) cdf += w[++i];
+		out_idxs.push_back(i);
+	}
+}
+
+/** Draws M sorted uniform values in [0,1) in O(M), from the normalized
+ * partial sums of M+1 exponential variables */
+void sorted_uniforms(
+	size_t M, mrpt::random::CRandomGenerator& rng, std::vector<double>& u)
+{
+	// Exponential variables, from uniforms in (0,1]: drawUniform() may return
+	// both ends of its interval, and log(0) would be -inf:
+	const auto drawExponential = [&rng]() {
+		return -std::log(
+			rng.drawUniform(std::numeric_limits<double>::min(), 1.0));
+	};
+
+	u.resize(M);
+	double acc = 0;
+	for (size_t k = 0; k < M; k++)
+	{
+		acc += drawExponential();
+		u[k] = acc;
+	}
+	acc += drawExponential();
+	for (auto& uk : u) uk /= acc;
+}
+}  // namespace
+
+// ---------------------------------------
+// ParticleBatch
+// ---------------------------------------
+ParticleBatch::ParticleBatch(
+	const ModelTopology::Ptr& topology_, size_t nParticles)
+	: topology(topology_)
+{
+	resize(nParticles);
+}
+
+void ParticleBatch::resize(size_t nParticles)
+{
+	ASSERT_(topology);
+	const size_t n = topology->numCoords();
+	const size_t nOld = size();
+
+	q.conservativeResize(n, nParticles);
+	dotq.conservativeResize(n, nParticles);
+	log_w.resize(nParticles, 0.0);
+
+	for (size_t i = nOld; i < nParticles; i++)
+	{
+		q.col(i) = topology->initial_q_;
+		dotq.col(i).setZero();
+	}
+}
+
+void ParticleBatch::load(size_t i, AssembledRigidModel& model) const
+{
+	model.q_ = q.col(i);
+	model.dotq_ = dotq.col(i);
+	// Particles may be far apart: do not warm-start from another one.
+	model.kinematicProjector().invalidate();
+}
+
+void ParticleBatch::store(size_t i, const AssembledRigidModel& model)
+{
+	q.col(i) = model.q_;
+	dotq.col(i) = model.dotq_;
+}
+
+void ParticleBatch::gather(const std::vector<size_t>& idxs)
+{
+	const Eigen::Index n = q.rows();
+	const size_t N = idxs.size();
+
+	Eigen::MatrixXd new_q(n, N), new_dotq(n, N);
+	for (size_t i = 0; i < N; i++)
+	{
+		new_q.col(i) = q.col(idxs[i]);
+		new_dotq.col(i) = dotq.col(idxs[i]);
+	}
+	q.swap(new_q);
+	dotq.swap(new_dotq);
+	log_w.assign(N, 0.0);
+}
+
+// ---------------------------------------
+// MultiBodyParticleFilter
+// ---------------------------------------
+
 // Ctor:
 MultiBodyParticleFilter::MultiBodyParticleFilter(
 	const size_t M, const ModelDefinition& mbs)
@@ -26,184 +225,305 @@ MultiBodyParticleFilter::MultiBodyParticleFilter(
 	TSymbolicAssembledModel sym_model(mbs);
 	mbs.assembleRigidMBS(sym_model);
 
+	// All particles share the same (immutable) topology:
+	const auto topology = std::make_shared<const ModelTopology>(sym_model);
+
 	// 2) Create particles:
-	m_particles.resize(M);
+	particles = ParticleBatch(topology, M);
 
-	for (auto& p : m_particles)
+	// Randomize:
+	mrpt::random::CRandomGenerator rng;
+	rng.randomize();
+	rng_seed_ = rng.drawUniform32bit();
+}
+
+// Dtor:
+MultiBodyParticleFilter::~MultiBodyParticleFilter() {}
+
+MultiBodyParticleFilter::Worker& MultiBodyParticleFilter::worker(
+	size_t threadIdx)
+{
+	if (workers_.size() <= threadIdx) workers_.resize(threadIdx + 1);
+
+	auto& w = workers_[threadIdx];
+	if (!w.model)
 	{
-		p.log_w = 0;
-		p.d.reset(new particle_t(sym_model));
+		w.model = std::make_shared<AssembledRigidModel>(particles.topology);
+		w.dyn_simul = std::make_shared<MBPF_SIMULATOR_TYPE>(w.model);
+		w.dyn_simul->prepare();
 	}
+	return w;
+}
 
-	// Randomize?
-	random_generator.randomize();
+void MultiBodyParticleFilter::seedRandomGenerators(const uint32_t seed)
+{
+	rng_seed_ = seed;
+	rng_step_ = 0;
+	mrpt::random::getRandomGenerator().randomize(seed);
 }
 
-// Dtor:
-MultiBodyParticleFilter::~MultiBodyParticleFilter() {}
+void MultiBodyParticleFilter::normalizeWeights()
+{
+	if (particles.log_w.empty()) return;
+	const double maxLogW =
+		*std::max_element(particles.log_w.begin(), particles.log_w.end());
+	for (auto& lw : particles.log_w) lw -= maxLogW;
+}
+
+double MultiBodyParticleFilter::ESS() const
+{
+	const auto& log_w = particles.log_w;
+	if (log_w.empty()) return 0;
+
+	const double maxLogW = *std::max_element(log_w.begin(), log_w.end());
+	double sum_w = 0, sum_w2 = 0;
+	for (const double lw : log_w)
+	{
+		const double w = std::exp(lw - maxLogW);
+		sum_w += w;
+		sum_w2 += w * w;
+	}
+	return (sum_w * sum_w) / (sum_w2 * log_w.size());
+}
+
+void MultiBodyParticleFilter::computeResamplingIndices(
+	mrpt::bayes::CParticleFilter::TParticleResamplingAlgorithm method,
+	const std::vector<double>& log_w, size_t M,
+	mrpt::random::CRandomGenerator& rng, std::vector<size_t>& out_idxs)
+{
+	using mrpt::bayes::CParticleFilter;
+
+	const size_t N = log_w.size();
+	ASSERT_GT_(N, 0U);
+
+	// Normalized linear weights:
+	const double maxLogW = *std::max_element(log_w.begin(), log_w.end());
+	std::vector<double> w(N);
+	double sum_w = 0;
+	for (size_t i = 0; i < N; i++)
+	{
+		w[i] = std::exp(log_w[i] - maxLogW);
+		sum_w += w[i];
+	}
+	for (auto& wi : w) wi /= sum_w;
+
+	out_idxs.clear();
+	out_idxs.reserve(M);
+	std::vector<double> u;
+
+	switch (method)
+	{
+		case CParticleFilter::prMultinomial:
+			sorted_uniforms(M, rng, u);
+			break;
+
+		case CParticleFilter::prStratified:
+			u.resize(M);
+			for (size_t k = 0; k < M; k++)
+				u[k] = (k + rng.drawUniform(0.0, 1.0)) / M;
+			break;
+
+		case CParticleFilter::prSystematic:
+		{
+			u.resize(M);
+			const double u0 = rng.drawUniform(0.0, 1.0);
+			for (size_t k = 0; k < M; k++) u[k] = (k + u0) / M;
+		}
+		break;
+
+		case CParticleFilter::prResidual:
+		{
+			// Deterministic copies of floor(M*w_i), then multinomial
+			// sampling of the rest with the residual weights:
+			double sum_res = 0;
+			for (size_t i = 0; i < N; i++)
+			{
+				const double Mw = M * w[i];
+				const size_t copies = static_cast<size_t>(Mw);
+				out_idxs.insert(out_idxs.end(), copies, i);
+				w[i] = Mw - copies;
+				sum_res += w[i];
+			}
+			const size_t nRest = M - out_idxs.size();
+			if (nRest == 0 || sum_res <= 0) break;
+
+			for (auto& wi : w) wi /= sum_res;
+			sorted_uniforms(nRest, rng, u);
+		}
+		break;
+
+		default:
+			THROW_EXCEPTION("Unknown value for PF_options.resamplingMethod");
+	};
+
+	if (!u.empty()) pick_from_sorted_uniforms(w, u, out_idxs);
+	ASSERT_EQUAL_(out_idxs.size(), M);
+}
+
+size_t MultiBodyParticleFilter::KLD_numberOfParticles(size_t nBins) const
+{
+	const auto& o = PF_options;
+	ASSERT_LE_(o.KLD_minSampleSize, o.KLD_maxSampleSize);
+
+	// Fox (2003), KLD-sampling bound, with the Wilson-Hilferty
+	// approximation of the chi-square quantile:
+	double n = 0;
+	if (nBins > 1)
+	{
+		const double k1 = static_cast<double>(nBins - 1);
+		const double a = 2.0 / (9.0 * k1);
+		const double z = mrpt::math::normalQuantile(1.0 - o.KLD_delta);
+		n = k1 / (2.0 * o.KLD_epsilon) *
+			std::pow(1.0 - a + std::sqrt(a) * z, 3);
+	}
+	n = std::max(n, static_cast<double>(nBins * o.KLD_minSamplesPerBin));
+
+	return std::clamp(
+		static_cast<size_t>(std::ceil(n)),
+		static_cast<size_t>(o.KLD_minSampleSize),
+		static_cast<size_t>(o.KLD_maxSampleSize));
+}
+
+size_t MultiBodyParticleFilter::countOccupiedBins(
+	const std::vector<size_t>& idxs) const
+{
+	// Independent coordinates (or all of them, if not known yet):
+	std::vector<size_t> coords = kld_coords_;
+	if (coords.empty())
+		for (size_t j = 0; j < static_cast<size_t>(particles.q.rows()); j++)
+			coords.push_back(j);
+
+	const double binSize = PF_options.KLD_binSize;
+	ASSERT_GT_(binSize, 0.0);
+
+	std::vector<std::vector<int64_t>> bins(idxs.size());
+	for (size_t k = 0; k < idxs.size(); k++)
+	{
+		bins[k].resize(coords.size());
+		for (size_t j = 0; j < coords.size(); j++)
+			bins[k][j] = static_cast<int64_t>(
+				std::floor(particles.q(coords[j], idxs[k]) / binSize));
+	}
+	std::sort(bins.begin(), bins.end());
+	return std::unique(bins.begin(), bins.end()) - bins.begin();
+}
 
 void MultiBodyParticleFilter::run_PF_step(
 	const double t_ini, const double t_end, const double max_t_step,
 	const std::vector<CVirtualSensor::Ptr>& sensor_descriptions,
 	const std::vector<double>& sensor_readings, TOutputInfo& out_info)
 {
-	mrpt::system::CTimeLoggerEntry tle(timelog(), "run_PF_step");
+	MBSE_PROFILE_SCOPE("run_PF_step");
 
 	ASSERT_(sensor_descriptions.size() == sensor_readings.size());
 
 	// 1) Executes probabilistic transition model:
 	// -----------------------------------------------------
-	timelog().enter("PF.1.forward_model");
+	MBSE_PROFILE_ENTER("PF.1.forward_model");
 
 	ASSERT_GT_(t_end, t_ini);
 	const double t_increment = t_end - t_ini;
 	const size_t nTimeSteps = ceil(t_increment / max_t_step);
-
 	const double t_step = t_increment / nTimeSteps;
-	const double t_step2 = t_step * 0.5;
-	const double t_step6 = t_step / 6.0;
-
-	Eigen::VectorXd q0;	 // Backup of state.
-	Eigen::VectorXd k1, k2, k3, k4;
-	Eigen::VectorXd v1, v2, v3, v4;	 // \dot{q}
-	Eigen::VectorXd ddotz1, ddotz2, ddotz3, ddotz4;	 // \ddot{q}
-	Eigen::VectorXd q_incr, dotz_incr;
-	Eigen::VectorXd dotz_noise;
+	const double noise_std = model_options.acc_xy_noise_std * t_step;
+
+	// Particles are independent: integrate each one over all the time steps
+	// in a single parallel loop. Exceptions can't leave an OpenMP region, so
+	// the first one is kept and rethrown afterwards.
+	const int nParts = static_cast<int>(particles.size());
+	const uint64_t pfStep = rng_step_++;
+	std::exception_ptr error;
+
+	// Create the per-thread models and solvers beforehand:
+#ifdef SPARSEMBS_HAVE_OPENMP
+	const int nThreads = omp_get_max_threads();
+#else
+	const int nThreads = 1;
+#endif
+	for (int th = 0; th < nThreads; th++) worker(th);
 
-	const size_t nParts = m_particles.size();
-	size_t i;
-	double t = t_ini;
-	for (size_t nTim = 0; nTim < nTimeSteps; nTim++, t += t_step)
+#ifdef SPARSEMBS_HAVE_OPENMP
+#pragma omp parallel num_threads(nThreads)
+#endif
 	{
-#if 0 && MBS_HAVE_OPENMP
-#pragma omp                                                                                                               \
-	parallel for private(q0) private(k1) private(k2) private(k3) private(k4) private(v1) private(v2) private(v3) private( \
-		v4) private(ddotq1) private(ddotq2) private(ddotq3) private(ddotq4) private(q_incr) private(dotq_incr) private(dotq_noise)
+		RK4Workspace ws;
+		mrpt::random::CRandomGenerator rng;
+
+#ifdef SPARSEMBS_HAVE_OPENMP
+		Worker& w = workers_[omp_get_thread_num()];
+#else
+		Worker& w = workers_[0];
 #endif
-		for (i = 0; i < nParts; i++)
-		{
-			auto part = m_particles[i].d;
 
-			// ODE_RK4:
-			// --------------------------------
+#ifdef SPARSEMBS_HAVE_OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+		for (int i = 0; i < nParts; i++)
+		{
+			try
 			{
-				q0 = part->num_model.q_;  // Make backup copy of state
-										  // (velocities will be in "v1")
-
-				// k1 = f(t,y);
-				// cur_time = t;
-				v1 = part->num_model.dotq_;
-				// No change needed: part->num_model.q_ = q0;
-
-				part->dyn_simul->can_choose_indep_coords_ = true;
-				part->dyn_simul->solve_ddotz(t, ddotz1);
-				part->dyn_simul->can_choose_indep_coords_ = false;
-
-				// k2 = f(t+At/2,y+At/2*k1)
-				// cur_time = t + t_step2;
-				part->dyn_simul->dq_plus_dz(
-					v1, t_step2 * ddotz1,
-					part->num_model
-						.dotq_);  // \dot{q}= \dot{q}_0 + At/2 * \ddot{q}_1
-				part->num_model.q_ = q0 + t_step2 * v1;
-				part->dyn_simul->correct_dependent_q_dq();
-
-				v2 = part->num_model.dotq_;
-				part->dyn_simul->solve_ddotz(t + t_step2, ddotz2);
-
-				// k3 = f(t+At/2,y+At/2*k2)
-				// cur_time = t + t_step2;
-				// part->num_model.dotq_ = v1 + t_step2*ddotq2;  // \dot{q}=
-				// \dot{q}_0 + At/2 * \ddot{q}_2
-				part->dyn_simul->dq_plus_dz(
-					v1, t_step2 * ddotz2, part->num_model.dotq_);
-
-				part->num_model.q_ = q0 + t_step2 * v2;
-				part->dyn_simul->correct_dependent_q_dq();
-
-				v3 = part->num_model.dotq_;
-				part->dyn_simul->solve_ddotz(t + t_step2, ddotz3);
-
-				// k4 = f(t+At  ,y+At*k3)
-				// cur_time = t + t_step;
-				// part->num_model.dotq_ = v1 + t_step*ddotq3;
-				part->dyn_simul->dq_plus_dz(
-					v1, t_step * ddotz3, part->num_model.dotq_);
-				part->num_model.q_ = q0 + t_step * v3;
-				part->dyn_simul->correct_dependent_q_dq();
-
-				v4 = part->num_model.dotq_;
-				part->dyn_simul->solve_ddotz(t + t_step, ddotz4);
-
-				// Runge-Kutta 4th order formula:
-				q_incr = t_step6 * (v1 + 2 * v2 + 2 * v3 + v4);
-				dotz_incr =
-					t_step6 * (ddotz1 + 2 * ddotz2 + 2 * ddotz3 + ddotz4);
+				rng.randomize(particle_stream_seed(rng_seed_, pfStep, i));
+
+				particles.load(i, *w.model);
+				double t = t_ini;
+				for (size_t nTim = 0; nTim < nTimeSteps; nTim++, t += t_step)
+					propagate_particle(
+						*w.model, *w.dyn_simul, t, t_step, noise_std, ws, rng);
+				particles.store(i, *w.model);
 			}
+			catch (...)
+			{
+#ifdef SPARSEMBS_HAVE_OPENMP
+#pragma omp critical(mbse_pf_error)
+#endif
+				if (!error) error = std::current_exception();
+			}
+		}
+	}
+	if (error) std::rethrow_exception(error);
 
-			// generate noise:
-			if (dotz_incr.size() != dotz_noise.size())
-				dotz_noise.resize(dotz_incr.size());
-			random_generator.drawGaussian1DMatrix(
-				dotz_noise, 0, model_options.acc_xy_noise_std * t_step);
-
-			// Add (noisy) increment:
-			part->num_model.q_ = q0 + q_incr;
-			part->dyn_simul->dq_plus_dz(
-				v1, dotz_incr + dotz_noise, part->num_model.dotq_);
-			part->dyn_simul->correct_dependent_q_dq();
-
-		}  // end numeric integration of one time_step
-
-	}  // end for each time_step
+	// The independent coordinates chosen by the solvers, for KLD-sampling:
+	kld_coords_ = workers_[0].dyn_simul->independent_coordinate_indices();
 
-	timelog().leave("PF.1.forward_model");
+	MBSE_PROFILE_LEAVE("PF.1.forward_model");
 
 	// 2) Update weights with sensor measurements:
 	// -----------------------------------------------------
-	timelog().enter("PF.2.sensor_likelihood");
+	MBSE_PROFILE_ENTER("PF.2.sensor_likelihood");
 
 	const size_t nSensors = sensor_descriptions.size();
 
-	//	std::vector<double> sensors_logw, sensors_loglik;
-	//	sensors_logw.reserve( nParts );
-	//	sensors_loglik.reserve( nParts );
-
-	for (CParticleList::iterator it = m_particles.begin();
-		 it != m_particles.end(); ++it)
+	if (nSensors > 0)
 	{
-		auto part = it->d;
-
-		double cum_log_lik = 0;
+		// Each sensor evaluates all particles at once, over the contiguous
+		// particle states:
+		Eigen::VectorXd cum_log_lik = Eigen::VectorXd::Zero(nParts);
+		Eigen::VectorXd log_lik(nParts);
 		for (size_t k = 0; k < nSensors; k++)
 		{
-			const double log_lik =
-				sensor_descriptions[k]->evaluate_log_likelihood(
-					sensor_readings[k], part->num_model);
+			sensor_descriptions[k]->evaluate_log_likelihoods(
+				sensor_readings[k], particles, log_lik);
 			cum_log_lik += log_lik;
 		}
-		it->log_w += cum_log_lik;
-
-		//		sensors_logw.push_back( it->log_w );
-		//		sensors_loglik.push_back( cum_log_lik );
+		for (int i = 0; i < nParts; i++) particles.log_w[i] += cum_log_lik[i];
 	}
 
 	//	double sensor_avrg_lik = mrpt::math::chi2
 	// CDF(nSensors,-mrpt::math::averageLogLikelihood(sensors_logw,sensors_loglik)
 	//);
-	timelog().leave("PF.2.sensor_likelihood");
+	MBSE_PROFILE_LEAVE("PF.2.sensor_likelihood");
 
 	//	cout << "Sensor lik: " << sensor_avrg_lik << endl;
 
 	// 3) Normalize weights:
 	// ---------------------------------------------------
-	timelog().enter("PF.3.renormalize_w");
+	MBSE_PROFILE_ENTER("PF.3.renormalize_w");
 	this->normalizeWeights();
-	timelog().leave("PF.3.renormalize_w");
+	MBSE_PROFILE_LEAVE("PF.3.renormalize_w");
 
 	// 4) Resampling:
 	// -----------------------------------------------------
-	timelog().enter("PF.4.resampling");
+	MBSE_PROFILE_ENTER("PF.4.resampling");
 
 	const double curESS = this->ESS();
 	out_info.resampling_done = false;
@@ -213,13 +533,33 @@ void MultiBodyParticleFilter::run_PF_step(
 	{
 		// printf("[PF] Resampling particles (ESS was %.02f)\n", curESS);
 
-		size_t nNewParts = nParts;	// std::max(40.0, nParts*0.95 );
+		// Resample: only indices are computed, then particle states are
+		// gathered from their columns.
+		auto& rng = mrpt::random::getRandomGenerator();
+		std::vector<size_t> idxs;
+		computeResamplingIndices(
+			PF_options.resamplingMethod, particles.log_w, particles.size(),
+			rng, idxs);
+
+		// KLD-sampling: adapt the number of particles to the spread of the
+		// resampled set:
+		if (PF_options.adaptiveSampleSize)
+		{
+			const size_t nNewParts =
+				KLD_numberOfParticles(countOccupiedBins(idxs));
+			if (nNewParts != idxs.size())
+				computeResamplingIndices(
+					PF_options.resamplingMethod, particles.log_w, nNewParts,
+					rng, idxs);
+		}
 
-		this->performResampling(PF_options, nNewParts);	 // Resample
+		particles.gather(idxs);
 
 		out_info.resampling_done = true;
 	}
-	timelog().leave("PF.4.resampling");
+	out_info.num_particles = particles.size();
+
+	MBSE_PROFILE_LEAVE("PF.4.resampling");
 }
 
 MultiBodyParticleFilter::TTransitionModelOptions::TTransitionModelOptions()
@@ -234,14 +574,18 @@ void MultiBodyParticleFilter::getAs3DRepresentation(
 	ASSERT_(outObj);
 
 	outObj->clear();
-	for (CParticleList::const_iterator it = m_particles.begin();
-		 it != m_particles.end(); ++it)
+
+	render_models_.resize(particles.size());
+	for (size_t i = 0; i < particles.size(); i++)
 	{
-		const auto part = it->d;
+		auto& mdl = render_models_[i];
+		if (!mdl)
+			mdl = std::make_shared<AssembledRigidModel>(particles.topology);
+		particles.load(i, *mdl);
 
 		mrpt::opengl::CSetOfObjects::Ptr gl_part =
 			mrpt::opengl::CSetOfObjects::Create();
-		part->num_model.getAs3DRepresentation(gl_part, rp);
+		mdl->getAs3DRepresentation(gl_part, rp);
 		outObj->insert(gl_part);
 	}
 }
@@ -249,19 +593,24 @@ void MultiBodyParticleFilter::getAs3DRepresentation(
 void MultiBodyParticleFilter::update3DRepresentation(
 	const Body::TRenderParams& rp_) const
 {
+	ASSERTMSG_(
+		render_models_.size() == particles.size(),
+		"getAs3DRepresentation() must be called after changing the number of "
+		"particles");
+
 	Body::TRenderParams rp = rp_;
 
 	rp.render_style = Body::reLine;
-	for (CParticleList::const_iterator it = m_particles.begin();
-		 it != m_particles.end(); ++it)
+	for (size_t i = 0; i < particles.size(); i++)
 	{
-		const auto part = it->d;
+		auto& mdl = *render_models_[i];
+		particles.load(i, mdl);
 
 		const uint8_t new_alpha =
-			uint8_t(std::max(0.2, std::exp(it->log_w)) * 255);
+			uint8_t(std::max(0.2, std::exp(particles.log_w[i])) * 255);
 
 		rp.line_alpha = new_alpha;
 
-		part->num_model.update3DRepresentation(rp);
+		mdl.update3DRepresentation(rp);
 	}
 }
@@ -19,9 +19,9 @@ using mrpt::square;
 				  ConstraintFixedSlider
    -------------------------------------------------------------------*/
 void ConstraintFixedSlider::buildSparseStructures(
-	AssembledRigidModel& arm) const
+	ModelTopology& topology) const
 {
-	commonbuildSparseStructures(arm);
+	commonbuildSparseStructures(topology);
 
 	Delta_ = line_pt[1] - line_pt[0];
 	ASSERTMSG_(
@@ -32,47 +32,47 @@ void ConstraintFixedSlider::buildSparseStructures(
 		!points_[0]->fixed, "Useless constraint added to a fixed point!");
 }
 
-void ConstraintFixedSlider::update(AssembledRigidModel& arm) const
+void ConstraintFixedSlider::update(ModelState& state) const
 {
 	// Get references to the point coordinates (either fixed or variables in q):
-	PointRef p = actual_coords(arm, 0);
+	PointRef p = actual_coords(state, 0);
 
 	// Update Phi[i] = Ax * (py-y0) - Ay * (px-x0)
 	// --------------------------------------------
 	const double py_y0 = p.y - line_pt[0].y;
 	const double px_x0 = p.x - line_pt[0].x;
-	arm.Phi_[idx_constr_[0]] = Delta_.x * py_y0 - Delta_.y * px_x0;
+	state.Phi_[idx_constr_[0]] = Delta_.x * py_y0 - Delta_.y * px_x0;
 
 	// Update dotPhi[i]
 	// ----------------------------------
-	arm.dotPhi_[idx_constr_[0]] = Delta_.x * p.doty - Delta_.y * p.dotx;
+	state.dotPhi_[idx_constr_[0]] = Delta_.x * p.doty - Delta_.y * p.dotx;
 
 	auto& j = jacob.at(0);	// 1st (and unique) jacob row
 
 	// Update Jacobian dPhi_dq(i,:)
 	// ----------------------------------
-	set(j.dPhi_dx[0], -Delta_.y);
-	set(j.dPhi_dy[0], Delta_.x);
+	set(state.Phi_q_, j.dPhi_dx[0], -Delta_.y);
+	set(state.Phi_q_, j.dPhi_dy[0], Delta_.x);
 
 	// Update Jacobian \dot{dPhi_dq}(i,:)
 	// ----------------------------------
-	if (j.dot_dPhi_dx[0]) *j.dot_dPhi_dx[0] = 0;
-	if (j.dot_dPhi_dy[0]) *j.dot_dPhi_dy[0] = 0;
+	set(state.dotPhi_q_, j.dot_dPhi_dx[0], 0);
+	set(state.dotPhi_q_, j.dot_dPhi_dy[0], 0);
 
 	// Update Phiqq_times_ddq
 	// ----------------------------------
 	MRPT_TODO("Write actual values!");
-	set(j.Phiqq_times_ddq_dx[0], 0);
-	set(j.Phiqq_times_ddq_dy[0], 0);
-	set(j.Phiqq_times_ddq_dx[1], 0);
-	set(j.Phiqq_times_ddq_dy[1], 0);
+	set(state.Phiqq_times_ddq_, j.Phiqq_times_ddq_dx[0], 0);
+	set(state.Phiqq_times_ddq_, j.Phiqq_times_ddq_dy[0], 0);
+	set(state.Phiqq_times_ddq_, j.Phiqq_times_ddq_dx[1], 0);
+	set(state.Phiqq_times_ddq_, j.Phiqq_times_ddq_dy[1], 0);
 
 	// Update dotPhiqq_times_dq_dx
 	// ----------------------------------
-	set(j.dotPhiqq_times_dq_dx[0], 0);
-	set(j.dotPhiqq_times_dq_dy[0], 0);
-	set(j.dotPhiqq_times_dq_dx[1], 0);
-	set(j.dotPhiqq_times_dq_dy[1], 0);
+	set(state.dotPhiqq_times_dq_, j.dotPhiqq_times_dq_dx[0], 0);
+	set(state.dotPhiqq_times_dq_, j.dotPhiqq_times_dq_dy[0], 0);
+	set(state.dotPhiqq_times_dq_, j.dotPhiqq_times_dq_dx[1], 0);
+	set(state.dotPhiqq_times_dq_, j.dotPhiqq_times_dq_dy[1], 0);
 }
 
 /** Creates a 3D representation of the constraint, if applicable (e.g. the line
@@ -17,47 +17,40 @@ using namespace Eigen;
 using mrpt::square;
 
 void ConstraintRelativeAngleAbsolute::buildSparseStructures(
-	AssembledRigidModel& arm) const
+	ModelTopology& topology) const
 {
-	commonbuildSparseStructures(arm);
+	commonbuildSparseStructures(topology);
 
 	ASSERTMSG_(
 		!(points_[0]->fixed && points_[1]->fixed),
 		"Useless relative coordinate added between two fixed points!");
+
+	// Always recalculating L leads to failed numerical Jacobian tests,
+	// since it introduces fake dependencies between (x,y) coordinates.
+	// Evaluate it once, from the initial coordinates:
+	L_ = (points_[1]->coords - points_[0]->coords).norm();
+
+	opFlagIdx_ = topology.addOperatingPointFlag();
 }
 
 void ConstraintRelativeAngleAbsolute::realizeOperatingPoint(
-	const AssembledRigidModel& arm) const
+	ModelState& state) const
 {
-	// Get references to the point coordinates and velocities
-	// (either fixed or variables in q):
-	PointRef p[2] = {actual_coords(arm, 0), actual_coords(arm, 1)};
-	RelCoordRef angle = actual_rel_coords(arm, 0);
-
-	const double Ax = p[1].x - p[0].x;
-	const double Ay = p[1].y - p[0].y;
-
-	// Always recalculating L leads to failed numerical Jacobian tests,
-	// since it introduces fake dependencies between (x,y) coordinates.
-	if (L_ == 0)
-	{
-		const auto Lsqr = Ax * Ax + Ay * Ay;
-		L_ = std::sqrt(Lsqr);
-		// std::cout << "UPDATING L: " << L_ << std::endl;
-	}
+	RelCoordRef angle = actual_rel_coords(state, 0);
 
 	const double theta = angle.x;
 	const double sinTh = std::sin(theta);
 
-	useCos_ = std::abs(sinTh) > 0.707;
+	const bool useCos = std::abs(sinTh) > 0.707;
+	state.operatingPointFlags_[opFlagIdx_] = useCos ? 0 : 1;
 }
 
-void ConstraintRelativeAngleAbsolute::update(AssembledRigidModel& arm) const
+void ConstraintRelativeAngleAbsolute::update(ModelState& state) const
 {
 	// Get references to the point coordinates and velocities
 	// (either fixed or variables in q):
-	PointRef p[2] = {actual_coords(arm, 0), actual_coords(arm, 1)};
-	RelCoordRef angle = actual_rel_coords(arm, 0);
+	PointRef p[2] = {actual_coords(state, 0), actual_coords(state, 1)};
+	RelCoordRef angle = actual_rel_coords(state, 0);
 
 	const double Ax = p[1].x - p[0].x;
 	const double Ay = p[1].y - p[0].y;
@@ -73,72 +66,81 @@ void ConstraintRelativeAngleAbsolute::update(AssembledRigidModel& arm) const
 	const double w = angle.dotx;
 	const double angAcc = angle.ddotx;
 	const double sinTh = std::sin(theta), cosTh = std::cos(theta);
+	const bool useCos = state.operatingPointFlags_[opFlagIdx_] == 0;
 
 	// Update Phi[i]
 	// ----------------------------------
-	const double PhiVal = useCos_ ? Ax - L_ * cosTh : Ay - L_ * sinTh;
-	arm.Phi_[idx_constr_[0]] = PhiVal;
+	const double PhiVal = useCos ? Ax - L_ * cosTh : Ay - L_ * sinTh;
+	state.Phi_[idx_constr_[0]] = PhiVal;
 
 	// Update dotPhi[i]
 	// ----------------------------------
-	arm.dotPhi_[idx_constr_[0]] =
-		useCos_ ? Adotx + L_ * sinTh * w : Adoty - L_ * cosTh * w;
+	state.dotPhi_[idx_constr_[0]] =
+		useCos ? Adotx + L_ * sinTh * w : Adoty - L_ * cosTh * w;
 
 	auto& j = jacob.at(0);	// 1st (and unique) jacob row
 
 	// Update Jacobian dPhi_dq(i,:)
 	// ----------------------------------
-	if (useCos_)
+	if (useCos)
 	{
-		set(j.dPhi_dx[0], -1);
-		set(j.dPhi_dx[1], 1);
-		set(j.dPhi_drel[0], L_ * sinTh);
+		set(state.Phi_q_, j.dPhi_dx[0], -1);
+		set(state.Phi_q_, j.dPhi_dx[1], 1);
+		set(state.Phi_q_, j.dPhi_drel[0], L_ * sinTh);
 
-		set(j.dPhi_dy[0], 0);
-		set(j.dPhi_dy[1], 0);
+		set(state.Phi_q_, j.dPhi_dy[0], 0);
+		set(state.Phi_q_, j.dPhi_dy[1], 0);
 	}
 	else
 	{
-		set(j.dPhi_dy[0], -1);
-		set(j.dPhi_dy[1], 1);
-		set(j.dPhi_drel[0], -L_ * cosTh);
+		set(state.Phi_q_, j.dPhi_dy[0], -1);
+		set(state.Phi_q_, j.dPhi_dy[1], 1);
+		set(state.Phi_q_, j.dPhi_drel[0], -L_ * cosTh);
 
-		set(j.dPhi_dx[0], 0);
-		set(j.dPhi_dx[1], 0);
+		set(state.Phi_q_, j.dPhi_dx[0], 0);
+		set(state.Phi_q_, j.dPhi_dx[1], 0);
 	}
 
 	// Update Jacobian \dot{dPhi_dq}(i,:)
 	// ----------------------------------
-	set(j.dot_dPhi_dx[0], 0);
-	set(j.dot_dPhi_dy[0], 0);
-	set(j.dot_dPhi_dx[1], 0);
-	set(j.dot_dPhi_dy[1], 0);
-	if (useCos_)
-		set(j.dot_dPhi_drel[0], L_ * cosTh * w);
+	set(state.dotPhi_q_, j.dot_dPhi_dx[0], 0);
+	set(state.dotPhi_q_, j.dot_dPhi_dy[0], 0);
+	set(state.dotPhi_q_, j.dot_dPhi_dx[1], 0);
+	set(state.dotPhi_q_, j.dot_dPhi_dy[1], 0);
+	if (useCos)
+		set(state.dotPhi_q_, j.dot_dPhi_drel[0], L_ * cosTh * w);
 	else
-		set(j.dot_dPhi_drel[0], L_ * sinTh * w);
+		set(state.dotPhi_q_, j.dot_dPhi_drel[0], L_ * sinTh * w);
 
 	// Update Phiqq_times_ddq
 	// ----------------------------------
-	set(j.Phiqq_times_ddq_dx[0], 0);
-	set(j.Phiqq_times_ddq_dy[0], 0);
-	set(j.Phiqq_times_ddq_dx[1], 0);
-	set(j.Phiqq_times_ddq_dy[1], 0);
-	if (useCos_)
-		set(j.Phiqq_times_ddq_drel[0], L_ * cosTh * angAcc);
+	set(state.Phiqq_times_ddq_, j.Phiqq_times_ddq_dx[0], 0);
+	set(state.Phiqq_times_ddq_, j.Phiqq_times_ddq_dy[0], 0);
+	set(state.Phiqq_times_ddq_, j.Phiqq_times_ddq_dx[1], 0);
+	set(state.Phiqq_times_ddq_, j.Phiqq_times_ddq_dy[1], 0);
+	if (useCos)
+		set(
+			state.Phiqq_times_ddq_, j.Phiqq_times_ddq_drel[0],
+			L_ * cosTh * angAcc);
 	else
-		set(j.Phiqq_times_ddq_drel[0], L_ * sinTh * angAcc);
+		set(
+			state.Phiqq_times_ddq_, j.Phiqq_times_ddq_drel[0],
+			L_ * sinTh * angAcc);
 
 	// Update dotPhiqq_times_dq
 	// ----------------------------------
-	set(j.dotPhiqq_times_dq_dx[0], 0);
-	set(j.dotPhiqq_times_dq_dy[0], 0);
-	set(j.dotPhiqq_times_dq_dx[1], 0);
-	set(j.dotPhiqq_times_dq_dy[1], 0);
-	if (useCos_)
-		set(j.dotPhiqq_times_dq_drel[0], -L_ * w * w * sinTh);
+	set(state.dotPhiqq_times_dq_, j.dotPhiqq_times_dq_dx[0], 0);
+	set(state.dotPhiqq_times_dq_, j.dotPhiqq_times_dq_dy[0], 0);
+	set(state.dotPhiqq_times_dq_, j.dotPhiqq_times_dq_dx[1], 0);
+	set(state.dotPhiqq_times_dq_, j.dotPhiqq_times_dq_dy[1], 0);
+	if (useCos)
+		set(
+			state.dotPhiqq_times_dq_, j.dotPhiqq_times_dq_drel[0],
+			-L_ * w * w * sinTh);
 	else
-		set(j.dotPhiqq_times_dq_drel[0], L_ * w * w * cosTh);
+		set(
+			state.dotPhiqq_times_dq_, j.dotPhiqq_times_dq_drel[0],
+			L_ * w * w * cosTh);
 }
 
 void ConstraintRelativeAngleAbsolute::print(std::ostream& o) const
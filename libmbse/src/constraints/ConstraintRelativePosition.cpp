@@ -18,13 +18,14 @@ using mrpt::square;
 				  ConstraintRelativePosition
    -------------------------------------------------------------------*/
 void ConstraintRelativePosition::buildSparseStructures(
-	AssembledRigidModel& arm) const
+	ModelTopology& topology) const
 {
-	commonbuildSparseStructures(arm);
+	commonbuildSparseStructures(topology);
 
-	const PointRef p[4] = {
-		actual_coords(arm, 0), actual_coords(arm, 1), actual_coords(arm, 2),
-		actual_coords(arm, 3)};
+	// Use the initial coordinates, from the model definition:
+	const mrpt::math::TPoint2D p[4] = {
+		points_[0]->coords, points_[1]->coords, points_[2]->coords,
+		points_[3]->coords};
 
 	const auto v01 = mrpt::math::TPoint2D(p[1].x - p[0].x, p[1].y - p[0].y);
 	const auto v02 = mrpt::math::TPoint2D(p[2].x - p[0].x, p[2].y - p[0].y);
@@ -44,13 +45,13 @@ void ConstraintRelativePosition::buildSparseStructures(
 	const_cast<ConstraintRelativePosition&>(*this).y_ = x.y();
 }
 
-void ConstraintRelativePosition::update(AssembledRigidModel& arm) const
+void ConstraintRelativePosition::update(ModelState& state) const
 {
 	// Get references to the point coordinates and velocities
 	// (either fixed or variables in q):
 	const PointRef p[4] = {
-		actual_coords(arm, 0), actual_coords(arm, 1), actual_coords(arm, 2),
-		actual_coords(arm, 3)};
+		actual_coords(state, 0), actual_coords(state, 1),
+		actual_coords(state, 2), actual_coords(state, 3)};
 
 	const auto v01 = mrpt::math::TPoint2D(p[1].x - p[0].x, p[1].y - p[0].y);
 	const auto v02 = mrpt::math::TPoint2D(p[2].x - p[0].x, p[2].y - p[0].y);
@@ -65,67 +66,67 @@ void ConstraintRelativePosition::update(AssembledRigidModel& arm) const
 
 	// Update Phi[i]
 	// ----------------------------------
-	arm.Phi_[idx_constr_.at(0)] = v03.x - x_ * v01.x - y_ * v02.x;
-	arm.Phi_[idx_constr_.at(1)] = v03.y - x_ * v01.y - y_ * v02.y;
+	state.Phi_[idx_constr_.at(0)] = v03.x - x_ * v01.x - y_ * v02.x;
+	state.Phi_[idx_constr_.at(1)] = v03.y - x_ * v01.y - y_ * v02.y;
 
 	// Update dotPhi[i]
 	// ----------------------------------
-	arm.dotPhi_[idx_constr_.at(0)] = dotv03.x - x_ * dotv01.x - y_ * dotv02.x;
-	arm.dotPhi_[idx_constr_.at(1)] = dotv03.y - x_ * dotv01.y - y_ * dotv02.y;
+	state.dotPhi_[idx_constr_.at(0)] = dotv03.x - x_ * dotv01.x - y_ * dotv02.x;
+	state.dotPhi_[idx_constr_.at(1)] = dotv03.y - x_ * dotv01.y - y_ * dotv02.y;
 
 	auto& j0 = jacob.at(0);	 // 1st jacob row
 	auto& j1 = jacob.at(1);	 // 2nd jacob row
 
 	// Update Jacobian dPhi_dq(i,:)
 	// ----------------------------------
-	set(j0.dPhi_dx[0], -1 + x_ + y_);
-	set(j0.dPhi_dx[1], -x_);
-	set(j0.dPhi_dx[2], -y_);
-	set(j0.dPhi_dx[3], 1);
-
-	set(j0.dPhi_dy[0], 0);
-	set(j0.dPhi_dy[1], 0);
-	set(j0.dPhi_dy[2], 0);
-	set(j0.dPhi_dy[3], 0);
-
-	set(j1.dPhi_dy[0], -1 + x_ + y_);
-	set(j1.dPhi_dy[1], -x_);
-	set(j1.dPhi_dy[2], -y_);
-	set(j1.dPhi_dy[3], 1);
-
-	set(j1.dPhi_dx[0], 0);
-	set(j1.dPhi_dx[1], 0);
-	set(j1.dPhi_dx[2], 0);
-	set(j1.dPhi_dx[3], 0);
+	set(state.Phi_q_, j0.dPhi_dx[0], -1 + x_ + y_);
+	set(state.Phi_q_, j0.dPhi_dx[1], -x_);
+	set(state.Phi_q_, j0.dPhi_dx[2], -y_);
+	set(state.Phi_q_, j0.dPhi_dx[3], 1);
+
+	set(state.Phi_q_, j0.dPhi_dy[0], 0);
+	set(state.Phi_q_, j0.dPhi_dy[1], 0);
+	set(state.Phi_q_, j0.dPhi_dy[2], 0);
+	set(state.Phi_q_, j0.dPhi_dy[3], 0);
+
+	set(state.Phi_q_, j1.dPhi_dy[0], -1 + x_ + y_);
+	set(state.Phi_q_, j1.dPhi_dy[1], -x_);
+	set(state.Phi_q_, j1.dPhi_dy[2], -y_);
+	set(state.Phi_q_, j1.dPhi_dy[3], 1);
+
+	set(state.Phi_q_, j1.dPhi_dx[0], 0);
+	set(state.Phi_q_, j1.dPhi_dx[1], 0);
+	set(state.Phi_q_, j1.dPhi_dx[2], 0);
+	set(state.Phi_q_, j1.dPhi_dx[3], 0);
 
 	// Update Jacobian \dot{dPhi_dq}(i,:)
 	// ----------------------------------
 	for (int i = 0; i < 4; i++)
 	{
-		set(j0.dot_dPhi_dx[i], 0);
-		set(j0.dot_dPhi_dy[i], 0);
-		set(j1.dot_dPhi_dx[i], 0);
-		set(j1.dot_dPhi_dy[i], 0);
+		set(state.dotPhi_q_, j0.dot_dPhi_dx[i], 0);
+		set(state.dotPhi_q_, j0.dot_dPhi_dy[i], 0);
+		set(state.dotPhi_q_, j1.dot_dPhi_dx[i], 0);
+		set(state.dotPhi_q_, j1.dot_dPhi_dy[i], 0);
 	}
 
 	// Update Phiqq_times_ddq
 	// ----------------------------------
 	for (int i = 0; i < 4; i++)
 	{
-		set(j0.Phiqq_times_ddq_dx[i], 0);
-		set(j0.Phiqq_times_ddq_dy[i], 0);
-		set(j1.Phiqq_times_ddq_dx[i], 0);
-		set(j1.Phiqq_times_ddq_dy[i], 0);
+		set(state.Phiqq_times_ddq_, j0.Phiqq_times_ddq_dx[i], 0);
+		set(state.Phiqq_times_ddq_, j0.Phiqq_times_ddq_dy[i], 0);
+		set(state.Phiqq_times_ddq_, j1.Phiqq_times_ddq_dx[i], 0);
+		set(state.Phiqq_times_ddq_, j1.Phiqq_times_ddq_dy[i], 0);
 	}
 
 	// Update dotPhiqq_times_dq_dx
 	// ----------------------------------
 	for (int i = 0; i < 4; i++)
 	{
-		set(j0.dotPhiqq_times_dq_dx[i], 0);
-		set(j0.dotPhiqq_times_dq_dy[i], 0);
-		set(j1.dotPhiqq_times_dq_dx[i], 0);
-		set(j1.dotPhiqq_times_dq_dy[i], 0);
+		set(state.dotPhiqq_times_dq_, j0.dotPhiqq_times_dq_dx[i], 0);
+		set(state.dotPhiqq_times_dq_, j0.dotPhiqq_times_dq_dy[i], 0);
+		set(state.dotPhiqq_times_dq_, j1.dotPhiqq_times_dq_dx[i], 0);
+		set(state.dotPhiqq_times_dq_, j1.dotPhiqq_times_dq_dy[i], 0);
 	}
 }
 
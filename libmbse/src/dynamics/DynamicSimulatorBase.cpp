@@ -12,6 +12,8 @@
 #include <mbse/AssembledRigidModel.h>
 #include <mbse/dynamics/dynamic-simulators.h>
 #include <fstream>
+#include <cmath>
+#include <functional>
 
 using namespace mbse;
 using namespace Eigen;
@@ -23,14 +25,88 @@ using namespace std;
 
 const double dummy_zero = 0;
 
+#if USE_BAUMGARTEN_STABILIZATION
+// epsilon=1, omega=10
+const double CDynamicSimulatorBase::BAUMGARTE_K_VEL = 2 * 1.0 * 10.0;
+const double CDynamicSimulatorBase::BAUMGARTE_K_POS = 10.0 * 10.0;
+#else
+const double CDynamicSimulatorBase::BAUMGARTE_K_VEL = 0;
+const double CDynamicSimulatorBase::BAUMGARTE_K_POS = 0;
+#endif
+
+// Row "i" of the "c" term of the RHS. All terms are evaluated in a single
+// pass over the rows, without any temporary storage:
+//  c = -\dot{Phi_q} * \dot{q}
+// and, with Baumgarten Stabilization:
+//  c = -\dot{Phi_q} * \dot{q}  - 2*eps*omega*dotPhi - omega^2 * Phi
+static inline double RHS_c_row(const AssembledRigidModel& arm, size_t i)
+{
+	// "-\dot{Phi_t}"
+	MRPT_TODO("Fix me!");
+
+#if USE_BAUMGARTEN_STABILIZATION
+	return -arm.dotPhi_q_.rowDot(i, &arm.dotq_[0]) -
+		   CDynamicSimulatorBase::BAUMGARTE_K_VEL * arm.dotPhi_[i] -
+		   CDynamicSimulatorBase::BAUMGARTE_K_POS * arm.Phi_[i];
+#else
+	return -arm.dotPhi_q_.rowDot(i, &arm.dotq_[0]);
+#endif
+}
+
 TSimulationState::TSimulationState(const AssembledRigidModel* arm_)
-	: t(0), arm(arm_)
+	: t(0), dt(0), arm(arm_)
 {
 }
 
 // Virtual destructor: requird for virtual bases
 CDynamicSimulatorBase::~CDynamicSimulatorBase() {}
 
+namespace
+{
+using simulator_factory_t = std::function<CDynamicSimulatorBase::Ptr(
+	const std::shared_ptr<AssembledRigidModel>&)>;
+
+template <class SIMUL>
+std::pair<std::string, simulator_factory_t> registerSimulator(
+	const char* name)
+{
+	return {name, [](const std::shared_ptr<AssembledRigidModel>& arm) {
+				return std::make_shared<SIMUL>(arm);
+			}};
+}
+
+const std::vector<std::pair<std::string, simulator_factory_t>>&
+	simulatorRegistry()
+{
+	static const std::vector<std::pair<std::string, simulator_factory_t>> r =
+		{registerSimulator<CDynamicSimulator_Lagrange_LU_dense>(
+			 "CDynamicSimulator_Lagrange_LU_dense"),
+		 registerSimulator<CDynamicSimulator_Lagrange_CHOLMOD>(
+			 "CDynamicSimulator_Lagrange_CHOLMOD"),
+		 registerSimulator<CDynamicSimulator_Lagrange_UMFPACK>(
+			 "CDynamicSimulator_Lagrange_UMFPACK"),
+		 registerSimulator<CDynamicSimulator_Lagrange_KLU>(
+			 "CDynamicSimulator_Lagrange_KLU"),
+		 registerSimulator<CDynamicSimulator_Lagrange_Tree>(
+			 "CDynamicSimulator_Lagrange_Tree"),
+		 registerSimulator<CDynamicSimulator_R_matrix_dense>(
+			 "CDynamicSimulator_R_matrix_dense"),
+		 registerSimulator<CDynamicSimulator_Indep_dense>(
+			 "CDynamicSimulator_Indep_dense"),
+		 registerSimulator<CDynamicSimulator_Indep_sparse>(
+			 "CDynamicSimulator_Indep_sparse"),
+		 registerSimulator<CDynamicSimulator_AugmentedLagrangian_KLU>(
+			 "CDynamicSimulator_AugmentedLagrangian_KLU"),
+		 registerSimulator<CDynamicSimulator_AugmentedLagrangian_Dense>(
+			 "CDynamicSimulator_AugmentedLagrangian_Dense"),
+		 registerSimulator<CDynamicSimulator_ALi3_Dense>(
+			 "CDynamicSimulator_ALi3_Dense"),
+		 registerSimulator<CDynamicSimulator_ALi3_Sparse>(
+			 "CDynamicSimulator_ALi3_Sparse")};
+	return r;
+}
+}  // namespace
+
 /** A class factory, creates a dynamic simulator from a string with the class
  * name: "CDynamicSimulator_Lagrange_LU_dense",
  * "CDynamicSimulator_Lagrange_UMFPACK", ...
@@ -38,16 +114,17 @@ CDynamicSimulatorBase::~CDynamicSimulatorBase() {}
 CDynamicSimulatorBase::Ptr CDynamicSimulatorBase::Create(
 	const std::string& name, const std::shared_ptr<AssembledRigidModel> arm_ptr)
 {
-	if (name == "CDynamicSimulator_Lagrange_LU_dense")
-		return Ptr(new CDynamicSimulator_Lagrange_LU_dense(arm_ptr));
-	else if (name == "CDynamicSimulator_Lagrange_CHOLMOD")
-		return Ptr(new CDynamicSimulator_Lagrange_CHOLMOD(arm_ptr));
-	else if (name == "CDynamicSimulator_Lagrange_UMFPACK")
-		return Ptr(new CDynamicSimulator_Lagrange_UMFPACK(arm_ptr));
-	else if (name == "CDynamicSimulator_Lagrange_KLU")
-		return Ptr(new CDynamicSimulator_Lagrange_KLU(arm_ptr));
-	else
-		THROW_EXCEPTION("Unknown dynamic simulator class name: " + name);
+	for (const auto& e : simulatorRegistry())
+		if (e.first == name) return e.second(arm_ptr);
+
+	THROW_EXCEPTION("Unknown dynamic simulator class name: " + name);
+}
+
+std::vector<std::string> CDynamicSimulatorBase::RegisteredNames()
+{
+	std::vector<std::string> names;
+	for (const auto& e : simulatorRegistry()) names.push_back(e.first);
+	return names;
 }
 
 // ---------------------------------------------------------------------------------------------
@@ -69,11 +146,66 @@ void CDynamicSimulatorBase::solve_ddotq(
 	this->internal_solve_ddotq(t, ddot_q, lagrangre);
 }
 
+void CDynamicSimulatorBase::solve_kkt(Eigen::MatrixXd& rhs)
+{
+	THROW_EXCEPTION("This dynamic formulation does not implement solve_kkt()");
+}
+
+void CDynamicSimulatorBase::solve_ddotq_batch(
+	double t, const Eigen::MatrixXd& q, const Eigen::MatrixXd& dq,
+	Eigen::MatrixXd& ddot_q, const Eigen::MatrixXd* Q)
+{
+	ASSERT_(init_);
+	const auto n = arm_->q_.size();
+	ASSERT_EQUAL_(q.rows(), n);
+	ASSERT_EQUAL_(dq.rows(), n);
+	ASSERT_EQUAL_(q.cols(), dq.cols());
+	if (Q)
+	{
+		ASSERT_EQUAL_(Q->rows(), n);
+		ASSERT_EQUAL_(Q->cols(), q.cols());
+	}
+
+	MBSE_PROFILE_SCOPE("solver_ddotq_batch");
+
+	q0 = arm_->q_;
+	v1 = arm_->dotq_;
+	const Eigen::VectorXd Q0 = arm_->Q_;
+
+	ddot_q.resize(n, q.cols());
+	for (Eigen::Index i = 0; i < q.cols(); i++)
+	{
+		arm_->q_ = q.col(i);
+		arm_->dotq_ = dq.col(i);
+		if (Q) arm_->Q_ = Q->col(i);
+		arm_->realize_operating_point();
+		this->internal_solve_ddotq(t, ddotq1);
+		ddot_q.col(i) = ddotq1;
+	}
+
+	arm_->q_ = q0;
+	arm_->dotq_ = v1;
+	arm_->Q_ = Q0;
+}
+
 /** Prepare the linear systems and anything else required to really call
  * solve_ddotq() */
 void CDynamicSimulatorBase::prepare()
 {
+	ASSERTMSG_(
+		this->supports_ode_solver(params.ode_solver),
+		mrpt::format(
+			"params.ode_solver=%i is not supported by this dynamic "
+			"formulation",
+			static_cast<int>(params.ode_solver)));
+
 	this->internal_prepare();
+	rk_fsal_ = false;
+	rk_dt_ = 0;
+	gen_alpha_.reset();
+	// Only for ODE_MultiRate (or lazily, if params.ode_solver changes later):
+	mr_prepared_ = false;
+	if (params.ode_solver == ODE_MultiRate) prepare_multirate();
 	init_ = true;
 }
 
@@ -92,9 +224,11 @@ double CDynamicSimulatorBase::run(const double t_ini, const double t_end)
 	const double t_step2 = t_step * 0.5;
 	const double t_step6 = t_step / 6.0;
 
-	double t;  // Declared here so we know the final "time":
-	for (t = t_ini; t < t_end; t += t_step)
+	double t = t_ini;  // Declared here so we know the final "time":
+	while (t < t_end)
 	{
+		double dt = t_step;
+
 		// Log sensor points:
 		// ------------------------------
 		for (auto& sd : sensors_)
@@ -105,7 +239,7 @@ double CDynamicSimulatorBase::run(const double t_ini, const double t_end)
 					   {*sd.pos[0], *sd.pos[1]}, {*sd.vel[0], *sd.vel[1]})));
 		}
 
-		timelog().enter("mbs.run_complete_timestep");
+		MBSE_PROFILE_ENTER("mbs.run_complete_timestep");
 
 		// Integrate:
 		// ------------------------------
@@ -231,7 +365,32 @@ double CDynamicSimulatorBase::run(const double t_ini, const double t_end)
 					ASSERTMSG_(
 						iter < MAX_ITERS, "Trapezoidal convergence failed!");
 
-					timelog().registerUserMeasure("trapezoidal.iters", iter);
+					MBSE_PROFILE_VALUE("trapezoidal.iters", iter);
+				}
+				break;
+
+				// Adaptive Dormand-Prince 5(4):
+				// -------------------------------------------
+				case ODE_RK45:
+				{
+					dt = this->integrate_RK45(t, t_end - t);
+					arm_->ddotq_ = rk_acc_[6];
+				}
+				break;
+
+				// Implicit generalized-alpha (index-3):
+				// -------------------------------------------
+				case ODE_GeneralizedAlpha:
+				{
+					gen_alpha_.step(*arm_, t_step);
+				}
+				break;
+
+				// Multi-rate, with subcycled fast coordinates:
+				// -------------------------------------------
+				case ODE_MultiRate:
+				{
+					this->integrate_multirate(t, t_step);
 				}
 				break;
 
@@ -242,59 +401,167 @@ double CDynamicSimulatorBase::run(const double t_ini, const double t_end)
 
 		this->post_iteration(t);
 
-		timelog().leave("mbs.run_complete_timestep");
+		MBSE_PROFILE_LEAVE("mbs.run_complete_timestep");
 
 		// User-callback:
 		// ------------------------------
 		sim_state.t = t;
+		sim_state.dt = dt;
 		if (params.user_callback) params.user_callback(sim_state);
+
+		// Adaptive steps end exactly at t_end:
+		t = (params.ode_solver == ODE_RK45 && dt >= t_end - t) ? t_end
+															   : t + dt;
 	}
 
 	return t;
 }
 
-void CDynamicSimulatorBase::build_RHS(double* Q, double* c)
+namespace
 {
-	const size_t nConstraints = arm_->Phi_.size();
-
-	// Q part:
-	arm_->builGeneralizedForces(Q);
+// Butcher tableau of the Dormand-Prince 5(4) method. The 5th order weights
+// are the last row of "a", so the last stage is evaluated at the new state.
+const double DP_c[7] = {0, 1. / 5, 3. / 10, 4. / 5, 8. / 9, 1, 1};
+const double DP_a[7][6] = {
+	{0, 0, 0, 0, 0, 0},
+	{1. / 5, 0, 0, 0, 0, 0},
+	{3. / 40, 9. / 40, 0, 0, 0, 0},
+	{44. / 45, -56. / 15, 32. / 9, 0, 0, 0},
+	{19372. / 6561, -25360. / 2187, 64448. / 6561, -212. / 729, 0, 0},
+	{9017. / 3168, -355. / 33, 46732. / 5247, 49. / 176, -5103. / 18656, 0},
+	{35. / 384, 0, 500. / 1113, 125. / 192, -2187. / 6784, 11. / 84}};
+// Difference between the 5th and 4th order weights (error estimate):
+const double DP_e[7] = {71. / 57600,	  0,		   -71. / 16695,
+						71. / 1920,		  -17253. / 339200, 22. / 525,
+						-1. / 40};
+}  // namespace
+
+double CDynamicSimulatorBase::integrate_RK45(double t, double max_dt)
+{
+	MBSE_PROFILE_SCOPE("rk45.step");
+
+	const Eigen::Index n = arm_->q_.size();
+
+	if (rk_dt_ <= 0) rk_dt_ = params.time_step;
+	double h_try = rk_dt_;
+	if (params.max_time_step > 0) h_try = std::min(h_try, params.max_time_step);
+
+	// k1 = f(t,y), unless it was already evaluated at the end of the last
+	// step (FSAL):
+	q0 = arm_->q_;
+	rk_vel_[0] = arm_->dotq_;
+	const bool fsal = rk_fsal_ && rk_t_end_ == t && arm_->q_ == rk_q_end_ &&
+					  arm_->dotq_ == rk_dq_end_ &&
+					  this->integrator_can_reuse_last_acc();
+	if (fsal)
+		rk_acc_[0].swap(rk_acc_[6]);
+	else
+		this->integrator_solve_acc(t, rk_acc_[0], true);
+	rk_fsal_ = false;
 
-	// "c" part:
-	if (c)
+	size_t rejected = 0;
+	for (;;)
 	{
-		// "-\dot{Phi_q} * \dot{q}"
-		for (size_t i = 0; i < nConstraints; i++)
+		const bool clipped = h_try >= max_dt;
+		const double h = clipped ? max_dt : h_try;
+
+		// Stages 2-7: y_s = y0 + h * sum_j a_sj k_j
+		for (int s = 1; s < 7; s++)
 		{
-			// c[i] = sum_k( -dot{Phi_q}[i,k] * dot_q[k] )
-			double ci = 0;
-			const CompressedRowSparseMatrix::row_t row_i =
-				arm_->dotPhi_q_.matrix[i];
-			for (const auto& colVal : row_i)
+			rk_q_ = q0;
+			rk_dacc_.setZero(rk_acc_[0].size());
+			for (int j = 0; j < s; j++)
 			{
-				const size_t col = colVal.first;
-				ci -= colVal.second * arm_->dotq_[col];
+				if (DP_a[s][j] == 0) continue;
+				rk_q_ += (h * DP_a[s][j]) * rk_vel_[j];
+				rk_dacc_ += (h * DP_a[s][j]) * rk_acc_[j];
 			}
+			arm_->q_ = rk_q_;
+			this->integrator_dq_plus_dacc(rk_vel_[0], rk_dacc_, arm_->dotq_);
+			this->integrator_correct_state();
 
-			// "-\dot{Phi_t}"
-			MRPT_TODO("Fix me!");
+			rk_vel_[s] = arm_->dotq_;
+			this->integrator_solve_acc(t + DP_c[s] * h, rk_acc_[s], false);
+		}
+		// The model now holds the 5th order solution.
 
-			// Save c_i in its place within "c":
-			c[i] = ci;
+		// Local error estimate, as the difference with the 4th order one:
+		rk_q_.setZero(n);
+		rk_dacc_.setZero(rk_acc_[0].size());
+		for (int j = 0; j < 7; j++)
+		{
+			if (DP_e[j] == 0) continue;
+			rk_q_ += (h * DP_e[j]) * rk_vel_[j];
+			rk_dacc_ += (h * DP_e[j]) * rk_acc_[j];
 		}
+		rk_err_dq_.setZero(n);
+		this->integrator_dq_plus_dacc(rk_err_dq_, rk_dacc_, rk_err_dq_);
 
-#if USE_BAUMGARTEN_STABILIZATION
-		// Use Baumgarten Stabilization
-		//  c= -\dot{Phi_q} * \dot{q}  - 2*eps*omega*dotPhi - omega^2 * Phi
-		const double epsilon = 1;
-		const double omega = 10;
-		for (size_t i = 0; i < nConstraints; i++)
-			c[i] -= 2 * epsilon * omega * arm_->dotPhi_[i] +
-					omega * omega * arm_->Phi_[i];
-#endif
+		double err2 = 0;
+		for (Eigen::Index i = 0; i < n; i++)
+		{
+			const double sq =
+				params.abs_tol +
+				params.rel_tol *
+					std::max(std::abs(q0[i]), std::abs(arm_->q_[i]));
+			const double sdq =
+				params.abs_tol +
+				params.rel_tol *
+					std::max(std::abs(rk_vel_[0][i]), std::abs(arm_->dotq_[i]));
+			err2 += mrpt::square(rk_q_[i] / sq) +
+					mrpt::square(rk_err_dq_[i] / sdq);
+		}
+		const double err = n > 0 ? std::sqrt(err2 / (2 * n)) : 0;
+
+		// Step size control, with the usual safety factor and limits:
+		const double factor =
+			err > 0 ? std::min(5.0, std::max(0.2, 0.9 * std::pow(err, -0.2)))
+					: 5.0;
+
+		if (err <= 1.0)
+		{
+			// Accepted. A step clipped to reach max_dt must not shrink the
+			// next one:
+			rk_dt_ = clipped ? std::max(h * factor, h_try) : h * factor;
+
+			rk_t_end_ = t + h;
+			rk_q_end_ = arm_->q_;
+			rk_dq_end_ = arm_->dotq_;
+			rk_fsal_ = true;
+
+			MBSE_PROFILE_VALUE("rk45.rejected_steps", rejected);
+			MBSE_PROFILE_VALUE("rk45.dt", h);
+			return h;
+		}
+
+		rejected++;
+		h_try = h * std::min(1.0, factor);
+		ASSERTMSG_(
+			h_try >= params.min_time_step,
+			mrpt::format(
+				"RK45: step size below min_time_step at t=%f (error=%e)", t,
+				err));
 	}
 }
 
+void CDynamicSimulatorBase::build_RHS(double* Q, double* c)
+{
+	const size_t nConstraints = arm_->Phi_.size();
+
+	// Q part:
+	arm_->builGeneralizedForces(Q);
+
+	// "c" part:
+	if (c)
+		for (size_t i = 0; i < nConstraints; i++) c[i] = RHS_c_row(*arm_, i);
+}
+
+void CDynamicSimulatorBase::build_RHS_c_rows(
+	const std::vector<size_t>& rows, double* c) const
+{
+	for (size_t i = 0; i < rows.size(); i++) c[i] = RHS_c_row(*arm_, rows[i]);
+}
+
 /** Add a "sensor" that grabs the position of a given point.
  * \sa saveSensorLogsToFile
  */
@@ -0,0 +1,317 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include <mbse/ModelDefinition.h>
+#include <mbse/AssembledRigidModel.h>
+#include <mbse/dynamics/dynamic-simulators.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace mbse;
+using namespace Eigen;
+using namespace std;
+
+void CDynamicSimulatorBase::setFastCoordinates(
+	const std::vector<dof_index_t>& dofs)
+{
+	mr_fast_dofs_ = dofs;
+	mr_user_fast_dofs_ = !dofs.empty();
+	init_ = false;	// prepare() must be called again
+}
+
+void CDynamicSimulatorBase::prepare_multirate()
+{
+	const size_t nDOFs = arm_->q_.size();
+
+	// Partition: user-provided, or the points of the "fast" bodies
+	if (!mr_user_fast_dofs_)
+	{
+		mr_fast_dofs_.clear();
+		for (const Body& b : arm_->mechanism_.bodies())
+		{
+			if (!b.fast) continue;
+			for (const point_index_t p : b.points)
+			{
+				const Point2ToDOF& pd = arm_->getPoints2DOFs().at(p);
+				if (pd.dof_x != INVALID_DOF) mr_fast_dofs_.push_back(pd.dof_x);
+				if (pd.dof_y != INVALID_DOF) mr_fast_dofs_.push_back(pd.dof_y);
+			}
+		}
+	}
+	std::sort(mr_fast_dofs_.begin(), mr_fast_dofs_.end());
+	mr_fast_dofs_.erase(
+		std::unique(mr_fast_dofs_.begin(), mr_fast_dofs_.end()),
+		mr_fast_dofs_.end());
+
+	mr_fast_index_.assign(nDOFs, INVALID_DOF);
+	for (size_t i = 0; i < mr_fast_dofs_.size(); i++)
+	{
+		ASSERT_LT_(mr_fast_dofs_[i], nDOFs);
+		mr_fast_index_[mr_fast_dofs_[i]] = i;
+	}
+	mr_slow_dofs_.clear();
+	for (size_t i = 0; i < nDOFs; i++)
+		if (mr_fast_index_[i] == INVALID_DOF) mr_slow_dofs_.push_back(i);
+
+	// Constraints of the fast subsystem: those with any fast coordinate.
+	// The rest of them only depend on the slow coordinates.
+	mr_rows_.clear();
+	const auto& Phi_q = arm_->Phi_q_;
+	for (size_t r = 0; r < arm_->Phi_.size(); r++)
+	{
+		for (size_t k = Phi_q.row_ptr[r]; k < Phi_q.row_ptr[r + 1]; k++)
+		{
+			if (mr_fast_index_[Phi_q.col_idx[k]] == INVALID_DOF) continue;
+			mr_rows_.push_back(r);
+			break;
+		}
+	}
+
+	// ...and the constraints to evaluate to update those rows:
+	std::vector<bool> is_fast_row(arm_->Phi_.size(), false);
+	for (const size_t r : mr_rows_) is_fast_row[r] = true;
+	const ModelTopology& topo = *arm_->topology();
+	mr_constraints_.clear();
+	for (size_t c = 0; c < topo.constraints_.size(); c++)
+	{
+		const auto [firstRow, nRows] = topo.constraintRows_[c];
+		for (size_t r = firstRow; r < firstRow + nRows; r++)
+		{
+			if (!is_fast_row[r]) continue;
+			mr_constraints_.push_back(c);
+			break;
+		}
+	}
+
+	// The mass part of the fast subsystem matrix is constant, and so is
+	// the block M_fs coupling it with the slow accelerations:
+	const size_t nF = mr_fast_dofs_.size(), nR = mr_rows_.size();
+	mr_A_.setZero(nF + nR, nF + nR);
+	std::vector<Eigen::Triplet<double>> M_fs_tri;
+	for (const auto& t : arm_->buildMassMatrix_sparse())
+	{
+		const auto i = mr_fast_index_[t.row()], j = mr_fast_index_[t.col()];
+		if (i == INVALID_DOF) continue;
+		if (j != INVALID_DOF)
+			mr_A_(i, j) += t.value();
+		else
+			M_fs_tri.emplace_back(i, t.col(), t.value());
+	}
+	mr_M_fs_.resize(nF, nDOFs);
+	mr_M_fs_.setFromTriplets(M_fs_tri.begin(), M_fs_tri.end());
+
+	mr_acc_end_valid_ = false;
+	mr_stats_ = TMultiRateStats();
+	mr_prepared_ = true;
+}
+
+void CDynamicSimulatorBase::multirate_set_slow_state(double tau)
+{
+	const double tau2 = 0.5 * tau * tau, tau3 = tau * tau * tau / 6.0;
+	for (const dof_index_t i : mr_slow_dofs_)
+	{
+		arm_->q_[i] = mr_q0_[i] + tau * mr_dq0_[i] + tau2 * mr_acc0_[i] +
+					  tau3 * mr_jerk_[i];
+		arm_->dotq_[i] = mr_dq0_[i] + tau * mr_acc0_[i] + tau2 * mr_jerk_[i];
+		mr_acc_[i] = mr_acc0_[i] + tau * mr_jerk_[i];
+	}
+}
+
+void CDynamicSimulatorBase::multirate_build_fast_matrix()
+{
+	const ModelTopology& topo = *arm_->topology();
+	for (const size_t c : mr_constraints_) topo.constraints_[c]->update(*arm_);
+	mr_stats_.constraint_evals += mr_constraints_.size();
+
+	const size_t nF = mr_fast_dofs_.size();
+	const auto& Phi_q = arm_->Phi_q_;
+	for (size_t ir = 0; ir < mr_rows_.size(); ir++)
+	{
+		const size_t r = mr_rows_[ir];
+		for (size_t k = Phi_q.row_ptr[r]; k < Phi_q.row_ptr[r + 1]; k++)
+		{
+			const auto j = mr_fast_index_[Phi_q.col_idx[k]];
+			if (j == INVALID_DOF) continue;
+			mr_A_(nF + ir, j) = Phi_q.values[k];
+			mr_A_(j, nF + ir) = Phi_q.values[k];
+		}
+	}
+	mr_lu_.compute(mr_A_);
+}
+
+void CDynamicSimulatorBase::multirate_solve_fast(Eigen::VectorXd& acc_f)
+{
+	MBSE_PROFILE_SCOPE("multirate.solve_fast");
+
+	const size_t nF = mr_fast_dofs_.size(), nR = mr_rows_.size();
+
+	multirate_build_fast_matrix();
+
+	// RHS: the rows of the fast subsystem, minus the terms of the (known)
+	// slow accelerations:
+	mr_rhs_.resize(nF + nR);
+	arm_->builGeneralizedForces(mr_fast_dofs_, mr_rhs_.data());
+	this->build_RHS_c_rows(mr_rows_, mr_rhs_.data() + nF);
+
+	for (const dof_index_t i : mr_fast_dofs_) mr_acc_[i] = 0;
+	mr_rhs_.head(nF).noalias() -= mr_M_fs_ * mr_acc_;
+	for (size_t ir = 0; ir < nR; ir++)
+		mr_rhs_[nF + ir] -= arm_->Phi_q_.rowDot(mr_rows_[ir], mr_acc_.data());
+
+	acc_f = mr_lu_.solve(mr_rhs_).head(nF);
+	mr_stats_.fast_solves++;
+}
+
+void CDynamicSimulatorBase::multirate_project_fast()
+{
+	MBSE_PROFILE_SCOPE("multirate.project_fast");
+
+	const size_t MAX_ITERS = 10;
+	const double PHI_MAX = 1e-12;
+
+	const size_t nF = mr_fast_dofs_.size(), nR = mr_rows_.size();
+	mr_rhs_.resize(nF + nR);
+
+	// Positions: minimum (mass-weighted) norm corrections of the fast
+	// coordinates, with the slow ones fixed:
+	//  [  M_ff  Phi_rf^t ] [ Aq_f ] = [    0   ]
+	//  [ Phi_rf    0     ] [  mu  ]   [ -Phi_r ]
+	for (size_t iter = 0;; iter++)
+	{
+		multirate_build_fast_matrix();
+
+		double phi_max = 0;
+		for (size_t ir = 0; ir < nR; ir++)
+		{
+			mr_rhs_[nF + ir] = -arm_->Phi_[mr_rows_[ir]];
+			phi_max = std::max(phi_max, std::abs(mr_rhs_[nF + ir]));
+		}
+		if (phi_max < PHI_MAX || iter == MAX_ITERS) break;
+
+		mr_rhs_.head(nF).setZero();
+		mr_rhs_ = mr_lu_.solve(mr_rhs_).eval();
+		for (size_t i = 0; i < nF; i++)
+			arm_->q_[mr_fast_dofs_[i]] += mr_rhs_[i];
+	}
+
+	// Velocities: same correction, so Phi_q * dq = 0 for these constraints
+	for (size_t ir = 0; ir < nR; ir++)
+	{
+		const size_t r = mr_rows_[ir];
+		mr_rhs_[nF + ir] = -arm_->Phi_q_.rowDot(r, arm_->dotq_.data());
+	}
+	mr_rhs_.head(nF).setZero();
+	mr_rhs_ = mr_lu_.solve(mr_rhs_).eval();
+	for (size_t i = 0; i < nF; i++)
+		arm_->dotq_[mr_fast_dofs_[i]] += mr_rhs_[i];
+}
+
+void CDynamicSimulatorBase::integrate_multirate(double t, double dt)
+{
+	MBSE_PROFILE_SCOPE("multirate.step");
+
+	if (!mr_prepared_) prepare_multirate();
+
+	ASSERTMSG_(
+		!mr_fast_dofs_.empty(),
+		"ODE_MultiRate requires fast coordinates: tag some bodies as `fast` "
+		"or call setFastCoordinates()");
+	ASSERT_GE_(params.multirate_substeps, 1U);
+
+	const size_t nF = mr_fast_dofs_.size();
+	const size_t nConstraints = arm_->topology()->constraints_.size();
+
+	// Accelerations at the beginning of the step, reused from the last one
+	// if the state has not been modified in between:
+	mr_q0_ = arm_->q_;
+	mr_dq0_ = arm_->dotq_;
+	if (mr_acc_end_valid_ && mr_q_end_ == arm_->q_ &&
+		mr_dq_end_ == arm_->dotq_)
+		mr_acc0_.swap(mr_acc_end_);
+	else
+	{
+		this->internal_solve_ddotq(t, mr_acc0_);
+		mr_stats_.full_solves++;
+		mr_stats_.constraint_evals += nConstraints;
+	}
+
+	// Accelerations at the end, at the state predicted with those at the
+	// beginning:
+	arm_->q_ = mr_q0_ + dt * mr_dq0_ + (0.5 * dt * dt) * mr_acc0_;
+	arm_->dotq_ = mr_dq0_ + dt * mr_acc0_;
+	this->internal_solve_ddotq(t + dt, mr_acc_end_);
+	mr_stats_.full_solves++;
+	mr_stats_.constraint_evals += nConstraints;
+	mr_jerk_ = (mr_acc_end_ - mr_acc0_) / dt;
+
+	// Fast coordinates: RK4 substeps, with the slow ones interpolated
+	// -----------------------------------------------------------------
+	mr_acc_.resize(arm_->q_.size());
+	for (int s = 0; s < 4; s++) mr_vf_[s].resize(nF);
+	mr_qf_.resize(nF);
+	for (size_t i = 0; i < nF; i++)
+	{
+		mr_qf_[i] = mr_q0_[mr_fast_dofs_[i]];
+		mr_vf_[0][i] = mr_dq0_[mr_fast_dofs_[i]];
+	}
+
+	const double h = dt / params.multirate_substeps;
+	// Time of each RK4 stage since the substep start, in units of h:
+	const double stage_x[4] = {0, 0.5, 0.5, 1.0};
+
+	for (size_t sub = 0; sub < params.multirate_substeps; sub++)
+	{
+		const double tau = sub * h;
+		for (int s = 0; s < 4; s++)
+		{
+			// Stage state: q = q0 + c*h*v_{s-1}, v = v0 + c*h*a_{s-1}
+			const double ch = stage_x[s] * h;
+			multirate_set_slow_state(tau + ch);
+			if (s > 0) mr_vf_[s] = mr_vf_[0] + ch * mr_af_[s - 1];
+			const Eigen::VectorXd& v_prev = mr_vf_[s > 0 ? s - 1 : 0];
+			for (size_t i = 0; i < nF; i++)
+			{
+				const auto dof = mr_fast_dofs_[i];
+				arm_->q_[dof] = mr_qf_[i] + ch * v_prev[i];
+				arm_->dotq_[dof] = mr_vf_[s][i];
+			}
+			multirate_solve_fast(mr_af_[s]);
+		}
+
+		// Runge-Kutta 4th order formula:
+		mr_qf_ += (h / 6.0) *
+				  (mr_vf_[0] + 2 * mr_vf_[1] + 2 * mr_vf_[2] + mr_vf_[3]);
+		mr_vf_[0] += (h / 6.0) *
+					 (mr_af_[0] + 2 * mr_af_[1] + 2 * mr_af_[2] + mr_af_[3]);
+	}
+
+	// Reconcile both parts at the end of the step
+	// -----------------------------------------------------------------
+	multirate_set_slow_state(dt);
+	for (size_t i = 0; i < nF; i++)
+	{
+		arm_->q_[mr_fast_dofs_[i]] = mr_qf_[i];
+		arm_->dotq_[mr_fast_dofs_[i]] = mr_vf_[0][i];
+	}
+	multirate_project_fast();
+
+	// Fast accelerations consistent with the final (projected) state, since
+	// they are also the first ones of the next step:
+	multirate_solve_fast(mr_af_[0]);
+	for (size_t i = 0; i < nF; i++)
+		mr_acc_end_[mr_fast_dofs_[i]] = mr_af_[0][i];
+
+	arm_->ddotq_ = mr_acc_end_;
+	mr_q_end_ = arm_->q_;
+	mr_dq_end_ = arm_->dotq_;
+	mr_acc_end_valid_ = true;
+
+	mr_stats_.macro_steps++;
+}
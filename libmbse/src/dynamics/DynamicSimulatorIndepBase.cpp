@@ -35,6 +35,50 @@ void CDynamicSimulatorIndepBase::solve_ddotz(double t, VectorXd& ddot_z)
 	this->internal_solve_ddotz(t, ddot_z);
 }
 
+void CDynamicSimulatorIndepBase::solve_ddotz_batch(
+	double t, const Eigen::MatrixXd& q, const Eigen::MatrixXd& dq,
+	Eigen::MatrixXd& ddot_z)
+{
+	ASSERT_(init_);
+	const auto n = arm_->q_.size();
+	ASSERT_EQUAL_(q.rows(), n);
+	ASSERT_EQUAL_(dq.rows(), n);
+	ASSERT_EQUAL_(q.cols(), dq.cols());
+
+	MBSE_PROFILE_SCOPE("solver_ddotz_batch");
+
+	q0 = arm_->q_;
+	v1 = arm_->dotq_;
+	// Keep the current independent coordinates for all states:
+	const bool can_choose = can_choose_indep_coords_;
+	can_choose_indep_coords_ = false;
+
+	const auto d = independent_coordinate_indices().size();
+	ddot_z.resize(d, q.cols());
+	try
+	{
+		for (Eigen::Index i = 0; i < q.cols(); i++)
+		{
+			arm_->q_ = q.col(i);
+			arm_->dotq_ = dq.col(i);
+			arm_->realize_operating_point();
+			this->internal_solve_ddotz(t, ddotz1);
+			ddot_z.col(i) = ddotz1;
+		}
+	}
+	catch (...)
+	{
+		can_choose_indep_coords_ = can_choose;
+		arm_->q_ = q0;
+		arm_->dotq_ = v1;
+		throw;
+	}
+
+	can_choose_indep_coords_ = can_choose;
+	arm_->q_ = q0;
+	arm_->dotq_ = v1;
+}
+
 // Run simulation:
 double CDynamicSimulatorIndepBase::run(const double t_ini, const double t_end)
 {
@@ -50,9 +94,12 @@ double CDynamicSimulatorIndepBase::run(const double t_ini, const double t_end)
 	const double t_step2 = t_step * 0.5;
 	const double t_step6 = t_step / 6.0;
 
-	double t;  // Declared here so we know the final "time":
-	for (t = t_ini; t < t_end; t += t_step)
+	double t = t_ini;  // Declared here so we know the final "time":
+	while (t < t_end)
 	{
+		double dt = t_step;
+		const Eigen::VectorXd* last_ddotz = &ddotz1;
+
 		// Log sensor points:
 		// ------------------------------
 		for (std::list<TSensorData>::iterator it = sensors_.begin();
@@ -65,7 +112,7 @@ double CDynamicSimulatorIndepBase::run(const double t_ini, const double t_end)
 					   mrpt::math::TPoint2D(*sd.vel[0], *sd.vel[1]))));
 		}
 
-		timelog().enter("mbs.run_complete_timestep");
+		MBSE_PROFILE_ENTER("mbs.run_complete_timestep");
 		arm_->realize_operating_point();
 
 		// Integrate:
@@ -195,13 +242,25 @@ double CDynamicSimulatorIndepBase::run(const double t_ini, const double t_end)
 				}
 				ASSERTMSG_(iter<MAX_ITERS,"Trapezoidal convergence failed!")
 
-				timelog().registerUserMeasure("trapezoidal.iters",iter);
+				MBSE_PROFILE_VALUE("trapezoidal.iters", iter);
 			}
 			break;
 #endif
 
+			// Adaptive Dormand-Prince 5(4):
+			// -------------------------------------------
+			case ODE_RK45:
+			{
+				dt = this->integrate_RK45(t, t_end - t);
+				last_ddotz = &rk_acc_[6];
+			}
+			break;
+
 			default:
-				THROW_EXCEPTION("Unknown value for params.ode_solver");
+				THROW_EXCEPTION(
+					"params.ode_solver not supported by formulations in "
+					"independent coordinates: use ODE_Euler, ODE_RK4 or "
+					"ODE_RK45");
 		};
 
 		// Save last ddotq:
@@ -209,19 +268,33 @@ double CDynamicSimulatorIndepBase::run(const double t_ini, const double t_end)
 		cdr.ddotq = &arm_->ddotq_;
 		arm_->computeDependentPosVelAcc(
 			independent_coordinate_indices(), false /*update q*/,
-			false /*update dq*/, {}, cdr, &ddotz1);
+			false /*update dq*/, {}, cdr, last_ddotz);
 
-		timelog().leave("mbs.run_complete_timestep");
+		MBSE_PROFILE_LEAVE("mbs.run_complete_timestep");
 
 		// User-callback:
 		// ------------------------------
 		sim_state.t = t;
+		sim_state.dt = dt;
 		if (params.user_callback) params.user_callback(sim_state);
+
+		// Adaptive steps end exactly at t_end:
+		t = (params.ode_solver == ODE_RK45 && dt >= t_end - t) ? t_end
+															   : t + dt;
 	}
 
 	return t;
 }
 
+void CDynamicSimulatorIndepBase::integrator_solve_acc(
+	double t, VectorXd& acc, bool step_start)
+{
+	// As in RK4: independent coordinates may only change at the beginning of
+	// a time step.
+	can_choose_indep_coords_ = step_start;
+	this->internal_solve_ddotz(t, acc);
+}
+
 /** Wrapper for ddotq computation, from ddotz */
 void CDynamicSimulatorIndepBase::internal_solve_ddotq(
 	double t, VectorXd& ddot_q, VectorXd* lagrangre)
@@ -29,7 +29,7 @@ CDynamicSimulator_ALi3_Dense::CDynamicSimulator_ALi3_Dense(
  * solve_ddotq() */
 void CDynamicSimulator_ALi3_Dense::internal_prepare()
 {
-	timelog().enter("solver_prepare");
+	MBSE_PROFILE_ENTER("solver_prepare");
 
 	M_ = arm_->buildMassMatrix_dense();
 	M_ldlt_.compute(M_);
@@ -37,7 +37,7 @@ void CDynamicSimulator_ALi3_Dense::internal_prepare()
 	const size_t nConstraints = arm_->Phi_.size();
 	Lambda_.setZero(nConstraints);
 
-	timelog().leave("solver_prepare");
+	MBSE_PROFILE_LEAVE("solver_prepare");
 }
 
 CDynamicSimulator_ALi3_Dense::~CDynamicSimulator_ALi3_Dense() {}
@@ -53,7 +53,7 @@ bool CDynamicSimulator_ALi3_Dense::internal_integrate(
 
 	const size_t nDepCoords = arm_->q_.size();
 
-	timelog().enter("internal_integrate");
+	MBSE_PROFILE_ENTER("internal_integrate");
 
 	Eigen::VectorXd Q(nDepCoords);
 
@@ -129,7 +129,7 @@ bool CDynamicSimulator_ALi3_Dense::internal_integrate(
 		M_ * arm_->ddotq_ - 0.25 * dt2 * params_penalty.alpha *
 								Phi_q_.transpose() * dotPhi_q_ * arm_->dotq_);
 
-	timelog().leave("internal_integrate");
+	MBSE_PROFILE_LEAVE("internal_integrate");
 
 	return true;
 }
@@ -143,7 +143,7 @@ void CDynamicSimulator_ALi3_Dense::internal_solve_ddotq(
 		throw std::runtime_error(
 			"This class can't solve for lagrange multipliers!");
 
-	timelog().enter("solver_ddotq");
+	MBSE_PROFILE_ENTER("solver_ddotq");
 
 	// Iterative solution to the Augmented Lagrangian Formulation (ALF):
 	// ---------------------------------------------------------------------
@@ -184,7 +184,7 @@ void CDynamicSimulator_ALi3_Dense::internal_solve_ddotq(
 
 	// Solve linear system:
 	// -----------------------------------
-	timelog().enter("solver_ddotq.solve");
+	MBSE_PROFILE_ENTER("solver_ddotq.solve");
 
 	Eigen::VectorXd ddotq_next, ddotq_prev;
 
@@ -202,9 +202,9 @@ void CDynamicSimulator_ALi3_Dense::internal_solve_ddotq(
 
 	//	cout << "lamba: " << Lambda_.transpose() << endl;
 
-	timelog().leave("solver_ddotq.solve");
+	MBSE_PROFILE_LEAVE("solver_ddotq.solve");
 
-	timelog().leave("solver_ddotq");
+	MBSE_PROFILE_LEAVE("solver_ddotq");
 }
 
 /** Integrators will call this after each time step */
@@ -0,0 +1,271 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include <mbse/AssembledRigidModel.h>
+#include <mbse/dynamics/dynamic-simulators.h>
+#include <mbse/mbse-utils.h>
+#include <map>
+
+using namespace mbse;
+using namespace Eigen;
+using namespace std;
+
+// ---------------------------------------------------------------------------------------------
+//  Solver: Sparse (CHOLMOD) solver with the index-3 Augmented Lagrange
+//  formulation (ALF) with projection of velocities and acelerations
+// ---------------------------------------------------------------------------------------------
+CDynamicSimulator_ALi3_Sparse::CDynamicSimulator_ALi3_Sparse(
+	const AssembledRigidModel::Ptr arm_ptr)
+	: CDynamicSimulatorBasePenalty(arm_ptr)
+{
+}
+
+CDynamicSimulator_ALi3_Sparse::~CDynamicSimulator_ALi3_Sparse() {}
+
+/** Prepare the linear systems and anything else required to really call
+ * solve_ddotq() */
+void CDynamicSimulator_ALi3_Sparse::internal_prepare()
+{
+	MBSE_PROFILE_ENTER("solver_prepare");
+
+	const size_t nDepCoords = arm_->q_.size();
+	const size_t nConstraints = arm_->Phi_.size();
+
+	const std::vector<Eigen::Triplet<double>> M_tri =
+		arm_->buildMassMatrix_sparse();
+
+	M_.resize(nDepCoords, nDepCoords);
+	M_.setFromTriplets(M_tri.begin(), M_tri.end());
+
+	// Upper triangle of A: the mass matrix, plus the entries (i,j), i<=j,
+	// such that columns i and j of Phi_q share some row:
+	std::vector<Eigen::Triplet<double>> A_tri;
+	for (const auto& t : M_tri)
+		if (t.row() <= t.col()) A_tri.push_back(t);
+
+	PhiqtPhi_.clear();
+	std::map<std::pair<size_t, size_t>, size_t> idx_of_entry;
+
+	const auto& Phi_q = arm_->Phi_q_;
+	for (size_t row = 0; row < nConstraints; row++)
+	{
+		const size_t k0 = Phi_q.row_ptr[row], k1 = Phi_q.row_ptr[row + 1];
+		// Columns are sorted within each row, so col(ki) <= col(kj):
+		for (size_t ki = k0; ki < k1; ki++)
+		{
+			for (size_t kj = ki; kj < k1; kj++)
+			{
+				const auto ij =
+					std::make_pair(Phi_q.col_idx[ki], Phi_q.col_idx[kj]);
+				auto it = idx_of_entry.find(ij);
+				if (it == idx_of_entry.end())
+				{
+					it = idx_of_entry.emplace(ij, PhiqtPhi_.size()).first;
+					PhiqtPhi_.emplace_back();
+					A_tri.emplace_back(ij.first, ij.second, 0.0);
+				}
+				PhiqtPhi_[it->second].lst_terms.emplace_back(ki, kj);
+			}
+		}
+	}
+
+	// The pattern never changes from now on:
+	A_.resize(nDepCoords, nDepCoords);
+	A_.setFromTriplets(A_tri.begin(), A_tri.end());
+
+	// Places of each Phi_q^t*Phi_q entry in the CCS matrix, so they can be
+	// updated in place. Their current values are those of the mass matrix:
+	for (const auto& e : idx_of_entry)
+	{
+		TSparseDotProduct& sdp = PhiqtPhi_[e.second];
+		sdp.out_ptr = ccs_entry_ptr(A_, e.first.first, e.first.second);
+		sdp.base = *sdp.out_ptr;
+	}
+
+	// Symbolic Cholesky decomposition, done only once:
+	cholmod_common& c = A_chol_.cholmod();
+	c.nmethods = 1;
+	switch (this->ordering)
+	{
+		case orderNatural:
+			c.method[0].ordering = CHOLMOD_NATURAL;
+			break;
+		case orderAMD:
+			c.method[0].ordering = CHOLMOD_AMD;
+			break;
+		case orderMETIS:
+			c.method[0].ordering = CHOLMOD_METIS;
+			break;
+		case orderNESDIS:
+			c.method[0].ordering = CHOLMOD_NESDIS;
+			break;
+		default:
+			THROW_EXCEPTION("Unknown or unsupported 'ordering' value.");
+	};
+	A_chol_.analyzePattern(A_);
+	if (A_chol_.info() != Eigen::Success)
+		THROW_EXCEPTION("CHOLMOD couldn't symbolic factorize A");
+
+	Lambda_.setZero(nConstraints);
+
+	MBSE_PROFILE_LEAVE("solver_prepare");
+}
+
+void CDynamicSimulator_ALi3_Sparse::update_and_factorize_A(double scale)
+{
+	MBSE_PROFILE_ENTER("solver_ddotq.update_PhiqtPhiq");
+	const double* Phi_q = arm_->Phi_q_.values.data();
+	const double s = scale * params_penalty.alpha;
+	for (TSparseDotProduct& sdp : PhiqtPhi_)
+	{
+		double res = 0;
+		for (const auto& term : sdp.lst_terms)
+			res += Phi_q[term.first] * Phi_q[term.second];
+		*sdp.out_ptr = sdp.base + s * res;
+	}
+	MBSE_PROFILE_LEAVE("solver_ddotq.update_PhiqtPhiq");
+
+	MBSE_PROFILE_ENTER("solver_ddotq.numeric_factor");
+	A_chol_.factorize(A_);
+	if (A_chol_.info() != Eigen::Success)
+		THROW_EXCEPTION("CHOLMOD couldn't numeric-factorize A");
+	MBSE_PROFILE_LEAVE("solver_ddotq.numeric_factor");
+}
+
+/** Implement a especific combination of dynamic formulation + integrator.
+ *  \return false if it's not implemented, so it should fallback to generic
+ * integrator + internal_solve_ddotq()
+ */
+bool CDynamicSimulator_ALi3_Sparse::internal_integrate(
+	double t, double dt, const ODE_integrator_t integr)
+{
+	if (integr != ODE_Trapezoidal) return false;
+
+	const size_t nDepCoords = arm_->q_.size();
+	const size_t nConstraints = arm_->Phi_.size();
+
+	MBSE_PROFILE_ENTER("internal_integrate");
+
+	Q_.resize(nDepCoords);
+	b_.resize(nConstraints);
+	rhs_.resize(nDepCoords);
+
+	const double dt2 = dt * dt;
+	const double k = 0.25 * dt2;
+
+	const Eigen::VectorXd qp_g = -(2. / dt * arm_->q_ + arm_->dotq_);
+	const Eigen::VectorXd qpp_g =
+		-(4. / dt2 * arm_->q_ + 4. / dt * arm_->dotq_ + arm_->ddotq_);
+
+	arm_->q_ += dt * arm_->dotq_ + 0.5 * dt * dt * arm_->ddotq_;
+
+	arm_->dotq_ = (2. / dt) * arm_->q_ + qp_g;
+	arm_->ddotq_ = (4. / dt2) * arm_->q_ + qpp_g;
+
+	double err = 1;
+	int iter = 0;
+
+	const double tol_dyn = 1e-6;
+	const int iter_max = 20;
+
+	arm_->update_numeric_Phi_and_Jacobians();
+
+	while (err > tol_dyn && iter < iter_max)
+	{
+		iter++;
+
+		// Get "Q" (may be dynamic)
+		this->build_RHS(&Q_[0] /* Q */, nullptr /* we don't need "c" */);
+
+		// RHS = dt^2/4 * (M*qpp + Phi_q^t*(alpha*Phi + lambda) - Q)
+		b_ = params_penalty.alpha * arm_->Phi_ + Lambda_;
+		rhs_.noalias() = M_ * arm_->ddotq_;
+		rhs_ -= Q_;
+		arm_->Phi_q_.multiplyTransposedAdd(b_.data(), &rhs_[0]);
+		rhs_ *= k;
+
+		// A = M + dt^2/4 * alpha * Phi_q^t * Phi_q
+		update_and_factorize_A(k);
+
+		const Eigen::VectorXd Aq = -A_chol_.solve(rhs_);
+
+		arm_->q_ += Aq;
+		arm_->dotq_ = (2. / dt) * arm_->q_ + qp_g;
+		arm_->ddotq_ = (4. / dt2) * arm_->q_ + qpp_g;
+
+		arm_->update_numeric_Phi_and_Jacobians();
+
+		Lambda_ += params_penalty.alpha * arm_->Phi_;
+		err = Aq.norm();
+	}
+
+	// Projections of velocities and accelerations, with the last
+	// factorization of A (no explicitly time-dependent constraints):
+	// qp_out = A \ (M*qp)
+	rhs_.noalias() = M_ * arm_->dotq_;
+	arm_->dotq_ = A_chol_.solve(rhs_);
+
+	// qpp_out = A \ (M*qpp - dt^2/4 * alpha * Phi_q^t * dotPhi_q * qp)
+	arm_->dotPhi_q_.multiply(&arm_->dotq_[0], b_.data());
+	b_ *= -k * params_penalty.alpha;
+	rhs_.noalias() = M_ * arm_->ddotq_;
+	arm_->Phi_q_.multiplyTransposedAdd(b_.data(), &rhs_[0]);
+	arm_->ddotq_ = A_chol_.solve(rhs_);
+
+	MBSE_PROFILE_VALUE("ali3.iters", iter);
+	MBSE_PROFILE_LEAVE("internal_integrate");
+
+	return true;
+}
+
+void CDynamicSimulator_ALi3_Sparse::internal_solve_ddotq(
+	double t, VectorXd& ddot_q, VectorXd* lagrangre)
+{
+	const size_t nDepCoords = arm_->q_.size();
+	const size_t nConstraints = arm_->Phi_.size();
+
+	if (lagrangre)
+		throw std::runtime_error(
+			"This class can't solve for lagrange multipliers!");
+
+	MBSE_PROFILE_ENTER("solver_ddotq");
+
+	// [ M + alpha * Phi_q^t * Phi_q ] \ddot{q} = RHS
+	//
+	// RHS = Q(q,dq) - alpha * Phi_q^t* [ \dot{Phi}_q * \dot{q} + 2 * xi * omega
+	// * \dot{Phi} + omega^2 * Phi ] - Phi_q^t * \lambda
+	//
+	Q_.resize(nDepCoords);
+	b_.resize(nConstraints);
+	this->build_RHS(&Q_[0] /* Q */, nullptr /* we don't need "c" */);
+
+	arm_->update_numeric_Phi_and_Jacobians();
+	update_and_factorize_A(1.0);
+
+	MBSE_PROFILE_ENTER("solver_ddotq.solve");
+
+	arm_->dotPhi_q_.multiply(&arm_->dotq_[0], b_.data());
+	const double xiw2 = 2 * params_penalty.xi * params_penalty.w;
+	const double w2 = params_penalty.w * params_penalty.w;
+	b_ += xiw2 * arm_->dotPhi_ + w2 * arm_->Phi_;
+	b_ *= -params_penalty.alpha;
+	b_ -= Lambda_;
+
+	rhs_ = Q_;
+	arm_->Phi_q_.multiplyTransposedAdd(b_.data(), &rhs_[0]);
+
+	ddot_q = A_chol_.solve(rhs_);
+
+	Lambda_ += params_penalty.alpha * arm_->Phi_;
+
+	MBSE_PROFILE_LEAVE("solver_ddotq.solve");
+
+	MBSE_PROFILE_LEAVE("solver_ddotq");
+}
@@ -10,6 +10,7 @@
 
 #include <mbse/AssembledRigidModel.h>
 #include <mbse/dynamics/dynamic-simulators.h>
+#include <mbse/mbse-utils.h>
 
 using namespace mbse;
 using namespace Eigen;
@@ -30,7 +31,7 @@ CDynamicSimulator_AugmentedLagrangian_KLU::
  * solve_ddotq() */
 void CDynamicSimulator_AugmentedLagrangian_KLU::internal_prepare()
 {
-	timelog().enter("solver_prepare");
+	MBSE_PROFILE_ENTER("solver_prepare");
 
 	const size_t nDepCoords = arm_->q_.size();
 	const size_t nConstraints = arm_->Phi_.size();
@@ -46,16 +47,12 @@ void CDynamicSimulator_AugmentedLagrangian_KLU::internal_prepare()
 	//
 	// Build mass matrix (constant), and set its triplet form as the beginning
 	// of the total "A" matrix:
-	M_tri_ = arm_->buildMassMatrix_sparse();
-	A_tri_ = M_tri_;
+	const std::vector<Eigen::Triplet<double>> M_tri =
+		arm_->buildMassMatrix_sparse();
+	std::vector<Eigen::Triplet<double>> A_tri = M_tri;
 
 	//  Add entries in the triplet form for the sparse Phi_q Jacobian.
 	// -----------------------------------------------------------
-	A_tri_.reserve(
-		A_tri_.size() + nDepCoords +
-		nDepCoords *
-			nDepCoords);  // *IMPORTANT* Reserve mem at once to avoid
-						  // reallocations, since we store pointers to places...
 
 	PhiqtPhi_.clear();
 	PhiqtPhi_.reserve(nDepCoords * nDepCoords);
@@ -73,21 +70,19 @@ void CDynamicSimulator_AugmentedLagrangian_KLU::internal_prepare()
 
 			for (size_t row = 0; row < nConstraints; row++)
 			{
-				const CompressedRowSparseMatrix::row_t& row_r =
-					arm_->Phi_q_.matrix[row];
+				const auto& Phi_q = arm_->Phi_q_;
 
 				const double *Phi_r_i = nullptr, *Phi_r_j = nullptr;
 
-				for (CompressedRowSparseMatrix::row_t::const_iterator itCol =
-						 row_r.begin();
-					 itCol != row_r.end(); ++itCol)
+				for (size_t k = Phi_q.row_ptr[row]; k < Phi_q.row_ptr[row + 1];
+					 k++)
 				{
-					const size_t col = itCol->first;
+					const size_t col = Phi_q.col_idx[k];
 					if (col > j) break;	 // We're done in this row.
 					if (col != i && col != j) continue;
 
-					if (col == i) Phi_r_i = &(itCol->second);
-					if (col == j) Phi_r_j = &(itCol->second);
+					if (col == i) Phi_r_i = &Phi_q.values[k];
+					if (col == j) Phi_r_j = &Phi_q.values[k];
 				}
 
 				// Were both Phi_q[r][i] and Phi_q[r][j] != 0??
@@ -100,31 +95,39 @@ void CDynamicSimulator_AugmentedLagrangian_KLU::internal_prepare()
 			// Is the product != 0?
 			if (!sdp.lst_terms.empty())
 			{
-				// Append a new triplet entry (i,j)
-				A_tri_.push_back( Eigen::Triplet<double>(i,j, 1.0 /* a dummy value, it'll be updated later on by reference */ ) );
-				sdp.out_ptr1 = const_cast<double*>(&(A_tri_.back().value()));
-
-				// And also (j,i) if i!=j:
-				sdp.out_ptr2 = nullptr;
-				if (i != j)
-				{
-					A_tri_.push_back( Eigen::Triplet<double>(j,i, 1.0 /* a dummy value, it'll be updated later on by reference */ ) );
-					sdp.out_ptr2 =
-						const_cast<double*>(&(A_tri_.back().value()));
-				}
+				// Append a new triplet entry (i,j), and also (j,i) if i!=j.
+				// Their values are set later on, in the CCS matrix:
+				A_tri.emplace_back(i, j, 0.0);
+				if (i != j) A_tri.emplace_back(j, i, 0.0);
 
+				sdp.row = i;
+				sdp.col = j;
 				PhiqtPhi_.push_back(sdp);
 			}
 
 		}  // end for "j"
 	}  // end for "i"
 
-	// Analyze the pattern once:
+	// The pattern never changes from now on:
 	A_.resize(nDepCoords, nDepCoords);
-	A_.setFromTriplets(A_tri_.begin(), A_tri_.end());
+	A_.setFromTriplets(A_tri.begin(), A_tri.end());
 
 	M_.resize(nDepCoords, nDepCoords);
-	M_.setFromTriplets(M_tri_.begin(), M_tri_.end());
+	M_.setFromTriplets(M_tri.begin(), M_tri.end());
+
+	// Places of each Phi_q^t*Phi_q entry in the CCS matrix, so they can be
+	// updated in place. Their current values are those of the mass matrix:
+	for (auto& sdp : PhiqtPhi_)
+	{
+		sdp.out_ptr1 = ccs_entry_ptr(A_, sdp.row, sdp.col);
+		sdp.base1 = *sdp.out_ptr1;
+		sdp.out_ptr2 = nullptr;
+		if (sdp.row != sdp.col)
+		{
+			sdp.out_ptr2 = ccs_entry_ptr(A_, sdp.col, sdp.row);
+			sdp.base2 = *sdp.out_ptr2;
+		}
+	}
 
 	/* Control [UMFPACK_ORDERING] and Info [UMFPACK_ORDERING_USED] are one of:
 	 */
@@ -154,7 +157,7 @@ void CDynamicSimulator_AugmentedLagrangian_KLU::internal_prepare()
 		M_.outerIndexPtr(), M_.innerIndexPtr(), M_.valuePtr(), symbolic_M_,
 		&common_);
 
-	timelog().leave("solver_prepare");
+	MBSE_PROFILE_LEAVE("solver_prepare");
 }
 
 CDynamicSimulator_AugmentedLagrangian_KLU::
@@ -177,7 +180,7 @@ void CDynamicSimulator_AugmentedLagrangian_KLU::internal_solve_ddotq(
 		throw std::runtime_error(
 			"This class can't solve for lagrange multipliers!");
 
-	timelog().enter("solver_ddotq");
+	MBSE_PROFILE_ENTER("solver_ddotq");
 
 	// Iterative solution to the Augmented Lagrangian Formulation (ALF):
 	// ---------------------------------------------------------------------
@@ -204,10 +207,10 @@ void CDynamicSimulator_AugmentedLagrangian_KLU::internal_solve_ddotq(
 	//
 
 	// Update numeric values of the constraint Jacobians:
-	timelog().enter("solver_ddotq.update_PhiqtPhiq");
+	MBSE_PROFILE_ENTER("solver_ddotq.update_PhiqtPhiq");
 	arm_->update_numeric_Phi_and_Jacobians();
 
-	// Move the updated Jacobian values to their places in the triplet form:
+	// Update the values of A = M + alpha * Phi_q^t * Phi_q in place:
 	for (size_t k = 0; k < PhiqtPhi_.size(); k++)
 	{
 		TSparseDotProduct& sdp = PhiqtPhi_[k];
@@ -218,28 +221,18 @@ void CDynamicSimulator_AugmentedLagrangian_KLU::internal_solve_ddotq(
 
 		res *= params_penalty.alpha;
 
-		if (sdp.out_ptr1) *sdp.out_ptr1 = res;
-		if (sdp.out_ptr2) *sdp.out_ptr2 = res;
+		if (sdp.out_ptr1) *sdp.out_ptr1 = sdp.base1 + res;
+		if (sdp.out_ptr2) *sdp.out_ptr2 = sdp.base2 + res;
 	}
-	timelog().leave("solver_ddotq.update_PhiqtPhiq");
+	MBSE_PROFILE_LEAVE("solver_ddotq.update_PhiqtPhiq");
 
-	// Solve numeric sparse LU:
+	// Numeric sparse LU, reusing the previous pivoting if possible:
 	// -----------------------------------
-	timelog().enter("solver_ddotq.ccs");
-	A_.setFromTriplets(A_tri_.begin(), A_tri_.end());
-	timelog().leave("solver_ddotq.ccs");
-
-	timelog().enter("solver_ddotq.numeric_factor");
-	if (numeric_) klu_free_numeric(&numeric_, &common_);
-
-	numeric_ = klu_factor(
-		A_.outerIndexPtr(), A_.innerIndexPtr(), A_.valuePtr(), symbolic_,
-		&common_);
-
-	if (!numeric_)
+	MBSE_PROFILE_ENTER("solver_ddotq.numeric_factor");
+	if (!klu_factor_or_refactor(A_, symbolic_, numeric_, common_, min_rcond))
 		THROW_EXCEPTION(
 			"Error: KLU couldn't numeric-factorize the augmented matrix.");
-	timelog().leave("solver_ddotq.numeric_factor");
+	MBSE_PROFILE_LEAVE("solver_ddotq.numeric_factor");
 
 	// Build the RHS vector:
 	// RHS = M*\ddot{q}_i -  Phi_q^t* alpha * [ \dot{Phi}_q * \dot{q} + 2 * xi *
@@ -247,7 +240,7 @@ void CDynamicSimulator_AugmentedLagrangian_KLU::internal_solve_ddotq(
 	//                               \ ------------------------------------v
 	//                               --------------------------------------/
 	//                                                                    = b
-	timelog().enter("solver_ddotq.build_rhs");
+	MBSE_PROFILE_ENTER("solver_ddotq.build_rhs");
 
 	// Evaluate "b":
 	// b = alpha * [ \dot{Phi}_q * \dot{q} + 2 * xi * omega * \dot{Phi} +
@@ -255,17 +248,7 @@ void CDynamicSimulator_AugmentedLagrangian_KLU::internal_solve_ddotq(
 	Eigen::VectorXd b(nConstraints);
 
 	// \dot{Phi}_q * \dot{q}
-	for (size_t r = 0; r < nConstraints; r++)
-	{
-		const CompressedRowSparseMatrix::row_t& row_r =
-			arm_->dotPhi_q_.matrix[r];
-		double res = 0;
-		for (CompressedRowSparseMatrix::row_t::const_iterator itCol =
-				 row_r.begin();
-			 itCol != row_r.end(); ++itCol)
-			res += itCol->second * arm_->dotq_[itCol->first];
-		b[r] = res;
-	}
+	arm_->dotPhi_q_.multiply(&arm_->dotq_[0], &b[0]);
 
 	// const Eigen::VectorXd dPhiq_dq = b;
 
@@ -281,23 +264,13 @@ void CDynamicSimulator_AugmentedLagrangian_KLU::internal_solve_ddotq(
 	Eigen::VectorXd RHS2(nDepCoords);
 	RHS2.setZero();
 	b *= params_penalty.alpha;
-	for (size_t r = 0; r < nConstraints; r++)
-	{
-		const CompressedRowSparseMatrix::row_t& row_r = arm_->Phi_q_.matrix[r];
-		for (CompressedRowSparseMatrix::row_t::const_iterator itCol =
-				 row_r.begin();
-			 itCol != row_r.end(); ++itCol)
-		{
-			const size_t col = itCol->first;
-			RHS2[col] += itCol->second * b[r];
-		}
-	}
+	arm_->Phi_q_.multiplyTransposedAdd(&b[0], &RHS2[0]);
 
-	timelog().leave("solver_ddotq.build_rhs");
+	MBSE_PROFILE_LEAVE("solver_ddotq.build_rhs");
 
 	// Solve linear system:
 	// -----------------------------------
-	timelog().enter("solver_ddotq.solve");
+	MBSE_PROFILE_ENTER("solver_ddotq.solve");
 
 	Eigen::VectorXd RHS(nDepCoords);
 
@@ -326,10 +299,10 @@ void CDynamicSimulator_AugmentedLagrangian_KLU::internal_solve_ddotq(
 
 	ddot_q.swap(ddotq_next);
 
-	timelog().leave("solver_ddotq.solve");
+	MBSE_PROFILE_LEAVE("solver_ddotq.solve");
 
 	ASSERTDEBMSG_(
 		((RHS.array() == RHS.array()).all()), "NaN found in result ddotq");
 
-	timelog().leave("solver_ddotq");
+	MBSE_PROFILE_LEAVE("solver_ddotq");
 }
@@ -10,6 +10,7 @@
 
 #include <mbse/AssembledRigidModel.h>
 #include <mbse/dynamics/dynamic-simulators.h>
+#include <exception>
 
 using namespace mbse;
 using namespace Eigen;
@@ -30,13 +31,13 @@ CDynamicSimulator_Indep_dense::CDynamicSimulator_Indep_dense(
  * solve_ddotq() */
 void CDynamicSimulator_Indep_dense::internal_prepare()
 {
-	timelog().enter("solver_prepare");
+	MBSE_PROFILE_ENTER("solver_prepare");
 
 	// Build mass matrix now and don't touch it anymore, since it's constant
 	// with this formulation:
 	mass_ = arm_->buildMassMatrix_dense();
 
-	timelog().leave("solver_prepare");
+	MBSE_PROFILE_LEAVE("solver_prepare");
 }
 
 /** Compute dependent velocities and positions from the independent ones */
@@ -62,7 +63,7 @@ void CDynamicSimulator_Indep_dense::dq_plus_dz(
 void CDynamicSimulator_Indep_dense::internal_solve_ddotz(
 	double t, VectorXd& ddot_z)
 {
-	timelog().enter("solver_ddotz");
+	MBSE_PROFILE_ENTER("solver_ddotz");
 
 	const size_t nDepCoords = arm_->q_.size();
 	const size_t nConstraints = arm_->Phi_.size();
@@ -73,15 +74,15 @@ void CDynamicSimulator_Indep_dense::internal_solve_ddotz(
 	// -----------------------------------------------------------
 
 	// Determine number of DOFs:
-	timelog().enter("solver_ddotz.update_jacob");
+	MBSE_PROFILE_ENTER("solver_ddotz.update_jacob");
 	arm_->update_numeric_Phi_and_Jacobians();
-	timelog().leave("solver_ddotz.update_jacob");
+	MBSE_PROFILE_LEAVE("solver_ddotz.update_jacob");
 
 	// Get Jacobian dPhi_dq
 	Eigen::MatrixXd Phiq(nConstraints, nDepCoords);
-	timelog().enter("solver_ddotz.get_dense_jacob");
+	MBSE_PROFILE_ENTER("solver_ddotz.get_dense_jacob");
 	arm_->Phi_q_.asDense(Phiq);
-	timelog().leave("solver_ddotz.get_dense_jacob");
+	MBSE_PROFILE_LEAVE("solver_ddotz.get_dense_jacob");
 
 	size_t nDOFs;
 	if (can_choose_indep_coords_)
@@ -143,7 +144,7 @@ void CDynamicSimulator_Indep_dense::internal_solve_ddotz(
 	// Build the RHS vector:
 	//   RHS = Rt*Q - Rt*M*Sc;
 	// --------------------------
-	timelog().enter("solver_ddotz.build_rhs");
+	MBSE_PROFILE_ENTER("solver_ddotz.build_rhs");
 	Eigen::VectorXd Q(nDepCoords);
 	Eigen::VectorXd c(nConstraints);
 
@@ -151,12 +152,12 @@ void CDynamicSimulator_Indep_dense::internal_solve_ddotz(
 
 	const Eigen::VectorXd RHS = R.transpose() * (Q - mass_ * S * c);
 
-	timelog().leave("solver_ddotz.build_rhs");
+	MBSE_PROFILE_LEAVE("solver_ddotz.build_rhs");
 
-	timelog().enter("solver_ddotz.solve");
+	MBSE_PROFILE_ENTER("solver_ddotz.solve");
 	const Eigen::MatrixXd RtMR = R.transpose() * mass_ * R;
 	ddot_z = RtMR.llt().solve(RHS);
-	timelog().enter("solver_ddotz.solve");
+	MBSE_PROFILE_LEAVE("solver_ddotz.solve");
 
 #if 0
 	//A.saveToTextFile("A.txt");
@@ -174,5 +175,95 @@ void CDynamicSimulator_Indep_dense::internal_solve_ddotz(
 	mrpt::system::pause();
 #endif
 
-	timelog().leave("solver_ddotz");
+	MBSE_PROFILE_LEAVE("solver_ddotz");
+}
+
+void CDynamicSimulator_Indep_dense::solve_ddotz_batch(
+	double t, const Eigen::MatrixXd& q, const Eigen::MatrixXd& dq,
+	Eigen::MatrixXd& ddot_z)
+{
+	ASSERT_(init_);
+	const auto n = arm_->q_.size();
+	const auto m = arm_->Phi_.size();
+	const auto d = indep_idxs_.size();
+	ASSERT_EQUAL_(q.rows(), n);
+	ASSERT_EQUAL_(dq.rows(), n);
+	ASSERT_EQUAL_(q.cols(), dq.cols());
+	ASSERT_EQUAL_(static_cast<size_t>(m + d), static_cast<size_t>(n));
+
+	MBSE_PROFILE_SCOPE("solver_ddotz_batch");
+
+	// Common to all states:
+	Eigen::VectorXd Q;
+	arm_->builGeneralizedForces(Q);
+
+	const ModelTopology& topology = *arm_->topology();
+	const double k_vel = BAUMGARTE_K_VEL;
+	const double k_pos = BAUMGARTE_K_POS;
+
+	const int nStates = static_cast<int>(q.cols());
+	ddot_z.resize(d, nStates);
+
+	// As in internal_solve_ddotz(), with the current independent coordinates
+	// and each thread on its own ModelState and workspace. Exceptions can't
+	// leave an OpenMP region, so the first one is kept and rethrown
+	// afterwards.
+	std::exception_ptr error;
+
+#ifdef SPARSEMBS_HAVE_OPENMP
+#pragma omp parallel
+#endif
+	{
+		ModelState s(static_cast<const ModelState&>(*arm_));
+		Eigen::MatrixXd A = Eigen::MatrixXd::Zero(n, n), A_inv(n, n);
+		Eigen::FullPivLU<Eigen::MatrixXd> lu_A(n, n);
+		Eigen::VectorXd c(m);
+		for (size_t i = 0; i < d; i++) A(m + i, indep_idxs_[i]) = 1.0;
+
+#ifdef SPARSEMBS_HAVE_OPENMP
+#pragma omp for schedule(static)
+#endif
+		for (int i = 0; i < nStates; i++)
+		{
+			try
+			{
+				s.q_ = q.col(i);
+				s.dotq_ = dq.col(i);
+				topology.realize_operating_point(s);
+				topology.update_numeric_Phi_and_Jacobians(s);
+
+				// [Phi_q; B], and "c" as in build_RHS():
+				const auto& Phi_q = s.Phi_q_;
+				A.topRows(m).setZero();
+				for (Eigen::Index r = 0; r < m; r++)
+				{
+					for (size_t k = Phi_q.row_ptr[r]; k < Phi_q.row_ptr[r + 1];
+						 k++)
+						A(r, Phi_q.col_idx[k]) = Phi_q.values[k];
+
+					c[r] = -s.dotPhi_q_.rowDot(r, &s.dotq_[0]) -
+						   k_vel * s.dotPhi_[r] - k_pos * s.Phi_[r];
+				}
+
+				lu_A.compute(A);
+				ASSERT_EQUAL_(lu_A.rank(), A.rows());
+				A_inv = lu_A.inverse();
+				const auto S = A_inv.leftCols(m);
+				const auto R = A_inv.rightCols(d);
+
+				const Eigen::VectorXd RHS =
+					R.transpose() * (Q - mass_ * (S * c));
+				const Eigen::MatrixXd RtMR = R.transpose() * mass_ * R;
+				ddot_z.col(i) = RtMR.llt().solve(RHS);
+			}
+			catch (...)
+			{
+#ifdef SPARSEMBS_HAVE_OPENMP
+#pragma omp critical(mbse_batch_error)
+#endif
+				if (!error) error = std::current_exception();
+			}
+		}
+	}
+	if (error) std::rethrow_exception(error);
 }
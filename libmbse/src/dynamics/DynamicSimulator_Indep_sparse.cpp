@@ -0,0 +1,275 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include <mbse/AssembledRigidModel.h>
+#include <mbse/dynamics/dynamic-simulators.h>
+#include <mbse/mbse-utils.h>
+
+using namespace mbse;
+using namespace Eigen;
+using namespace std;
+
+// ---------------------------------------------------------------------------------------------
+//  Solver: Sparse KLU on [Phi_q; B]
+// ---------------------------------------------------------------------------------------------
+CDynamicSimulator_Indep_sparse::CDynamicSimulator_Indep_sparse(
+	const std::shared_ptr<AssembledRigidModel> arm_ptr)
+	: CDynamicSimulatorIndepBase(arm_ptr)
+{
+	klu_defaults(&common_);
+}
+
+CDynamicSimulator_Indep_sparse::~CDynamicSimulator_Indep_sparse()
+{
+	if (symbolic_) klu_free_symbolic(&symbolic_, &common_);
+	if (numeric_) klu_free_numeric(&numeric_, &common_);
+}
+
+/** Prepare the linear systems and anything else required to really call
+ * solve_ddotq() */
+void CDynamicSimulator_Indep_sparse::internal_prepare()
+{
+	MBSE_PROFILE_ENTER("solver_prepare");
+
+	const size_t nDepCoords = arm_->q_.size();
+
+	// Build mass matrix now and don't touch it anymore, since it's constant
+	// with this formulation:
+	const auto mass_tri = arm_->buildMassMatrix_sparse();
+	mass_.resize(nDepCoords, nDepCoords);
+	mass_.setFromTriplets(mass_tri.begin(), mass_tri.end());
+
+	// The [Phi_q; B] pattern depends on the independent coordinates, which
+	// are chosen (if needed) on the first solve:
+	pattern_ok_ = false;
+
+	MBSE_PROFILE_LEAVE("solver_prepare");
+}
+
+/** Compute dependent velocities and positions from the independent ones */
+void CDynamicSimulator_Indep_sparse::correct_dependent_q_dq()
+{
+	arm_->finiteDisplacement(
+		indep_idxs_, 1e-9, 20, true /* also solve dot{q} */);
+}
+
+void CDynamicSimulator_Indep_sparse::dq_plus_dz(
+	const Eigen::VectorXd& dq, const Eigen::VectorXd& dz,
+	Eigen::VectorXd& out_dq) const
+{
+	// In this model, independent accelerations are some selected indices out
+	// from the vector of all dependent coordinates, so just add them:
+	out_dq = dq;
+	for (size_t i = 0; i < indep_idxs_.size(); i++)
+		out_dq[indep_idxs_[i]] += dz[i];
+}
+
+void CDynamicSimulator_Indep_sparse::choose_independent_coordinates(bool dense)
+{
+	MBSE_PROFILE_ENTER("solver_ddotz.choose_indep");
+
+	const auto& Phi_q = arm_->Phi_q_;
+	const size_t nDepCoords = arm_->q_.size();
+
+	size_t nDOFs;
+	if (!dense)
+	{
+		// Columns left out of the basis by the column pivoting of the QR
+		// are the independent coordinates:
+		std::vector<Eigen::Triplet<double>> tri;
+		tri.reserve(Phi_q.getNumNonZeros());
+		for (size_t i = 0; i < Phi_q.getNumRows(); i++)
+			for (size_t k = Phi_q.row_ptr[i]; k < Phi_q.row_ptr[i + 1]; k++)
+				tri.emplace_back(i, Phi_q.col_idx[k], Phi_q.values[k]);
+
+		Eigen::SparseMatrix<double> Phiq(Phi_q.getNumRows(), nDepCoords);
+		Phiq.setFromTriplets(tri.begin(), tri.end());
+
+		Eigen::SparseQR<Eigen::SparseMatrix<double>, Eigen::COLAMDOrdering<int>>
+			qr(Phiq);
+		ASSERTMSG_(qr.info() == Eigen::Success, "Sparse QR of Phi_q failed");
+
+		nDOFs = nDepCoords - qr.rank();
+		indep_idxs_.resize(nDOFs);
+		for (size_t i = 0; i < nDOFs; i++)
+			indep_idxs_[i] = qr.colsPermutation().indices()[qr.rank() + i];
+	}
+	else
+	{
+		// Same method than CDynamicSimulator_Indep_dense: slower, but picks
+		// the best conditioned set of coordinates.
+		Eigen::MatrixXd Phiq;
+		Phi_q.asDense(Phiq);
+
+		Eigen::FullPivLU<Eigen::MatrixXd> lu_Phiq(Phiq);
+
+		nDOFs = nDepCoords - lu_Phiq.rank();
+		indep_idxs_.resize(nDOFs);
+		for (size_t i = 0; i < nDOFs; i++)
+			indep_idxs_[i] =
+				lu_Phiq.permutationQ().indices()[nDepCoords - nDOFs + i];
+	}
+
+	pattern_ok_ = false;
+
+	MBSE_PROFILE_LEAVE("solver_ddotz.choose_indep");
+}
+
+void CDynamicSimulator_Indep_sparse::build_pattern()
+{
+	MBSE_PROFILE_ENTER("solver_ddotz.build_pattern");
+
+	const auto& Phi_q = arm_->Phi_q_;
+	const size_t nDepCoords = arm_->q_.size();
+	const size_t nConstraints = arm_->Phi_.size();
+	const size_t nDOFs = indep_idxs_.size();
+
+	ASSERTMSG_(
+		nConstraints + nDOFs == nDepCoords,
+		mrpt::format(
+			"[Phi_q; B] must be square, but there are %u constraints and %u "
+			"independent coordinates for %u coordinates. Redundant "
+			"constraints are not supported by this solver.",
+			static_cast<unsigned>(nConstraints),
+			static_cast<unsigned>(nDOFs), static_cast<unsigned>(nDepCoords)));
+
+	std::vector<Eigen::Triplet<double>> tri;
+	tri.reserve(Phi_q.getNumNonZeros() + nDOFs);
+	for (size_t i = 0; i < nConstraints; i++)
+		for (size_t k = Phi_q.row_ptr[i]; k < Phi_q.row_ptr[i + 1]; k++)
+			tri.emplace_back(i, Phi_q.col_idx[k], 0.0);
+	// The "B" part (constant values):
+	for (size_t i = 0; i < nDOFs; i++)
+		tri.emplace_back(nConstraints + i, indep_idxs_[i], 1.0);
+
+	A_.resize(nDepCoords, nDepCoords);
+	A_.setFromTriplets(tri.begin(), tri.end());
+
+	// Locate each Phi_q entry in the CCS storage, in CRS order:
+	A_ptrs_Phi_q_.resize(Phi_q.getNumNonZeros());
+	for (size_t i = 0; i < nConstraints; i++)
+	{
+		for (size_t k = Phi_q.row_ptr[i]; k < Phi_q.row_ptr[i + 1]; k++)
+		{
+			const auto col = Phi_q.col_idx[k];
+			const int* rows = A_.innerIndexPtr();
+			const int* it = std::lower_bound(
+				rows + A_.outerIndexPtr()[col],
+				rows + A_.outerIndexPtr()[col + 1], static_cast<int>(i));
+			A_ptrs_Phi_q_[k] = A_.valuePtr() + (it - rows);
+		}
+	}
+
+	if (symbolic_) klu_free_symbolic(&symbolic_, &common_);
+	if (numeric_) klu_free_numeric(&numeric_, &common_);
+
+	symbolic_ = klu_analyze(
+		A_.rows(), A_.outerIndexPtr(), A_.innerIndexPtr(), &common_);
+	if (!symbolic_)
+		THROW_EXCEPTION("Error: KLU couldn't analyze the [Phi_q; B] matrix.");
+
+	pattern_ok_ = true;
+
+	MBSE_PROFILE_LEAVE("solver_ddotz.build_pattern");
+}
+
+bool CDynamicSimulator_Indep_sparse::factorize()
+{
+	// Move the updated Jacobian values to their places in the CCS matrix:
+	const auto& values = arm_->Phi_q_.values;
+	for (size_t k = 0; k < values.size(); k++)
+		*A_ptrs_Phi_q_[k] = values[k];
+
+	if (!klu_factor_or_refactor(A_, symbolic_, numeric_, common_, min_rcond))
+		return false;
+	return common_.rcond >= min_rcond;
+}
+
+// method: R matrix projection (as in section 5.2.3 of "J. García De Jalon &
+// Bayo" book.
+void CDynamicSimulator_Indep_sparse::internal_solve_ddotz(
+	double t, VectorXd& ddot_z)
+{
+	MBSE_PROFILE_ENTER("solver_ddotz");
+
+	const size_t nDepCoords = arm_->q_.size();
+	const size_t nConstraints = arm_->Phi_.size();
+
+	MBSE_PROFILE_ENTER("solver_ddotz.update_jacob");
+	arm_->update_numeric_Phi_and_Jacobians();
+	MBSE_PROFILE_LEAVE("solver_ddotz.update_jacob");
+
+	// 1) Factorize [Phi_q; B], choosing new independent coordinates only if
+	//    there are none yet, or the current ones lead to a (nearly) singular
+	//    matrix:
+	// -----------------------------------------------------------
+	MBSE_PROFILE_ENTER("solver_ddotz.numeric_factor");
+	if (indep_idxs_.empty() && can_choose_indep_coords_)
+		choose_independent_coordinates(false);
+	if (!pattern_ok_) build_pattern();
+
+	bool ok = factorize();
+	for (int attempt = 0; !ok && can_choose_indep_coords_ && attempt < 2;
+		 attempt++)
+	{
+		// First retry with the sparse QR pivots, then with dense LU ones:
+		choose_independent_coordinates(attempt == 1);
+		build_pattern();
+		ok = factorize();
+	}
+	// Ill-conditioned, but usable until coordinates can be chosen again:
+	if (!ok && !numeric_)
+		THROW_EXCEPTION(
+			"Error: [Phi_q; B] is singular for the chosen independent "
+			"coordinates.");
+	MBSE_PROFILE_LEAVE("solver_ddotz.numeric_factor");
+
+	const size_t nDOFs = indep_idxs_.size();
+
+	// 2) Build the RHS of the dynamics:
+	// -----------------------------------------------------------
+	MBSE_PROFILE_ENTER("solver_ddotz.build_rhs");
+	Q_.resize(nDepCoords);
+	c_.resize(nConstraints);
+	this->build_RHS(&Q_[0], &c_[0]);
+	MBSE_PROFILE_LEAVE("solver_ddotz.build_rhs");
+
+	// 3) R and S*c from one multiple-RHS sparse solve:
+	//
+	// [ Phi_q ]              [ 0 | c ]
+	// [ ----- ] [ R | Sc ] = [ ----- ]
+	// [   B   ]              [ I | 0 ]
+	//
+	// -----------------------------------------------------------
+	MBSE_PROFILE_ENTER("solver_ddotz.solve_R");
+	rhs_.setZero(nDepCoords, nDOFs + 1);
+	for (size_t i = 0; i < nDOFs; i++) rhs_(nConstraints + i, i) = 1.0;
+	rhs_.col(nDOFs).head(nConstraints) = c_;
+
+	klu_solve(
+		symbolic_, numeric_, nDepCoords, nDOFs + 1, rhs_.data(), &common_);
+	if (common_.status != KLU_OK)
+		THROW_EXCEPTION("Error: KLU couldn't solve the linear system.");
+	MBSE_PROFILE_LEAVE("solver_ddotz.solve_R");
+
+	const auto R = rhs_.leftCols(nDOFs);
+	const auto Sc = rhs_.col(nDOFs);
+
+	// 4) (R^t M R) ddot_z = R^t (Q - M S c)
+	// -----------------------------------------------------------
+	MBSE_PROFILE_ENTER("solver_ddotz.solve");
+	MR_.noalias() = mass_ * R;
+	RtMR_.noalias() = R.transpose() * MR_;
+	Q_.noalias() -= mass_ * Sc;
+	ddot_z = RtMR_.llt().solve(R.transpose() * Q_);
+	MBSE_PROFILE_LEAVE("solver_ddotz.solve");
+
+	MBSE_PROFILE_LEAVE("solver_ddotz");
+}
@@ -36,7 +36,7 @@ CDynamicSimulator_Lagrange_CHOLMOD::CDynamicSimulator_Lagrange_CHOLMOD(
  * solve_ddotq() */
 void CDynamicSimulator_Lagrange_CHOLMOD::internal_prepare()
 {
-	timelog().enter("solver_prepare");
+	MBSE_PROFILE_ENTER("solver_prepare");
 
 	const size_t nDOFs = arm_->q_.size();
 	const size_t nConstraints = arm_->Phi_.size();
@@ -104,15 +104,13 @@ void CDynamicSimulator_Lagrange_CHOLMOD::internal_prepare()
 	for (size_t i = 0; i < nConstraints; i++)
 	{
 		// Constraint "i" goes to column "nDOFs+i" in the augmented matrix:
-		const CompressedRowSparseMatrix::row_t row_i = arm_->Phi_q_.matrix[i];
-		for (CompressedRowSparseMatrix::row_t::const_iterator itCol =
-				 row_i.begin();
-			 itCol != row_i.end(); ++itCol)
+		const auto& Phi_q = arm_->Phi_q_;
+		for (size_t k = Phi_q.row_ptr[i]; k < Phi_q.row_ptr[i + 1]; k++)
 		{
 			// We have precomputed the order in which we find the numeric
 			// values, just insert at their correct place:
 			const size_t idx = Phi_q_t_tri_->nnz;
-			static_cast<int*>(Phi_q_t_tri_->i)[idx] = itCol->first;
+			static_cast<int*>(Phi_q_t_tri_->i)[idx] = Phi_q.col_idx[k];
 			static_cast<int*>(Phi_q_t_tri_->j)[idx] = i;
 			ptrs_Phi_q_t_tri_.push_back(
 				static_cast<double*>(Phi_q_t_tri_->x) + idx);
@@ -182,7 +180,7 @@ void CDynamicSimulator_Lagrange_CHOLMOD::internal_prepare()
 	cholmod_free_sparse(&E_t, &cholmod_common_);
 	cholmod_free_sparse(&E, &cholmod_common_);
 
-	timelog().leave("solver_prepare");
+	MBSE_PROFILE_LEAVE("solver_prepare");
 }
 
 CDynamicSimulator_Lagrange_CHOLMOD::~CDynamicSimulator_Lagrange_CHOLMOD()
@@ -204,7 +202,7 @@ CDynamicSimulator_Lagrange_CHOLMOD::~CDynamicSimulator_Lagrange_CHOLMOD()
 void CDynamicSimulator_Lagrange_CHOLMOD::internal_solve_ddotq(
 	double t, VectorXd& ddot_q, VectorXd* lagrangre)
 {
-	timelog().enter("solver_ddotq");
+	MBSE_PROFILE_ENTER("solver_ddotq");
 
 	// [   M    Phi_q^t  ] [ ddot_q ] = [ Q ]
 	// [ Phi_q     0     ] [ lambda ]   [ c ]
@@ -216,41 +214,32 @@ void CDynamicSimulator_Lagrange_CHOLMOD::internal_solve_ddotq(
 	const size_t nConstraints = arm_->Phi_.size();
 
 	// Update numeric values of the constraint Jacobians:
-	timelog().enter("solver_ddotq.update_jacob");
+	MBSE_PROFILE_ENTER("solver_ddotq.update_jacob");
 	arm_->update_numeric_Phi_and_Jacobians();
 
 	// Insert Phi_q^t Jacobian in right-top block of augmented matrix:
+	// The triplets were created in prepare() in the same row-major order in
+	// which the CRS values are stored, so this is a flat copy:
 	{
-		size_t cnt = 0;
-		for (size_t i = 0; i < nConstraints; i++)
-		{
-			// Constraint "i" goes to column "nDOFs+i" in the augmented matrix:
-			const CompressedRowSparseMatrix::row_t row_i =
-				arm_->Phi_q_.matrix[i];
-			for (CompressedRowSparseMatrix::row_t::const_iterator itCol =
-					 row_i.begin();
-				 itCol != row_i.end(); ++itCol)
-			{
-				// We have precomputed the order in which we find the numeric
-				// values, just insert at their correct place:
-				*ptrs_Phi_q_t_tri_[cnt++] = itCol->second;
-			}
-		}
+		const auto& values = arm_->Phi_q_.values;
+		ASSERTDEB_EQUAL_(values.size(), ptrs_Phi_q_t_tri_.size());
+		for (size_t k = 0; k < values.size(); k++)
+			*ptrs_Phi_q_t_tri_[k] = values[k];
 	}
-	timelog().leave("solver_ddotq.update_jacob");
+	MBSE_PROFILE_LEAVE("solver_ddotq.update_jacob");
 
 	// Compress sparse matrix Phi_q_t:
-	timelog().enter("solver_ddotq.ccs");
+	MBSE_PROFILE_ENTER("solver_ddotq.ccs");
 	cholmod_sparse* Phi_q_t = cholmod_triplet_to_sparse(
 		Phi_q_t_tri_, Phi_q_t_tri_->nnz, &cholmod_common_);
 	ASSERTDEB_(Phi_q_t != nullptr);
-	timelog().leave("solver_ddotq.ccs");
+	MBSE_PROFILE_LEAVE("solver_ddotq.ccs");
 
 	// Solve:
 	//   L   *   X   = B
 	//   Lm  *  E^t  = Phi_q^t
 	//
-	timelog().enter("solver_ddotq.solve_E");
+	MBSE_PROFILE_ENTER("solver_ddotq.solve_E");
 	cholmod_sparse* E_t =
 		cholmod_spsolve(CHOLMOD_L /*Lx=b*/, Lm_, Phi_q_t, &cholmod_common_);
 	ASSERTDEB_(E_t != nullptr);
@@ -258,26 +247,26 @@ void CDynamicSimulator_Lagrange_CHOLMOD::internal_solve_ddotq(
 	cholmod_sparse* E = cholmod_transpose(
 		E_t, 2 /* A' complex conjugate transpose */, &cholmod_common_);
 	ASSERTDEB_(E != nullptr);
-	timelog().leave("solver_ddotq.solve_E");
+	MBSE_PROFILE_LEAVE("solver_ddotq.solve_E");
 
 	//  T = E * E^t
 	//  T = Lt * Lt^t
 	// Numeric factorization: E*E' = Lt*Lt' --> Lt=chol(E*E')
 	// ---------------------------------------------------------------
-	timelog().enter("solver_ddotq.numeric_factor");
+	MBSE_PROFILE_ENTER("solver_ddotq.numeric_factor");
 	cholmod_factorize(E, Lt_, &cholmod_common_);
-	timelog().leave("solver_ddotq.numeric_factor");
+	MBSE_PROFILE_LEAVE("solver_ddotq.numeric_factor");
 
 	// static int k=0;
 	// if (!k++) mbse::save_matrix(E,"E.txt",&cholmod_common_);
 
 	// Update the RHS vectors:
 	// --------------------------
-	timelog().enter("solver_ddotq.build_rhs");
+	MBSE_PROFILE_ENTER("solver_ddotq.build_rhs");
 	this->build_RHS(static_cast<double*>(Q_->x), static_cast<double*>(c_->x));
-	timelog().leave("solver_ddotq.build_rhs");
+	MBSE_PROFILE_LEAVE("solver_ddotq.build_rhs");
 
-	timelog().enter("solver_ddotq.solve");
+	MBSE_PROFILE_ENTER("solver_ddotq.solve");
 	// Solve: Lm x2 = Q
 	cholmod_dense* x2 =
 		cholmod_solve(CHOLMOD_L /*Lx=b*/, Lm_, Q_, &cholmod_common_);
@@ -303,7 +292,7 @@ void CDynamicSimulator_Lagrange_CHOLMOD::internal_solve_ddotq(
 
 	cholmod_dense* x =
 		cholmod_solve(CHOLMOD_Lt /*Ltx=b*/, Lm_, x2, &cholmod_common_);
-	timelog().leave("solver_ddotq.solve");
+	MBSE_PROFILE_LEAVE("solver_ddotq.solve");
 
 	// Copy result:
 	ddot_q.resize(nDOFs);
@@ -335,5 +324,5 @@ void CDynamicSimulator_Lagrange_CHOLMOD::internal_solve_ddotq(
 	cholmod_free_dense(&x, &cholmod_common_);
 	cholmod_free_dense(&l, &cholmod_common_);
 
-	timelog().leave("solver_ddotq");
+	MBSE_PROFILE_LEAVE("solver_ddotq");
 }
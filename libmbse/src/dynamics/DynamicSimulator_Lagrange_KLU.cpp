@@ -10,6 +10,7 @@
 
 #include <mbse/AssembledRigidModel.h>
 #include <mbse/dynamics/dynamic-simulators.h>
+#include <mbse/mbse-utils.h>
 
 using namespace mbse;
 using namespace Eigen;
@@ -32,7 +33,7 @@ CDynamicSimulator_Lagrange_KLU::CDynamicSimulator_Lagrange_KLU(
  * solve_ddotq() */
 void CDynamicSimulator_Lagrange_KLU::internal_prepare()
 {
-	timelog().enter("solver_prepare");
+	MBSE_PROFILE_ENTER("solver_prepare");
 
 	const size_t nDOFs = arm_->q_.size();
 	const size_t nConstraints = arm_->Phi_.size();
@@ -40,46 +41,42 @@ void CDynamicSimulator_Lagrange_KLU::internal_prepare()
 
 	// Build mass matrix now and don't touch it anymore, since it's constant
 	// with this formulation:
-	mass_tri_ = arm_->buildMassMatrix_sparse();
-
-	// Start augmented matrix:
-	A_tri_ = mass_tri_;
+	std::vector<Eigen::Triplet<double>> A_tri = arm_->buildMassMatrix_sparse();
 
 	//  Add entries in the triplet form for the sparse Phi_q Jacobian.
 	// -----------------------------------------------------------
-	A_tri_.reserve(
-		A_tri_.size() +
-		2 * nConstraints *
-			nDOFs);	 // *IMPORTANT* Reserve mem at once to avoid reallocations,
-					 // since we store pointers to places...
+	const auto& Phi_q = arm_->Phi_q_;
+	A_tri.reserve(A_tri.size() + 2 * Phi_q.getNumNonZeros());
 
 	for (size_t i = 0; i < nConstraints; i++)
 	{
 		// Constraint "i" goes to column "nDOFs+i" in the augmented matrix:
-		const CompressedRowSparseMatrix::row_t row_i = arm_->Phi_q_.matrix[i];
-		for (CompressedRowSparseMatrix::row_t::const_iterator itCol =
-				 row_i.begin();
-			 itCol != row_i.end(); ++itCol)
+		for (size_t k = Phi_q.row_ptr[i]; k < Phi_q.row_ptr[i + 1]; k++)
 		{
-			// We have precomputed the order in which we find the numeric
-			// values, just insert at their correct place:
-			const size_t idx0 = A_tri_.size();
-
-			A_tri_.push_back(
-				Eigen::Triplet<double>(itCol->first, nDOFs + i, 1.0));
-			A_tri_.push_back(
-				Eigen::Triplet<double>(nDOFs + i, itCol->first, 1.0));
-
-			A_tri_ptrs_Phi_q_.push_back(
-				const_cast<double*>(&A_tri_[idx0].value()));
-			A_tri_ptrs_Phi_q_.push_back(
-				const_cast<double*>(&A_tri_[idx0 + 1].value()));
+			const size_t col = Phi_q.col_idx[k];
+			A_tri.emplace_back(col, nDOFs + i, 0.0);
+			A_tri.emplace_back(nDOFs + i, col, 0.0);
 		}
 	}
 
-	// Analyze the pattern once:
+	// The pattern never changes from now on:
 	A_.resize(nTot, nTot);
-	A_.setFromTriplets(A_tri_.begin(), A_tri_.end());
+	A_.setFromTriplets(A_tri.begin(), A_tri.end());
+
+	// Places of the Jacobian values in the CCS matrix, in the CRS storage
+	// order, so they can be updated in place:
+	A_ptrs_Phi_q_.clear();
+	A_ptrs_Phi_q_.reserve(2 * Phi_q.getNumNonZeros());
+	for (size_t i = 0; i < nConstraints; i++)
+	{
+		for (size_t k = Phi_q.row_ptr[i]; k < Phi_q.row_ptr[i + 1]; k++)
+		{
+			const int col = Phi_q.col_idx[k];
+			const int row = nDOFs + i;
+			A_ptrs_Phi_q_.push_back(ccs_entry_ptr(A_, col, row));
+			A_ptrs_Phi_q_.push_back(ccs_entry_ptr(A_, row, col));
+		}
+	}
 
 	//   int btf ;               /* use BTF pre-ordering, or not */
 	//   int ordering ;          /* 0: AMD, 1: COLAMD, 2: user P and Q,
@@ -108,7 +105,7 @@ void CDynamicSimulator_Lagrange_KLU::internal_prepare()
 
 	// A_.toDense().saveToTextFile("A.txt");
 
-	timelog().leave("solver_prepare");
+	MBSE_PROFILE_LEAVE("solver_prepare");
 }
 
 CDynamicSimulator_Lagrange_KLU::~CDynamicSimulator_Lagrange_KLU()
@@ -121,7 +118,7 @@ CDynamicSimulator_Lagrange_KLU::~CDynamicSimulator_Lagrange_KLU()
 void CDynamicSimulator_Lagrange_KLU::internal_solve_ddotq(
 	double t, VectorXd& ddot_q, VectorXd* lagrangre)
 {
-	timelog().enter("solver_ddotq");
+	MBSE_PROFILE_ENTER("solver_ddotq");
 
 	// [   M    Phi_q^t  ] [ ddot_q ] = [ Q ]
 	// [ Phi_q     0     ] [ lambda ]   [ c ]
@@ -134,58 +131,41 @@ void CDynamicSimulator_Lagrange_KLU::internal_solve_ddotq(
 	const size_t nTot = nDOFs + nConstraints;
 
 	// Update numeric values of the constraint Jacobians:
-	timelog().enter("solver_ddotq.update_jacob");
+	MBSE_PROFILE_ENTER("solver_ddotq.update_jacob");
 	arm_->update_numeric_Phi_and_Jacobians();
-	timelog().leave("solver_ddotq.update_jacob");
+	MBSE_PROFILE_LEAVE("solver_ddotq.update_jacob");
 
-	timelog().enter("solver_ddotq.update_jacob_triplets");
-	// Move the updated Jacobian values to their places in the triplet form:
+	MBSE_PROFILE_ENTER("solver_ddotq.update_ccs");
+	// Move the updated Jacobian values to their places in the CCS matrix:
 	{
+		const auto& values = arm_->Phi_q_.values;
 		size_t idx = 0;
-		for (size_t i = 0; i < nConstraints; i++)
+		for (size_t k = 0; k < values.size(); k++)
 		{
-			// Constraint "i" goes to column "nDOFs+i" in the augmented matrix:
-			const CompressedRowSparseMatrix::row_t row_i =
-				arm_->Phi_q_.matrix[i];
-			for (CompressedRowSparseMatrix::row_t::const_iterator itCol =
-					 row_i.begin();
-				 itCol != row_i.end(); ++itCol)
-			{
-				*A_tri_ptrs_Phi_q_[idx++] = itCol->second;
-				*A_tri_ptrs_Phi_q_[idx++] = itCol->second;
-			}
+			*A_ptrs_Phi_q_[idx++] = values[k];
+			*A_ptrs_Phi_q_[idx++] = values[k];
 		}
 	}
-	timelog().leave("solver_ddotq.update_jacob_triplets");
+	MBSE_PROFILE_LEAVE("solver_ddotq.update_ccs");
 
-	// Solve numeric sparse LU:
+	// Numeric sparse LU, reusing the previous pivoting if possible:
 	// -----------------------------------
-	timelog().enter("solver_ddotq.ccs");
-	A_.setFromTriplets(A_tri_.begin(), A_tri_.end());
-	timelog().leave("solver_ddotq.ccs");
-
-	timelog().enter("solver_ddotq.numeric_factor");
-	if (numeric_) klu_free_numeric(&numeric_, &common_);
-
-	numeric_ = klu_factor(
-		A_.outerIndexPtr(), A_.innerIndexPtr(), A_.valuePtr(), symbolic_,
-		&common_);
-
-	if (!numeric_)
+	MBSE_PROFILE_ENTER("solver_ddotq.numeric_factor");
+	if (!klu_factor_or_refactor(A_, symbolic_, numeric_, common_, min_rcond))
 		THROW_EXCEPTION(
 			"Error: KLU couldn't numeric-factorize the augmented matrix.");
-	timelog().leave("solver_ddotq.numeric_factor");
+	MBSE_PROFILE_LEAVE("solver_ddotq.numeric_factor");
 
 	// Build the RHS vector:
 	// --------------------------
-	timelog().enter("solver_ddotq.build_rhs");
+	MBSE_PROFILE_ENTER("solver_ddotq.build_rhs");
 	Eigen::VectorXd RHS(nTot);
 	this->build_RHS(&RHS[0], &RHS[nDOFs]);
-	timelog().leave("solver_ddotq.build_rhs");
+	MBSE_PROFILE_LEAVE("solver_ddotq.build_rhs");
 
 	// Solve linear system:
 	// -----------------------------------
-	timelog().enter("solver_ddotq.solve");
+	MBSE_PROFILE_ENTER("solver_ddotq.solve");
 
 	// Eigen::VectorXd solution(nTot);
 	// KLU leaves solution in the same place than the input RHS vector:
@@ -195,7 +175,7 @@ void CDynamicSimulator_Lagrange_KLU::internal_solve_ddotq(
 	if (common_.status != KLU_OK)
 		THROW_EXCEPTION("Error: KLU couldn't solve the linear system.");
 
-	timelog().leave("solver_ddotq.solve");
+	MBSE_PROFILE_LEAVE("solver_ddotq.solve");
 
 	ddot_q = RHS.head(nDOFs);
 	if (lagrangre) *lagrangre = RHS.tail(nConstraints);
@@ -208,5 +188,14 @@ void CDynamicSimulator_Lagrange_KLU::internal_solve_ddotq(
 	mrpt::system::pause();
 #endif
 
-	timelog().leave("solver_ddotq");
+	MBSE_PROFILE_LEAVE("solver_ddotq");
+}
+
+void CDynamicSimulator_Lagrange_KLU::solve_kkt(Eigen::MatrixXd& rhs)
+{
+	ASSERT_(numeric_);
+	ASSERT_EQUAL_(rhs.rows(), A_.cols());
+	if (!rhs.cols()) return;
+	klu_solve(
+		symbolic_, numeric_, A_.cols(), rhs.cols(), rhs.data(), &common_);
 }
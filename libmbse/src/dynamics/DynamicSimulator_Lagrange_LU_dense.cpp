@@ -10,6 +10,7 @@
 
 #include <mbse/AssembledRigidModel.h>
 #include <mbse/dynamics/dynamic-simulators.h>
+#include <exception>
 
 using namespace mbse;
 using namespace Eigen;
@@ -30,19 +31,20 @@ CDynamicSimulator_Lagrange_LU_dense::CDynamicSimulator_Lagrange_LU_dense(
  * solve_ddotq() */
 void CDynamicSimulator_Lagrange_LU_dense::internal_prepare()
 {
-	timelog().enter("solver_prepare");
+	MBSE_PROFILE_ENTER("solver_prepare");
 
 	// Build mass matrix now and don't touch it anymore, since it's constant
 	// with this formulation:
 	mass_ = arm_->buildMassMatrix_dense();
+	mass_llt_.compute(mass_);
 
-	timelog().leave("solver_prepare");
+	MBSE_PROFILE_LEAVE("solver_prepare");
 }
 
 void CDynamicSimulator_Lagrange_LU_dense::internal_solve_ddotq(
 	double t, VectorXd& ddot_q, VectorXd* lagrangre)
 {
-	timelog().enter("solver_ddotq");
+	MBSE_PROFILE_ENTER("solver_ddotq");
 
 	// [   M    Phi_q^t  ] [ ddot_q ] = [ Q ]
 	// [ Phi_q     0     ] [ lambda ]   [ c ]
@@ -62,36 +64,37 @@ void CDynamicSimulator_Lagrange_LU_dense::internal_solve_ddotq(
 	A.block(nDOFs, nDOFs, nConstraints, nConstraints).setZero();
 
 	// Update numeric values of the constraint Jacobians:
-	timelog().enter("solver_ddotq.update_jacob");
+	MBSE_PROFILE_ENTER("solver_ddotq.update_jacob");
 	arm_->update_numeric_Phi_and_Jacobians();
 
 	for (size_t i = 0; i < nConstraints; i++)
 	{
 		// Constraint "i" goes to column "nDOFs+i" in the augmented matrix:
-		const CompressedRowSparseMatrix::row_t& row_i = arm_->Phi_q_.matrix[i];
-		for (const auto& kv : row_i)
+		const auto& Phi_q = arm_->Phi_q_;
+		for (size_t k = Phi_q.row_ptr[i]; k < Phi_q.row_ptr[i + 1]; k++)
 		{
-			const size_t col = kv.first;
+			const size_t col = Phi_q.col_idx[k];
 			// Insert at (col,i) because it's tranposed:
 
-			A.coeffRef(col, nDOFs + i) = kv.second;
-			A.coeffRef(nDOFs + i, col) = kv.second;
+			A.coeffRef(col, nDOFs + i) = Phi_q.values[k];
+			A.coeffRef(nDOFs + i, col) = Phi_q.values[k];
 		}
 	}
-	timelog().leave("solver_ddotq.update_jacob");
+	MBSE_PROFILE_LEAVE("solver_ddotq.update_jacob");
 
 	// Build the RHS vector:
 	// --------------------------
-	timelog().enter("solver_ddotq.build_rhs");
+	MBSE_PROFILE_ENTER("solver_ddotq.build_rhs");
 	Eigen::VectorXd RHS(nTot);
 	this->build_RHS(&RHS[0], &RHS[nDOFs]);
-	timelog().leave("solver_ddotq.build_rhs");
+	MBSE_PROFILE_LEAVE("solver_ddotq.build_rhs");
 
 	// Solve linear system (using LU dense decomposition):
 	// -------------------------------------------------------------
-	timelog().enter("solver_ddotq.solve");
-	const Eigen::VectorXd solution = A.partialPivLu().solve(RHS);
-	timelog().leave("solver_ddotq.solve");
+	MBSE_PROFILE_ENTER("solver_ddotq.solve");
+	A_lu_.compute(A);
+	const Eigen::VectorXd solution = A_lu_.solve(RHS);
+	MBSE_PROFILE_LEAVE("solver_ddotq.solve");
 
 	ddot_q = solution.head(nDOFs);
 	if (lagrangre) *lagrangre = solution.tail(nConstraints);
@@ -108,5 +111,114 @@ void CDynamicSimulator_Lagrange_LU_dense::internal_solve_ddotq(
 	mrpt::system::pause();
 #endif
 
-	timelog().leave("solver_ddotq");
+	MBSE_PROFILE_LEAVE("solver_ddotq");
+}
+
+void CDynamicSimulator_Lagrange_LU_dense::solve_kkt(Eigen::MatrixXd& rhs)
+{
+	ASSERT_EQUAL_(rhs.rows(), A_lu_.rows());
+	rhs = A_lu_.solve(rhs).eval();
+}
+
+void CDynamicSimulator_Lagrange_LU_dense::solve_ddotq_batch(
+	double t, const Eigen::MatrixXd& q, const Eigen::MatrixXd& dq,
+	Eigen::MatrixXd& ddot_q, const Eigen::MatrixXd* Q)
+{
+	ASSERT_(init_);
+	if (mass_llt_.info() != Eigen::Success)
+	{
+		CDynamicSimulatorBase::solve_ddotq_batch(t, q, dq, ddot_q, Q);
+		return;
+	}
+
+	const auto n = arm_->q_.size();
+	const auto m = arm_->Phi_.size();
+	ASSERT_EQUAL_(q.rows(), n);
+	ASSERT_EQUAL_(dq.rows(), n);
+	ASSERT_EQUAL_(q.cols(), dq.cols());
+	if (Q)
+	{
+		ASSERT_EQUAL_(Q->rows(), n);
+		ASSERT_EQUAL_(Q->cols(), q.cols());
+	}
+
+	MBSE_PROFILE_SCOPE("solver_ddotq_batch");
+
+	// Common to all states: the generalized forces and M^-1 times them,
+	// except for the external forces of each state, if given:
+	Eigen::VectorXd Q_model;
+	arm_->builGeneralizedForces(Q_model);
+	if (Q) Q_model -= arm_->Q_;
+	const Eigen::VectorXd MinvQ_model = mass_llt_.solve(Q_model);
+
+	const ModelTopology& topology = *arm_->topology();
+	const double k_vel = BAUMGARTE_K_VEL;
+	const double k_pos = BAUMGARTE_K_POS;
+
+	const int nStates = static_cast<int>(q.cols());
+	ddot_q.resize(n, nStates);
+
+	// States are independent: each thread works on its own ModelState and
+	// workspace. Exceptions can't leave an OpenMP region, so the first one is
+	// kept and rethrown afterwards.
+	std::exception_ptr error;
+
+#ifdef SPARSEMBS_HAVE_OPENMP
+#pragma omp parallel
+#endif
+	{
+		ModelState s(static_cast<const ModelState&>(*arm_));
+		Eigen::MatrixXd Phi_qt(n, m), Y(n, m), S(m, m);
+		Eigen::VectorXd c(m), lambda(m), MinvQ(n);
+		Eigen::LDLT<Eigen::MatrixXd> S_ldlt(m);
+
+#ifdef SPARSEMBS_HAVE_OPENMP
+#pragma omp for schedule(static)
+#endif
+		for (int i = 0; i < nStates; i++)
+		{
+			try
+			{
+				s.q_ = q.col(i);
+				s.dotq_ = dq.col(i);
+				topology.realize_operating_point(s);
+				topology.update_numeric_Phi_and_Jacobians(s);
+
+				MinvQ = MinvQ_model;
+				if (Q) MinvQ += mass_llt_.solve(Q->col(i));
+
+				// Phi_q^T, and "c" as in build_RHS():
+				const auto& Phi_q = s.Phi_q_;
+				Phi_qt.setZero();
+				for (Eigen::Index r = 0; r < m; r++)
+				{
+					for (size_t k = Phi_q.row_ptr[r]; k < Phi_q.row_ptr[r + 1];
+						 k++)
+						Phi_qt(Phi_q.col_idx[k], r) = Phi_q.values[k];
+
+					c[r] = -s.dotPhi_q_.rowDot(r, &s.dotq_[0]) -
+						   k_vel * s.dotPhi_[r] - k_pos * s.Phi_[r];
+				}
+
+				// Y = M^-1 * Phi_q^T ; S = Phi_q * M^-1 * Phi_q^T
+				Y = mass_llt_.solve(Phi_qt);
+				S.noalias() = Phi_qt.transpose() * Y;
+				S_ldlt.compute(S);
+
+				c.noalias() -= Phi_qt.transpose() * MinvQ;
+				lambda = S_ldlt.solve(-c);
+
+				ddot_q.col(i) = MinvQ;
+				ddot_q.col(i).noalias() -= Y * lambda;
+			}
+			catch (...)
+			{
+#ifdef SPARSEMBS_HAVE_OPENMP
+#pragma omp critical(mbse_batch_error)
+#endif
+				if (!error) error = std::current_exception();
+			}
+		}
+	}
+	if (error) std::rethrow_exception(error);
 }
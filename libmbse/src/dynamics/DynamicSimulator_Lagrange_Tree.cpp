@@ -0,0 +1,444 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include <mbse/AssembledRigidModel.h>
+#include <mbse/dynamics/dynamic-simulators.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+
+using namespace mbse;
+using namespace Eigen;
+using namespace std;
+
+// ---------------------------------------------------------------------------------------------
+//  Solver: Recursive elimination over the spanning tree of the model
+// ---------------------------------------------------------------------------------------------
+CDynamicSimulator_Lagrange_Tree::CDynamicSimulator_Lagrange_Tree(
+	const std::shared_ptr<AssembledRigidModel> arm_ptr)
+	: CDynamicSimulatorBase(arm_ptr)
+{
+}
+
+namespace
+{
+size_t local_index(const std::vector<size_t>& vars, size_t var)
+{
+	const auto it = std::find(vars.begin(), vars.end(), var);
+	ASSERT_(it != vars.end());
+	return it - vars.begin();
+}
+}  // namespace
+
+/** Prepare the linear systems and anything else required to really call
+ * solve_ddotq() */
+void CDynamicSimulator_Lagrange_Tree::internal_prepare()
+{
+	MBSE_PROFILE_ENTER("solver_prepare");
+
+	const size_t nDOFs = arm_->q_.size();
+	const size_t nConstraints = arm_->Phi_.size();
+	const auto& Phi_q = arm_->Phi_q_;
+
+	// 1) One node per non-fixed point:
+	// -----------------------------------------
+	std::vector<std::vector<size_t>> node_dofs;
+	std::vector<size_t> node_of_dof(nDOFs, INVALID_NODE);
+	for (const Point2ToDOF& p : arm_->getPoints2DOFs())
+	{
+		if (p.dof_x == INVALID_DOF) continue;
+		node_of_dof[p.dof_x] = node_of_dof[p.dof_y] = node_dofs.size();
+		node_dofs.push_back({p.dof_x, p.dof_y});
+	}
+	ASSERTMSG_(
+		std::find(node_of_dof.begin(), node_of_dof.end(), INVALID_NODE) ==
+			node_of_dof.end(),
+		"CDynamicSimulator_Lagrange_Tree does not support relative "
+		"coordinates");
+	const size_t nNodes = node_dofs.size();
+
+	// Nodes of each constraint:
+	std::vector<std::vector<size_t>> row_nodes(nConstraints);
+	for (size_t r = 0; r < nConstraints; r++)
+	{
+		auto& rn = row_nodes[r];
+		for (size_t k = Phi_q.row_ptr[r]; k < Phi_q.row_ptr[r + 1]; k++)
+			rn.push_back(node_of_dof[Phi_q.col_idx[k]]);
+		std::sort(rn.begin(), rn.end());
+		rn.erase(std::unique(rn.begin(), rn.end()), rn.end());
+	}
+
+	// Mass matrix (constant):
+	const std::vector<Eigen::Triplet<double>> M_tri =
+		arm_->buildMassMatrix_sparse();
+	Eigen::SparseMatrix<double> M(nDOFs, nDOFs);
+	M.setFromTriplets(M_tri.begin(), M_tri.end());
+
+	// 2) Spanning forest, by breadth-first search over the couplings
+	// between nodes. Roots are preferably nodes joined to fixed points.
+	// -----------------------------------------
+	std::vector<std::set<size_t>> adjacency(nNodes);
+	std::vector<bool> is_grounded(nNodes, false);
+	for (const auto& rn : row_nodes)
+	{
+		if (rn.size() == 1) is_grounded[rn[0]] = true;
+		if (rn.size() != 2) continue;
+		adjacency[rn[0]].insert(rn[1]);
+		adjacency[rn[1]].insert(rn[0]);
+	}
+	for (int col = 0; col < M.outerSize(); ++col)
+		for (Eigen::SparseMatrix<double>::InnerIterator it(M, col); it; ++it)
+		{
+			const size_t a = node_of_dof[it.row()], b = node_of_dof[it.col()];
+			if (a != b && it.value() != 0) adjacency[a].insert(b);
+		}
+
+	std::vector<size_t> parent(nNodes, INVALID_NODE), bfs_order;
+	std::vector<bool> visited(nNodes, false);
+	bfs_order.reserve(nNodes);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (size_t root = 0; root < nNodes; root++)
+		{
+			if (visited[root] || (pass == 0 && !is_grounded[root])) continue;
+			std::deque<size_t> pending = {root};
+			visited[root] = true;
+			while (!pending.empty())
+			{
+				const size_t n = pending.front();
+				pending.pop_front();
+				bfs_order.push_back(n);
+				for (size_t c : adjacency[n])
+				{
+					if (visited[c]) continue;
+					visited[c] = true;
+					parent[c] = n;
+					pending.push_back(c);
+				}
+			}
+		}
+	}
+
+	// 3) Owner of each constraint: the child node of the tree edge it
+	// lies on, or its only node. Up to one constraint per coordinate of the
+	// node, so its diagonal block can be invertible. The rest are cut.
+	// -----------------------------------------
+	std::vector<size_t> row_owner(nConstraints, INVALID_NODE);
+	std::vector<size_t> num_owned(nNodes, 0);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (size_t r = 0; r < nConstraints; r++)
+		{
+			const auto& rn = row_nodes[r];
+			size_t owner = INVALID_NODE;
+			if (pass == 0 && rn.size() == 2)
+			{
+				if (parent[rn[1]] == rn[0]) owner = rn[1];
+				if (parent[rn[0]] == rn[1]) owner = rn[0];
+			}
+			if (pass == 1 && rn.size() == 1) owner = rn[0];
+
+			if (owner == INVALID_NODE ||
+				num_owned[owner] >= node_dofs[owner].size())
+				continue;
+			row_owner[r] = owner;
+			num_owned[owner]++;
+		}
+	}
+
+	// 4) Nodes in elimination order (reverse BFS: children first), plus
+	// one isolated node per cut constraint:
+	// -----------------------------------------
+	std::vector<size_t> new_index(nNodes);
+	for (size_t i = 0; i < nNodes; i++)
+		new_index[bfs_order[nNodes - 1 - i]] = i;
+
+	nodes_.clear();
+	nodes_.resize(nNodes);
+	for (size_t old = 0; old < nNodes; old++)
+	{
+		TNode& node = nodes_[new_index[old]];
+		node.vars = node_dofs[old];
+		if (parent[old] != INVALID_NODE) node.parent = new_index[parent[old]];
+	}
+	for (size_t r = 0; r < nConstraints; r++)
+		if (row_owner[r] != INVALID_NODE)
+			nodes_[new_index[row_owner[r]]].vars.push_back(nDOFs + r);
+
+	std::vector<size_t> node_of_var(nDOFs + nConstraints, INVALID_NODE);
+	for (size_t i = 0; i < nodes_.size(); i++)
+		for (size_t v : nodes_[i].vars) node_of_var[v] = i;
+
+	lowrank_U_.clear();
+	lowrank_B_.clear();
+	cut_rows_.clear();
+	for (size_t r = 0; r < nConstraints; r++)
+	{
+		if (row_owner[r] != INVALID_NODE) continue;
+
+		// The constraint itself is added with the correction. Its multiplier
+		// is an isolated node with a unit diagonal, which is also undone by
+		// the correction:
+		// K - K_tree = g*e^t + e*(g - e)^t
+		const size_t var = nDOFs + r;
+		node_of_var[var] = nodes_.size();
+		nodes_.emplace_back();
+		nodes_.back().vars = {var};
+		nodes_.back().D_base.setIdentity(1, 1);
+
+		cut_rows_.emplace_back(r, lowrank_U_.size());
+		sparse_vector_t g;
+		for (size_t k = Phi_q.row_ptr[r]; k < Phi_q.row_ptr[r + 1]; k++)
+			g.emplace_back(Phi_q.col_idx[k], 0.0);
+		lowrank_U_.push_back(g);
+		lowrank_B_.push_back({{var, 1.0}});
+		lowrank_U_.push_back({{var, 1.0}});
+		g.emplace_back(var, -1.0);
+		lowrank_B_.push_back(g);
+	}
+
+	for (TNode& node : nodes_)
+	{
+		const auto n = node.vars.size();
+		ASSERT_LE_(n, 4U);
+		if (node.D_base.size() == 0) node.D_base.setZero(n, n);
+		if (node.parent != INVALID_NODE)
+			node.K_up_base.setZero(n, nodes_[node.parent].vars.size());
+	}
+
+	// 5) Mass matrix, into the blocks or the correction:
+	// -----------------------------------------
+	std::map<size_t, size_t> cut_mass_row;	// dof => index in lowrank_B_
+	for (int col = 0; col < M.outerSize(); ++col)
+	{
+		for (Eigen::SparseMatrix<double>::InnerIterator it(M, col); it; ++it)
+		{
+			const size_t i = it.row(), j = it.col();
+			const size_t a = node_of_var[i], b = node_of_var[j];
+			TNode& na = nodes_[a];
+			if (a == b)
+				na.D_base(local_index(na.vars, i), local_index(na.vars, j)) +=
+					it.value();
+			else if (na.parent == b)
+				na.K_up_base(
+					local_index(na.vars, i),
+					local_index(nodes_[b].vars, j)) += it.value();
+			else if (nodes_[b].parent == a)
+				continue;  // Stored as K_up of "b"
+			else
+			{
+				// Loop-closing coupling: K - K_tree += e_i * (M_ij * e_j^t)
+				auto itRow = cut_mass_row.find(i);
+				if (itRow == cut_mass_row.end())
+				{
+					itRow = cut_mass_row.emplace(i, lowrank_U_.size()).first;
+					lowrank_U_.push_back({{i, 1.0}});
+					lowrank_B_.emplace_back();
+				}
+				lowrank_B_[itRow->second].emplace_back(j, it.value());
+			}
+		}
+	}
+
+	// 6) Where each value of Phi_q goes:
+	// -----------------------------------------
+	Phi_q_scatter_.clear();
+	Phi_q_scatter_.resize(Phi_q.getNumNonZeros());
+	for (size_t r = 0; r < nConstraints; r++)
+	{
+		const size_t o = node_of_var[nDOFs + r];
+		for (size_t k = Phi_q.row_ptr[r]; k < Phi_q.row_ptr[r + 1]; k++)
+		{
+			TScatter& s = Phi_q_scatter_[k];
+			s.node = o;
+			if (row_owner[r] == INVALID_NODE)
+			{
+				s.node = INVALID_NODE;	// In the correction
+				continue;
+			}
+			const size_t dof = Phi_q.col_idx[k];
+			const size_t t = node_of_var[dof];
+			s.row = static_cast<uint8_t>(
+				local_index(nodes_[o].vars, nDOFs + r));
+			s.col = static_cast<uint8_t>(local_index(nodes_[t].vars, dof));
+			s.diag = (t == o);
+			ASSERT_(s.diag || t == nodes_[o].parent);
+		}
+	}
+
+	MBSE_PROFILE_VALUE("tree.cut_terms", lowrank_U_.size());
+	MBSE_PROFILE_LEAVE("solver_prepare");
+}
+
+void CDynamicSimulator_Lagrange_Tree::factorize()
+{
+	// Blocks with the current Phi_q:
+	for (TNode& node : nodes_)
+	{
+		node.D = node.D_base;
+		if (node.parent != INVALID_NODE) node.K_up = node.K_up_base;
+	}
+	const auto& values = arm_->Phi_q_.values;
+	for (size_t k = 0; k < values.size(); k++)
+	{
+		const TScatter& s = Phi_q_scatter_[k];
+		if (s.node == INVALID_NODE) continue;
+		TNode& node = nodes_[s.node];
+		if (s.diag)
+		{
+			node.D(s.row, s.col) = values[k];
+			node.D(s.col, s.row) = values[k];
+		}
+		else
+			node.K_up(s.row, s.col) = values[k];
+	}
+
+	// Leaves to root: D_parent -= K_up^t * D^-1 * K_up
+	for (TNode& node : nodes_)
+	{
+		node.D_lu.compute(node.D);
+		ASSERTMSG_(
+			node.D_lu.isInvertible(),
+			"Singular block in the tree elimination (singular "
+			"configuration?)");
+		if (node.parent == INVALID_NODE) continue;
+		node.W = node.D_lu.solve(node.K_up);
+		nodes_[node.parent].D.noalias() -= node.K_up.transpose() * node.W;
+	}
+
+	// Loop-closing terms:
+	const size_t nLowRank = lowrank_U_.size();
+	if (!nLowRank) return;
+
+	const auto& Phi_q = arm_->Phi_q_;
+	for (const auto& cr : cut_rows_)
+	{
+		sparse_vector_t& g = lowrank_U_[cr.second];
+		sparse_vector_t& g_e = lowrank_B_[cr.second + 1];
+		for (size_t k = Phi_q.row_ptr[cr.first], i = 0;
+			 k < Phi_q.row_ptr[cr.first + 1]; k++, i++)
+			g[i].second = g_e[i].second = Phi_q.values[k];
+	}
+
+	const size_t nTot = arm_->q_.size() + arm_->Phi_.size();
+	Z_.setZero(nTot, nLowRank);
+	for (size_t j = 0; j < nLowRank; j++)
+	{
+		for (const auto& e : lowrank_U_[j]) Z_(e.first, j) = e.second;
+		solve_tree(Z_.col(j));
+	}
+
+	Eigen::MatrixXd S = Eigen::MatrixXd::Identity(nLowRank, nLowRank);
+	for (size_t i = 0; i < nLowRank; i++)
+		for (const auto& e : lowrank_B_[i])
+			S.row(i) += e.second * Z_.row(e.first);
+	S_lu_.compute(S);
+	ASSERTMSG_(
+		S_lu_.isInvertible(),
+		"Singular loop-closure system (singular configuration?)");
+}
+
+void CDynamicSimulator_Lagrange_Tree::solve_tree(
+	Eigen::Ref<Eigen::VectorXd> x) const
+{
+	block_vector_t y, xp;
+
+	// Leaves to root: y_parent -= W^t * y
+	for (const TNode& node : nodes_)
+	{
+		if (node.parent == INVALID_NODE) continue;
+		const auto n = node.vars.size();
+		y.resize(n);
+		for (size_t k = 0; k < n; k++) y[k] = x[node.vars[k]];
+
+		const auto& pvars = nodes_[node.parent].vars;
+		for (size_t l = 0; l < pvars.size(); l++)
+			x[pvars[l]] -= node.W.col(l).dot(y);
+	}
+
+	// Root to leaves: x = D^-1 * y - W * x_parent
+	for (auto it = nodes_.rbegin(); it != nodes_.rend(); ++it)
+	{
+		const TNode& node = *it;
+		const auto n = node.vars.size();
+		y.resize(n);
+		for (size_t k = 0; k < n; k++) y[k] = x[node.vars[k]];
+		y = node.D_lu.solve(y).eval();
+
+		if (node.parent != INVALID_NODE)
+		{
+			const auto& pvars = nodes_[node.parent].vars;
+			xp.resize(pvars.size());
+			for (size_t l = 0; l < pvars.size(); l++) xp[l] = x[pvars[l]];
+			y.noalias() -= node.W * xp;
+		}
+		for (size_t k = 0; k < n; k++) x[node.vars[k]] = y[k];
+	}
+}
+
+void CDynamicSimulator_Lagrange_Tree::internal_solve_ddotq(
+	double t, VectorXd& ddot_q, VectorXd* lagrangre)
+{
+	MBSE_PROFILE_ENTER("solver_ddotq");
+
+	// [   M    Phi_q^t  ] [ ddot_q ] = [ Q ]
+	// [ Phi_q     0     ] [ lambda ]   [ c ]
+	//
+	const size_t nDOFs = arm_->q_.size();
+	const size_t nConstraints = arm_->Phi_.size();
+
+	MBSE_PROFILE_ENTER("solver_ddotq.update_jacob");
+	arm_->update_numeric_Phi_and_Jacobians();
+	MBSE_PROFILE_LEAVE("solver_ddotq.update_jacob");
+
+	rhs_.resize(nDOFs + nConstraints);
+
+	MBSE_PROFILE_ENTER("solver_ddotq.numeric_factor");
+	this->factorize();
+	MBSE_PROFILE_LEAVE("solver_ddotq.numeric_factor");
+
+	MBSE_PROFILE_ENTER("solver_ddotq.build_rhs");
+	this->build_RHS(&rhs_[0], &rhs_[nDOFs]);
+	MBSE_PROFILE_LEAVE("solver_ddotq.build_rhs");
+
+	MBSE_PROFILE_ENTER("solver_ddotq.solve");
+	solve_factorized(rhs_);
+	MBSE_PROFILE_LEAVE("solver_ddotq.solve");
+
+	ddot_q = rhs_.head(nDOFs);
+	if (lagrangre) *lagrangre = rhs_.tail(nConstraints);
+
+	MBSE_PROFILE_LEAVE("solver_ddotq");
+}
+
+void CDynamicSimulator_Lagrange_Tree::solve_factorized(
+	Eigen::Ref<Eigen::VectorXd> x)
+{
+	solve_tree(x);
+
+	// Woodbury: x = y - Z * (I + B*Z)^-1 * B * y
+	const size_t nLowRank = lowrank_U_.size();
+	if (nLowRank)
+	{
+		Bx_.setZero(nLowRank);
+		for (size_t i = 0; i < nLowRank; i++)
+			for (const auto& e : lowrank_B_[i])
+				Bx_[i] += e.second * x[e.first];
+		x.noalias() -= Z_ * S_lu_.solve(Bx_);
+	}
+}
+
+void CDynamicSimulator_Lagrange_Tree::solve_kkt(Eigen::MatrixXd& rhs)
+{
+	ASSERT_EQUAL_(
+		static_cast<size_t>(rhs.rows()), arm_->q_.size() + arm_->Phi_.size());
+	for (Eigen::Index c = 0; c < rhs.cols(); c++) solve_factorized(rhs.col(c));
+}
@@ -10,6 +10,7 @@
 
 #include <mbse/AssembledRigidModel.h>
 #include <mbse/dynamics/dynamic-simulators.h>
+#include <mbse/mbse-utils.h>
 #include <mrpt/math/utils.h>  // saveEigenSparseTripletsToFile()
 
 using namespace mbse;
@@ -32,7 +33,7 @@ CDynamicSimulator_Lagrange_UMFPACK::CDynamicSimulator_Lagrange_UMFPACK(
  * solve_ddotq() */
 void CDynamicSimulator_Lagrange_UMFPACK::internal_prepare()
 {
-	timelog().enter("solver_prepare");
+	MBSE_PROFILE_ENTER("solver_prepare");
 
 	const size_t nDOFs = arm_->q_.size();
 	const size_t nConstraints = arm_->Phi_.size();
@@ -40,46 +41,42 @@ void CDynamicSimulator_Lagrange_UMFPACK::internal_prepare()
 
 	// Build mass matrix now and don't touch it anymore, since it's constant
 	// with this formulation:
-	mass_tri_ = arm_->buildMassMatrix_sparse();
-
-	// Start augmented matrix:
-	A_tri_ = mass_tri_;
+	std::vector<Eigen::Triplet<double>> A_tri = arm_->buildMassMatrix_sparse();
 
 	//  Add entries in the triplet form for the sparse Phi_q Jacobian.
 	// -----------------------------------------------------------
-	A_tri_.reserve(
-		A_tri_.size() +
-		2 * nConstraints *
-			nDOFs);	 // *IMPORTANT* Reserve mem at once to avoid reallocations,
-					 // since we store pointers to places...
+	const auto& Phi_q = arm_->Phi_q_;
+	A_tri.reserve(A_tri.size() + 2 * Phi_q.getNumNonZeros());
 
 	for (size_t i = 0; i < nConstraints; i++)
 	{
 		// Constraint "i" goes to column "nDOFs+i" in the augmented matrix:
-		const CompressedRowSparseMatrix::row_t row_i = arm_->Phi_q_.matrix[i];
-		for (CompressedRowSparseMatrix::row_t::const_iterator itCol =
-				 row_i.begin();
-			 itCol != row_i.end(); ++itCol)
+		for (size_t k = Phi_q.row_ptr[i]; k < Phi_q.row_ptr[i + 1]; k++)
 		{
-			// We have precomputed the order in which we find the numeric
-			// values, just insert at their correct place:
-			const size_t idx0 = A_tri_.size();
-
-			A_tri_.push_back(
-				Eigen::Triplet<double>(itCol->first, nDOFs + i, 1.0));
-			A_tri_.push_back(
-				Eigen::Triplet<double>(nDOFs + i, itCol->first, 1.0));
-
-			A_tri_ptrs_Phi_q_.push_back(
-				const_cast<double*>(&A_tri_[idx0].value()));
-			A_tri_ptrs_Phi_q_.push_back(
-				const_cast<double*>(&A_tri_[idx0 + 1].value()));
+			const size_t col = Phi_q.col_idx[k];
+			A_tri.emplace_back(col, nDOFs + i, 0.0);
+			A_tri.emplace_back(nDOFs + i, col, 0.0);
 		}
 	}
 
-	// Analyze the pattern once:
+	// The pattern never changes from now on:
 	A_.resize(nTot, nTot);
-	A_.setFromTriplets(A_tri_.begin(), A_tri_.end());
+	A_.setFromTriplets(A_tri.begin(), A_tri.end());
+
+	// Places of the Jacobian values in the CCS matrix, in the CRS storage
+	// order, so they can be updated in place:
+	A_ptrs_Phi_q_.clear();
+	A_ptrs_Phi_q_.reserve(2 * Phi_q.getNumNonZeros());
+	for (size_t i = 0; i < nConstraints; i++)
+	{
+		for (size_t k = Phi_q.row_ptr[i]; k < Phi_q.row_ptr[i + 1]; k++)
+		{
+			const int col = Phi_q.col_idx[k];
+			const int row = nDOFs + i;
+			A_ptrs_Phi_q_.push_back(ccs_entry_ptr(A_, col, row));
+			A_ptrs_Phi_q_.push_back(ccs_entry_ptr(A_, row, col));
+		}
+	}
 
 	// Set defaults:
 	umfpack_di_defaults(umf_control_);
@@ -115,7 +112,7 @@ void CDynamicSimulator_Lagrange_UMFPACK::internal_prepare()
 		THROW_EXCEPTION(
 			"Error: UMFPACK couldn't factorize the augmented matrix.");
 
-	timelog().leave("solver_prepare");
+	MBSE_PROFILE_LEAVE("solver_prepare");
 }
 
 CDynamicSimulator_Lagrange_UMFPACK::~CDynamicSimulator_Lagrange_UMFPACK()
@@ -135,7 +132,7 @@ CDynamicSimulator_Lagrange_UMFPACK::~CDynamicSimulator_Lagrange_UMFPACK()
 void CDynamicSimulator_Lagrange_UMFPACK::internal_solve_ddotq(
 	double t, VectorXd& ddot_q, VectorXd* lagrangre)
 {
-	timelog().enter("solver_ddotq");
+	MBSE_PROFILE_ENTER("solver_ddotq");
 
 	// [   M    Phi_q^t  ] [ ddot_q ] = [ Q ]
 	// [ Phi_q     0     ] [ lambda ]   [ c ]
@@ -148,35 +145,24 @@ void CDynamicSimulator_Lagrange_UMFPACK::internal_solve_ddotq(
 	const size_t nTot = nDOFs + nConstraints;
 
 	// Update numeric values of the constraint Jacobians:
-	timelog().enter("solver_ddotq.update_jacob");
+	MBSE_PROFILE_ENTER("solver_ddotq.update_jacob");
 	arm_->update_numeric_Phi_and_Jacobians();
 
-	// Move the updated Jacobian values to their places in the triplet form:
+	// Move the updated Jacobian values to their places in the CCS matrix:
 	{
+		const auto& values = arm_->Phi_q_.values;
 		size_t idx = 0;
-		for (size_t i = 0; i < nConstraints; i++)
+		for (size_t k = 0; k < values.size(); k++)
 		{
-			// Constraint "i" goes to column "nDOFs+i" in the augmented matrix:
-			const CompressedRowSparseMatrix::row_t row_i =
-				arm_->Phi_q_.matrix[i];
-			for (CompressedRowSparseMatrix::row_t::const_iterator itCol =
-					 row_i.begin();
-				 itCol != row_i.end(); ++itCol)
-			{
-				*A_tri_ptrs_Phi_q_[idx++] = itCol->second;
-				*A_tri_ptrs_Phi_q_[idx++] = itCol->second;
-			}
+			*A_ptrs_Phi_q_[idx++] = values[k];
+			*A_ptrs_Phi_q_[idx++] = values[k];
 		}
 	}
-	timelog().leave("solver_ddotq.update_jacob");
+	MBSE_PROFILE_LEAVE("solver_ddotq.update_jacob");
 
-	// Solve numeric sparse LU:
+	// Numeric sparse LU (the symbolic analysis is reused):
 	// -----------------------------------
-	timelog().enter("solver_ddotq.ccs");
-	A_.setFromTriplets(A_tri_.begin(), A_tri_.end());
-	timelog().leave("solver_ddotq.ccs");
-
-	timelog().enter("solver_ddotq.numeric_factor");
+	MBSE_PROFILE_ENTER("solver_ddotq.numeric_factor");
 
 	if (numeric_)
 	{
@@ -191,18 +177,18 @@ void CDynamicSimulator_Lagrange_UMFPACK::internal_solve_ddotq(
 		THROW_EXCEPTION(
 			"Error: UMFPACK couldn't numeric-factorize the augmented matrix.");
 
-	timelog().leave("solver_ddotq.numeric_factor");
+	MBSE_PROFILE_LEAVE("solver_ddotq.numeric_factor");
 
 	// Build the RHS vector:
 	// --------------------------
-	timelog().enter("solver_ddotq.build_rhs");
+	MBSE_PROFILE_ENTER("solver_ddotq.build_rhs");
 	Eigen::VectorXd RHS(nTot);
 	this->build_RHS(&RHS[0], &RHS[nDOFs]);
-	timelog().leave("solver_ddotq.build_rhs");
+	MBSE_PROFILE_LEAVE("solver_ddotq.build_rhs");
 
 	// Solve linear system:
 	// -----------------------------------
-	timelog().enter("solver_ddotq.solve");
+	MBSE_PROFILE_ENTER("solver_ddotq.solve");
 
 	Eigen::VectorXd solution(nTot);
 
@@ -212,13 +198,18 @@ void CDynamicSimulator_Lagrange_UMFPACK::internal_solve_ddotq(
 
 	if (errorCode != 0)
 	{
+		std::vector<Eigen::Triplet<double>> A_tri;
+		for (int col = 0; col < A_.outerSize(); col++)
+			for (Eigen::SparseMatrix<double>::InnerIterator it(A_, col); it;
+				 ++it)
+				A_tri.emplace_back(it.row(), it.col(), it.value());
 		mrpt::math::saveEigenSparseTripletsToFile(
-			"DUMP_UMFPACK_ERROR_A.txt", A_tri_);
+			"DUMP_UMFPACK_ERROR_A.txt", A_tri);
 		// RHS.saveToTextFile("DUMP_UMFPACK_ERROR_RHS.txt");
 		THROW_EXCEPTION("Error: UMFPACK couldn't solve the linear system.");
 	}
 
-	timelog().leave("solver_ddotq.solve");
+	MBSE_PROFILE_LEAVE("solver_ddotq.solve");
 
 	ddot_q = solution.head(nDOFs);
 	if (lagrangre) *lagrangre = solution.tail(nConstraints);
@@ -231,5 +222,23 @@ void CDynamicSimulator_Lagrange_UMFPACK::internal_solve_ddotq(
 	mrpt::system::pause();
 #endif
 
-	timelog().leave("solver_ddotq");
+	MBSE_PROFILE_LEAVE("solver_ddotq");
+}
+
+void CDynamicSimulator_Lagrange_UMFPACK::solve_kkt(Eigen::MatrixXd& rhs)
+{
+	ASSERT_(numeric_);
+	ASSERT_EQUAL_(rhs.rows(), A_.cols());
+
+	Eigen::VectorXd solution(rhs.rows());
+	for (Eigen::Index c = 0; c < rhs.cols(); c++)
+	{
+		const int errorCode = umfpack_di_solve(
+			UMFPACK_A, A_.outerIndexPtr(), A_.innerIndexPtr(), A_.valuePtr(),
+			&solution[0], &rhs.coeffRef(0, c), numeric_, umf_control_,
+			umf_info_);
+		if (errorCode != 0)
+			THROW_EXCEPTION("Error: UMFPACK couldn't solve the linear system.");
+		rhs.col(c) = solution;
+	}
 }
@@ -31,7 +31,7 @@ CDynamicSimulator_R_matrix_dense::CDynamicSimulator_R_matrix_dense(
  * solve_ddotq() */
 void CDynamicSimulator_R_matrix_dense::internal_prepare()
 {
-	auto tle = mrpt::system::CTimeLoggerEntry(timelog(), "solver_prepare");
+	MBSE_PROFILE_SCOPE("solver_prepare");
 
 	// Build mass matrix now and don't touch it anymore, since it's constant
 	// with this formulation:
@@ -41,7 +41,7 @@ void CDynamicSimulator_R_matrix_dense::internal_prepare()
 void CDynamicSimulator_R_matrix_dense::internal_solve_ddotq(
 	double t, VectorXd& ddot_q, VectorXd* lagrangre)
 {
-	auto tle = mrpt::system::CTimeLoggerEntry(timelog(), "solver_ddotq");
+	MBSE_PROFILE_SCOPE("solver_ddotq");
 
 	if (lagrangre != nullptr)
 	{
@@ -58,22 +58,22 @@ void CDynamicSimulator_R_matrix_dense::internal_solve_ddotq(
 	size_t nConstraints = arm_->Phi_.size();
 
 	// Update numeric values of the constraint Jacobians:
-	timelog().enter("solver_ddotq.update_jacob");
+	MBSE_PROFILE_ENTER("solver_ddotq.update_jacob");
 
 	arm_->update_numeric_Phi_and_Jacobians();
 
-	timelog().leave("solver_ddotq.update_jacob");
+	MBSE_PROFILE_LEAVE("solver_ddotq.update_jacob");
 
 	// Get Jacobian dPhi_dq
-	timelog().enter("solver_ddotq.get_dense_jacob");
+	MBSE_PROFILE_ENTER("solver_ddotq.get_dense_jacob");
 
 	// nrows=nConstraints, ncols = nDepCoords
 	Eigen::MatrixXd Phiq = arm_->Phi_q_.asDense();
 
-	timelog().leave("solver_ddotq.get_dense_jacob");
+	MBSE_PROFILE_LEAVE("solver_ddotq.get_dense_jacob");
 
 	// Compute R: the kernel of Phi_q
-	timelog().enter("solver_ddotq.Phiq_kernel");
+	MBSE_PROFILE_ENTER("solver_ddotq.Phiq_kernel");
 	Eigen::FullPivLU<Eigen::MatrixXd> lu;
 	lu.compute(Phiq);
 
@@ -106,7 +106,7 @@ void CDynamicSimulator_R_matrix_dense::internal_solve_ddotq(
 		ASSERT_EQUAL_(static_cast<size_t>(Phiq.rows()), Phi_q_rank);
 	}
 
-	timelog().leave("solver_ddotq.Phiq_kernel");
+	MBSE_PROFILE_LEAVE("solver_ddotq.Phiq_kernel");
 
 	ASSERT_EQUAL_(nDepCoords, nConstraints + nDOFs);
 
@@ -117,18 +117,18 @@ void CDynamicSimulator_R_matrix_dense::internal_solve_ddotq(
 
 	// Build the RHS vector:
 	// --------------------------
-	timelog().enter("solver_ddotq.build_rhs");
+	MBSE_PROFILE_ENTER("solver_ddotq.build_rhs");
 	Eigen::VectorXd RHS(nDepCoords);
 	Eigen::VectorXd Q(nDepCoords);
 
 	this->build_RHS(&Q[0], &RHS[0] /* c => [0:nConstraints-1] */);
 	RHS.tail(nDOFs) = R.transpose() * Q;
 
-	timelog().leave("solver_ddotq.build_rhs");
+	MBSE_PROFILE_LEAVE("solver_ddotq.build_rhs");
 
 	// Solve linear system (using LU dense decomposition):
 	// -------------------------------------------------------------
-	timelog().enter("solver_ddotq.solve");
+	MBSE_PROFILE_ENTER("solver_ddotq.solve");
 	ddot_q = A.partialPivLu().solve(RHS);
-	timelog().leave("solver_ddotq.solve");
+	MBSE_PROFILE_LEAVE("solver_ddotq.solve");
 }
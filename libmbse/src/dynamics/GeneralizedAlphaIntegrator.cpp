@@ -0,0 +1,257 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include <mbse/AssembledRigidModel.h>
+#include <mbse/dynamics/GeneralizedAlphaIntegrator.h>
+#include <mbse/mbse-utils.h>
+
+using namespace mbse;
+using namespace Eigen;
+
+GeneralizedAlphaIntegrator& GeneralizedAlphaIntegrator::operator=(
+	const GeneralizedAlphaIntegrator& o)
+{
+	params = o.params;
+	reset();
+	return *this;
+}
+
+GeneralizedAlphaIntegrator::~GeneralizedAlphaIntegrator() { reset(); }
+
+void GeneralizedAlphaIntegrator::reset()
+{
+	if (numeric_) klu_free_numeric(&numeric_, &common_);
+	if (symbolic_) klu_free_symbolic(&symbolic_, &common_);
+	prepared_ = false;
+	factorized_ = false;
+	initialized_ = false;
+}
+
+void GeneralizedAlphaIntegrator::prepare(AssembledRigidModel& arm)
+{
+	MBSE_PROFILE_SCOPE("generalized_alpha.prepare");
+
+	const size_t nDOFs = arm.q_.size();
+	const size_t nConstraints = arm.Phi_.size();
+	const size_t nTot = nDOFs + nConstraints;
+
+	// [   M    Phi_q^t ]
+	// [ Phi_q     0    ]
+	const std::vector<Eigen::Triplet<double>> M_tri =
+		arm.buildMassMatrix_sparse();
+	std::vector<Eigen::Triplet<double>> A_tri = M_tri;
+
+	const auto& Phi_q = arm.Phi_q_;
+	A_tri.reserve(A_tri.size() + 2 * Phi_q.getNumNonZeros());
+	for (size_t i = 0; i < nConstraints; i++)
+	{
+		for (size_t k = Phi_q.row_ptr[i]; k < Phi_q.row_ptr[i + 1]; k++)
+		{
+			const size_t col = Phi_q.col_idx[k];
+			A_tri.emplace_back(col, nDOFs + i, 0.0);
+			A_tri.emplace_back(nDOFs + i, col, 0.0);
+		}
+	}
+
+	// The pattern never changes from now on:
+	A_.resize(nTot, nTot);
+	A_.setFromTriplets(A_tri.begin(), A_tri.end());
+
+	M_.resize(nDOFs, nDOFs);
+	M_.setFromTriplets(M_tri.begin(), M_tri.end());
+
+	A_ptrs_Phi_q_.clear();
+	A_ptrs_Phi_q_.reserve(2 * Phi_q.getNumNonZeros());
+	for (size_t i = 0; i < nConstraints; i++)
+	{
+		for (size_t k = Phi_q.row_ptr[i]; k < Phi_q.row_ptr[i + 1]; k++)
+		{
+			const int col = Phi_q.col_idx[k];
+			const int row = nDOFs + i;
+			A_ptrs_Phi_q_.push_back(ccs_entry_ptr(A_, col, row));
+			A_ptrs_Phi_q_.push_back(ccs_entry_ptr(A_, row, col));
+		}
+	}
+
+	common_.ordering = 1;  // COLAMD
+	symbolic_ = klu_analyze(
+		A_.rows(), A_.outerIndexPtr(), A_.innerIndexPtr(), &common_);
+	if (!symbolic_)
+		THROW_EXCEPTION("Error: KLU couldn't analyze the iteration matrix.");
+
+	prepared_ = true;
+	factorized_ = false;
+	initialized_ = false;
+}
+
+void GeneralizedAlphaIntegrator::factorize(const AssembledRigidModel& arm)
+{
+	MBSE_PROFILE_SCOPE("generalized_alpha.factorize");
+
+	const auto& vals = arm.Phi_q_.values;
+	for (size_t k = 0; k < vals.size(); k++)
+	{
+		*A_ptrs_Phi_q_[2 * k] = vals[k];
+		*A_ptrs_Phi_q_[2 * k + 1] = vals[k];
+	}
+
+	if (!klu_factor_or_refactor(
+			A_, symbolic_, numeric_, common_, params.minRcond))
+		THROW_EXCEPTION(
+			"Error: KLU couldn't numeric-factorize the iteration matrix.");
+
+	factorized_ = true;
+	stats_.numFactorizations++;
+}
+
+void GeneralizedAlphaIntegrator::initialize(AssembledRigidModel& arm)
+{
+	const Index nDOFs = arm.q_.size();
+	const Index nConstraints = arm.Phi_.size();
+
+	// [   M    Phi_q^t ] [ ddot_q ] = [ Q ]
+	// [ Phi_q     0    ] [ lambda ]   [ c ]
+	// with c = - \dot{Phi_q} * \dot{q}, solved with a fresh factorization:
+	arm.update_numeric_Phi_and_Jacobians();
+	factorize(arm);
+
+	rhs_.resize(nDOFs + nConstraints);
+	arm.builGeneralizedForces(rhs_.data());
+	arm.dotPhi_q_.multiply(arm.dotq_.data(), rhs_.data() + nDOFs);
+	rhs_.tail(nConstraints) *= -1;
+
+	klu_solve(symbolic_, numeric_, A_.cols(), 1, rhs_.data(), &common_);
+	if (common_.status != KLU_OK)
+		THROW_EXCEPTION("Error: KLU couldn't solve the linear system.");
+
+	ddotq_ = rhs_.head(nDOFs);
+	lambda_ = rhs_.tail(nConstraints);
+	a_ = ddotq_;
+	initialized_ = true;
+}
+
+void GeneralizedAlphaIntegrator::step(AssembledRigidModel& arm, double dt)
+{
+	MBSE_PROFILE_SCOPE("generalized_alpha.step");
+
+	ASSERT_GT_(dt, 0);
+
+	const Index nDOFs = arm.q_.size();
+	const Index nConstraints = arm.Phi_.size();
+
+	if (!prepared_ || A_.rows() != nDOFs + nConstraints)
+	{
+		reset();
+		prepare(arm);
+	}
+
+	// Start from consistent accelerations if the state was changed from
+	// outside since the last step:
+	if (!initialized_ || arm.q_ != q_end_ || arm.dotq_ != dotq_end_)
+		initialize(arm);
+
+	// Method coefficients from the spectral radius at infinity:
+	const double rho = std::min(1.0, std::max(0.0, params.rhoInfinity));
+	const double alpha_m = (2 * rho - 1) / (rho + 1);
+	const double alpha_f = rho / (rho + 1);
+	const double gamma = 0.5 + alpha_f - alpha_m;
+	const double beta = 0.25 * mrpt::square(gamma + 0.5);
+
+	// Derivatives of \ddot{q} and \dot{q} wrt q, within a step:
+	const double beta_p = (1 - alpha_m) / (dt * dt * beta * (1 - alpha_f));
+	const double gamma_p = gamma / (dt * beta);
+
+	q0_ = arm.q_;
+	dotq0_ = arm.dotq_;
+	ddotq0_ = ddotq_;
+	lambda0_ = lambda_;
+
+	rhs_.resize(nDOFs + nConstraints);
+
+	size_t iter = 0;
+	bool converged = false;
+	for (int attempt = 0; attempt < 2 && !converged; attempt++)
+	{
+		if (attempt > 0)
+		{
+			// Retry from the beginning of the step with a fresh matrix:
+			ddotq_ = ddotq0_;
+			lambda_ = lambda0_;
+			factorized_ = false;
+		}
+
+		// Predictor: same accelerations and multipliers as in the last step
+		a_next_ = (ddotq_ - alpha_m * a_) / (1 - alpha_m);
+		arm.q_ = q0_ + dt * dotq0_ +
+				 (dt * dt) * ((0.5 - beta) * a_ + beta * a_next_);
+		arm.dotq_ = dotq0_ + dt * ((1 - gamma) * a_ + gamma * a_next_);
+
+		double last_corr = 0;
+		for (size_t i = 0; i < params.maxIters; i++, iter++)
+		{
+			arm.update_numeric_Phi_and_Jacobians();
+			if (!factorized_) factorize(arm);
+
+			// Residuals, scaled for the iteration matrix [M Phi_q^t; Phi_q 0]
+			// r_q = -(M \ddot{q} + Phi_q^t \lambda - Q) / beta'
+			// r_l = -Phi
+			arm.builGeneralizedForces(Q_);
+			rhs_.head(nDOFs).noalias() = M_ * ddotq_;
+			rhs_.head(nDOFs) -= Q_;
+			arm.Phi_q_.multiplyTransposedAdd(lambda_.data(), rhs_.data());
+			rhs_.head(nDOFs) *= -1.0 / beta_p;
+			rhs_.tail(nConstraints) = -arm.Phi_;
+
+			klu_solve(
+				symbolic_, numeric_, A_.cols(), 1, rhs_.data(), &common_);
+			if (common_.status != KLU_OK)
+				THROW_EXCEPTION(
+					"Error: KLU couldn't solve the linear system.");
+
+			const auto dq = rhs_.head(nDOFs);
+			arm.q_ += dq;
+			arm.dotq_ += gamma_p * dq;
+			ddotq_ += beta_p * dq;
+			lambda_ += beta_p * rhs_.tail(nConstraints);
+
+			const double corr = nDOFs > 0 ? dq.lpNorm<Eigen::Infinity>() : 0;
+			if (corr <= params.tolerance)
+			{
+				converged = true;
+				iter++;
+				break;
+			}
+
+			// Modified Newton: keep the matrix while it converges fast
+			if (i > 0 && corr > params.maxContraction * last_corr)
+				factorized_ = false;
+			last_corr = corr;
+		}
+	}
+
+	ASSERTMSG_(
+		converged,
+		mrpt::format(
+			"Generalized-alpha: Newton iterations did not converge "
+			"(dt=%e)",
+			dt));
+
+	// Update the acceleration-like variable:
+	a_ = (alpha_f * ddotq0_ - alpha_m * a_ + (1 - alpha_f) * ddotq_) /
+		 (1 - alpha_m);
+
+	arm.ddotq_ = ddotq_;
+	q_end_ = arm.q_;
+	dotq_end_ = arm.dotq_;
+
+	stats_.numSteps++;
+	stats_.numIters += iter;
+	MBSE_PROFILE_VALUE("generalized_alpha.iters", iter);
+}
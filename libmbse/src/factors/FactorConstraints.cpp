@@ -58,7 +58,8 @@ gtsam::Vector FactorConstraints::evaluateError(
 	if (H1)
 	{
 		auto& Hv = *H1;
-		Hv = arm_->Phi_q_.asDense();
+		Hv.setZero(arm_->Phi_.rows(), n);
+		arm_->Phi_q_.addToDense(Hv);
 	}
 
 	return err;
@@ -22,8 +22,7 @@ FactorConstraintsAccIndep::FactorConstraintsAccIndep(
 	gtsam::Key key_dotq_k, gtsam::Key key_ddotq_k, gtsam::Key key_ddotz_k)
 	: Base(noiseModel, key_q_k, key_dotq_k, key_ddotq_k, key_ddotz_k),
 	  arm_(arm),
-	  indCoordsIndices_(indCoordsIndices),
-	  matrix_Iidx_(selector_matrix(indCoordsIndices, arm->q_.size()))
+	  indCoordsIndices_(indCoordsIndices)
 {
 }
 
@@ -80,12 +79,10 @@ gtsam::Vector FactorConstraintsAccIndep::evaluateError(
 	if (m < 1) throw std::runtime_error("Empty Phi() vector!");
 
 	// Evaluate error:
-	const Eigen::MatrixXd Phi_q = arm_->Phi_q_.asDense();
-	const Eigen::MatrixXd dotPhi_q = arm_->dotPhi_q_.asDense();
-	const Eigen::MatrixXd dPhiqdq_dq = Phi_q;
-
-	gtsam::Vector err = gtsam::Vector::Zero(m + d);
-	err.head(m) = dotPhi_q * dotq_k + Phi_q * ddotq_k;
+	gtsam::Vector err(m + d);
+	for (Eigen::Index r = 0; r < m; r++)
+		err[r] = arm_->dotPhi_q_.rowDot(r, &dotq_k[0]) +
+				 arm_->Phi_q_.rowDot(r, &ddotq_k[0]);
 	err.tail(d) = mbse::subset(ddotq_k, indCoordsIndices_) - ddotz_k;
 
 	// Get the Jacobians required for optimization:
@@ -94,28 +91,25 @@ gtsam::Vector FactorConstraintsAccIndep::evaluateError(
 	if (de_dq)
 	{
 		auto& Hv = *de_dq;
-		Hv.resize(m + d, n);
+		Hv.setZero(m + d, n);
 		// first block = 	\dotPhiqq(\q_t) \dq_t + \Phiqq(\q_t) \ddq_t
-		const Eigen::MatrixXd t1 = arm_->Phiqq_times_ddq_.asDense();
-		const Eigen::MatrixXd t2 = arm_->dotPhiqq_times_dq_.asDense();
-		Hv.block(0, 0, m, n) = t1 + t2;
-		Hv.block(m, 0, d, n).setZero();
+		arm_->Phiqq_times_ddq_.addToDense(Hv);
+		arm_->dotPhiqq_times_dq_.addToDense(Hv);
 	}
 
 	if (de_dqp)
 	{
 		auto& Hv = *de_dqp;
-		Hv.resize(m + d, n);
-		Hv.block(0, 0, m, n) = 2 * arm_->dotPhi_q_.asDense();
-		Hv.block(m, 0, d, n).setZero();
+		Hv.setZero(m + d, n);
+		arm_->dotPhi_q_.addToDense(Hv, 2.0);
 	}
 
 	if (de_dqpp)
 	{
 		auto& Hv = *de_dqpp;
-		Hv.resize(m + d, n);
-		Hv.block(0, 0, m, n) = arm_->Phi_q_.asDense();
-		Hv.block(m, 0, d, n) = matrix_Iidx_;
+		Hv.setZero(m + d, n);
+		arm_->Phi_q_.addToDense(Hv);
+		add_selector_matrix(Hv.bottomRows(d), indCoordsIndices_);
 	}
 
 	if (de_dzpp)
@@ -21,8 +21,7 @@ FactorConstraintsIndep::FactorConstraintsIndep(
 	gtsam::Key key_q_k)
 	: Base(noiseModel, key_z_k, key_q_k),
 	  arm_(arm),
-	  indCoordsIndices_(indCoordsIndices),
-	  matrix_Iidx_(selector_matrix(indCoordsIndices, arm->q_.size()))
+	  indCoordsIndices_(indCoordsIndices)
 {
 }
 
@@ -94,10 +93,10 @@ gtsam::Vector FactorConstraintsIndep::evaluateError(
 	if (de_dq)
 	{
 		auto& Hv = *de_dq;
-		Hv.resize(m + d, n);
-		Hv.block(0, 0, m, n) = arm_->Phi_q_.asDense();
-		// Build "I_idx", as called in the paper (sect. 6.7)
-		Hv.block(m, 0, d, n) = matrix_Iidx_;
+		Hv.setZero(m + d, n);
+		arm_->Phi_q_.addToDense(Hv);
+		// "I_idx", as called in the paper (sect. 6.7)
+		add_selector_matrix(Hv.bottomRows(d), indCoordsIndices_);
 	}
 
 	return err;
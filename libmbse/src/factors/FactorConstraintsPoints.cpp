@@ -0,0 +1,139 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include <mbse/factors/FactorConstraintsPoints.h>
+#include <mbse/AssembledRigidModel.h>
+
+using namespace mbse;
+
+static gtsam::KeyVector blockKeys(
+	const StateBlocks& blocks, size_t constraintIndex, size_t timeStep)
+{
+	gtsam::KeyVector keys;
+	for (const auto b : blocks.constraintBlocks(constraintIndex))
+		keys.push_back(blocks.key(timeStep, b));
+	return keys;
+}
+
+FactorConstraintsPoints::FactorConstraintsPoints(
+	const AssembledRigidModel::Ptr& arm, const StateBlocks::Ptr& blocks,
+	const gtsam::SharedNoiseModel& noiseModel, size_t constraintIndex,
+	size_t timeStep)
+	: Base(noiseModel, blockKeys(*blocks, constraintIndex, timeStep)),
+	  arm_(arm),
+	  blocks_(blocks),
+	  constraintIndex_(constraintIndex),
+	  blockIdxs_(blocks->constraintBlocks(constraintIndex))
+{
+	ASSERT_EQUAL_(
+		noiseModel->dim(),
+		arm_->topology()->constraintRows_.at(constraintIndex).second);
+}
+
+FactorConstraintsPoints::~FactorConstraintsPoints() = default;
+
+gtsam::NonlinearFactor::shared_ptr FactorConstraintsPoints::clone() const
+{
+	return gtsam::NonlinearFactor::shared_ptr(new This(*this));
+}
+
+void FactorConstraintsPoints::print(
+	const std::string& s, const gtsam::KeyFormatter& keyFormatter) const
+{
+	std::cout << s << "mbse::FactorConstraintsPoints(#" << constraintIndex_;
+	for (const auto k : keys()) std::cout << "," << keyFormatter(k);
+	std::cout << ")\n";
+	noiseModel_->print("  noise model: ");
+}
+
+bool FactorConstraintsPoints::equals(
+	const gtsam::NonlinearFactor& expected, double tol) const
+{
+	const This* e = dynamic_cast<const This*>(&expected);
+	return e != nullptr && Base::equals(*e, tol) &&
+		   constraintIndex_ == e->constraintIndex_;
+}
+
+gtsam::Vector FactorConstraintsPoints::unwhitenedError(
+	const gtsam::Values& x,
+	boost::optional<std::vector<gtsam::Matrix>&> H) const
+{
+	MRPT_START
+
+	const auto& topo = *arm_->topology();
+	const auto [firstRow, nRows] = topo.constraintRows_[constraintIndex_];
+
+	// Set the coordinates of our points in the multibody model. The rest of
+	// "q" is not read by this constraint:
+	for (size_t i = 0; i < blockIdxs_.size(); i++)
+	{
+		const state_t& p = x.at<state_t>(keys()[i]);
+		const auto& dofs = blocks_->blockDOFs(blockIdxs_[i]);
+		ASSERT_EQUAL_(static_cast<size_t>(p.size()), dofs.size());
+		for (size_t j = 0; j < dofs.size(); j++) arm_->q_[dofs[j]] = p[j];
+	}
+
+	// Update only this constraint:
+	const auto& c = *topo.constraints_[constraintIndex_];
+	c.realizeOperatingPoint(*arm_);
+	c.update(*arm_);
+
+	// Evaluate error:
+	gtsam::Vector err = arm_->Phi_.segment(firstRow, nRows);
+
+	// d err / d p_i: scatter the Jacobian rows of this constraint into the
+	// blocks of each key:
+	if (H)
+	{
+		auto& Hs = *H;
+		Hs.resize(blockIdxs_.size());
+		for (size_t i = 0; i < blockIdxs_.size(); i++)
+			Hs[i].setZero(nRows, blocks_->blockDOFs(blockIdxs_[i]).size());
+
+		const auto& Phi_q = arm_->Phi_q_;
+		for (size_t row = firstRow; row < firstRow + nRows; row++)
+		{
+			for (size_t k = Phi_q.row_ptr[row]; k < Phi_q.row_ptr[row + 1];
+				 k++)
+			{
+				const dof_index_t dof = Phi_q.col_idx[k];
+				const size_t b = blocks_->blockOfDOF(dof);
+				const auto it =
+					std::lower_bound(blockIdxs_.begin(), blockIdxs_.end(), b);
+				const size_t i = it - blockIdxs_.begin();
+				const auto& dofs = blocks_->blockDOFs(b);
+				const size_t j =
+					std::find(dofs.begin(), dofs.end(), dof) - dofs.begin();
+				Hs[i](row - firstRow, j) += Phi_q.values[k];
+			}
+		}
+	}
+
+	return err;
+
+	MRPT_END
+}
+
+void mbse::addConstraintFactors(
+	gtsam::NonlinearFactorGraph& fg, const AssembledRigidModel::Ptr& arm,
+	const StateBlocks::Ptr& blocks, size_t timeStep, double sigmaConstr)
+{
+	const auto& topo = *arm->topology();
+
+	for (size_t i = 0; i < topo.constraints_.size(); i++)
+	{
+		const size_t nRows = topo.constraintRows_[i].second;
+		if (!nRows || blocks->constraintBlocks(i).empty()) continue;
+		fg.emplace_shared<FactorConstraintsPoints>(
+			arm, blocks,
+			gtsam::noiseModel::Isotropic::Sigma(nRows, sigmaConstr), i,
+			timeStep);
+	}
+}
@@ -89,9 +89,6 @@ gtsam::Vector FactorConstraintsVel::evaluateError(
 {
 	MRPT_START
 
-	// const auto n = q_k.size();
-	// const auto m = arm_->Phi_.rows();
-
 	ASSERT_EQUAL_(dotq_k.size(), q_k.size());
 	ASSERT_(q_k.size() > 0);
 
@@ -103,11 +100,12 @@ gtsam::Vector FactorConstraintsVel::evaluateError(
 	arm_->realize_operating_point();
 	arm_->update_numeric_Phi_and_Jacobians();
 
-	// Evaluate error:
-	const Eigen::MatrixXd Phi_q = arm_->Phi_q_.asDense();
-	const Eigen::MatrixXd dPhiqdq_dq = arm_->dotPhi_q_.asDense();
+	const auto n = q_k.size();
+	const auto m = arm_->Phi_.rows();
 
-	gtsam::Vector err = Phi_q * dotq_k;
+	// Evaluate error, err = Phi_q * dotq:
+	gtsam::Vector err(m);
+	arm_->Phi_q_.multiply(&dotq_k[0], &err[0]);
 
 	// Get the Jacobians required for optimization:
 	// d err / d q_k
@@ -131,7 +129,9 @@ gtsam::Vector FactorConstraintsVel::evaluateError(
 				gtsam::Vector& err)>(&num_err_wrt_q),
 			x_incr, p, Hv);
 #else
-		Hv = dPhiqdq_dq;
+		// Phi_qq*dq = \dot{Phi_q}
+		Hv.setZero(m, n);
+		arm_->dotPhi_q_.addToDense(Hv);
 
 #endif
 	}
@@ -156,7 +156,8 @@ gtsam::Vector FactorConstraintsVel::evaluateError(
 				gtsam::Vector& err)>(&num_err_wrt_dq),
 			x_incr, p, Hv);
 #else
-		Hv = Phi_q;
+		Hv.setZero(m, n);
+		arm_->Phi_q_.addToDense(Hv);
 #endif
 	}
 
@@ -22,8 +22,7 @@ FactorConstraintsVelIndep::FactorConstraintsVelIndep(
 	gtsam::Key key_dotq_k, gtsam::Key key_dotz_k)
 	: Base(noiseModel, key_q_k, key_dotq_k, key_dotz_k),
 	  arm_(arm),
-	  indCoordsIndices_(indCoordsIndices),
-	  matrix_Iidx_(selector_matrix(indCoordsIndices, arm->q_.size()))
+	  indCoordsIndices_(indCoordsIndices)
 {
 }
 
@@ -77,11 +76,8 @@ gtsam::Vector FactorConstraintsVelIndep::evaluateError(
 	if (m < 1) throw std::runtime_error("Empty Phi() vector!");
 
 	// Evaluate error:
-	const Eigen::MatrixXd Phi_q = arm_->Phi_q_.asDense();
-	const Eigen::MatrixXd dPhiqdq_dq = Phi_q;
-
-	gtsam::Vector err = gtsam::Vector::Zero(m + d);
-	err.head(m) = Phi_q * dotq_k;
+	gtsam::Vector err(m + d);
+	arm_->Phi_q_.multiply(&dotq_k[0], &err[0]);
 	err.tail(d) = mbse::subset(dotq_k, indCoordsIndices_) - dotz_k;
 
 	// Get the Jacobians required for optimization:
@@ -90,18 +86,17 @@ gtsam::Vector FactorConstraintsVelIndep::evaluateError(
 	if (de_dq)
 	{
 		auto& Hv = *de_dq;
-		Hv.resize(m + d, n);
+		Hv.setZero(m + d, n);
 		// Phi_qq*dq = \dot{Phi_q}
-		Hv.block(0, 0, m, n) = arm_->dotPhi_q_.asDense();
-		Hv.block(m, 0, d, n).setZero();
+		arm_->dotPhi_q_.addToDense(Hv);
 	}
 
 	if (de_dqp)
 	{
 		auto& Hv = *de_dqp;
-		Hv.resize(m + d, n);
-		Hv.block(0, 0, m, n) = arm_->Phi_q_.asDense();
-		Hv.block(m, 0, d, n) = matrix_Iidx_;
+		Hv.setZero(m + d, n);
+		arm_->Phi_q_.addToDense(Hv);
+		add_selector_matrix(Hv.bottomRows(d), indCoordsIndices_);
 	}
 
 	if (de_dzp)
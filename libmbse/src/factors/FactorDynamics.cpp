@@ -17,15 +17,6 @@
 //#if defined(GTSAM_USE_TBB)
 //#error "So far, MBSE is incompatible with GTSAM+TBB!"
 //#endif
-MRPT_TODO(
-	"**IMPORTANT** Refactor AssembledRigidModel to separate state and model "
-	"data to avoid multithread errors using GTSAM+TBB")
-
-#define USE_NUMERIC_JACOBIAN 1
-
-#if USE_NUMERIC_JACOBIAN
-#include <mrpt/math/num_jacobian.h>
-#endif
 
 using namespace mbse;
 
@@ -46,44 +37,120 @@ void FactorDynamics::print(
 	noiseModel_->print("  noise model: ");
 }
 
-struct NumericJacobParams
+/** Central finite-difference Jacobians of the predicted accelerations,
+ * evaluating all the 2n perturbed states (for each requested Jacobian) in a
+ * single batch call. */
+static void numeric_ddq_jacobians(
+	CDynamicSimulatorBase& solver, const gtsam::Vector& q,
+	const gtsam::Vector& dq, gtsam::Matrix* H_q, gtsam::Matrix* H_dq)
 {
-	AssembledRigidModel* arm = nullptr;
-	CDynamicSimulatorBase* dynamic_solver = nullptr;
-	gtsam::Vector q, dq, ddq;
-};
+	const auto n = q.size();
+	const double delta = 1e-5;
 
-static void num_err_wrt_q(
-	const gtsam::Vector& new_q, const NumericJacobParams& p, gtsam::Vector& err)
-{
-	// Set q & dq in the multibody model:
-	p.arm->q_ = new_q;
-	p.arm->dotq_ = p.dq;
+	// Columns: [q+d_k | q-d_k] for H_q, then the same for dq:
+	const auto nStates = 2 * n * ((H_q ? 1 : 0) + (H_dq ? 1 : 0));
+	Eigen::MatrixXd qs = q.replicate(1, nStates);
+	Eigen::MatrixXd dqs = dq.replicate(1, nStates);
 
-	// Predict accelerations:
-	Eigen::VectorXd qpp_predicted;
+	Eigen::Index col = 0;
+	for (Eigen::MatrixXd* x : {H_q ? &qs : nullptr, H_dq ? &dqs : nullptr})
+	{
+		if (!x) continue;
+		for (Eigen::Index k = 0; k < n; k++)
+		{
+			(*x)(k, col + k) += delta;
+			(*x)(k, col + n + k) -= delta;
+		}
+		col += 2 * n;
+	}
+
+	Eigen::MatrixXd ddqs;
 	const double t = 0;	 // wallclock time (useless?)
-	p.dynamic_solver->solve_ddotq(t, qpp_predicted);
+	solver.solve_ddotq_batch(t, qs, dqs, ddqs);
 
-	// Evaluate error:
-	err = qpp_predicted - p.ddq;
+	col = 0;
+	for (gtsam::Matrix* H : {H_q, H_dq})
+	{
+		if (!H) continue;
+		*H = (ddqs.middleCols(col, n) - ddqs.middleCols(col + n, n)) /
+			 (2 * delta);
+		col += 2 * n;
+	}
 }
 
-static void num_err_wrt_dq(
-	const gtsam::Vector& new_dq, const NumericJacobParams& p,
-	gtsam::Vector& err)
+/** Analytic Jacobians of the accelerations of the Lagrange multipliers
+ * formulation solved by CDynamicSimulatorBase:
+ *
+ *  [ M      Phi_q^T ] [ ddq    ]   [ Q ]
+ *  [ Phi_q  0       ] [ lambda ] = [ c ]
+ *
+ *  c = -dotPhi_q * dq - k_vel * dotPhi - k_pos * Phi
+ *
+ * Differentiating wrt q (M and Q are constant in natural coordinates), and
+ * wrt dq, gives systems with the same augmented matrix:
+ *
+ *  [ M Phi_q^T ] [ dddq_dq ]   [ -sum_i(lambda_i * Phi_i_qq)               ]
+ *  [ Phi_q   0 ] [ ...     ] = [ -dotPhiqq_times_dq - Phiqq_times_ddq      ]
+ *                              [   - k_vel * dotPhi_q - k_pos * Phi_q      ]
+ *
+ *  [ M Phi_q^T ] [ dddq_ddq ]   [ 0                           ]
+ *  [ Phi_q   0 ] [ ...      ] = [ -2*dotPhi_q - k_vel * Phi_q ]
+ *
+ * The column k of sum_i(lambda_i * Phi_i_qq) is Phiqq_times_ddq^T * lambda
+ * evaluated with ddq=e_k, so it only needs the constraints' own Hessian
+ * products, evaluated on a scratch copy of the model state. The multipliers
+ * and the factorization of the augmented matrix are those of the solver's
+ * last solve_ddotq() call, so this requires is_lagrange_kkt_solver().
+ */
+static void analytic_ddq_jacobians(
+	CDynamicSimulatorBase& solver, const Eigen::VectorXd& ddq,
+	const Eigen::VectorXd& lambda, gtsam::Matrix* H_q, gtsam::Matrix* H_dq)
 {
-	// Set q & dq in the multibody model:
-	p.arm->q_ = p.q;
-	p.arm->dotq_ = new_dq;
+	MBSE_PROFILE_SCOPE("FactorDynamics.jacobians");
 
-	// Predict accelerations:
-	Eigen::VectorXd qpp_predicted;
-	const double t = 0;	 // wallclock time (useless?)
-	p.dynamic_solver->solve_ddotq(t, qpp_predicted);
+	const AssembledRigidModel& arm = *solver.get_model();
+	const auto n = arm.q_.size();
+	const auto m = arm.Phi_.size();
+	ASSERT_EQUAL_(static_cast<size_t>(lambda.size()), m);
+	const double k_vel = CDynamicSimulatorBase::BAUMGARTE_K_VEL;
+	const double k_pos = CDynamicSimulatorBase::BAUMGARTE_K_POS;
 
-	// Evaluate error:
-	err = qpp_predicted - p.ddq;
+	const ModelTopology& topology = *arm.topology();
+	ModelState s(static_cast<const ModelState&>(arm));
+
+	s.ddotq_ = ddq;
+	topology.update_numeric_Phi_and_Jacobians(s);
+
+	const auto nCols = (H_q ? n : 0) + (H_dq ? n : 0);
+	Eigen::MatrixXd RHS = Eigen::MatrixXd::Zero(n + m, nCols);
+
+	if (H_q)
+	{
+		RHS.bottomLeftCorner(m, n) = -s.dotPhiqq_times_dq_.asDense() -
+									 s.Phiqq_times_ddq_.asDense() -
+									 k_vel * s.dotPhi_q_.asDense() -
+									 k_pos * s.Phi_q_.asDense();
+
+		for (Eigen::Index k = 0; k < n; k++)
+		{
+			s.ddotq_.setZero();
+			s.ddotq_[k] = 1.0;
+			topology.update_numeric_Phi_and_Jacobians(s);
+
+			Eigen::VectorXd col = Eigen::VectorXd::Zero(n);
+			s.Phiqq_times_ddq_.multiplyTransposedAdd(lambda.data(), col.data());
+			RHS.col(k).head(n) = -col;
+		}
+	}
+	if (H_dq)
+	{
+		RHS.bottomRightCorner(m, n) =
+			-2 * s.dotPhi_q_.asDense() - k_vel * s.Phi_q_.asDense();
+	}
+
+	solver.solve_kkt(RHS);
+	if (H_q) *H_q = RHS.topLeftCorner(n, n);
+	if (H_dq) *H_dq = RHS.topRightCorner(n, n);
 }
 
 bool FactorDynamics::equals(
@@ -117,117 +184,33 @@ gtsam::Vector FactorDynamics::evaluateError(
 
 	dynamic_solver_->get_model()->realize_operating_point();
 
-	dynamic_solver_->solve_ddotq(t, qpp_predicted);
+	// The analytic Jacobians reuse the multipliers and the factorization of
+	// the Lagrange formulations; any other one goes the numeric way:
+	const bool analytic = (H1 || H2) && !numericJacobians_ &&
+						  dynamic_solver_->is_lagrange_kkt_solver();
+	Eigen::VectorXd lambda;
+
+	dynamic_solver_->solve_ddotq(
+		t, qpp_predicted, analytic ? &lambda : nullptr);
 
 	// Evaluate error:
 	gtsam::Vector err = qpp_predicted - ddq_k;
 
-	// d err / d q_k
-	if (H1)
+	if (!H1 && !H2)
+	{
+		// Nothing else to do
+	}
+	else if (analytic)
 	{
-		auto& Hv = *H1;
-#if USE_NUMERIC_JACOBIAN
-		NumericJacobParams p;
-		p.arm = &arm;
-		p.dynamic_solver = dynamic_solver_;
-		p.q = q_k;
-		p.dq = dq_k;
-		p.ddq = ddq_k;
-
-		const gtsam::Vector x = p.q;
-		const gtsam::Vector x_incr =
-			Eigen::VectorXd::Constant(x.rows(), x.cols(), 1e-5);
-
-		mrpt::math::estimateJacobian(
-			x,
-			std::function<void(
-				const gtsam::Vector& new_q, const NumericJacobParams& p,
-				gtsam::Vector& err)>(&num_err_wrt_q),
-			x_incr, p, Hv);
-#else
-		Hv.setZero(n, n);
-/*
-dq = param.dq;
-invM = param.invM;
-Q = param.Q;
-Phiq = ConstLen_q(q);
-Phiqq = NumJacob3D(@ConstLen_q, q);
-Phiqq_T = NumJacob3D(@ConstLen_T_q, q);
-G = Gamma(q,param);
-invGamma = inv(G);
-c = -InnerTensVect(Phiqq,param.dq)*param.dq;
-% ================================== [1]
-==================================
-A1 = invM*Q;
-B1 = Phiq*A1;
-C1 = invGamma*B1;
-D1 = InnerTensVect(Phiqq_T,C1);
-ddq_I = -invM*D1;
-dGamma_q = NumJacob3D(@Gamma, q, param);
-A2 = InnerTensVect(dGamma_q,C1);
-B2 = invGamma*A2;
-C2 = Phiq'*B2;
-ddq_II = invM*C2;
-A3 = invM*Q;
-B3 = InnerTensVect(Phiqq,A3);
-C3 = invGamma*B3;
-D3 = Phiq'*C3;
-ddq_III = -invM*D3;
-% ================================== [2]
-==================================
-dotPq = InnerTensVect(Phiqq,dq);A4 = dotPq*dq;
-B4 = invGamma*A4;
-C4 = InnerTensVect(Phiqq_T,B4);
-ddq_IV = -invM*C4;
-A5 = InnerTensVect(dGamma_q,B4);
-B5 = invGamma*A5;
-C5 = Phiq'*B5;
-ddq_V = invM*C5;
-% Theoretical Jacobian
-Jacc_qt = ddq_I+ddq_II+ddq_III+ddq_IV+ddq_V;
-*/
-#endif
+		analytic_ddq_jacobians(
+			*dynamic_solver_, qpp_predicted, lambda, H1 ? &(*H1) : nullptr,
+			H2 ? &(*H2) : nullptr);
 	}
-	// d err / d dq_k
-	if (H2)
+	else
 	{
-		auto& Hv = *H2;
-#if USE_NUMERIC_JACOBIAN
-		NumericJacobParams p;
-		p.arm = &arm;
-		p.dynamic_solver = dynamic_solver_;
-		p.q = q_k;
-		p.dq = dq_k;
-		p.ddq = ddq_k;
-
-		const gtsam::Vector x = p.dq;
-		const gtsam::Vector x_incr =
-			Eigen::VectorXd::Constant(x.rows(), x.cols(), 1e-5);
-
-		mrpt::math::estimateJacobian(
-			x,
-			std::function<void(
-				const gtsam::Vector& new_q, const NumericJacobParams& p,
-				gtsam::Vector& err)>(&num_err_wrt_dq),
-			x_incr, p, Hv);
-#else
-		Hv.setZero(n, n);
-/*
-q = param.q;
-invM = param.invM;
-Q = param.Q;
-Phiq = ConstLen_q(q);
-Phiqq = NumJacob3D(@ConstLen_q, q);
-Phiqq_T = NumJacob3D(@ConstLen_T_q, q);
-G = Gamma(q,param);
-invGamma = inv(G);
-c = -InnerTensVect(Phiqq,dq)*dq;
-dotPq = InnerTensVect(Phiqq,dq);
-A = invGamma*dotPq;
-B = Phiq'*A;
-Jacc_dqt = -2*invM*B;
-*/
-#endif
+		numeric_ddq_jacobians(
+			*dynamic_solver_, q_k, dq_k, H1 ? &(*H1) : nullptr,
+			H2 ? &(*H2) : nullptr);
 	}
 	// d err / d ddq_k
 	if (H3)
@@ -16,10 +16,6 @@
 
 #define USE_NUMERIC_JACOBIAN 1
 
-#if USE_NUMERIC_JACOBIAN
-#include <mrpt/math/num_jacobian.h>
-#endif
-
 using namespace mbse;
 
 FactorDynamicsIndep::~FactorDynamicsIndep() = default;
@@ -38,73 +34,67 @@ void FactorDynamicsIndep::print(
 	noiseModel_->print("  noise model: ");
 }
 
-struct NumericJacobParams
-{
-	AssembledRigidModel* arm = nullptr;
-	CDynamicSimulatorIndepBase* dynamic_solver = nullptr;
-	gtsam::Vector z, dz, ddz, q;
-};
-
-static void num_err_wrt_z(
-	const gtsam::Vector& new_z, const NumericJacobParams& p, gtsam::Vector& err)
-{
-	const auto& zIndices = p.dynamic_solver->independent_coordinate_indices();
-
-	// Set q & dq in the multibody model:
-	p.arm->q_ = p.q;
-	// Overwrite "z" & "dz":
-	mbse::overwrite_subset(p.arm->q_, new_z, zIndices);
-	mbse::overwrite_subset(p.arm->dotq_, p.dz, zIndices);
-
-	// Ensure q and dq are updated after the change in "z":
-	AssembledRigidModel::ComputeDependentParams cdp;
-	AssembledRigidModel::ComputeDependentResults cdr;
-	cdp.nItersMax = 3;
-	p.arm->computeDependentPosVelAcc(
-		zIndices, true /*update_q*/, true /* update_dq*/, cdp, cdr);
-
-	ASSERT_LT_(cdr.pos_final_phi, 1e-3);
-
-	// Predict accelerations:
-	const double t = 0;	 // wallclock time (useless?)
-	Eigen::VectorXd zpp_predicted;
-
-	p.dynamic_solver->solve_ddotz(t, zpp_predicted);
-
-	// Evaluate error:
-	err = zpp_predicted - p.ddz;
-}
-
-static void num_err_wrt_dz(
-	const gtsam::Vector& new_dz, const NumericJacobParams& p,
-	gtsam::Vector& err)
+#if USE_NUMERIC_JACOBIAN
+/** Central finite-difference Jacobians of the predicted independent
+ * accelerations wrt z and dz. The perturbed states are made consistent one by
+ * one (a few kinematic iterations each), then all their accelerations are
+ * solved in a single batch call. */
+static void numeric_ddz_jacobians(
+	CDynamicSimulatorIndepBase& solver, const Eigen::VectorXd& q,
+	const Eigen::VectorXd& dq, gtsam::Matrix* H_z, gtsam::Matrix* H_dz)
 {
-	const auto& zIndices = p.dynamic_solver->independent_coordinate_indices();
+	AssembledRigidModel& arm = *solver.get_model_non_const();
+	const auto& zIndices = solver.independent_coordinate_indices();
+	const auto n = q.size();
+	const auto d = static_cast<Eigen::Index>(zIndices.size());
+	const double delta = 1e-5;
 
-	// Set q & dq in the multibody model:
-	p.arm->q_ = p.q;
-	// Overwrite "z" & "dz":
-	mbse::overwrite_subset(p.arm->q_, p.z, zIndices);
-	mbse::overwrite_subset(p.arm->dotq_, new_dz, zIndices);
+	// Columns: [z+d_k | z-d_k] for H_z, then the same for dz:
+	const auto nStates = 2 * d * ((H_z ? 1 : 0) + (H_dz ? 1 : 0));
+	Eigen::MatrixXd qs(n, nStates), dqs(n, nStates);
 
-	// Ensure q and dq are updated after the change in "z":
 	AssembledRigidModel::ComputeDependentParams cdp;
 	AssembledRigidModel::ComputeDependentResults cdr;
 	cdp.nItersMax = 3;
-	p.arm->computeDependentPosVelAcc(
-		zIndices, true /*update_q*/, true /* update_dq*/, cdp, cdr);
 
-	ASSERT_LT_(cdr.pos_final_phi, 1e-3);
+	Eigen::Index col = 0;
+	for (int wrt_dz = 0; wrt_dz < 2; wrt_dz++)
+	{
+		if (!(wrt_dz ? H_dz : H_z)) continue;
+		for (Eigen::Index k = 0; k < 2 * d; k++)
+		{
+			arm.q_ = q;
+			arm.dotq_ = dq;
+			Eigen::VectorXd& x = wrt_dz ? arm.dotq_ : arm.q_;
+			x[zIndices[k % d]] += k < d ? delta : -delta;
+
+			// Ensure q and dq are updated after the change in "z":
+			arm.computeDependentPosVelAcc(
+				zIndices, true /*update_q*/, true /* update_dq*/, cdp, cdr);
+			ASSERT_LT_(cdr.pos_final_phi, 1e-3);
+
+			qs.col(col + k) = arm.q_;
+			dqs.col(col + k) = arm.dotq_;
+		}
+		col += 2 * d;
+	}
+	arm.q_ = q;
+	arm.dotq_ = dq;
 
-	// Predict accelerations:
+	Eigen::MatrixXd ddzs;
 	const double t = 0;	 // wallclock time (useless?)
-	Eigen::VectorXd zpp_predicted;
-
-	p.dynamic_solver->solve_ddotz(t, zpp_predicted);
+	solver.solve_ddotz_batch(t, qs, dqs, ddzs);
 
-	// Evaluate error:
-	err = zpp_predicted - p.ddz;
+	col = 0;
+	for (gtsam::Matrix* H : {H_z, H_dz})
+	{
+		if (!H) continue;
+		*H = (ddzs.middleCols(col, d) - ddzs.middleCols(col + d, d)) /
+			 (2 * delta);
+		col += 2 * d;
+	}
 }
+#endif
 
 bool FactorDynamicsIndep::equals(
 	const gtsam::NonlinearFactor& expected, double tol) const
@@ -159,58 +149,18 @@ gtsam::Vector FactorDynamicsIndep::evaluateError(
 	// Evaluate error:
 	gtsam::Vector err = zpp_predicted - ddz_k;
 
-	// d err / d z_k
-	if (de_dz)
-	{
-		auto& Hv = *de_dz;
-#if USE_NUMERIC_JACOBIAN
-		NumericJacobParams p;
-		p.arm = &arm;
-		p.dynamic_solver = dynamic_solver_;
-		p.q = q_k;
-		p.z = z_k;
-		p.dz = dz_k;
-		p.ddz = ddz_k;
-
-		const gtsam::Vector x = p.z;
-		const gtsam::Vector x_incr =
-			Eigen::VectorXd::Constant(x.rows(), x.cols(), 1e-5);
-
-		mrpt::math::estimateJacobian(
-			x,
-			std::function<void(
-				const gtsam::Vector& new_q, const NumericJacobParams& p,
-				gtsam::Vector& err)>(&num_err_wrt_z),
-			x_incr, p, Hv);
-#else
-		Hv.setZero(n, n);
-#endif
-	}
-	// d err / d dz_k
-	if (de_dzp)
+	// d err / d z_k, d err / d dz_k
+	if (de_dz || de_dzp)
 	{
-		auto& Hv = *de_dzp;
 #if USE_NUMERIC_JACOBIAN
-		NumericJacobParams p;
-		p.arm = &arm;
-		p.dynamic_solver = dynamic_solver_;
-		p.q = q_k;
-		p.z = z_k;
-		p.dz = dz_k;
-		p.ddz = ddz_k;
-
-		const gtsam::Vector x = p.dz;
-		const gtsam::Vector x_incr =
-			Eigen::VectorXd::Constant(x.rows(), x.cols(), 1e-5);
-
-		mrpt::math::estimateJacobian(
-			x,
-			std::function<void(
-				const gtsam::Vector& new_q, const NumericJacobParams& p,
-				gtsam::Vector& err)>(&num_err_wrt_dz),
-			x_incr, p, Hv);
+		// Copies, since the model state is used for the perturbed states:
+		const Eigen::VectorXd q = arm.q_, dq = arm.dotq_;
+		numeric_ddz_jacobians(
+			*dynamic_solver_, q, dq, de_dz ? &(*de_dz) : nullptr,
+			de_dzp ? &(*de_dzp) : nullptr);
 #else
-		Hv.setZero(n, n);
+		if (de_dz) de_dz->setZero(d, d);
+		if (de_dzp) de_dzp->setZero(d, d);
 #endif
 	}
 	// d err / d ddz_k
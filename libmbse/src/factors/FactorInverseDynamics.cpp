@@ -14,10 +14,6 @@
 
 //#define USE_NUMERIC_JACOBIAN 1
 
-#if USE_NUMERIC_JACOBIAN
-#include <mrpt/math/num_jacobian.h>
-#endif
-
 using namespace mbse;
 
 FactorInverseDynamics::~FactorInverseDynamics() = default;
@@ -39,65 +35,6 @@ void FactorInverseDynamics::print(
 
 #if USE_NUMERIC_JACOBIAN
 const double FINITE_DIFF_DELTA = 1e-4;
-
-struct NumericJacobParams
-{
-	AssembledRigidModel* arm = nullptr;
-	CDynamicSimulatorBase* dynamic_solver = nullptr;
-	gtsam::Vector q, dq, ddq, Q;
-};
-
-static void num_err_wrt_Q(
-	const gtsam::Vector& new_Q, const NumericJacobParams& p, gtsam::Vector& err)
-{
-	// Set q & dq in the multibody model:
-	p.arm->q_ = p.q;
-	p.arm->dotq_ = p.dq;
-	p.arm->Q_ = new_Q;
-
-	// Predict accelerations:
-	Eigen::VectorXd qpp_predicted;
-	const double t = 0;	 // wallclock time (useless?)
-	p.dynamic_solver->solve_ddotq(t, qpp_predicted);
-
-	// Evaluate error:
-	err = qpp_predicted - p.ddq;
-}
-
-static void num_err_wrt_q(
-	const gtsam::Vector& new_q, const NumericJacobParams& p, gtsam::Vector& err)
-{
-	// Set q & dq in the multibody model:
-	p.arm->q_ = new_q;
-	p.arm->dotq_ = p.dq;
-	p.arm->Q_ = p.Q;
-
-	// Predict accelerations:
-	Eigen::VectorXd qpp_predicted;
-	const double t = 0;	 // wallclock time (useless?)
-	p.dynamic_solver->solve_ddotq(t, qpp_predicted);
-
-	// Evaluate error:
-	err = qpp_predicted - p.ddq;
-}
-
-static void num_err_wrt_dq(
-	const gtsam::Vector& new_dq, const NumericJacobParams& p,
-	gtsam::Vector& err)
-{
-	// Set q & dq in the multibody model:
-	p.arm->q_ = p.q;
-	p.arm->dotq_ = new_dq;
-	p.arm->Q_ = p.Q;
-
-	// Predict accelerations:
-	Eigen::VectorXd qpp_predicted;
-	const double t = 0;	 // wallclock time (useless?)
-	p.dynamic_solver->solve_ddotq(t, qpp_predicted);
-
-	// Evaluate error:
-	err = qpp_predicted - p.ddq;
-}
 #endif
 
 bool FactorInverseDynamics::equals(
@@ -191,24 +128,21 @@ gtsam::Vector FactorInverseDynamics::evaluateError(
 		}
 		else
 		{
-			NumericJacobParams p;
-			p.arm = &arm;
-			p.dynamic_solver = dynamic_solver_;
-			p.q = q_k;
-			p.dq = dq_k;
-			p.ddq = ddq_k;
-			p.Q = Q_k;
-
-			const gtsam::Vector x = p.Q;
-			const gtsam::Vector x_incr = Eigen::VectorXd::Constant(
-				x.rows(), x.cols(), FINITE_DIFF_DELTA);
-
-			mrpt::math::estimateJacobian(
-				x,
-				std::function<void(
-					const gtsam::Vector& new_Q, const NumericJacobParams& p,
-					gtsam::Vector& err)>(&num_err_wrt_Q),
-				x_incr, p, Hv);
+			// Central differences wrt Q, solving all the 2n perturbed states
+			// in a single batch:
+			const Eigen::MatrixXd qs = q_k.replicate(1, 2 * n);
+			const Eigen::MatrixXd dqs = dq_k.replicate(1, 2 * n);
+			Eigen::MatrixXd Qs = Q_k.replicate(1, 2 * n);
+			for (Eigen::Index k = 0; k < n; k++)
+			{
+				Qs(k, k) += FINITE_DIFF_DELTA;
+				Qs(k, n + k) -= FINITE_DIFF_DELTA;
+			}
+
+			Eigen::MatrixXd ddqs;
+			dynamic_solver_->solve_ddotq_batch(t, qs, dqs, ddqs, &Qs);
+			Hv = (ddqs.leftCols(n) - ddqs.rightCols(n)) /
+				 (2 * FINITE_DIFF_DELTA);
 
 			cached_d_e_Q_ = Hv;
 			cached_q_ = q_k;
@@ -0,0 +1,106 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include <mbse/factors/SlidingWindowSmoother.h>
+#include <mbse/mbse-common.h>
+#include <gtsam/nonlinear/BatchFixedLagSmoother.h>
+#include <gtsam/nonlinear/LevenbergMarquardtOptimizer.h>
+#include <mrpt/core/bits_math.h>
+
+#include <algorithm>
+
+using namespace mbse;
+
+SlidingWindowSmoother::Parameters::Parameters()
+	: lm(gtsam::LevenbergMarquardtParams::LegacyDefaults())
+{
+}
+
+SlidingWindowSmoother::UpdateResult SlidingWindowSmoother::update(
+	const gtsam::NonlinearFactorGraph& newFactors,
+	const gtsam::Values& newValues, const KeyTimestampMap& newTimestamps)
+{
+	MBSE_PROFILE_SCOPE("SlidingWindowSmoother");
+
+	UpdateResult r;
+
+	// Old variables are marginalized at their last estimate, before the new
+	// factors are added:
+	for (const auto& kv : newTimestamps) mrpt::keep_max(latestTime_, kv.second);
+	r.numMarginalized = marginalizeOldVariables();
+
+	factors_.push_back(newFactors);
+	values_.insert(newValues);
+	for (const auto& kv : newTimestamps) timestamps_[kv.first] = kv.second;
+
+	// Optimize, warm-started from the previous solution:
+	r.numFactors = factors_.size();
+	r.errorBefore = factors_.error(values_);
+
+	gtsam::LevenbergMarquardtOptimizer lm(factors_, values_, params.lm);
+	values_ = lm.optimize();
+
+	r.errorAfter = factors_.error(values_);
+	r.iterations = lm.iterations();
+
+	return r;
+}
+
+size_t SlidingWindowSmoother::marginalizeOldVariables()
+{
+	const double tMin = latestTime_ - params.lag;
+
+	gtsam::KeyVector oldKeys;
+	gtsam::KeySet oldKeySet;
+	for (const auto& kv : timestamps_)
+	{
+		if (kv.second >= tMin) continue;
+		oldKeys.push_back(kv.first);
+		oldKeySet.insert(kv.first);
+	}
+	if (oldKeys.empty()) return 0;
+
+	// Split the window into the factors involving old variables, and the
+	// rest. Only the former take part in the marginalization:
+	gtsam::NonlinearFactorGraph oldFactors, keptFactors;
+	for (const auto& f : factors_)
+	{
+		if (!f) continue;
+		const bool isOld = std::any_of(
+			f->begin(), f->end(),
+			[&](const gtsam::Key k) { return oldKeySet.count(k) != 0; });
+		if (isOld)
+			oldFactors.push_back(f);
+		else
+			keptFactors.push_back(f);
+	}
+
+	// Replace them by a linear Gaussian prior on the remaining variables
+	// (variables without factors have nothing to marginalize):
+	const gtsam::KeySet involvedKeys = oldFactors.keys();
+	gtsam::KeyVector marginalizeKeys;
+	for (const auto k : oldKeys)
+		if (involvedKeys.count(k)) marginalizeKeys.push_back(k);
+
+	if (!marginalizeKeys.empty())
+	{
+		keptFactors.push_back(
+			gtsam::BatchFixedLagSmoother::CalculateMarginalFactors(
+				oldFactors, values_, marginalizeKeys));
+	}
+
+	factors_ = std::move(keptFactors);
+	for (const auto k : oldKeys)
+	{
+		values_.erase(k);
+		timestamps_.erase(k);
+	}
+	return oldKeys.size();
+}
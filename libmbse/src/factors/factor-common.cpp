@@ -9,7 +9,82 @@
   +-------------------------------------------------------------------------+ */
 
 #include <mbse/factors/factor-common.h>
+#include <gtsam/inference/Symbol.h>
 #include <cmath>
 #include <iostream>
 
 using namespace mbse;
+
+StateBlocks::StateBlocks(
+	const ModelTopology& topology, unsigned char symbolChar)
+	: symbolChar_(symbolChar)
+{
+	const size_t n = topology.numCoords();
+	dof2block_.assign(n, static_cast<size_t>(-1));
+
+	// One block per non-fixed point:
+	for (const auto& p2d : topology.getPoints2DOFs())
+	{
+		std::vector<dof_index_t> dofs;
+		if (p2d.dof_x != INVALID_DOF) dofs.push_back(p2d.dof_x);
+		if (p2d.dof_y != INVALID_DOF) dofs.push_back(p2d.dof_y);
+		if (dofs.empty()) continue;
+
+		for (const auto d : dofs) dof2block_[d] = blocks_.size();
+		blocks_.emplace_back(std::move(dofs));
+	}
+
+	// One block per relative coordinate (or any other coordinate left):
+	for (dof_index_t d = 0; d < n; d++)
+	{
+		if (dof2block_[d] != static_cast<size_t>(-1)) continue;
+		dof2block_[d] = blocks_.size();
+		blocks_.push_back({d});
+	}
+
+	// Blocks touched by each constraint, from the Jacobian sparsity pattern:
+	const auto& Phi_q = topology.Phi_q_;
+	constraintBlocks_.resize(topology.constraints_.size());
+	for (size_t i = 0; i < topology.constraints_.size(); i++)
+	{
+		const auto [firstRow, nRows] = topology.constraintRows_.at(i);
+		auto& cb = constraintBlocks_[i];
+		for (size_t row = firstRow; row < firstRow + nRows; row++)
+			for (size_t k = Phi_q.row_ptr[row]; k < Phi_q.row_ptr[row + 1];
+				 k++)
+				cb.push_back(dof2block_.at(Phi_q.col_idx[k]));
+
+		std::sort(cb.begin(), cb.end());
+		cb.erase(std::unique(cb.begin(), cb.end()), cb.end());
+	}
+}
+
+gtsam::Key StateBlocks::key(size_t timeStep, size_t block) const
+{
+	return gtsam::Symbol(symbolChar_, timeStep * blocks_.size() + block);
+}
+
+void StateBlocks::insert(
+	gtsam::Values& values, size_t timeStep, const state_t& q) const
+{
+	for (size_t b = 0; b < blocks_.size(); b++)
+	{
+		const auto& dofs = blocks_[b];
+		state_t v(dofs.size());
+		for (size_t i = 0; i < dofs.size(); i++) v[i] = q[dofs[i]];
+		values.insert(key(timeStep, b), v);
+	}
+}
+
+void StateBlocks::gather(
+	const gtsam::Values& values, size_t timeStep, state_t& q) const
+{
+	for (size_t b = 0; b < blocks_.size(); b++)
+	{
+		const auto k = key(timeStep, b);
+		if (!values.exists(k)) continue;
+		const auto& v = values.at<state_t>(k);
+		const auto& dofs = blocks_[b];
+		for (size_t i = 0; i < dofs.size(); i++) q[dofs[i]] = v[i];
+	}
+}
@@ -0,0 +1,335 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include <mbse/profiler.h>
+#include <mrpt/core/exceptions.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+
+using namespace mbse::profiler;
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+/** Statistics slot of one scope in one thread. Only the owner thread writes;
+ * atomics (relaxed) let collectStats() read them from other threads. */
+struct Slot
+{
+	std::atomic<uint64_t> count{0};
+	std::atomic<double> total{0}, min{0}, max{0};
+
+	/** Start times of the nested (recursive) entries of this scope still
+	 * running, owner thread only. Entries deeper than MAX_DEPTH are not
+	 * timed. */
+	static constexpr std::size_t MAX_DEPTH = 8;
+	std::array<Clock::time_point, MAX_DEPTH> starts{};
+	std::size_t depth = 0;
+
+	void add(double v)
+	{
+		const uint64_t n = count.load(std::memory_order_relaxed);
+		const double mi = min.load(std::memory_order_relaxed);
+		const double ma = max.load(std::memory_order_relaxed);
+		total.store(
+			total.load(std::memory_order_relaxed) + v,
+			std::memory_order_relaxed);
+		min.store(n == 0 ? v : std::min(mi, v), std::memory_order_relaxed);
+		max.store(n == 0 ? v : std::max(ma, v), std::memory_order_relaxed);
+		count.store(n + 1, std::memory_order_release);
+	}
+
+	void reset()
+	{
+		count = 0;
+		total = 0;
+		min = 0;
+		max = 0;
+	}
+};
+
+struct TraceEvent
+{
+	scope_id_t id;
+	int64_t start_ns, duration_ns;
+};
+
+struct ThreadData
+{
+	explicit ThreadData(int id) : thread_id(id) {}
+
+	const int thread_id;
+	std::array<Slot, MAX_SCOPES> slots;
+
+	std::vector<TraceEvent> events;	 //!< Fixed capacity, see num_events
+	std::atomic<std::size_t> num_events{0};
+};
+
+struct Registry
+{
+	std::mutex mtx;
+	std::vector<std::string> names;
+	std::vector<ScopeKind> kinds;
+	std::map<std::string, scope_id_t> name2id;
+	std::vector<std::shared_ptr<ThreadData>> threads;
+	std::size_t trace_capacity = 0;
+	const Clock::time_point epoch = Clock::now();
+};
+
+Registry& registry()
+{
+	static Registry r;
+	return r;
+}
+
+std::atomic<bool> g_enabled{true};
+
+/** This thread's slots, registered on first use so they outlive the thread
+ * and can be collected later. */
+ThreadData& thisThread()
+{
+	static thread_local std::shared_ptr<ThreadData> td = []() {
+		auto& r = registry();
+		std::lock_guard<std::mutex> lck(r.mtx);
+		const int id = static_cast<int>(r.threads.size());
+		auto d = std::make_shared<ThreadData>(id);
+		d->events.resize(r.trace_capacity);
+		r.threads.push_back(d);
+		return d;
+	}();
+	return *td;
+}
+
+void writeJSONString(std::ostream& o, const std::string& s)
+{
+	o << '"';
+	for (const char c : s)
+	{
+		if (c == '"' || c == '\\') o << '\\';
+		o << c;
+	}
+	o << '"';
+}
+
+}  // namespace
+
+scope_id_t mbse::profiler::registerScope(const char* name, ScopeKind kind)
+{
+	auto& r = registry();
+	std::lock_guard<std::mutex> lck(r.mtx);
+
+	if (auto it = r.name2id.find(name); it != r.name2id.end())
+		return it->second;
+
+	ASSERTMSG_(
+		r.names.size() < MAX_SCOPES,
+		"Too many profiler scopes, increase profiler::MAX_SCOPES");
+
+	const auto id = static_cast<scope_id_t>(r.names.size());
+	r.names.emplace_back(name);
+	r.kinds.push_back(kind);
+	r.name2id[name] = id;
+	return id;
+}
+
+void mbse::profiler::enable(bool enabled) { g_enabled = enabled; }
+bool mbse::profiler::isEnabled() { return g_enabled; }
+
+void mbse::profiler::enter(scope_id_t id)
+{
+	if (!g_enabled.load(std::memory_order_relaxed)) return;
+	Slot& s = thisThread().slots[id];
+	if (s.depth < Slot::MAX_DEPTH) s.starts[s.depth] = Clock::now();
+	s.depth++;
+}
+
+void mbse::profiler::leave(scope_id_t id)
+{
+	if (!g_enabled.load(std::memory_order_relaxed)) return;
+	const auto now = Clock::now();
+
+	ThreadData& td = thisThread();
+	Slot& s = td.slots[id];
+	// Left without entering (e.g. profiler enabled in between): ignore
+	if (s.depth == 0) return;
+	if (--s.depth >= Slot::MAX_DEPTH) return;
+
+	const Clock::time_point start = s.starts[s.depth];
+	const auto dt = now - start;
+	s.add(std::chrono::duration<double>(dt).count());
+
+	const std::size_t n = td.num_events.load(std::memory_order_relaxed);
+	if (n < td.events.size())
+	{
+		auto& ev = td.events[n];
+		ev.id = id;
+		ev.start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+						  start - registry().epoch)
+						  .count();
+		ev.duration_ns =
+			std::chrono::duration_cast<std::chrono::nanoseconds>(dt).count();
+		td.num_events.store(n + 1, std::memory_order_release);
+	}
+}
+
+void mbse::profiler::recordValue(scope_id_t id, double value)
+{
+	if (!g_enabled.load(std::memory_order_relaxed)) return;
+	thisThread().slots[id].add(value);
+}
+
+void mbse::profiler::setTraceCapacity(std::size_t maxEventsPerThread)
+{
+	auto& r = registry();
+	std::lock_guard<std::mutex> lck(r.mtx);
+	r.trace_capacity = maxEventsPerThread;
+	for (auto& td : r.threads)
+	{
+		td->num_events = 0;
+		td->events.resize(maxEventsPerThread);
+	}
+}
+
+std::vector<ScopeStats> mbse::profiler::collectStats()
+{
+	auto& r = registry();
+	std::lock_guard<std::mutex> lck(r.mtx);
+
+	std::vector<ScopeStats> ret;
+	for (scope_id_t id = 0; id < r.names.size(); id++)
+	{
+		ScopeStats st;
+		st.name = r.names[id];
+		st.kind = r.kinds[id];
+		for (const auto& td : r.threads)
+		{
+			const Slot& s = td->slots[id];
+			const uint64_t n = s.count.load(std::memory_order_acquire);
+			if (!n) continue;
+			const double mi = s.min.load(std::memory_order_relaxed);
+			const double ma = s.max.load(std::memory_order_relaxed);
+			st.min = st.count ? std::min(st.min, mi) : mi;
+			st.max = st.count ? std::max(st.max, ma) : ma;
+			st.total += s.total.load(std::memory_order_relaxed);
+			st.count += n;
+		}
+		if (st.count) ret.emplace_back(std::move(st));
+	}
+	return ret;
+}
+
+ScopeStats mbse::profiler::getStats(const std::string& name)
+{
+	for (auto& st : collectStats())
+		if (st.name == name) return st;
+	ScopeStats st;
+	st.name = name;
+	return st;
+}
+
+void mbse::profiler::clear()
+{
+	auto& r = registry();
+	std::lock_guard<std::mutex> lck(r.mtx);
+	for (auto& td : r.threads)
+	{
+		for (auto& s : td->slots) s.reset();
+		td->num_events = 0;
+	}
+}
+
+void mbse::profiler::printStats(std::ostream& o)
+{
+	const auto stats = collectStats();
+	const auto oldFlags = o.flags();
+	const auto oldPrec = o.precision();
+
+	o << std::fixed << std::left << std::setw(48) << "Scope" << std::right
+	  << std::setw(10) << "Count" << std::setw(12) << "Mean" << std::setw(12)
+	  << "Min" << std::setw(12) << "Max" << std::setw(12) << "Total" << "\n";
+
+	const auto fmt = [&](const ScopeStats& st, double v) {
+		if (st.kind == ScopeKind::Time)
+			o << std::setw(10) << std::setprecision(2) << v * 1e6 << "us";
+		else
+			o << std::setw(12) << std::setprecision(3) << v;
+	};
+
+	for (const auto& st : stats)
+	{
+		o << std::left << std::setw(48) << st.name << std::right
+		  << std::setw(10) << st.count;
+		fmt(st, st.mean());
+		fmt(st, st.min);
+		fmt(st, st.max);
+		fmt(st, st.total);
+		o << "\n";
+	}
+	o.flags(oldFlags);
+	o.precision(oldPrec);
+}
+
+void mbse::profiler::exportJSON(std::ostream& o)
+{
+	const auto stats = collectStats();
+	const auto oldPrec = o.precision(12);
+
+	o << "{\n  \"scopes\": [";
+	for (std::size_t i = 0; i < stats.size(); i++)
+	{
+		const auto& st = stats[i];
+		o << (i ? ",\n" : "\n") << "    {\"name\": ";
+		writeJSONString(o, st.name);
+		o << ", \"kind\": \""
+		  << (st.kind == ScopeKind::Time ? "time" : "value") << "\""
+		  << ", \"count\": " << st.count << ", \"total\": " << st.total
+		  << ", \"mean\": " << st.mean() << ", \"min\": " << st.min
+		  << ", \"max\": " << st.max << "}";
+	}
+	o << "\n  ]\n}\n";
+	o.precision(oldPrec);
+}
+
+void mbse::profiler::exportChromeTrace(std::ostream& o)
+{
+	auto& r = registry();
+	std::lock_guard<std::mutex> lck(r.mtx);
+	const auto oldFlags = o.flags();
+	const auto oldPrec = o.precision(3);
+
+	o << std::fixed << "{\"traceEvents\": [";
+	bool first = true;
+	for (const auto& td : r.threads)
+	{
+		const std::size_t n = td->num_events.load(std::memory_order_acquire);
+		for (std::size_t i = 0; i < n; i++)
+		{
+			const TraceEvent& ev = td->events[i];
+			o << (first ? "\n" : ",\n") << "{\"name\": ";
+			writeJSONString(o, r.names[ev.id]);
+			o << ", \"cat\": \"mbse\", \"ph\": \"X\", \"pid\": 0"
+			  << ", \"tid\": " << td->thread_id
+			  << ", \"ts\": " << ev.start_ns * 1e-3
+			  << ", \"dur\": " << ev.duration_ns * 1e-3 << "}";
+			first = false;
+		}
+	}
+	o << "\n], \"displayTimeUnit\": \"ms\"}\n";
+	o.flags(oldFlags);
+	o.precision(oldPrec);
+}
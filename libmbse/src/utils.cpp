@@ -22,6 +22,44 @@ mrpt::system::CTimeLogger& mbse::timelog()
 	return tl;
 }
 
+double* mbse::ccs_entry_ptr(Eigen::SparseMatrix<double>& A, int row, int col)
+{
+	ASSERT_(A.isCompressed());
+	const int* rows = A.innerIndexPtr();
+	const int* begin = rows + A.outerIndexPtr()[col];
+	const int* end = rows + A.outerIndexPtr()[col + 1];
+	const int* it = std::lower_bound(begin, end, row);
+	ASSERTMSG_(
+		it != end && *it == row,
+		mrpt::format("Entry (%i,%i) not in the sparse matrix", row, col));
+	return A.valuePtr() + (it - rows);
+}
+
+bool mbse::klu_factor_or_refactor(
+	Eigen::SparseMatrix<double>& A, klu_symbolic* symbolic,
+	klu_numeric*& numeric, klu_common& common, double min_rcond)
+{
+	if (numeric)
+	{
+		const bool ok = klu_refactor(
+			A.outerIndexPtr(), A.innerIndexPtr(), A.valuePtr(), symbolic,
+			numeric, &common);
+		if (ok && klu_rcond(symbolic, numeric, &common) &&
+			common.rcond >= min_rcond)
+			return true;
+
+		// The old pivoting is not good anymore:
+		klu_free_numeric(&numeric, &common);
+	}
+
+	numeric = klu_factor(
+		A.outerIndexPtr(), A.innerIndexPtr(), A.valuePtr(), symbolic, &common);
+	if (!numeric) return false;
+
+	klu_rcond(symbolic, numeric, &common);
+	return true;
+}
+
 bool mbse::save_matrix(
 	cholmod_sparse* tri, const char* filename, cholmod_common* c)
 {
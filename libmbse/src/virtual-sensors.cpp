@@ -9,6 +9,7 @@
   +-------------------------------------------------------------------------+ */
 
 #include <mbse/AssembledRigidModel.h>
+#include <mbse/MultiBodyParticleFilter.h>
 #include <mbse/virtual-sensors.h>
 
 using namespace mbse;
@@ -17,6 +18,68 @@ using namespace mrpt::math;
 using namespace mrpt;
 using namespace std;
 
+// ---------------------------------------
+// Virtual sensor: base class
+// ---------------------------------------
+void CVirtualSensor::simulate_readings(
+	const ParticleBatch& particles, Eigen::Ref<Eigen::VectorXd> out) const
+{
+	ASSERT_EQUAL_(static_cast<size_t>(out.size()), particles.size());
+
+	AssembledRigidModel mdl(particles.topology);
+	for (size_t i = 0; i < particles.size(); i++)
+	{
+		particles.load(i, mdl);
+		out[i] = simulate_reading(mdl);
+	}
+}
+
+void CVirtualSensor::evaluate_log_likelihoods(
+	const double sensor_reading, const ParticleBatch& particles,
+	Eigen::Ref<Eigen::VectorXd> out) const
+{
+	simulate_readings(particles, out);
+
+	const double inv_std = 1.0 / sensor_noise_std;
+	out = (-0.5 * ((out.array() - sensor_reading) * inv_std).square())
+			  .matrix();
+}
+
+namespace
+{
+/** Copies the coordinates and velocities of point `pt_idx` in all particles
+ * into contiguous arrays. Fixed points get their constant coordinates. */
+void gather_point(
+	const ParticleBatch& particles, size_t pt_idx, ArrayXd& x, ArrayXd& y,
+	ArrayXd& vx, ArrayXd& vy)
+{
+	const ModelTopology& topo = *particles.topology;
+	const Point2& pt_info = topo.mechanism_.getPointInfo(pt_idx);
+	const Point2ToDOF& pt_dofs = topo.points2DOFs_[pt_idx];
+
+	if (pt_dofs.dof_x != INVALID_DOF)
+	{
+		x = particles.q.row(pt_dofs.dof_x).transpose();
+		vx = particles.dotq.row(pt_dofs.dof_x).transpose();
+	}
+	else
+	{
+		x.setConstant(particles.size(), pt_info.coords.x);
+		vx.setZero(particles.size());
+	}
+	if (pt_dofs.dof_y != INVALID_DOF)
+	{
+		y = particles.q.row(pt_dofs.dof_y).transpose();
+		vy = particles.dotq.row(pt_dofs.dof_y).transpose();
+	}
+	else
+	{
+		y.setConstant(particles.size(), pt_info.coords.y);
+		vy.setZero(particles.size());
+	}
+}
+}  // namespace
+
 // ---------------------------------------
 // Virtual sensor: Gyroscope
 // ---------------------------------------
@@ -60,3 +123,24 @@ double CVirtualSensor_Gyro::simulate_reading(
 
 	return w;
 }
+
+void CVirtualSensor_Gyro::simulate_readings(
+	const ParticleBatch& particles, Eigen::Ref<Eigen::VectorXd> out) const
+{
+	ASSERT_EQUAL_(static_cast<size_t>(out.size()), particles.size());
+
+	const std::vector<Body>& bodies = particles.topology->mechanism_.bodies();
+	ASSERTDEB_(body_idx_ < bodies.size());
+	const Body& body = bodies[body_idx_];
+
+	// Rows of q are strided (one column per particle): gather them once.
+	ArrayXd x0, y0, vx0, vy0, x1, y1, vx1, vy1;
+	gather_point(particles, body.points[0], x0, y0, vx0, vy0);
+	gather_point(particles, body.points[1], x1, y1, vx1, vy1);
+
+	// Same as simulate_reading(), without the square root:
+	//  w = (rel_vel . v) / len,  with v = (-u.y, u.x) / len
+	const ArrayXd ux = x1 - x0, uy = y1 - y0;
+	out = (((vy1 - vy0) * ux - (vx1 - vx0) * uy) / (ux.square() + uy.square()))
+			  .matrix();
+}
@@ -0,0 +1,113 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include <gtest/gtest.h>
+
+#include <mbse/AssembledRigidModel.h>
+#include <mbse/model-examples.h>
+
+// Repeated position/velocity/acceleration projections, which reuse the
+// persistent factorization of Phi_d, must satisfy the constraints:
+TEST(DependentCoordinates, RepeatedProjections)
+{
+	mbse::timelog().enable(false);
+
+	auto aMBS = mbse::buildFourBarsMBS().assembleRigidMBS();
+	const std::vector<size_t> z_indices = {0};
+
+	for (int trial = 0; trial < 3; trial++)
+	{
+		aMBS->q_ += Eigen::VectorXd::Constant(aMBS->q_.size(), 0.02);
+		aMBS->dotq_.setConstant(0.5 + trial);
+		const double z = aMBS->q_[0];
+
+		std::vector<size_t> idxs_d;
+		const double phi = aMBS->finiteDisplacement(
+			z_indices, 1e-12, 20, true /*velocities*/, &idxs_d);
+
+		EXPECT_LT(phi, 1e-10);
+		EXPECT_EQ(aMBS->q_[0], z);
+		EXPECT_EQ(idxs_d.size(), aMBS->q_.size() - z_indices.size());
+
+		aMBS->update_numeric_Phi_and_Jacobians();
+		Eigen::VectorXd dPhi(aMBS->Phi_.size());
+		aMBS->Phi_q_.multiply(&aMBS->dotq_[0], &dPhi[0]);
+		EXPECT_LT(dPhi.norm(), 1e-8);
+
+		// Accelerations: Phi_q*ddq + dotPhi_q*dq = 0
+		mbse::AssembledRigidModel::ComputeDependentResults cdr;
+		Eigen::VectorXd ddotq;
+		cdr.ddotq = &ddotq;
+		const Eigen::VectorXd ddotz = Eigen::VectorXd::Constant(1, 1.0);
+		aMBS->computeDependentPosVelAcc(
+			z_indices, true, true, {}, cdr, &ddotz);
+
+		EXPECT_EQ(ddotq[0], 1.0);
+		Eigen::VectorXd ddPhi(aMBS->Phi_.size()), tmp(aMBS->Phi_.size());
+		aMBS->Phi_q_.multiply(&ddotq[0], &ddPhi[0]);
+		aMBS->dotPhi_q_.multiply(&aMBS->dotq_[0], &tmp[0]);
+		EXPECT_LT((ddPhi + tmp).norm(), 1e-8);
+	}
+}
+
+// Small steps of the independent coordinate, as within an integrator, must
+// reuse the factorization of Phi_d from previous calls:
+TEST(DependentCoordinates, WarmStartedProjector)
+{
+	mbse::timelog().enable(false);
+
+	auto aMBS = mbse::buildFourBarsMBS().assembleRigidMBS();
+	const std::vector<size_t> z_indices = {0};
+
+	auto& projector = aMBS->kinematicProjector();
+	projector.resetStats();
+
+	const size_t nSteps = 20;
+	for (size_t i = 0; i < nSteps; i++)
+	{
+		aMBS->q_[0] += 1e-3;
+		aMBS->dotq_.setConstant(1.0);
+
+		const double phi = aMBS->finiteDisplacement(
+			z_indices, 1e-12, 20, true /*velocities*/);
+		EXPECT_LT(phi, 1e-10);
+
+		aMBS->update_numeric_Phi_and_Jacobians();
+		Eigen::VectorXd dPhi(aMBS->Phi_.size());
+		aMBS->Phi_q_.multiply(&aMBS->dotq_[0], &dPhi[0]);
+		EXPECT_LT(dPhi.norm(), 1e-8);
+	}
+
+	EXPECT_LT(projector.stats().numFactorizations, nSteps);
+}
+
+// refinePositions() must not reuse a factorization from a former call, which
+// may have been computed at a very different configuration:
+TEST(DependentCoordinates, RefinePositionRefactorizesOnEachCall)
+{
+	mbse::timelog().enable(false);
+
+	auto aMBS = mbse::buildFourBarsMBS().assembleRigidMBS();
+	auto& projector = aMBS->kinematicProjector();
+
+	aMBS->q_.array() += 1e-2;
+	EXPECT_LT(aMBS->refinePosition(1e-12, 20), 1e-10);
+
+	const Eigen::VectorXd q0 = aMBS->q_;
+	for (int i = 0; i < 3; i++)
+	{
+		projector.resetStats();
+		aMBS->q_ = q0;
+		aMBS->q_[0] += 0.05 * (i + 1);
+
+		EXPECT_LT(aMBS->refinePosition(1e-12, 20), 1e-10);
+		EXPECT_GE(projector.stats().numFactorizations, 1U);
+	}
+}
@@ -13,6 +13,9 @@
 #include <mbse/mbse.h>
 #include <mbse/model-examples.h>
 
+#include <set>
+#include <type_traits>
+
 template <class DYNAMIC_SOLVER_T>
 void testerPendulumDynamics(bool addRelativeAngle = false)
 {
@@ -84,6 +87,14 @@ TEST(PendulumDynamics, CDynamicSimulator_ALi3_Dense)
 {
 	testerPendulumDynamics<mbse::CDynamicSimulator_ALi3_Dense>();
 }
+TEST(PendulumDynamics, CDynamicSimulator_ALi3_Sparse)
+{
+	testerPendulumDynamics<mbse::CDynamicSimulator_ALi3_Sparse>();
+}
+TEST(PendulumDynamics, CDynamicSimulator_Lagrange_Tree)
+{
+	testerPendulumDynamics<mbse::CDynamicSimulator_Lagrange_Tree>();
+}
 TEST(PendulumDynamics, CDynamicSimulator_R_matrix_dense)
 {
 	testerPendulumDynamics<mbse::CDynamicSimulator_R_matrix_dense>();
@@ -157,3 +168,596 @@ TEST(PendulumDynamicsWithRelCoord, NoDiscontinuityAcceleration)
 	EXPECT_NEAR(d0(2), d1(2), 1e-3);
 	EXPECT_NEAR(d1(2), d2(2), 1e-3);
 }
+
+// -------------
+// The sparse independent-coordinates solver must give the same independent
+// accelerations than the dense one, for the same choice of coordinates:
+static void testerIndepSparseVsDense(const mbse::ModelDefinition& model)
+{
+	mbse::timelog().enable(false);	// avois clutter in cout
+
+	std::shared_ptr<mbse::AssembledRigidModel> aMBS = model.assembleRigidMBS();
+	aMBS->setGravityVector(0, -9.81, 0);
+	aMBS->dotq_.setRandom();
+	aMBS->update_numeric_Phi_and_Jacobians();
+
+	mbse::CDynamicSimulator_Indep_dense dense(aMBS);
+	dense.prepare();
+	Eigen::VectorXd ddotz_dense;
+	dense.solve_ddotz(0.0, ddotz_dense);
+
+	mbse::CDynamicSimulator_Indep_sparse sparse(aMBS);
+	sparse.independent_coordinate_indices(
+		dense.independent_coordinate_indices());
+	sparse.prepare();
+	Eigen::VectorXd ddotz_sparse;
+	sparse.solve_ddotz(0.0, ddotz_sparse);
+
+	ASSERT_EQ(ddotz_dense.size(), ddotz_sparse.size());
+	EXPECT_NEAR(
+		(ddotz_dense - ddotz_sparse).array().abs().maxCoeff(), 0,
+		1e-6 * (1.0 + ddotz_dense.array().abs().maxCoeff()))
+		<< "dense : " << ddotz_dense.transpose() << "\n"
+		<< "sparse: " << ddotz_sparse.transpose() << "\n";
+
+	// Automatic choice of coordinates:
+	mbse::CDynamicSimulator_Indep_sparse sparseAuto(aMBS);
+	sparseAuto.prepare();
+	Eigen::VectorXd ddotz_auto;
+	sparseAuto.solve_ddotz(0.0, ddotz_auto);
+	EXPECT_EQ(
+		sparseAuto.independent_coordinate_indices().size(),
+		dense.independent_coordinate_indices().size());
+}
+
+TEST(IndepSparse, MatchesDenseFourBars)
+{
+	testerIndepSparseVsDense(mbse::buildFourBarsMBS());
+}
+TEST(IndepSparse, MatchesDenseGrid)
+{
+	testerIndepSparseVsDense(mbse::buildParameterizedMBS(3, 2));
+}
+
+// -------------
+// Sparse solvers update their factorizations in place from one step to the
+// next; trajectories must match those of the dense solver:
+template <class DYNAMIC_SOLVER_T>
+void testerTrajectoryVsDense()
+{
+	mbse::timelog().enable(false);	// avois clutter in cout
+
+	const mbse::ModelDefinition model = mbse::buildParameterizedMBS(2, 2);
+
+	auto aMBS_ref = model.assembleRigidMBS();
+	auto aMBS = model.assembleRigidMBS();
+
+	mbse::CDynamicSimulator_Lagrange_LU_dense ref(aMBS_ref);
+	DYNAMIC_SOLVER_T dynSimul(aMBS);
+	for (mbse::CDynamicSimulatorBase* s :
+		 {static_cast<mbse::CDynamicSimulatorBase*>(&ref),
+		  static_cast<mbse::CDynamicSimulatorBase*>(&dynSimul)})
+	{
+		s->params.ode_solver = mbse::ODE_RK4;
+		s->params.time_step = 1e-3;
+		s->prepare();
+		s->run(0, 0.05);
+	}
+
+	EXPECT_NEAR((aMBS->q_ - aMBS_ref->q_).norm(), 0, 1e-6)
+		<< "q    : " << aMBS->q_.transpose() << "\n"
+		<< "q_ref: " << aMBS_ref->q_.transpose() << "\n";
+}
+
+TEST(TrajectoryVsDense, CDynamicSimulator_Lagrange_KLU)
+{
+	testerTrajectoryVsDense<mbse::CDynamicSimulator_Lagrange_KLU>();
+}
+TEST(TrajectoryVsDense, CDynamicSimulator_Lagrange_UMFPACK)
+{
+	testerTrajectoryVsDense<mbse::CDynamicSimulator_Lagrange_UMFPACK>();
+}
+TEST(TrajectoryVsDense, CDynamicSimulator_Lagrange_Tree)
+{
+	testerTrajectoryVsDense<mbse::CDynamicSimulator_Lagrange_Tree>();
+}
+
+// -------------
+// solve_ddotq_batch() must match one solve_ddotq() per state, both with the
+// Schur complement path (LU_dense) and with the generic one (KLU), and with
+// the model external forces or per-state ones:
+template <class DYNAMIC_SOLVER_T>
+void testerBatchVsSingle(const mbse::ModelDefinition& model)
+{
+	mbse::timelog().enable(false);	// avois clutter in cout
+
+	auto aMBS = model.assembleRigidMBS();
+	aMBS->setGravityVector(0, -9.81, 0);
+
+	DYNAMIC_SOLVER_T dynSimul(aMBS);
+	dynSimul.prepare();
+
+	const auto n = aMBS->q_.size();
+	const int nStates = 6;
+	const Eigen::MatrixXd qs = aMBS->q_.replicate(1, nStates) +
+							   1e-2 * Eigen::MatrixXd::Random(n, nStates);
+	const Eigen::MatrixXd dqs = Eigen::MatrixXd::Random(n, nStates);
+	const Eigen::MatrixXd Qs = Eigen::MatrixXd::Random(n, nStates);
+	const Eigen::VectorXd q0 = aMBS->q_;
+	const Eigen::VectorXd Q0 = aMBS->Q_;
+
+	for (const bool withForces : {false, true})
+	{
+		Eigen::MatrixXd ddqs;
+		dynSimul.solve_ddotq_batch(
+			0.0, qs, dqs, ddqs, withForces ? &Qs : nullptr);
+		ASSERT_EQ(ddqs.cols(), nStates);
+		EXPECT_EQ(aMBS->q_, q0);
+		EXPECT_EQ(aMBS->Q_, Q0);
+
+		for (int i = 0; i < nStates; i++)
+		{
+			aMBS->q_ = qs.col(i);
+			aMBS->dotq_ = dqs.col(i);
+			if (withForces) aMBS->Q_ = Qs.col(i);
+			Eigen::VectorXd ddq;
+			dynSimul.solve_ddotq(0.0, ddq);
+			EXPECT_NEAR(
+				(ddq - ddqs.col(i)).norm(), 0, 1e-6 * (1 + ddq.norm()))
+				<< "state #" << i << " withForces: " << withForces;
+		}
+		aMBS->q_ = q0;
+		aMBS->Q_ = Q0;
+	}
+}
+
+TEST(SolveBatch, LU_dense)
+{
+	testerBatchVsSingle<mbse::CDynamicSimulator_Lagrange_LU_dense>(
+		mbse::buildFourBarsMBS());
+	testerBatchVsSingle<mbse::CDynamicSimulator_Lagrange_LU_dense>(
+		mbse::buildParameterizedMBS(2, 2));
+}
+TEST(SolveBatch, KLU)
+{
+	testerBatchVsSingle<mbse::CDynamicSimulator_Lagrange_KLU>(
+		mbse::buildParameterizedMBS(2, 2));
+}
+
+// Same for solve_ddotz_batch(), with the dense override and the generic
+// implementation (sparse), on consistent states of a single-DOF mechanism:
+template <class DYNAMIC_SOLVER_T>
+void testerBatchDdotzVsSingle()
+{
+	mbse::timelog().enable(false);	// avois clutter in cout
+
+	auto aMBS = mbse::buildFourBarsMBS().assembleRigidMBS();
+	aMBS->setGravityVector(0, -9.81, 0);
+
+	DYNAMIC_SOLVER_T dynSimul(aMBS);
+	dynSimul.prepare();
+	Eigen::VectorXd ddz;
+	dynSimul.solve_ddotz(0.0, ddz);
+	const auto zIdxs = dynSimul.independent_coordinate_indices();
+
+	const auto n = aMBS->q_.size();
+	const int nStates = 4;
+	Eigen::MatrixXd qs(n, nStates), dqs(n, nStates);
+	const Eigen::VectorXd q0 = aMBS->q_;
+	for (int i = 0; i < nStates; i++)
+	{
+		aMBS->q_ = q0;
+		aMBS->dotq_.setZero();
+		for (const auto z : zIdxs)
+		{
+			aMBS->q_[z] += 1e-2 * (i + 1);
+			aMBS->dotq_[z] = 0.5 * i - 1.0;
+		}
+		ASSERT_LT(
+			aMBS->finiteDisplacement(zIdxs, 1e-12, 20, true /*dq*/), 1e-9);
+		qs.col(i) = aMBS->q_;
+		dqs.col(i) = aMBS->dotq_;
+	}
+	aMBS->q_ = q0;
+
+	Eigen::MatrixXd ddzs;
+	dynSimul.solve_ddotz_batch(0.0, qs, dqs, ddzs);
+	ASSERT_EQ(ddzs.cols(), nStates);
+	EXPECT_EQ(aMBS->q_, q0);
+	EXPECT_EQ(dynSimul.independent_coordinate_indices(), zIdxs);
+	EXPECT_TRUE(dynSimul.can_choose_indep_coords_);
+
+	// The batch keeps the independent coordinates; so must the single calls:
+	dynSimul.independent_coordinate_indices(zIdxs);
+	for (int i = 0; i < nStates; i++)
+	{
+		aMBS->q_ = qs.col(i);
+		aMBS->dotq_ = dqs.col(i);
+		dynSimul.solve_ddotz(0.0, ddz);
+		EXPECT_NEAR((ddz - ddzs.col(i)).norm(), 0, 1e-6 * (1 + ddz.norm()))
+			<< "state #" << i;
+	}
+}
+
+TEST(SolveBatch, Indep_dense)
+{
+	testerBatchDdotzVsSingle<mbse::CDynamicSimulator_Indep_dense>();
+}
+TEST(SolveBatch, Indep_sparse)
+{
+	testerBatchDdotzVsSingle<mbse::CDynamicSimulator_Indep_sparse>();
+}
+
+// -------------
+// build_RHS() runs several times per integrator step and per particle, so it
+// must not allocate. Eigen allocations are caught by its runtime checks
+// (with MBSE_EIGEN_RUNTIME_NO_MALLOC, in builds with assertions):
+namespace
+{
+class RHSBuilder : public mbse::CDynamicSimulator_Lagrange_LU_dense
+{
+   public:
+	using mbse::CDynamicSimulator_Lagrange_LU_dense::
+		CDynamicSimulator_Lagrange_LU_dense;
+	using mbse::CDynamicSimulatorBase::build_RHS;
+};
+}  // namespace
+
+TEST(BuildRHS, NoEigenAllocations)
+{
+#if !defined(EIGEN_RUNTIME_NO_MALLOC) || defined(NDEBUG)
+	GTEST_SKIP() << "Requires EIGEN_RUNTIME_NO_MALLOC and eigen_assert()";
+#else
+	mbse::timelog().enable(false);	// avois clutter in cout
+
+	auto aMBS = mbse::buildLongStringMBS(20).assembleRigidMBS();
+	aMBS->setGravityVector(0, -9.81, 0);
+	aMBS->dotq_.setRandom();
+	aMBS->update_numeric_Phi_and_Jacobians();
+
+	RHSBuilder builder(aMBS);
+	Eigen::VectorXd Q(aMBS->q_.size()), c(aMBS->Phi_.size());
+	builder.build_RHS(&Q[0], &c[0]);  // Builds the cached constant forces
+
+	const Eigen::VectorXd Q0 = Q, c0 = c;
+	Eigen::internal::set_is_malloc_allowed(false);
+	for (int i = 0; i < 10; i++) builder.build_RHS(&Q[0], &c[0]);
+	Eigen::internal::set_is_malloc_allowed(true);
+
+	EXPECT_EQ(Q, Q0);
+	EXPECT_EQ(c, c0);
+#endif
+}
+
+// -------------
+// The adaptive RK45 integrator must follow a fine fixed-step RK4 trajectory,
+// taking steps much longer than the reference one:
+template <class DYNAMIC_SOLVER_T>
+void testerRK45VsRK4()
+{
+	mbse::timelog().enable(false);	// avois clutter in cout
+
+	const mbse::ModelDefinition model = mbse::buildFourBarsMBS();
+
+	auto aMBS_ref = model.assembleRigidMBS();
+	auto aMBS = model.assembleRigidMBS();
+	aMBS_ref->setGravityVector(0, -9.81, 0);
+	aMBS->setGravityVector(0, -9.81, 0);
+
+	const double t_end = 0.5;
+
+	DYNAMIC_SOLVER_T ref(aMBS_ref);
+	ref.params.ode_solver = mbse::ODE_RK4;
+	ref.params.time_step = 1e-4;
+	ref.prepare();
+	ref.run(0, t_end);
+
+	DYNAMIC_SOLVER_T dynSimul(aMBS);
+	dynSimul.params.ode_solver = mbse::ODE_RK45;
+	dynSimul.params.abs_tol = 1e-8;
+	dynSimul.params.rel_tol = 1e-8;
+	size_t numSteps = 0;
+	double t_last = 0;
+	dynSimul.params.user_callback = [&](mbse::TSimulationStateRef st) {
+		EXPECT_GT(st.dt, 0);
+		t_last = st.t + st.dt;
+		numSteps++;
+	};
+	dynSimul.prepare();
+	const double t_final = dynSimul.run(0, t_end);
+
+	EXPECT_DOUBLE_EQ(t_final, t_end);
+	EXPECT_DOUBLE_EQ(t_last, t_end);
+	EXPECT_LT(
+		numSteps, static_cast<size_t>(t_end / ref.params.time_step / 10));
+
+	EXPECT_NEAR((aMBS->q_ - aMBS_ref->q_).norm(), 0, 1e-5)
+		<< "q    : " << aMBS->q_.transpose() << "\n"
+		<< "q_ref: " << aMBS_ref->q_.transpose() << "\n";
+	EXPECT_NEAR((aMBS->dotq_ - aMBS_ref->dotq_).norm(), 0, 1e-4)
+		<< "dq    : " << aMBS->dotq_.transpose() << "\n"
+		<< "dq_ref: " << aMBS_ref->dotq_.transpose() << "\n";
+}
+
+TEST(RK45VsRK4, CDynamicSimulator_Lagrange_LU_dense)
+{
+	testerRK45VsRK4<mbse::CDynamicSimulator_Lagrange_LU_dense>();
+}
+TEST(RK45VsRK4, CDynamicSimulator_Indep_dense)
+{
+	testerRK45VsRK4<mbse::CDynamicSimulator_Indep_dense>();
+}
+
+// A pendulum released from the horizontal passes through configurations
+// where each of its two coordinates is singular as the independent one, so
+// RK45 steps must be able to re-select them:
+template <class DYNAMIC_SOLVER_T>
+void testerRK45IndepCoordsChange(double min_rcond = 0)
+{
+	mbse::timelog().enable(false);	// avois clutter in cout
+
+	const mbse::ModelDefinition model = mbse::buildLongStringMBS(1, 0.5, 1.0);
+
+	auto aMBS_ref = model.assembleRigidMBS();
+	auto aMBS = model.assembleRigidMBS();
+	aMBS_ref->setGravityVector(0, -9.81, 0);
+	aMBS->setGravityVector(0, -9.81, 0);
+
+	// A bit more than one oscillation:
+	const double t_end = 2.0;
+
+	mbse::CDynamicSimulator_Lagrange_LU_dense ref(aMBS_ref);
+	ref.params.ode_solver = mbse::ODE_RK4;
+	ref.params.time_step = 1e-4;
+	ref.prepare();
+	ref.run(0, t_end);
+
+	DYNAMIC_SOLVER_T dynSimul(aMBS);
+	if constexpr (std::is_same_v<
+					  DYNAMIC_SOLVER_T, mbse::CDynamicSimulator_Indep_sparse>)
+		dynSimul.min_rcond = min_rcond;
+	dynSimul.params.ode_solver = mbse::ODE_RK45;
+	dynSimul.params.abs_tol = 1e-9;
+	dynSimul.params.rel_tol = 1e-9;
+	std::set<std::vector<size_t>> usedIndepCoords;
+	dynSimul.params.user_callback = [&](mbse::TSimulationStateRef) {
+		usedIndepCoords.insert(dynSimul.independent_coordinate_indices());
+	};
+	dynSimul.prepare();
+	EXPECT_DOUBLE_EQ(dynSimul.run(0, t_end), t_end);
+
+	EXPECT_EQ(usedIndepCoords.size(), 2U);
+	EXPECT_NEAR((aMBS->q_ - aMBS_ref->q_).norm(), 0, 1e-4)
+		<< "q    : " << aMBS->q_.transpose() << "\n"
+		<< "q_ref: " << aMBS_ref->q_.transpose() << "\n";
+	EXPECT_NEAR((aMBS->dotq_ - aMBS_ref->dotq_).norm(), 0, 1e-3)
+		<< "dq    : " << aMBS->dotq_.transpose() << "\n"
+		<< "dq_ref: " << aMBS_ref->dotq_.transpose() << "\n";
+}
+
+TEST(RK45IndepCoordsChange, CDynamicSimulator_Indep_dense)
+{
+	testerRK45IndepCoordsChange<mbse::CDynamicSimulator_Indep_dense>();
+}
+TEST(RK45IndepCoordsChange, CDynamicSimulator_Indep_sparse)
+{
+	// Re-select coordinates well before they become singular:
+	testerRK45IndepCoordsChange<mbse::CDynamicSimulator_Indep_sparse>(0.5);
+}
+
+// -------------
+// The generalized-alpha integrator must follow a fine RK4 trajectory, keep
+// the position constraints satisfied, and reuse its factorization:
+static void testerGeneralizedAlpha(double rhoInfinity)
+{
+	mbse::timelog().enable(false);	// avois clutter in cout
+
+	const mbse::ModelDefinition model = mbse::buildFourBarsMBS();
+
+	auto aMBS_ref = model.assembleRigidMBS();
+	auto aMBS = model.assembleRigidMBS();
+	aMBS_ref->setGravityVector(0, -9.81, 0);
+	aMBS->setGravityVector(0, -9.81, 0);
+
+	const double t_end = 0.5;
+
+	mbse::CDynamicSimulator_Lagrange_LU_dense ref(aMBS_ref);
+	ref.params.ode_solver = mbse::ODE_RK4;
+	ref.params.time_step = 1e-4;
+	ref.prepare();
+	ref.run(0, t_end);
+
+	mbse::CDynamicSimulator_Lagrange_LU_dense dynSimul(aMBS);
+	dynSimul.params.ode_solver = mbse::ODE_GeneralizedAlpha;
+	dynSimul.params.time_step = 1e-3;
+	dynSimul.generalizedAlpha().params.rhoInfinity = rhoInfinity;
+	dynSimul.prepare();
+	dynSimul.run(0, t_end);
+
+	EXPECT_NEAR((aMBS->q_ - aMBS_ref->q_).norm(), 0, 1e-3)
+		<< "q    : " << aMBS->q_.transpose() << "\n"
+		<< "q_ref: " << aMBS_ref->q_.transpose() << "\n";
+
+	aMBS->update_numeric_Phi_and_Jacobians();
+	EXPECT_LT(aMBS->Phi_.norm(), 1e-8);
+
+	const auto& stats = dynSimul.generalizedAlpha().stats();
+	EXPECT_GE(stats.numSteps, 500U);
+	EXPECT_LT(stats.numFactorizations, stats.numSteps);
+}
+
+TEST(GeneralizedAlpha, Undamped) { testerGeneralizedAlpha(1.0); }
+TEST(GeneralizedAlpha, Damped) { testerGeneralizedAlpha(0.6); }
+
+// -------------
+// Multi-rate integration must follow a fine RK4 trajectory, solving the
+// whole model only once per time step:
+TEST(MultiRate, MatchesFineRK4)
+{
+	mbse::timelog().enable(false);	// avois clutter in cout
+
+	mbse::ModelDefinition model = mbse::buildLongStringMBS(5, 0.5, 1.0);
+	model.bodies().at(3).fast = true;
+	model.bodies().at(4).fast = true;
+
+	auto aMBS_ref = model.assembleRigidMBS();
+	auto aMBS = model.assembleRigidMBS();
+	aMBS_ref->setGravityVector(0, -9.81, 0);
+	aMBS->setGravityVector(0, -9.81, 0);
+
+	const double t_end = 0.2;
+
+	mbse::CDynamicSimulator_Lagrange_LU_dense ref(aMBS_ref);
+	ref.params.ode_solver = mbse::ODE_RK4;
+	ref.params.time_step = 1e-4;
+	ref.prepare();
+	ref.run(0, t_end);
+
+	mbse::CDynamicSimulator_Lagrange_LU_dense dynSimul(aMBS);
+	dynSimul.params.ode_solver = mbse::ODE_MultiRate;
+	dynSimul.params.time_step = 1e-3;
+	dynSimul.params.multirate_substeps = 10;
+	dynSimul.prepare();
+	// Points #3, #4 and #5:
+	EXPECT_EQ(dynSimul.fastCoordinates().size(), 6U);
+	dynSimul.run(0, t_end);
+
+	EXPECT_NEAR((aMBS->q_ - aMBS_ref->q_).norm(), 0, 1e-4)
+		<< "q    : " << aMBS->q_.transpose() << "\n"
+		<< "q_ref: " << aMBS_ref->q_.transpose() << "\n";
+
+	aMBS->update_numeric_Phi_and_Jacobians();
+	EXPECT_LT(aMBS->Phi_.norm(), 1e-4);
+
+	// One full solve per step (and one to start), against 4 per (ten times
+	// shorter) step of the reference. The fast subsystem is solved at each
+	// RK4 stage, plus once at the end of each step:
+	const auto& stats = dynSimul.multiRateStats();
+	EXPECT_GE(stats.macro_steps, 200U);
+	EXPECT_EQ(stats.full_solves, stats.macro_steps + 1);
+	EXPECT_EQ(stats.fast_solves, (4 * 10 + 1) * stats.macro_steps);
+
+	// Total model work: the fast solves and the final projection (one
+	// evaluation per iteration, at most 11) only evaluate the 3 constraints
+	// with fast coordinates (bars #2 to #4), so it all stays below the
+	// evaluations of the whole model by the reference:
+	const size_t nC = aMBS->topology()->constraints_.size();
+	ASSERT_EQ(nC, 5U);
+	const size_t fullEvals = stats.full_solves * nC;
+	EXPECT_GE(
+		stats.constraint_evals,
+		fullEvals + 3 * (stats.fast_solves + stats.macro_steps));
+	EXPECT_LE(
+		stats.constraint_evals,
+		fullEvals + 3 * (stats.fast_solves + 11 * stats.macro_steps));
+	const size_t refEvals = 4 * nC * static_cast<size_t>(t_end / 1e-4);
+	EXPECT_LT(stats.constraint_evals, refEvals);
+
+	// Published accelerations are consistent with the final state:
+	aMBS->update_numeric_Phi_and_Jacobians();
+	Eigen::VectorXd ddPhi(aMBS->Phi_.size()), c(aMBS->Phi_.size());
+	aMBS->Phi_q_.multiply(&aMBS->ddotq_[0], &ddPhi[0]);
+	aMBS->dotPhi_q_.multiply(&aMBS->dotq_[0], &c[0]);
+	EXPECT_LT((ddPhi + c).norm(), 1e-2);
+}
+
+// Formulations in independent coordinates have their own integrators, which
+// do not include these ones:
+TEST(MultiRate, RejectedByIndepFormulations)
+{
+	mbse::timelog().enable(false);	// avois clutter in cout
+
+	auto aMBS = mbse::buildFourBarsMBS().assembleRigidMBS();
+	for (const auto integr : {mbse::ODE_MultiRate, mbse::ODE_GeneralizedAlpha})
+	{
+		mbse::CDynamicSimulator_Indep_dense dynSimul(aMBS);
+		dynSimul.params.ode_solver = integr;
+		EXPECT_ANY_THROW(dynSimul.prepare());
+
+		dynSimul.params.ode_solver = mbse::ODE_RK4;
+		EXPECT_NO_THROW(dynSimul.prepare());
+	}
+}
+
+// -------------
+// The sparse ALi3 solver must integrate the same trajectories than the dense
+// one, with its own (trapezoidal) integrator:
+TEST(ALi3Sparse, MatchesDenseTrapezoidal)
+{
+	mbse::timelog().enable(false);	// avois clutter in cout
+
+	const mbse::ModelDefinition model = mbse::buildParameterizedMBS(3, 2);
+
+	auto aMBS_ref = model.assembleRigidMBS();
+	auto aMBS = model.assembleRigidMBS();
+
+	mbse::CDynamicSimulator_ALi3_Dense ref(aMBS_ref);
+	mbse::CDynamicSimulator_ALi3_Sparse dynSimul(aMBS);
+	for (mbse::CDynamicSimulatorBase* s :
+		 {static_cast<mbse::CDynamicSimulatorBase*>(&ref),
+		  static_cast<mbse::CDynamicSimulatorBase*>(&dynSimul)})
+	{
+		s->params.ode_solver = mbse::ODE_Trapezoidal;
+		s->params.time_step = 1e-3;
+		s->prepare();
+		s->run(0, 0.1);
+	}
+
+	EXPECT_NEAR((aMBS->q_ - aMBS_ref->q_).norm(), 0, 1e-6)
+		<< "q    : " << aMBS->q_.transpose() << "\n"
+		<< "q_ref: " << aMBS_ref->q_.transpose() << "\n";
+	EXPECT_NEAR((aMBS->dotq_ - aMBS_ref->dotq_).norm(), 0, 1e-5)
+		<< "dq    : " << aMBS->dotq_.transpose() << "\n"
+		<< "dq_ref: " << aMBS_ref->dotq_.transpose() << "\n";
+}
+
+// -------------
+// The tree solver must give the same accelerations and multipliers than the
+// dense one. Chains and single loops closed through fixed points need no
+// correction terms:
+static void testerTreeVsDense(
+	const mbse::ModelDefinition& model, bool expectNoCuts)
+{
+	mbse::timelog().enable(false);	// avois clutter in cout
+
+	std::shared_ptr<mbse::AssembledRigidModel> aMBS = model.assembleRigidMBS();
+	aMBS->setGravityVector(0, -9.81, 0);
+	aMBS->dotq_.setRandom();
+
+	mbse::CDynamicSimulator_Lagrange_LU_dense dense(aMBS);
+	dense.prepare();
+	Eigen::VectorXd ddotq_dense, lambda_dense;
+	dense.solve_ddotq(0.0, ddotq_dense, &lambda_dense);
+
+	mbse::CDynamicSimulator_Lagrange_Tree tree(aMBS);
+	tree.prepare();
+	Eigen::VectorXd ddotq_tree, lambda_tree;
+	tree.solve_ddotq(0.0, ddotq_tree, &lambda_tree);
+
+	if (expectNoCuts)
+		EXPECT_EQ(tree.num_cut_terms(), 0U);
+	else
+		EXPECT_GT(tree.num_cut_terms(), 0U);
+
+	EXPECT_NEAR(
+		(ddotq_dense - ddotq_tree).array().abs().maxCoeff(), 0,
+		1e-6 * (1.0 + ddotq_dense.array().abs().maxCoeff()))
+		<< "dense: " << ddotq_dense.transpose() << "\n"
+		<< "tree : " << ddotq_tree.transpose() << "\n";
+	EXPECT_NEAR(
+		(lambda_dense - lambda_tree).array().abs().maxCoeff(), 0,
+		1e-6 * (1.0 + lambda_dense.array().abs().maxCoeff()));
+}
+
+TEST(LagrangeTree, MatchesDenseLongString)
+{
+	testerTreeVsDense(mbse::buildLongStringMBS(20, 5.0, 0.1), true);
+}
+TEST(LagrangeTree, MatchesDenseFourBars)
+{
+	testerTreeVsDense(mbse::buildFourBarsMBS(), true);
+}
+TEST(LagrangeTree, MatchesDenseGrid)
+{
+	testerTreeVsDense(mbse::buildParameterizedMBS(3, 2), false);
+}
@@ -0,0 +1,79 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include <gtest/gtest.h>
+
+#include <mbse/model-examples.h>
+#include <mbse/dynamics/dynamic-simulators.h>
+#include <mbse/AssembledRigidModel.h>
+#include <gtsam/nonlinear/factorTesting.h>
+#include <mbse/factors/FactorConstraintsPoints.h>
+
+using namespace std;
+using namespace mbse;
+
+TEST(Jacobians, FactorConstraintsPoints)
+{
+	// for use in EXPECT_CORRECT_FACTOR_JACOBIANS
+	const auto name_ = "FactorConstraintsPoints";
+#define EXPECT ASSERT_
+
+	// Create the multibody object:
+	const ModelDefinition model = mbse::buildFourBarsMBS();
+
+	auto aMBS = model.assembleRigidMBS();
+	aMBS->setGravityVector(0, -9.81, 0);
+
+	const auto& topo = *aMBS->topology();
+	const auto blocks = std::make_shared<const StateBlocks>(topo);
+
+	// Each coordinate is in exactly one block:
+	size_t nInBlocks = 0;
+	for (size_t b = 0; b < blocks->numBlocks(); b++)
+		nInBlocks += blocks->blockDOFs(b).size();
+	EXPECT_EQ(nInBlocks, topo.numCoords());
+
+	CDynamicSimulator_R_matrix_dense dynSimul(aMBS);
+	// Must be called before solve_ddotq():
+	dynSimul.prepare();
+
+	for (int ti = 0; ti < 10; ti++)
+	{
+		const double dt = 1.0;
+		double t = ti * dt;
+		dynSimul.run(t, t + dt);
+
+		const state_t q = state_t(aMBS->q_);
+
+		gtsam::Values values;
+		blocks->insert(values, 1, q);
+
+		// The reference, whole Phi(q):
+		aMBS->update_numeric_Phi_and_Jacobians();
+		const Eigen::VectorXd Phi = aMBS->Phi_;
+
+		gtsam::NonlinearFactorGraph fg;
+		addConstraintFactors(fg, aMBS, blocks, 1, 0.1);
+
+		for (const auto& f : fg)
+		{
+			const auto* fc =
+				dynamic_cast<const FactorConstraintsPoints*>(f.get());
+			ASSERT_TRUE(fc != nullptr);
+
+			const auto [firstRow, nRows] =
+				topo.constraintRows_[fc->constraintIndex()];
+			const gtsam::Vector err = fc->unwhitenedError(values);
+			EXPECT_NEAR((err - Phi.segment(firstRow, nRows)).norm(), 0.0, 1e-9);
+
+			EXPECT_CORRECT_FACTOR_JACOBIANS(*fc, values, 1e-9, 1e-3);
+		}
+	}
+}
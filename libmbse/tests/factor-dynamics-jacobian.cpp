@@ -44,7 +44,8 @@ static void num_err_wrt_state(
 	err = p.factor->evaluateError(q, dq, ddq);
 }
 
-TEST(Jacobians, FactorDynamics)
+static void test_factor_dynamics_jacobians(
+	const std::string& solverName, bool analytic)
 {
 	try
 	{
@@ -59,9 +60,11 @@ TEST(Jacobians, FactorDynamics)
 		std::shared_ptr<AssembledRigidModel> aMBS = model.assembleRigidMBS();
 		aMBS->setGravityVector(0, -9.81, 0);
 
-		CDynamicSimulator_R_matrix_dense dynSimul(aMBS);
+		const auto dynSimulPtr = CDynamicSimulatorBase::Create(solverName, aMBS);
+		auto& dynSimul = *dynSimulPtr;
 		// Must be called before solve_ddotq():
 		dynSimul.prepare();
+		EXPECT_EQ(dynSimul.is_lagrange_kkt_solver(), analytic) << solverName;
 
 		// Add factors:
 		// Create factor noises:
@@ -117,6 +120,7 @@ TEST(Jacobians, FactorDynamics)
 			timlog.enter("factorsDyn.theoretical_jacob");
 
 			factorDyn->evaluateError(q, dotq, ddotq, H0_opt, H1_opt, H2_opt);
+			const gtsam::Matrix H[3] = {H0, H1, H2};
 
 
 			//    factorDyn->evaluateError(q, dotq, ddotq, H[0], H[1], H[2]);
@@ -150,6 +154,7 @@ TEST(Jacobians, FactorDynamics)
 				// Check:
 				EXPECT_NEAR(
 					(H[i] - H_num[i]).array().abs().maxCoeff(), 0.0, 1e-2)
+					<< solverName << "\n"
 					<< "H[" << i << "] Theoretical:\n"
 					<< H[i]
 					<< "\n"
@@ -166,3 +171,19 @@ TEST(Jacobians, FactorDynamics)
 	}
 }
 
+// Finite differences (projection formulation):
+TEST(Jacobians, FactorDynamics)
+{
+	test_factor_dynamics_jacobians("CDynamicSimulator_R_matrix_dense", false);
+}
+
+// Analytic, with the multipliers and factorization of each KKT solver:
+TEST(Jacobians, FactorDynamicsLagrange)
+{
+	for (const char* name :
+		 {"CDynamicSimulator_Lagrange_LU_dense",
+		  "CDynamicSimulator_Lagrange_KLU",
+		  "CDynamicSimulator_Lagrange_UMFPACK",
+		  "CDynamicSimulator_Lagrange_Tree"})
+		test_factor_dynamics_jacobians(name, true);
+}
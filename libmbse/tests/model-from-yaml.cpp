@@ -45,3 +45,32 @@ planar_bodies:
 
 	EXPECT_NEAR(model.bodies().at(0).length(), 2.0, 1e-5);
 }
+
+TEST(ModelFromYaml, FastBodies)
+{
+	const std::string sDef = R"(# Double pendulum, with a fast second link
+points:
+  - { x: 0, y: 0, fixed: true }
+  - { x: 1, y: 0 }
+  - { x: 1.2, y: 0 }
+planar_bodies:
+  - points: [0, 1]
+    length: auto
+    mass: 1.0
+    I0: (1/3)*mass*length^2
+    cog: [0.5*length, 0.0]
+  - points: [1, 2]
+    length: auto
+    mass: 0.01
+    I0: (1/3)*mass*length^2
+    cog: [0.5*length, 0.0]
+    fast: true
+)";
+
+	const auto model =
+		mbse::ModelDefinition::FromYAML(mrpt::containers::yaml::FromText(sDef));
+
+	ASSERT_EQ(model.bodies().size(), 2U);
+	EXPECT_FALSE(model.bodies().at(0).fast);
+	EXPECT_TRUE(model.bodies().at(1).fast);
+}
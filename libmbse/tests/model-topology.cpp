@@ -0,0 +1,99 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include <gtest/gtest.h>
+
+#include <mbse/AssembledRigidModel.h>
+#include <mbse/ModelDefinition.h>
+#include <mbse/model-examples.h>
+
+TEST(ModelTopology, SharedBetweenStates)
+{
+	const mbse::ModelDefinition model = mbse::buildFourBarsMBS();
+
+	mbse::TSymbolicAssembledModel armi(model);
+	model.assembleRigidMBS(armi);
+	const auto topology = std::make_shared<const mbse::ModelTopology>(armi);
+
+	mbse::AssembledRigidModel a(topology), b(topology);
+	EXPECT_EQ(a.topology(), b.topology());
+	EXPECT_EQ(a.q_.size(), static_cast<Eigen::Index>(topology->numCoords()));
+
+	// Perturb only one state:
+	b.q_ += Eigen::VectorXd::LinSpaced(b.q_.size(), 0.1, 0.3);
+	b.dotq_.setConstant(1.0);
+
+	a.update_numeric_Phi_and_Jacobians();
+	b.update_numeric_Phi_and_Jacobians();
+
+	// The initial configuration is consistent; the perturbed one is not:
+	EXPECT_LT(a.Phi_.norm(), 1e-6);
+	EXPECT_GT(b.Phi_.norm(), 1e-6);
+	EXPECT_GT((a.Phi_q_.asDense() - b.Phi_q_.asDense()).norm(), 0.0);
+	EXPECT_GT(b.dotPhi_.norm(), 0.0);
+
+	// The shared pattern itself stays untouched:
+	EXPECT_EQ(topology->Phi_q_.asDense().norm(), 0.0);
+}
+
+TEST(AssembledRigidModel, GeneralizedForcesCache)
+{
+	mbse::ModelDefinition model = mbse::buildFourBarsMBS();
+
+	mbse::TSymbolicAssembledModel armi(model);
+	model.assembleRigidMBS(armi);
+	const auto topology = std::make_shared<const mbse::ModelTopology>(armi);
+
+	mbse::AssembledRigidModel a(topology);
+	a.setGravityVector(0, -9.81, 0);
+
+	Eigen::VectorXd Q0, Q;
+	a.builGeneralizedForces(Q0);
+	ASSERT_GT(Q0.norm(), 0.0);
+
+	// External forces are added on each call, not cached:
+	a.Q_.setConstant(1.0);
+	a.builGeneralizedForces(Q);
+	EXPECT_NEAR((Q - Q0 - a.Q_).norm(), 0.0, 1e-12);
+	a.Q_.setZero();
+
+	// Changing gravity invalidates the cached weights:
+	a.setGravityVector(0, -2 * 9.81, 0);
+	a.builGeneralizedForces(Q);
+	EXPECT_NEAR((Q - 2 * Q0).norm(), 0.0, 1e-12);
+
+	// ...and so does modifying a body:
+	a.setGravityVector(0, -9.81, 0);
+	model.bodies()[0].mass() *= 3;
+	a.builGeneralizedForces(Q);
+	EXPECT_GT((Q - Q0).norm(), 1e-6);
+
+	// Restoring it rebuilds them again:
+	model.bodies()[0].mass() /= 3;
+	a.builGeneralizedForces(Q);
+	EXPECT_NEAR((Q - Q0).norm(), 0.0, 1e-12);
+
+	// Const reads do not count as changes:
+	const mbse::ModelDefinition& const_model = model;
+	const size_t revision = model.bodies_revision();
+	EXPECT_GT(const_model.bodies()[0].mass(), 0.0);
+	a.builGeneralizedForces(Q);
+	EXPECT_EQ(model.bodies_revision(), revision);
+
+	// Changes through a kept reference need an explicit invalidation:
+	auto& bodies = model.bodies();
+	a.builGeneralizedForces(Q);
+	bodies[0].cog().x += 0.1;
+	a.builGeneralizedForces(Q);
+	EXPECT_NEAR((Q - Q0).norm(), 0.0, 1e-12);
+	a.invalidate_constant_forces();
+	a.builGeneralizedForces(Q);
+	EXPECT_GT((Q - Q0).norm(), 1e-6);
+}
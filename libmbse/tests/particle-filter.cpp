@@ -0,0 +1,165 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include <gtest/gtest.h>
+
+#include <mbse/MultiBodyParticleFilter.h>
+#include <mbse/model-examples.h>
+#include <mrpt/random/RandomGenerators.h>
+
+TEST(MultiBodyParticleFilter, ReproducibleForSameSeed)
+{
+	const mbse::ModelDefinition model = mbse::buildFourBarsMBS();
+
+	const size_t M = 16;
+	mbse::MultiBodyParticleFilter pf1(M, model), pf2(M, model);
+	pf1.seedRandomGenerators(123);
+	pf2.seedRandomGenerators(123);
+
+	mbse::MultiBodyParticleFilter::TOutputInfo info;
+	for (int step = 0; step < 3; step++)
+	{
+		const double t0 = step * 0.01;
+		pf1.run_PF_step(t0, t0 + 0.01, 0.005, {}, {}, info);
+		pf2.run_PF_step(t0, t0 + 0.01, 0.005, {}, {}, info);
+	}
+
+	const auto& P1 = pf1.particles;
+	const auto& P2 = pf2.particles;
+	ASSERT_EQ(P1.size(), P2.size());
+
+	double maxSpread = 0;
+	for (size_t i = 0; i < P1.size(); i++)
+	{
+		EXPECT_EQ(P1.q.col(i), P2.q.col(i));
+		EXPECT_EQ(P1.dotq.col(i), P2.dotq.col(i));
+		maxSpread =
+			std::max(maxSpread, (P1.dotq.col(i) - P1.dotq.col(0)).norm());
+	}
+	// Each particle must have drawn its own noise:
+	EXPECT_GT(maxSpread, 0.0);
+}
+
+TEST(MultiBodyParticleFilter, GatherParticles)
+{
+	const mbse::ModelDefinition model = mbse::buildFourBarsMBS();
+
+	mbse::MultiBodyParticleFilter pf(4, model);
+	auto& P = pf.particles;
+	for (size_t i = 0; i < P.size(); i++)
+	{
+		P.q.col(i).setConstant(double(i));
+		P.log_w[i] = -double(i);
+	}
+
+	P.gather({3, 3, 0, 1, 2});
+	ASSERT_EQ(P.size(), 5U);
+	EXPECT_EQ(P.q(0, 0), 3.0);
+	EXPECT_EQ(P.q(0, 1), 3.0);
+	EXPECT_EQ(P.q(0, 2), 0.0);
+	EXPECT_EQ(P.q(0, 4), 2.0);
+	for (const double lw : P.log_w) EXPECT_EQ(lw, 0.0);
+	EXPECT_NEAR(pf.ESS(), 1.0, 1e-12);
+}
+
+TEST(MultiBodyParticleFilter, BatchedSensorReadings)
+{
+	const mbse::ModelDefinition model = mbse::buildFourBarsMBS();
+
+	const size_t M = 8;
+	mbse::MultiBodyParticleFilter pf(M, model);
+	pf.seedRandomGenerators(1);
+
+	// Let the noise spread the particle velocities:
+	mbse::MultiBodyParticleFilter::TOutputInfo info;
+	pf.run_PF_step(0, 0.02, 0.005, {}, {}, info);
+
+	const auto& P = pf.particles;
+	mbse::AssembledRigidModel mdl(P.topology);
+
+	// Body 0 has a fixed point, body 1 has none:
+	for (size_t body = 0; body < 2; body++)
+	{
+		mbse::CVirtualSensor_Gyro gyro(body);
+		gyro.sensor_noise_std = 0.1;
+
+		Eigen::VectorXd readings(P.size()), log_liks(P.size());
+		gyro.simulate_readings(P, readings);
+		gyro.evaluate_log_likelihoods(0.5, P, log_liks);
+
+		for (size_t i = 0; i < P.size(); i++)
+		{
+			P.load(i, mdl);
+			EXPECT_NEAR(readings[i], gyro.simulate_reading(mdl), 1e-12);
+			EXPECT_NEAR(
+				log_liks[i], gyro.evaluate_log_likelihood(0.5, mdl), 1e-9);
+		}
+	}
+}
+
+TEST(MultiBodyParticleFilter, ResamplingMethods)
+{
+	using mrpt::bayes::CParticleFilter;
+
+	mrpt::random::CRandomGenerator rng(1234);
+
+	// One dominant particle, and some negligible ones:
+	const std::vector<double> log_w = {-50, 0, -50, -1e3, -50};
+
+	for (const auto method :
+		 {CParticleFilter::prMultinomial, CParticleFilter::prResidual,
+		  CParticleFilter::prStratified, CParticleFilter::prSystematic})
+	{
+		for (const size_t M : {1U, 5U, 17U})
+		{
+			std::vector<size_t> idxs;
+			mbse::MultiBodyParticleFilter::computeResamplingIndices(
+				method, log_w, M, rng, idxs);
+			ASSERT_EQ(idxs.size(), M);
+			for (const size_t i : idxs) EXPECT_EQ(i, 1U);
+		}
+	}
+
+	// Equal weights: systematic and residual keep every particle once
+	const std::vector<double> flat(8, -3.0);
+	for (const auto method :
+		 {CParticleFilter::prResidual, CParticleFilter::prSystematic})
+	{
+		std::vector<size_t> idxs;
+		mbse::MultiBodyParticleFilter::computeResamplingIndices(
+			method, flat, flat.size(), rng, idxs);
+		std::sort(idxs.begin(), idxs.end());
+		for (size_t i = 0; i < idxs.size(); i++) EXPECT_EQ(idxs[i], i);
+	}
+}
+
+TEST(MultiBodyParticleFilter, KLDAdaptiveSampleSize)
+{
+	const mbse::ModelDefinition model = mbse::buildFourBarsMBS();
+
+	mbse::MultiBodyParticleFilter pf(100, model);
+	pf.PF_options.KLD_binSize = 0.1;
+	pf.PF_options.KLD_minSampleSize = 10;
+	pf.PF_options.KLD_maxSampleSize = 1000;
+
+	// All particles in the same bin: the minimum is enough
+	std::vector<size_t> idxs(pf.particles.size());
+	for (size_t i = 0; i < idxs.size(); i++) idxs[i] = i;
+	EXPECT_EQ(pf.countOccupiedBins(idxs), 1U);
+	EXPECT_EQ(pf.KLD_numberOfParticles(1), 10U);
+
+	// Spread particles need more of them:
+	for (size_t i = 0; i < pf.particles.size(); i++)
+		pf.particles.q(0, i) += 0.25 * i;
+	const size_t nBins = pf.countOccupiedBins(idxs);
+	EXPECT_EQ(nBins, pf.particles.size());
+	EXPECT_GT(pf.KLD_numberOfParticles(nBins), nBins);
+	EXPECT_LE(pf.KLD_numberOfParticles(nBins), 1000U);
+}
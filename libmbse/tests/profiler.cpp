@@ -0,0 +1,93 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include <gtest/gtest.h>
+
+#include <mbse/profiler.h>
+#include <chrono>
+#include <sstream>
+#include <thread>
+
+TEST(Profiler, CountsAndExport)
+{
+	namespace prof = mbse::profiler;
+
+	const auto id = prof::registerScope("test.scope");
+	const auto idVal =
+		prof::registerScope("test.value", prof::ScopeKind::Value);
+	EXPECT_EQ(id, prof::registerScope("test.scope"));
+
+	prof::clear();
+	prof::setTraceCapacity(100);
+
+	// Records from two threads are merged:
+	const auto work = [&]() {
+		for (int i = 0; i < 10; i++)
+		{
+			prof::Scope s(id);
+			prof::recordValue(idVal, i);
+		}
+	};
+	std::thread th(work);
+	work();
+	th.join();
+
+	const auto st = prof::getStats("test.scope");
+	EXPECT_EQ(st.count, 20U);
+	EXPECT_GE(st.min, 0.0);
+	EXPECT_GE(st.max, st.min);
+
+	const auto sv = prof::getStats("test.value");
+	EXPECT_EQ(sv.kind, prof::ScopeKind::Value);
+	EXPECT_DOUBLE_EQ(sv.min, 0.0);
+	EXPECT_DOUBLE_EQ(sv.max, 9.0);
+	EXPECT_DOUBLE_EQ(sv.mean(), 4.5);
+
+	// Disabled at runtime: nothing recorded
+	prof::enable(false);
+	work();
+	prof::enable(true);
+	EXPECT_EQ(prof::getStats("test.scope").count, 20U);
+
+	std::stringstream ssJson, ssTrace;
+	prof::exportJSON(ssJson);
+	prof::exportChromeTrace(ssTrace);
+	EXPECT_NE(ssJson.str().find("\"test.scope\""), std::string::npos);
+	EXPECT_NE(ssTrace.str().find("\"ph\": \"X\""), std::string::npos);
+
+	prof::setTraceCapacity(0);
+	prof::clear();
+	EXPECT_EQ(prof::getStats("test.scope").count, 0U);
+}
+
+TEST(Profiler, ReentrantScopes)
+{
+	namespace prof = mbse::profiler;
+
+	const auto id = prof::registerScope("test.recursive");
+	prof::clear();
+
+	// The outer entry must include the time of the inner one:
+	{
+		prof::Scope outer(id);
+		{
+			prof::Scope inner(id);
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+	const auto st = prof::getStats("test.recursive");
+	EXPECT_EQ(st.count, 2U);
+	EXPECT_GE(st.min, 0.02);
+	EXPECT_GE(st.max, 0.04);
+	EXPECT_GE(st.max, st.min + 0.015);
+
+	prof::clear();
+}
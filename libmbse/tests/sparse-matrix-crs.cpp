@@ -0,0 +1,78 @@
+/*+-------------------------------------------------------------------------+
+  |            Multi Body State Estimation (mbse) C++ library               |
+  |                                                                         |
+  | Copyright (C) 2014-2024 University of Almeria                           |
+  | Copyright (C) 2021 University of Salento                                |
+  | See README for list of authors and papers                               |
+  | Distributed under 3-clause BSD license                                  |
+  |  See: <https://opensource.org/licenses/BSD-3-Clause>                    |
+  +-------------------------------------------------------------------------+ */
+
+#include <gtest/gtest.h>
+
+#include <mbse/ModelDefinition.h>
+#include <mbse/model-examples.h>
+
+TEST(CompressedRowSparseMatrix, BuildAndFreeze)
+{
+	mbse::CompressedRowSparseMatrix M;
+	M.ncols = 4;
+	M.setRowCount(2);
+
+	using mbse::CompressedRowSparseMatrix;
+	std::size_t i03 = CompressedRowSparseMatrix::INVALID_ENTRY;
+	std::size_t i01 = i03, i12 = i03;
+	M.bindEntry(0, 3, &i03);
+	M.bindEntry(0, 1, &i01);
+	M.bindEntry(1, 2, &i12);
+	M.insertEntry(0, 3);  // duplicates are ignored
+
+	EXPECT_FALSE(M.isFrozen());
+	M.freeze();
+	EXPECT_TRUE(M.isFrozen());
+
+	ASSERT_EQ(M.getNumRows(), 2U);
+	ASSERT_EQ(M.getNumNonZeros(), 3U);
+	ASSERT_EQ(M.row_ptr.size(), 3U);
+
+	// Columns must be sorted within each row:
+	EXPECT_EQ(M.col_idx[0], 1U);
+	EXPECT_EQ(M.col_idx[1], 3U);
+	EXPECT_EQ(M.col_idx[2], 2U);
+
+	EXPECT_EQ(i01, 0U);
+	EXPECT_EQ(i03, 1U);
+	EXPECT_EQ(i12, 2U);
+	M.setEntry(i03, 3.0);
+	M.setEntry(i01, 1.0);
+	M.setEntry(i12, 2.0);
+
+	const Eigen::MatrixXd D = M.asDense();
+	EXPECT_EQ(D(0, 1), 1.0);
+	EXPECT_EQ(D(0, 3), 3.0);
+	EXPECT_EQ(D(1, 2), 2.0);
+	EXPECT_EQ(D.sum(), 6.0);
+	EXPECT_EQ(M.entryIndex(0, 3), 1U);
+
+	EXPECT_ANY_THROW(M.setRowCount(3));
+}
+
+TEST(CompressedRowSparseMatrix, ModelJacobiansAreFrozen)
+{
+	const mbse::ModelDefinition model = mbse::buildFourBarsMBS();
+
+	const auto aMBS = model.assembleRigidMBS();
+	aMBS->update_numeric_Phi_and_Jacobians();
+
+	for (const auto* M : {&aMBS->Phi_q_, &aMBS->dotPhi_q_,
+						  &aMBS->Phiqq_times_ddq_, &aMBS->dotPhiqq_times_dq_})
+	{
+		EXPECT_TRUE(M->isFrozen());
+		EXPECT_EQ(M->getNumRows(), static_cast<size_t>(aMBS->Phi_.size()));
+		EXPECT_EQ(M->getNumCols(), static_cast<size_t>(aMBS->q_.size()));
+	}
+
+	// Phi_q must be non-empty for a constrained mechanism:
+	EXPECT_GT(aMBS->Phi_q_.getNumNonZeros(), 0U);
+	EXPECT_GT(aMBS->Phi_q_.asDense().norm(), 0.0);
+}